@@ -0,0 +1,294 @@
+// Adaptive chunk, batch and window sizes (ORION_ADAPT=1).
+// Must be included after common.h and result.h.
+//
+// Without it, sizes are fixed for the whole transfer: one message per socket
+// write, a 4 KiB ring, whatever the kernel picks for the socket buffers. With
+// it, the side moving the data tunes them while it runs. The transfer is cut
+// into epochs of ORION_ADAPT_EPOCH_MS, and every size is measured over two of
+// them, whose mean the controller compares with the best size so far. It
+// doubles (or halves) the size it tunes while that gains more than
+// ORION_ADAPT_GAIN_PCT. A step without a gain does not settle the size at once:
+// the best size is measured again first, and the step only loses against the
+// mean of both its measurements, so that one lucky epoch cannot hold the size
+// below its real optimum. A size whose first step did not pay off is
+// tried in the other direction once. Stalls (waits for room in a full buffer)
+// break ties: a step that keeps the throughput within the margin but halves the
+// stalls per byte is kept too, since every stall is a wake-up syscall on both
+// sides. Several sizes are tuned one after the other, each from where the
+// previous one settled. The first epoch warms caches and the connection up and
+// is not measured.
+
+#define ADAPT_MAX_KNOBS 2
+
+const int ADAPT_DEFAULT_EPOCH_MS = 20; // shorter epochs let scheduling noise pick the sizes
+const int ADAPT_DEFAULT_GAIN_PCT = 5;
+const int ADAPT_EPOCHS_PER_SIZE = 2; // epochs averaged into the rate of a size
+
+// One size being tuned, in bytes
+struct adaptKnob {
+  char* name;
+  int value;
+  int startValue;
+  int minValue;
+  int maxValue;
+  int bestValue;
+  double bestRate; // bytes per second at bestValue, 0 before it was measured
+  double bestStallRate; // stalls per byte at bestValue
+  int direction; // 1 doubles, -1 halves
+  bool hasTurned; // the other direction was tried
+  // Epochs measured at value so far
+  double sumRate;
+  double sumStallRate;
+  int numSamples;
+  // Back at bestValue to measure it again, after candidateValue did worse
+  bool isRechecking;
+  int candidateValue;
+  double candidateRate;
+  double candidateStallRate;
+};
+
+struct adaptController {
+  bool isEnabled;
+  struct adaptKnob knobs[ADAPT_MAX_KNOBS];
+  int numKnobs;
+  int current; // knob being tuned, numKnobs once every one settled
+  int numEpochs; // measured epochs
+  bool isWarm; // the warm-up epoch is over
+  uint64_t epoch_ns;
+  double gain;
+  uint64_t epochStart_ns;
+  uint64_t epochBytes;
+  uint64_t epochStalls;
+  char* caller;
+  int fdlog_info;
+};
+
+// Whether sizes are tuned at runtime
+bool adaptIsRequested() {
+  return getEnvInt("ORION_ADAPT", 0) != 0;
+}
+
+// Bytes of a ring whose window starts at ringBytes: with ORION_ADAPT the ring
+// is mapped at ORION_ADAPT_RING_MAX_KIB, so that its window can grow. Producer
+// and consumer must agree on it.
+size_t adaptRingBytes(size_t ringBytes) {
+  size_t maxBytes = (size_t) getEnvInt("ORION_ADAPT_RING_MAX_KIB", 1024) * 1024;
+
+  if (!adaptIsRequested() || maxBytes < ringBytes) {
+    return ringBytes;
+  }
+  return maxBytes;
+}
+
+// Prepares a controller, enabled if isEnabled and ORION_ADAPT=1. Knobs are
+// added with adaptAddKnob.
+void adaptInit(struct adaptController* adapt, bool isEnabled, char* caller, int fdlog_info) {
+  memset(adapt, 0, sizeof(*adapt));
+  adapt->isEnabled = isEnabled && adaptIsRequested();
+  adapt->epoch_ns = (uint64_t) getEnvInt("ORION_ADAPT_EPOCH_MS", ADAPT_DEFAULT_EPOCH_MS) * 1000000;
+  adapt->gain = getEnvInt("ORION_ADAPT_GAIN_PCT", ADAPT_DEFAULT_GAIN_PCT) / 100.0;
+  adapt->caller = caller;
+  adapt->fdlog_info = fdlog_info;
+}
+
+// Adds a size to tune, starting at value and kept between minValue and
+// maxValue. Returns its index.
+int adaptAddKnob(struct adaptController* adapt, char* name, int value, int minValue, int maxValue) {
+  struct adaptKnob* knob = &adapt->knobs[adapt->numKnobs];
+
+  knob->name = name;
+  knob->value = value;
+  knob->startValue = value;
+  knob->bestValue = value;
+  knob->minValue = minValue < value ? minValue : value;
+  knob->maxValue = maxValue > value ? maxValue : value;
+  knob->direction = 1;
+
+  return adapt->numKnobs++;
+}
+
+// The caller asked for the current value of a knob and applied applied. Less
+// than asked for means a limit (the kernel's, say): the knob goes no further,
+// and holds what was applied. Otherwise nothing changes, so a knob moving down
+// keeps its room to move up again.
+void adaptLimit(struct adaptController* adapt, int knob, int applied) {
+  struct adaptKnob* k = &adapt->knobs[knob];
+
+  if (applied >= k->value) {
+    return;
+  }
+  k->maxValue = applied > k->minValue ? applied : k->minValue;
+  k->value = k->maxValue;
+  if (k->bestValue > k->maxValue) {
+    k->bestValue = k->maxValue;
+  }
+}
+
+// Current value of a knob
+int adaptValue(struct adaptController* adapt, int knob) {
+  return adapt->knobs[knob].value;
+}
+
+// Whether every knob settled
+bool adaptIsConverged(struct adaptController* adapt) {
+  return adapt->current >= adapt->numKnobs;
+}
+
+// Next value after value in the knob's direction, within its bounds
+int adaptStep(struct adaptKnob* knob, int value) {
+  int64_t next = knob->direction > 0 ? (int64_t) value * 2 : value / 2;
+
+  if (next > knob->maxValue) {
+    next = knob->maxValue;
+  } else if (next < knob->minValue) {
+    next = knob->minValue;
+  }
+  return (int) next;
+}
+
+// The current knob settled at its best value
+void adaptSettle(struct adaptController* adapt, struct adaptKnob* knob) {
+  char logMessage[192];
+
+  knob->value = knob->bestValue;
+  sprintf(logMessage, "[%s] Adaptive %s settled at %d bytes (%.2f MiB/s)", adapt->caller, knob->name,
+      knob->value, knob->bestRate / (1024 * 1024));
+  writeInfoLog(adapt->fdlog_info, logMessage);
+  adapt->current++;
+}
+
+// Whether a size measured at rate and stallRate beats the best one so far
+bool adaptBeatsBest(struct adaptController* adapt, struct adaptKnob* knob, double rate, double stallRate) {
+  return knob->bestRate == 0 || rate > knob->bestRate * (1 + adapt->gain) ||
+      (rate >= knob->bestRate * (1 - adapt->gain) && stallRate < knob->bestStallRate / 2);
+}
+
+// Ends an epoch: once the current size was measured over ADAPT_EPOCHS_PER_SIZE
+// epochs, moves the current knob according to their mean
+void adaptEndEpoch(struct adaptController* adapt, double rate, double stallRate) {
+  struct adaptKnob* knob = &adapt->knobs[adapt->current];
+  char logMessage[192];
+  int next;
+
+  adapt->numEpochs++;
+  knob->sumRate += rate;
+  knob->sumStallRate += stallRate;
+  if (++knob->numSamples < ADAPT_EPOCHS_PER_SIZE) {
+    return;
+  }
+  rate = knob->sumRate / knob->numSamples;
+  stallRate = knob->sumStallRate / knob->numSamples;
+  knob->sumRate = 0;
+  knob->sumStallRate = 0;
+  knob->numSamples = 0;
+
+  if (knob->isRechecking) {
+    // The best size measured again: both measurements count
+    knob->isRechecking = false;
+    knob->bestRate = (knob->bestRate + rate) / 2;
+    knob->bestStallRate = (knob->bestStallRate + stallRate) / 2;
+    if (adaptBeatsBest(adapt, knob, knob->candidateRate, knob->candidateStallRate)) {
+      // The first measurement of the best size was a lucky one: climb on
+      knob->bestValue = knob->candidateValue;
+      knob->bestRate = knob->candidateRate;
+      knob->bestStallRate = knob->candidateStallRate;
+    } else if (knob->hasTurned || knob->bestValue != knob->startValue) {
+      // Past the top
+      adaptSettle(adapt, knob);
+      return;
+    } else {
+      // The first step did not pay off: try the other way
+      knob->hasTurned = true;
+      knob->direction = -knob->direction;
+    }
+  } else if (adaptBeatsBest(adapt, knob, rate, stallRate)) {
+    // Better than any size so far: keep climbing
+    knob->bestValue = knob->value;
+    knob->bestRate = rate;
+    knob->bestStallRate = stallRate;
+  } else {
+    // Worse: one lucky measurement of the best size must not decide, so it is
+    // measured again before the step is given up
+    knob->isRechecking = true;
+    knob->candidateValue = knob->value;
+    knob->candidateRate = rate;
+    knob->candidateStallRate = stallRate;
+    sprintf(logMessage, "[%s] Adaptive %s: %d -> %d bytes after %.2f MiB/s, measuring it again", adapt->caller,
+        knob->name, knob->value, knob->bestValue, rate / (1024 * 1024));
+    writeInfoLog(adapt->fdlog_info, logMessage);
+    knob->value = knob->bestValue;
+    return;
+  }
+
+  next = adaptStep(knob, knob->bestValue);
+  if (next == knob->bestValue && !knob->hasTurned && knob->bestValue == knob->startValue) {
+    // Started at a bound
+    knob->hasTurned = true;
+    knob->direction = -knob->direction;
+    next = adaptStep(knob, knob->bestValue);
+  }
+  if (next == knob->bestValue) {
+    adaptSettle(adapt, knob);
+    return;
+  }
+
+  sprintf(logMessage, "[%s] Adaptive %s: %d -> %d bytes after %.2f MiB/s", adapt->caller, knob->name,
+      knob->value, next, rate / (1024 * 1024));
+  writeInfoLog(adapt->fdlog_info, logMessage);
+  knob->value = next;
+}
+
+// Counts bytes moved and stalls since the last call, and ends the epoch if it
+// is over. Returns the knob that changed, for the caller to apply, -1 if none
+// did. Costs a clock read per call while tuning, nothing once every knob settled.
+int adaptUpdate(struct adaptController* adapt, uint64_t bytes, uint64_t stalls) {
+  uint64_t now_ns;
+  double elapsed_s;
+  int current = adapt->current;
+  int previous;
+
+  if (!adapt->isEnabled || adaptIsConverged(adapt)) {
+    return -1;
+  }
+
+  now_ns = getMonotonicTimeNS();
+  if (adapt->epochStart_ns == 0) {
+    adapt->epochStart_ns = now_ns;
+  }
+  adapt->epochBytes += bytes;
+  adapt->epochStalls += stalls;
+  if (now_ns - adapt->epochStart_ns < adapt->epoch_ns || adapt->epochBytes == 0) {
+    return -1;
+  }
+
+  previous = adapt->knobs[current].value;
+  elapsed_s = (now_ns - adapt->epochStart_ns) / 1.0e9;
+  if (adapt->isWarm) {
+    adaptEndEpoch(adapt, adapt->epochBytes / elapsed_s, (double) adapt->epochStalls / adapt->epochBytes);
+  }
+  adapt->isWarm = true;
+  adapt->epochStart_ns = now_ns;
+  adapt->epochBytes = 0;
+  adapt->epochStalls = 0;
+
+  // A knob that settled may go back to its best value
+  return adapt->knobs[current].value != previous ? current : -1;
+}
+
+// Logs where the knobs are, and whether they all settled
+void adaptLog(struct adaptController* adapt) {
+  char logMessage[256];
+  int length;
+
+  if (!adapt->isEnabled) {
+    return;
+  }
+
+  length = sprintf(logMessage, "[%s] Adaptive sizes after %d epochs (%s):", adapt->caller, adapt->numEpochs,
+      adaptIsConverged(adapt) ? "settled" : "still tuning when the transfer ended");
+  for (int i = 0; i < adapt->numKnobs; i++) {
+    length += sprintf(logMessage + length, " %s %d bytes%s", adapt->knobs[i].name, adapt->knobs[i].value,
+        i < adapt->numKnobs - 1 ? "," : "");
+  }
+  writeInfoLog(adapt->fdlog_info, logMessage);
+}
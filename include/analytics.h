@@ -0,0 +1,561 @@
+// Optional processing of received data on a work-stealing thread pool
+// (ORION_ANALYTICS). Must be included after common.h, stats.h, trace.h,
+// kernels.h and element.h, and before ring.h, which hands over what it reads.
+//
+// The receive thread never waits for processing: every time another
+// ORION_ANALYTICS_CHUNK_KIB of the payload has arrived, it pushes that range
+// onto its own deque and wakes a worker only if one is asleep. Each of the
+// ORION_ANALYTICS_WORKERS workers owns a Chase-Lev deque: it pops ranges from
+// the bottom of its own, splits them in halves down to a grain size, pushing
+// one half back for others to steal, and steals from the top of the other
+// deques (the receive thread's included) when its own is empty. Kernels keep a
+// partial result per worker, merged once everything has been processed, and
+// run the kernels of the payload's element type (element.h). Ranges are
+// counted in 4-byte messages and split on 8-byte boundaries, so that no
+// sample straddles two of them.
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define ANALYTICS_DEQUE_TASKS 64 // per worker: splitting only goes log2(chunk/grain) deep
+
+const int ANALYTICS_DEFAULT_CHUNK_KIB = 64;
+const int ANALYTICS_GRAIN_MESSAGES = 4096; // ranges are not split below this
+const int ANALYTICS_SPINS = 64; // failed steal rounds before a worker sleeps
+
+// Partial result of the kernels over the ranges one worker processed
+struct analyticsPartial {
+  uint64_t histogram[KERNEL_HISTOGRAM_BINS];
+  double sum;
+  double min;
+  double max;
+  uint64_t numAbove; // samples at or above the threshold
+  uint64_t firstAbove; // index of the first one, UINT64_MAX if none
+  double windowMax; // highest sum over a moving window, -INFINITY if none
+  uint64_t numMessages;
+  uint64_t numSamples;
+};
+
+// A kernel processes a range of messages into a partial result, then partial
+// results are merged and described
+struct analyticsKernel {
+  const char* name;
+  void (*run)(int messages[], size_t from, size_t to, struct analyticsPartial* partial);
+  void (*merge)(struct analyticsPartial* total, struct analyticsPartial* partial);
+  void (*describe)(struct analyticsPartial* total, char* buf);
+};
+
+// Deque of ranges, each packed as from << 32 | to. Only its owner pushes and
+// pops at the bottom; anyone steals from the top.
+struct analyticsDeque {
+  int64_t top __attribute__((aligned(64)));
+  int64_t bottom __attribute__((aligned(64)));
+  uint64_t* tasks;
+  int64_t mask;
+};
+
+struct analyticsWorker {
+  pthread_t thread;
+  int id;
+  uint32_t random; // victim selection
+  uint64_t numTasks;
+  uint64_t numSteals;
+  struct analyticsPartial partial;
+} __attribute__((aligned(64)));
+
+struct analyticsPool {
+  int* messages;
+  size_t numMessages;
+  size_t chunkMessages;
+  size_t submittedTo; // receive thread: messages handed over so far
+  int numWorkers;
+  struct analyticsWorker* workers;
+  // Deques of the workers, then of the receive thread
+  struct analyticsDeque* deques;
+  uint32_t numSubmitted; // futex word idle workers sleep on
+  uint32_t numSleeping;
+  uint32_t isStopping;
+  uint32_t isClosed; // everything was submitted
+  uint32_t isDone; // futex word: everything was processed
+  uint64_t numProcessed; // messages
+  uint64_t start_ns;
+  uint64_t done_ns;
+  bool isSelected[5]; // in ANALYTICS_KERNELS order
+};
+
+struct analyticsPool analytics;
+bool isAnalyticsEnabled = false;
+
+//////////////////////
+////    KERNELS   ////
+//////////////////////
+
+void analyticsRunHistogram(int messages[], size_t from, size_t to, struct analyticsPartial* partial) {
+  elementType->histogram(messages, elementAt(from), elementAt(to), partial->histogram);
+}
+
+void analyticsMergeHistogram(struct analyticsPartial* total, struct analyticsPartial* partial) {
+  for (int i = 0; i < KERNEL_HISTOGRAM_BINS; i++) {
+    total->histogram[i] += partial->histogram[i];
+  }
+}
+
+void analyticsDescribeHistogram(struct analyticsPartial* total, char* buf) {
+  int mode = 0;
+
+  for (int i = 1; i < KERNEL_HISTOGRAM_BINS; i++) {
+    if (total->histogram[i] > total->histogram[mode]) {
+      mode = i;
+    }
+  }
+  sprintf(buf, "histogram of %d bins, mode %d (%lu samples)", KERNEL_HISTOGRAM_BINS, mode,
+      (unsigned long) total->histogram[mode]);
+}
+
+void analyticsRunSum(int messages[], size_t from, size_t to, struct analyticsPartial* partial) {
+  partial->sum += elementType->sum(messages, elementAt(from), elementAt(to));
+}
+
+void analyticsMergeSum(struct analyticsPartial* total, struct analyticsPartial* partial) {
+  total->sum += partial->sum;
+}
+
+void analyticsDescribeSum(struct analyticsPartial* total, char* buf) {
+  sprintf(buf, "sum %.15g (mean %.3f)", total->sum, total->numSamples > 0 ? total->sum / total->numSamples : 0);
+}
+
+void analyticsRunMinMax(int messages[], size_t from, size_t to, struct analyticsPartial* partial) {
+  elementType->minMax(messages, elementAt(from), elementAt(to), &partial->min, &partial->max);
+}
+
+void analyticsMergeMinMax(struct analyticsPartial* total, struct analyticsPartial* partial) {
+  total->min = partial->min < total->min ? partial->min : total->min;
+  total->max = partial->max > total->max ? partial->max : total->max;
+}
+
+void analyticsDescribeMinMax(struct analyticsPartial* total, char* buf) {
+  sprintf(buf, "min %g max %g", total->min, total->max);
+}
+
+double analyticsThreshold;
+
+void analyticsRunThreshold(int messages[], size_t from, size_t to, struct analyticsPartial* partial) {
+  size_t first;
+  uint64_t count = elementType->threshold(messages, elementAt(from), elementAt(to), analyticsThreshold, &first);
+
+  partial->numAbove += count;
+  if (count > 0 && first < partial->firstAbove) {
+    partial->firstAbove = first;
+  }
+}
+
+void analyticsMergeThreshold(struct analyticsPartial* total, struct analyticsPartial* partial) {
+  total->numAbove += partial->numAbove;
+  total->firstAbove = partial->firstAbove < total->firstAbove ? partial->firstAbove : total->firstAbove;
+}
+
+void analyticsDescribeThreshold(struct analyticsPartial* total, char* buf) {
+  if (total->numAbove > 0) {
+    sprintf(buf, "%lu samples at or above %g, first at %lu", (unsigned long) total->numAbove,
+        analyticsThreshold, (unsigned long) total->firstAbove);
+  } else {
+    sprintf(buf, "no sample at or above %g", analyticsThreshold);
+  }
+}
+
+size_t analyticsWindow;
+
+// Windows ending in the range reach back into earlier ranges, which have all
+// arrived by then
+void analyticsRunAverage(int messages[], size_t from, size_t to, struct analyticsPartial* partial) {
+  double windowMax = elementType->windowMax(messages, elementAt(from), elementAt(to), analyticsWindow);
+
+  partial->windowMax = windowMax > partial->windowMax ? windowMax : partial->windowMax;
+}
+
+void analyticsMergeAverage(struct analyticsPartial* total, struct analyticsPartial* partial) {
+  total->windowMax = partial->windowMax > total->windowMax ? partial->windowMax : total->windowMax;
+}
+
+void analyticsDescribeAverage(struct analyticsPartial* total, char* buf) {
+  if (total->windowMax > -INFINITY) {
+    sprintf(buf, "peak moving average over %zu samples %.3f", analyticsWindow, total->windowMax / analyticsWindow);
+  } else {
+    sprintf(buf, "fewer than %zu samples", analyticsWindow);
+  }
+}
+
+const struct analyticsKernel ANALYTICS_KERNELS[] = {
+  {"histogram", analyticsRunHistogram, analyticsMergeHistogram, analyticsDescribeHistogram},
+  {"sum", analyticsRunSum, analyticsMergeSum, analyticsDescribeSum},
+  {"minmax", analyticsRunMinMax, analyticsMergeMinMax, analyticsDescribeMinMax},
+  {"threshold", analyticsRunThreshold, analyticsMergeThreshold, analyticsDescribeThreshold},
+  {"average", analyticsRunAverage, analyticsMergeAverage, analyticsDescribeAverage}
+};
+const int NUM_ANALYTICS_KERNELS = sizeof(ANALYTICS_KERNELS) / sizeof(ANALYTICS_KERNELS[0]);
+
+void analyticsResetPartial(struct analyticsPartial* partial) {
+  memset(partial, 0, sizeof(*partial));
+  partial->min = INFINITY;
+  partial->max = -INFINITY;
+  partial->firstAbove = UINT64_MAX;
+  partial->windowMax = -INFINITY;
+}
+
+//////////////////////
+////    DEQUES    ////
+//////////////////////
+
+void analyticsDequeInit(struct analyticsDeque* deque, size_t capacity) {
+  size_t size = 1;
+
+  while (size < capacity) {
+    size <<= 1;
+  }
+  deque->top = 0;
+  deque->bottom = 0;
+  deque->tasks = calloc(size, sizeof(uint64_t));
+  deque->mask = size - 1;
+}
+
+// Owner only
+void analyticsPush(struct analyticsDeque* deque, size_t from, size_t to) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&deque->tasks[bottom & deque->mask], (uint64_t) from << 32 | to, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+// Owner only. Returns false if the deque is empty.
+bool analyticsPop(struct analyticsDeque* deque, uint64_t* task) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  int64_t top;
+  bool isTaken = true;
+
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (top > bottom) {
+    // Empty
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  *task = __atomic_load_n(&deque->tasks[bottom & deque->mask], __ATOMIC_RELAXED);
+  if (top == bottom) {
+    // Last task: race thieves for it
+    isTaken = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+
+  return isTaken;
+}
+
+// Anyone. Returns false if the deque is empty or another thief won.
+bool analyticsSteal(struct analyticsDeque* deque, uint64_t* task) {
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  int64_t bottom;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) {
+    return false;
+  }
+
+  *task = __atomic_load_n(&deque->tasks[top & deque->mask], __ATOMIC_RELAXED);
+  return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+//////////////////////
+////     POOL     ////
+//////////////////////
+
+// Wakes up to numWorkers sleeping workers
+void analyticsWake(int numWorkers) {
+  if (__atomic_load_n(&analytics.numSleeping, __ATOMIC_SEQ_CST) > 0) {
+    syscall(SYS_futex, &analytics.numSubmitted, FUTEX_WAKE_PRIVATE, numWorkers, NULL, NULL, 0);
+  }
+}
+
+// Steals from another deque, trying them all from a random one
+bool analyticsStealAny(struct analyticsWorker* worker, uint64_t* task) {
+  int numDeques = analytics.numWorkers + 1;
+  int first;
+
+  worker->random ^= worker->random << 13;
+  worker->random ^= worker->random >> 17;
+  worker->random ^= worker->random << 5;
+  first = worker->random % numDeques;
+
+  for (int i = 0; i < numDeques; i++) {
+    int victim = (first + i) % numDeques;
+
+    if (victim != worker->id && analyticsSteal(&analytics.deques[victim], task)) {
+      worker->numSteals++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Runs the selected kernels over a range, splitting it while it is large
+void analyticsProcess(struct analyticsWorker* worker, size_t from, size_t to) {
+  uint64_t numProcessed;
+
+  while (to - from > (size_t) ANALYTICS_GRAIN_MESSAGES) {
+    size_t middle = from + ((to - from) / 2 & ~(size_t) 1);
+
+    analyticsPush(&analytics.deques[worker->id], middle, to);
+    analyticsWake(1);
+    to = middle;
+  }
+
+  for (int k = 0; k < NUM_ANALYTICS_KERNELS; k++) {
+    if (analytics.isSelected[k]) {
+      ANALYTICS_KERNELS[k].run(analytics.messages, from, to, &worker->partial);
+    }
+  }
+  worker->partial.numMessages += to - from;
+  worker->partial.numSamples += elementAt(to) - elementAt(from);
+  worker->numTasks++;
+
+  // The worker processing the last message reports it
+  numProcessed = __atomic_add_fetch(&analytics.numProcessed, to - from, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&analytics.isClosed, __ATOMIC_SEQ_CST) && numProcessed == analytics.numMessages &&
+      __atomic_exchange_n(&analytics.isDone, 1, __ATOMIC_SEQ_CST) == 0) {
+    analytics.done_ns = getMonotonicTimeNS();
+    syscall(SYS_futex, &analytics.isDone, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+  }
+}
+
+void* analyticsWorkerMain(void* arg) {
+  struct analyticsWorker* worker = arg;
+  uint64_t start_ns = traceBegin();
+  uint64_t task;
+  uint32_t seen;
+  int numFailed = 0;
+
+  while (!__atomic_load_n(&analytics.isStopping, __ATOMIC_ACQUIRE)) {
+    if (analyticsPop(&analytics.deques[worker->id], &task) || analyticsStealAny(worker, &task)) {
+      analyticsProcess(worker, task >> 32, task & UINT32_MAX);
+      numFailed = 0;
+      continue;
+    }
+
+    if (++numFailed < ANALYTICS_SPINS) {
+      continue;
+    }
+
+    // Nothing to do: sleep until something is submitted, checking once more
+    // after announcing it so that no wake-up is missed
+    seen = __atomic_load_n(&analytics.numSubmitted, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&analytics.numSleeping, 1, __ATOMIC_SEQ_CST);
+    if (analyticsStealAny(worker, &task)) {
+      __atomic_sub_fetch(&analytics.numSleeping, 1, __ATOMIC_SEQ_CST);
+      analyticsProcess(worker, task >> 32, task & UINT32_MAX);
+      numFailed = 0;
+      continue;
+    }
+    if (!__atomic_load_n(&analytics.isStopping, __ATOMIC_ACQUIRE)) {
+      syscall(SYS_futex, &analytics.numSubmitted, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+    }
+    __atomic_sub_fetch(&analytics.numSleeping, 1, __ATOMIC_SEQ_CST);
+    numFailed = 0;
+  }
+  traceEnd("analytics worker", "analytics", start_ns);
+
+  return NULL;
+}
+
+// Selects kernels from a comma-separated list ("all" for every one). Returns
+// false if a name is unknown.
+bool analyticsSelectKernels(char* list) {
+  char* names = strdup(list);
+  char* saveptr;
+  bool isValid = true;
+
+  for (char* name = strtok_r(names, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)) {
+    bool isFound = false;
+
+    for (int k = 0; k < NUM_ANALYTICS_KERNELS; k++) {
+      if (strcmp(name, "all") == 0 || strcmp(name, ANALYTICS_KERNELS[k].name) == 0) {
+        analytics.isSelected[k] = true;
+        isFound = true;
+      }
+    }
+    isValid = isValid && isFound;
+  }
+  free(names);
+
+  return isValid;
+}
+
+// Turns ORION_ANALYTICS off for a transfer mode whose data does not arrive
+// in one piece, before analyticsOpen
+void analyticsDisable(char* caller, int fdlog_info) {
+  char logMessage[128];
+
+  if (getEnvString("ORION_ANALYTICS", NULL) != NULL) {
+    sprintf(logMessage, "[%s] Analytics are not supported by this transfer mode, data is not processed", caller);
+    writeInfoLog(fdlog_info, logMessage);
+    unsetenv("ORION_ANALYTICS");
+  }
+}
+
+// Starts the pool if ORION_ANALYTICS lists kernels, to process numMessages
+// messages as they arrive in messages
+void analyticsOpen(int messages[], size_t numMessages, char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[160];
+  char* list = getEnvString("ORION_ANALYTICS", NULL);
+  long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  isAnalyticsEnabled = false;
+  if (list == NULL || list[0] == '\0' || numMessages == 0) {
+    return;
+  }
+
+  memset(&analytics, 0, sizeof(analytics));
+  if (!analyticsSelectKernels(list)) {
+    sprintf(logMessage, "[%s] Unknown kernel in ORION_ANALYTICS=%s, expecting histogram, sum, minmax, "
+        "threshold, average or all", caller, list);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+  analyticsThreshold = getEnvInt("ORION_ANALYTICS_THRESHOLD", 99);
+  analyticsWindow = getEnvInt("ORION_ANALYTICS_WINDOW", 1024) > 0 ? getEnvInt("ORION_ANALYTICS_WINDOW", 1024) : 1;
+  kernelsSelect(caller, fdlog_info);
+  elementSelect(caller, fdlog_info);
+
+  analytics.messages = messages;
+  analytics.numMessages = numMessages;
+  analytics.chunkMessages = (size_t) getEnvInt("ORION_ANALYTICS_CHUNK_KIB", ANALYTICS_DEFAULT_CHUNK_KIB) * 1024
+      / sizeof(int);
+  if (analytics.chunkMessages < 2) {
+    analytics.chunkMessages = 2;
+  }
+  analytics.numWorkers = getEnvInt("ORION_ANALYTICS_WORKERS", numCpus > 1 ? numCpus : 1);
+  if (analytics.numWorkers < 1) {
+    analytics.numWorkers = 1;
+  }
+
+  analytics.deques = aligned_alloc(64, (analytics.numWorkers + 1) * sizeof(struct analyticsDeque));
+  analytics.workers = aligned_alloc(64, analytics.numWorkers * sizeof(struct analyticsWorker));
+  for (int i = 0; i < analytics.numWorkers; i++) {
+    analyticsDequeInit(&analytics.deques[i], ANALYTICS_DEQUE_TASKS);
+  }
+  // The receive thread's deque holds every chunk, so pushing never fails
+  analyticsDequeInit(&analytics.deques[analytics.numWorkers], numMessages / analytics.chunkMessages + 2);
+
+  sprintf(logMessage, "[%s] Processing received data on %d workers in chunks of %zu messages",
+      caller, analytics.numWorkers, analytics.chunkMessages);
+  writeInfoLog(fdlog_info, logMessage);
+
+  isAnalyticsEnabled = true;
+  analytics.start_ns = getMonotonicTimeNS();
+  for (int i = 0; i < analytics.numWorkers; i++) {
+    memset(&analytics.workers[i], 0, sizeof(struct analyticsWorker));
+    analytics.workers[i].id = i;
+    analytics.workers[i].random = 2654435761u * (i + 1);
+    analyticsResetPartial(&analytics.workers[i].partial);
+    threadCreate(&analytics.workers[i].thread, analyticsWorkerMain, &analytics.workers[i], fdlog_err);
+  }
+}
+
+// Receive thread: hands over the range up to to
+void analyticsSubmit(size_t to) {
+  analyticsPush(&analytics.deques[analytics.numWorkers], analytics.submittedTo, to);
+  analytics.submittedTo = to;
+  __atomic_add_fetch(&analytics.numSubmitted, 1, __ATOMIC_SEQ_CST);
+  analyticsWake(1);
+}
+
+// Receive thread: numMessages messages from index on have arrived. Hands over
+// every complete chunk, without waiting.
+void analyticsArrived(uint64_t index, size_t numMessages) {
+  if (!isAnalyticsEnabled) {
+    return;
+  }
+
+  while (index + numMessages - analytics.submittedTo >= analytics.chunkMessages) {
+    analyticsSubmit(analytics.submittedTo + analytics.chunkMessages);
+  }
+}
+
+// Receive thread, once the transfer is over: hands over the rest, waits for
+// the workers to process it, merges and logs the results. Returns the time from
+// transferStart_ns to the end of processing in seconds, 0 without analytics.
+double analyticsFinish(uint64_t transferStart_ns, char* caller, int fdlog_info, int fdlog_err) {
+  struct analyticsPartial total;
+  char logMessage[256];
+  char description[128];
+  uint64_t numSteals = 0;
+  uint64_t numTasks = 0;
+  uint64_t lastArrival_ns;
+  double endToEnd_s;
+
+  if (!isAnalyticsEnabled) {
+    return 0;
+  }
+
+  // Transports that do not report arrivals (striped sockets, io_uring) hand
+  // everything over here
+  lastArrival_ns = getMonotonicTimeNS();
+  if (analytics.submittedTo < analytics.numMessages) {
+    analyticsSubmit(analytics.numMessages);
+  }
+
+  __atomic_store_n(&analytics.isClosed, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&analytics.numProcessed, __ATOMIC_SEQ_CST) == analytics.numMessages &&
+      __atomic_exchange_n(&analytics.isDone, 1, __ATOMIC_SEQ_CST) == 0) {
+    analytics.done_ns = getMonotonicTimeNS();
+  }
+  while (__atomic_load_n(&analytics.isDone, __ATOMIC_SEQ_CST) == 0) {
+    syscall(SYS_futex, &analytics.isDone, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+  }
+
+  __atomic_store_n(&analytics.isStopping, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&analytics.numSubmitted, 1, __ATOMIC_SEQ_CST);
+  syscall(SYS_futex, &analytics.numSubmitted, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+
+  analyticsResetPartial(&total);
+  for (int i = 0; i < analytics.numWorkers; i++) {
+    threadJoin(analytics.workers[i].thread, fdlog_err);
+    for (int k = 0; k < NUM_ANALYTICS_KERNELS; k++) {
+      if (analytics.isSelected[k]) {
+        ANALYTICS_KERNELS[k].merge(&total, &analytics.workers[i].partial);
+      }
+    }
+    total.numMessages += analytics.workers[i].partial.numMessages;
+    total.numSamples += analytics.workers[i].partial.numSamples;
+    numSteals += analytics.workers[i].numSteals;
+    numTasks += analytics.workers[i].numTasks;
+  }
+
+  sprintf(logMessage, "[%s] Processed %lu %s samples on %d workers: %lu ranges, %lu stolen, done %.3f ms after "
+      "the last arrival", caller, (unsigned long) total.numSamples, elementType->name, analytics.numWorkers,
+      (unsigned long) numTasks, (unsigned long) numSteals,
+      analytics.done_ns > lastArrival_ns ? (analytics.done_ns - lastArrival_ns) / 1.0e6 : 0);
+  writeInfoLog(fdlog_info, logMessage);
+  for (int k = 0; k < NUM_ANALYTICS_KERNELS; k++) {
+    if (analytics.isSelected[k]) {
+      ANALYTICS_KERNELS[k].describe(&total, description);
+      sprintf(logMessage, "[%s] Analytics %s: %s", caller, ANALYTICS_KERNELS[k].name, description);
+      writeInfoLog(fdlog_info, logMessage);
+    }
+  }
+
+  endToEnd_s = (analytics.done_ns - transferStart_ns) / 1.0e9;
+  sprintf(logMessage, "[%s] End-to-end time including processing: %.6f seconds (%.2f MiB/s)", caller,
+      endToEnd_s, endToEnd_s > 0 ? analytics.numMessages * sizeof(int) / 1048576.0 / endToEnd_s : 0);
+  writeInfoLog(fdlog_info, logMessage);
+
+  for (int i = 0; i <= analytics.numWorkers; i++) {
+    free(analytics.deques[i].tasks);
+  }
+  free(analytics.deques);
+  free(analytics.workers);
+  isAnalyticsEnabled = false;
+
+  return endToEnd_s;
+}
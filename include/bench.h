@@ -0,0 +1,331 @@
+// Summary statistics over repeated transmissions, used by the master's bench mode.
+// Must be included after common.h.
+//
+// One timing of a transfer says little on a busy machine, so the master repeats
+// it, discards warmup runs and summarises the rest. Outliers can optionally be
+// rejected with Tukey's fences (outside 1.5 interquartile ranges of the
+// quartiles) before the summary is computed.
+
+#include <math.h>
+
+//// SUMMARY STATISTICS ////
+
+struct benchSummary {
+  int numRuns; // runs summarised, after outlier rejection
+  int numRejected; // outliers discarded
+  double mean;
+  double median;
+  double stddev; // sample standard deviation
+  double min;
+  double max;
+  double p95;
+  double ciLow; // 95% confidence interval of the mean
+  double ciHigh;
+};
+
+// Two-sided 95% critical values of Student's t distribution, by degrees of freedom
+const double STUDENT_T_95[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+    2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+const int NUM_STUDENT_T_95 = sizeof(STUDENT_T_95) / sizeof(STUDENT_T_95[0]);
+
+// Critical value for a 95% confidence interval with df degrees of freedom
+double benchStudentT95(int df) {
+  if (df < 1) {
+    return 0;
+  }
+  if (df <= NUM_STUDENT_T_95) {
+    return STUDENT_T_95[df - 1];
+  }
+  return 1.960; // close enough to the normal distribution
+}
+
+int benchCompareDoubles(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+
+  return (x > y) - (x < y);
+}
+
+// Percentile p (0 to 100) of n sorted samples, interpolating between ranks
+double benchPercentile(double sorted[], int n, double p) {
+  double rank;
+  int below;
+
+  if (n == 0) {
+    return 0;
+  }
+
+  rank = p / 100.0 * (n - 1);
+  below = (int) rank;
+  if (below >= n - 1) {
+    return sorted[n - 1];
+  }
+  return sorted[below] + (rank - below) * (sorted[below + 1] - sorted[below]);
+}
+
+// Summarises n samples (seconds). samples is sorted in place; with
+// rejectOutliers, samples outside Tukey's fences are left out of the summary.
+void benchSummarize(double samples[], int n, bool rejectOutliers, struct benchSummary* summary) {
+  double* kept = samples;
+  int numKept = n;
+  double sum;
+  double squares;
+
+  memset(summary, 0, sizeof(*summary));
+  if (n == 0) {
+    return;
+  }
+
+  qsort(samples, n, sizeof(double), benchCompareDoubles);
+
+  if (rejectOutliers && n >= 4) {
+    double q1 = benchPercentile(samples, n, 25);
+    double q3 = benchPercentile(samples, n, 75);
+    double lowFence = q1 - 1.5 * (q3 - q1);
+    double highFence = q3 + 1.5 * (q3 - q1);
+    int first = 0;
+
+    while (first < n && samples[first] < lowFence) {
+      first++;
+    }
+    numKept = n - first;
+    while (numKept > 0 && samples[first + numKept - 1] > highFence) {
+      numKept--;
+    }
+    kept = samples + first;
+  }
+
+  summary->numRuns = numKept;
+  summary->numRejected = n - numKept;
+  summary->min = kept[0];
+  summary->max = kept[numKept - 1];
+  summary->median = benchPercentile(kept, numKept, 50);
+  summary->p95 = benchPercentile(kept, numKept, 95);
+
+  sum = 0;
+  for (int i = 0; i < numKept; i++) {
+    sum += kept[i];
+  }
+  summary->mean = sum / numKept;
+
+  squares = 0;
+  for (int i = 0; i < numKept; i++) {
+    squares += (kept[i] - summary->mean) * (kept[i] - summary->mean);
+  }
+  summary->stddev = numKept > 1 ? sqrt(squares / (numKept - 1)) : 0;
+
+  double halfWidth = benchStudentT95(numKept - 1) * summary->stddev / sqrt(numKept);
+  summary->ciLow = summary->mean - halfWidth;
+  summary->ciHigh = summary->mean + halfWidth;
+}
+
+//// BASELINES ////
+
+// A benchmark saved as a baseline holds one entry per protocol and size, in a
+// CSV file. Later benchmarks are compared with it using Welch's t-test: a
+// change of the mean transfer time counts when it is both larger than the
+// threshold and statistically significant at the 95% level.
+
+#define BENCH_MAX_ENTRIES 64
+#define BENCH_NAME_LENGTH 32
+#define BENCH_TUNING_LENGTH 128
+
+const char* BENCH_CSV_HEADER = "protocol,name,size_mib,runs,mean_s,median_s,stddev_s,min_s,max_s,p95_s,tuning";
+
+// Summary of one protocol and size
+struct benchEntry {
+  int protocol; // as numbered in the master's menu
+  char name[BENCH_NAME_LENGTH];
+  int sizeDataMiB;
+  struct benchSummary summary;
+  char tuning[BENCH_TUNING_LENGTH]; // socket tuning of the runs, "-" for other protocols
+};
+
+enum benchVerdict {
+  BENCH_NEW = 0, // nothing to compare with
+  BENCH_UNCHANGED,
+  BENCH_IMPROVED,
+  BENCH_REGRESSED,
+  BENCH_FAILED // no successful run
+};
+
+const char* BENCH_VERDICT_NAMES[] = {"new", "unchanged", "improved", "REGRESSED", "FAILED"};
+
+struct benchComparison {
+  struct benchEntry current;
+  struct benchEntry baseline; // only meaningful when there was one
+  double change; // relative change of the mean time, 0.05 = 5% slower
+  double t; // Welch's t statistic
+  double df; // Welch-Satterthwaite degrees of freedom
+  enum benchVerdict verdict;
+  double overhead; // mean time over that of the in-process baseline, 0 if not measured
+};
+
+// Reads a baseline file into entries. Returns the number of entries, -1 if
+// the file cannot be opened.
+int benchLoadBaseline(char* path, struct benchEntry entries[], int maxEntries) {
+  FILE* file;
+  char line[512];
+  int numEntries = 0;
+
+  file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  while (numEntries < maxEntries && fgets(line, sizeof(line), file) != NULL) {
+    struct benchEntry* entry = &entries[numEntries];
+
+    memset(entry, 0, sizeof(*entry));
+    strcpy(entry->tuning, "-");
+    // The header and malformed lines do not parse. Baselines saved before the
+    // tuning was recorded have no tuning column.
+    if (sscanf(line, "%d,%31[^,],%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%127[^,\n]", &entry->protocol, entry->name,
+        &entry->sizeDataMiB, &entry->summary.numRuns, &entry->summary.mean, &entry->summary.median,
+        &entry->summary.stddev, &entry->summary.min, &entry->summary.max, &entry->summary.p95,
+        entry->tuning) >= 10) {
+      numEntries++;
+    }
+  }
+  fclose(file);
+
+  return numEntries;
+}
+
+// Writes entries to a baseline file, replacing it. Returns false on error.
+bool benchSaveBaseline(char* path, struct benchEntry entries[], int numEntries) {
+  FILE* file;
+
+  file = fopen(path, "w");
+  if (file == NULL) {
+    perror("ERROR in benchSaveBaseline fopen");
+    return false;
+  }
+
+  fprintf(file, "%s\n", BENCH_CSV_HEADER);
+  for (int i = 0; i < numEntries; i++) {
+    struct benchSummary* s = &entries[i].summary;
+
+    fprintf(file, "%d,%s,%d,%d,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%s\n", entries[i].protocol, entries[i].name,
+        entries[i].sizeDataMiB, s->numRuns, s->mean, s->median, s->stddev, s->min, s->max, s->p95,
+        entries[i].tuning);
+  }
+
+  return fclose(file) == 0;
+}
+
+// Entry for a protocol and size, NULL if there is none
+struct benchEntry* benchFindEntry(struct benchEntry entries[], int numEntries, int protocol, int sizeDataMiB) {
+  for (int i = 0; i < numEntries; i++) {
+    if (entries[i].protocol == protocol && entries[i].sizeDataMiB == sizeDataMiB) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+// Compares a benchmark with its baseline (NULL if none). threshold is the
+// smallest relative change of the mean time worth reporting (0.05 = 5%).
+void benchCompare(struct benchEntry* current, struct benchEntry* baseline, double threshold,
+    struct benchComparison* comparison) {
+  struct benchSummary* a;
+  struct benchSummary* b;
+  double varianceA;
+  double varianceB;
+  double stderrSquared;
+  bool isSignificant;
+
+  memset(comparison, 0, sizeof(*comparison));
+  comparison->current = *current;
+  if (current->summary.numRuns == 0) {
+    comparison->verdict = BENCH_FAILED;
+    return;
+  }
+  if (baseline == NULL || baseline->summary.numRuns == 0 || baseline->summary.mean <= 0) {
+    comparison->verdict = BENCH_NEW;
+    return;
+  }
+  comparison->baseline = *baseline;
+
+  a = &baseline->summary;
+  b = &current->summary;
+  comparison->change = (b->mean - a->mean) / a->mean;
+
+  // Welch's t-test: the two runs need not have the same variance or size
+  varianceA = a->stddev * a->stddev / a->numRuns;
+  varianceB = b->stddev * b->stddev / b->numRuns;
+  stderrSquared = varianceA + varianceB;
+  if (stderrSquared > 0) {
+    comparison->t = (b->mean - a->mean) / sqrt(stderrSquared);
+    comparison->df = stderrSquared * stderrSquared /
+        ((a->numRuns > 1 ? varianceA * varianceA / (a->numRuns - 1) : 0) +
+         (b->numRuns > 1 ? varianceB * varianceB / (b->numRuns - 1) : 0));
+    isSignificant = fabs(comparison->t) > benchStudentT95((int) comparison->df);
+  } else {
+    // No spread at all (single runs): any difference stands out
+    isSignificant = b->mean != a->mean;
+  }
+
+  if (isSignificant && comparison->change > threshold) {
+    comparison->verdict = BENCH_REGRESSED;
+  } else if (isSignificant && comparison->change < -threshold) {
+    comparison->verdict = BENCH_IMPROVED;
+  } else {
+    comparison->verdict = BENCH_UNCHANGED;
+  }
+}
+
+// Writes a comparison report: markdown if path ends in ".md", CSV otherwise.
+// Returns false on error.
+bool benchWriteReport(char* path, struct benchComparison comparisons[], int numComparisons,
+    double threshold) {
+  FILE* file;
+  size_t length = strlen(path);
+  bool isMarkdown = length >= 3 && !strcmp(path + length - 3, ".md");
+
+  file = fopen(path, "w");
+  if (file == NULL) {
+    perror("ERROR in benchWriteReport fopen");
+    return false;
+  }
+
+  if (isMarkdown) {
+    fprintf(file, "# Orion benchmark report\n\n");
+    fprintf(file, "Changes of the mean transfer time above %.1f%% that are significant at the 95%% level "
+        "(Welch's t-test) are flagged.\n\n", 100 * threshold);
+    fprintf(file, "The overhead is the mean time relative to the in-process (threads) baseline of the same size.\n\n");
+    fprintf(file, "| Protocol | Size (MiB) | Baseline mean (s) | Mean (s) | Change | t | Verdict | Overhead | Tuning |\n");
+    fprintf(file, "|---|---|---|---|---|---|---|---|---|\n");
+  } else {
+    fprintf(file, "protocol,name,size_mib,baseline_mean_s,baseline_stddev_s,baseline_runs,"
+        "mean_s,stddev_s,runs,change,t,df,verdict,overhead,tuning\n");
+  }
+
+  for (int i = 0; i < numComparisons; i++) {
+    struct benchComparison* c = &comparisons[i];
+    bool hasBaseline = c->verdict != BENCH_NEW && c->verdict != BENCH_FAILED;
+
+    if (isMarkdown && hasBaseline) {
+      fprintf(file, "| %s | %d | %.6f | %.6f | %+.1f%% | %.2f | %s |", c->current.name,
+          c->current.sizeDataMiB, c->baseline.summary.mean, c->current.summary.mean,
+          100 * c->change, c->t, BENCH_VERDICT_NAMES[c->verdict]);
+    } else if (isMarkdown) {
+      fprintf(file, "| %s | %d | - | %.6f | - | - | %s |", c->current.name, c->current.sizeDataMiB,
+          c->current.summary.mean, BENCH_VERDICT_NAMES[c->verdict]);
+    } else {
+      fprintf(file, "%d,%s,%d,%.9f,%.9f,%d,%.9f,%.9f,%d,%.6f,%.4f,%.2f,%s,%.3f,%s\n", c->current.protocol,
+          c->current.name, c->current.sizeDataMiB, c->baseline.summary.mean, c->baseline.summary.stddev,
+          c->baseline.summary.numRuns, c->current.summary.mean, c->current.summary.stddev,
+          c->current.summary.numRuns, c->change, c->t, c->df, BENCH_VERDICT_NAMES[c->verdict], c->overhead,
+          c->current.tuning);
+    }
+    if (isMarkdown && c->overhead > 0) {
+      fprintf(file, " %.2fx | %s |\n", c->overhead, c->current.tuning);
+    } else if (isMarkdown) {
+      fprintf(file, " - | %s |\n", c->current.tuning);
+    }
+  }
+
+  return fclose(file) == 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -8,7 +9,11 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include<sys/wait.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <poll.h>
 #include <netdb.h>
 #include <strings.h>
 #include <string.h>
@@ -18,7 +23,10 @@
 #include <time.h>
 #include <math.h>
 #include <semaphore.h>
+#include <mqueue.h>
 #include <termios.h>
+#include <stdint.h>
+#include <pthread.h>
 
 /////////////////
 //// LOGGING ////
@@ -139,6 +147,40 @@ double getCurrrentTimeMS () {
   return currTime_ms;
 }
 
+// Returns a monotonic timestamp in nanoseconds, comparable across processes
+uint64_t getMonotonicTimeNS () {
+  struct timespec spec;
+
+  clock_gettime(CLOCK_MONOTONIC, &spec);
+
+  return (uint64_t) spec.tv_sec * 1000000000ULL + spec.tv_nsec;
+}
+
+// Reads an integer tuning option from the environment (e.g. ORION_URING_DEPTH),
+// returning defaultValue if it is not set. Options are passed through the
+// environment so that they reach every process spawned for a transfer.
+int getEnvInt(char* name, int defaultValue) {
+  char* value = getenv(name);
+
+  if (value == NULL || value[0] == '\0') {
+    return defaultValue;
+  }
+
+  return atoi(value);
+}
+
+// Reads a string tuning option from the environment, returning defaultValue if
+// it is not set
+char* getEnvString(char* name, char* defaultValue) {
+  char* value = getenv(name);
+
+  if (value == NULL || value[0] == '\0') {
+    return defaultValue;
+  }
+
+  return value;
+}
+
 // Changes terminal color
 // colorCode - ANSI color code
 void terminalColor(int colorCode, bool isBold) {
@@ -316,7 +358,7 @@ void* shmInit(char* shmPath, void* addr, size_t length, int prot, int flags, off
     exit(-1);
   }
 
-  ptr = mmap(NULL, length, PROT_WRITE, MAP_SHARED, fdShm, 0);
+  ptr = mmap(addr, length, prot, flags, fdShm, offset);
   if (ptr == MAP_FAILED) {
     printf("Error %d in ", errno);
     fflush(stdout);
@@ -476,13 +518,15 @@ sem_t* semOpen(char *pathname, int initValue, int fdlog_err) {
 
   sem = sem_open(pathname, O_CREAT | O_RDWR, 0666, initValue);
 
-  if (sem < 0) {
+  if (sem == SEM_FAILED) {
     printf("Error %d in ", errno);
     fflush(stdout);
     perror("common.h sem_open");
     writeErrorLog(fdlog_err, "common.h: sem_open failed", errno);
     exit(-1);
   }
+
+  return sem;
 }
 
 // Calls a sem_wait on given semaphore
@@ -496,6 +540,35 @@ void semWait(sem_t* sem, int fdlog_err) {
   }
 }
 
+// Calls a sem_wait on given semaphore, giving up after timeout_ms. Returns
+// false if the semaphore was not posted in time.
+bool semTimedWait(sem_t* sem, int timeout_ms, int fdlog_err) {
+  struct timespec deadline;
+  int ret;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  do {
+    ret = sem_timedwait(sem, &deadline);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0 && errno != ETIMEDOUT) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h sem_timedwait");
+    writeErrorLog(fdlog_err, "common.h: sem_timedwait failed", errno);
+    exit(-1);
+  }
+
+  return ret == 0;
+}
+
 // Calls a sem_post on given sempahore
 void semPost(sem_t* sem, int fdlog_err) {
   if (sem_post(sem) < 0) {
@@ -565,29 +638,83 @@ struct hostent* getHostFromName(const char* name, int fdlog_err) {
   return ent;
 }
 
-// Wrapper for connect()
+// Wrapper for connect(). The producer may not be listening yet, so refused
+// attempts are retried with exponential backoff (starting well under a
+// millisecond) until a 5 second deadline.
 void socketConnect(int sockfd, const struct sockaddr* addr, socklen_t addrlen, int fdlog_err) {
-  bool isFailed = true;
-  int retConnect;
-
-  // Keep trying to connect for a while before giving up
-  for (int i = 0; i < 5; i++) {
-    retConnect = connect(sockfd, addr, addrlen);
-    if (retConnect < 0) {
-      sleep(1);
-    } else {
-      isFailed = false;
+  const uint64_t timeout_ns = 5000000000ULL;
+  const long maxBackoff_ns = 50000000; // 50 ms
+  long backoff_ns = 100000; // 100 us
+  uint64_t deadline_ns;
+  struct timespec backoff;
+  struct pollfd pfd;
+  int flags;
+  int err;
+  socklen_t errLen;
+  bool isConnected = false;
+
+  deadline_ns = getMonotonicTimeNS() + timeout_ns;
+
+  // Non-blocking, so that a pending attempt can be waited on with a short timeout
+  flags = fcntl(sockfd, F_GETFL, 0);
+  fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+  while (!isConnected) {
+    if (connect(sockfd, addr, addrlen) == 0 || errno == EISCONN) {
+      isConnected = true;
+      break;
+    }
+
+    if (errno == EINPROGRESS || errno == EALREADY) {
+      pfd.fd = sockfd;
+      pfd.events = POLLOUT;
+      backoff.tv_sec = 0;
+      backoff.tv_nsec = backoff_ns;
+      if (ppoll(&pfd, 1, &backoff, NULL) > 0) {
+        errLen = sizeof(err);
+        getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+        if (err == 0) {
+          isConnected = true;
+          break;
+        }
+        errno = err;
+      } else {
+        // Still in progress: keep waiting, with a longer timeout next time
+        errno = EINPROGRESS;
+      }
+    }
+
+    if (errno != ECONNREFUSED && errno != EINPROGRESS && errno != EAGAIN &&
+        errno != ENOENT && errno != ETIMEDOUT) {
+      break;
+    }
+
+    if (getMonotonicTimeNS() > deadline_ns) {
+      errno = ETIMEDOUT;
       break;
     }
+
+    if (errno != EINPROGRESS) {
+      backoff.tv_sec = 0;
+      backoff.tv_nsec = backoff_ns;
+      nanosleep(&backoff, NULL);
+    }
+
+    backoff_ns *= 2;
+    if (backoff_ns > maxBackoff_ns) {
+      backoff_ns = maxBackoff_ns;
+    }
   }
 
-  if (isFailed) {
+  if (!isConnected) {
     printf("Error %d in ", errno);
     fflush(stdout);
     perror("common.h socketConnect");
     writeErrorLog(fdlog_err, "common.h: socketConnect failed, connection timed out", errno);
     exit(-1);
   }
+
+  fcntl(sockfd, F_SETFL, flags);
 }
 
 // Wrapper for write()
@@ -601,19 +728,140 @@ void socketWrite(int fd, int message, int messageLength, int fdlog_err) {
   }
 }
 
-// Read from socket and return value
+// Read from socket and return value. A message split over two segments can
+// arrive in two pieces.
 int socketRead(int fd, int messageLength, int fdlog_err) {
   int message;
+  ssize_t ret;
+  int numRead = 0;
+
+  while (numRead < messageLength) {
+    ret = read(fd, (char*) &message + numRead, messageLength - numRead);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("common.h socketRead");
+      writeErrorLog(fdlog_err, "common.h: socketRead failed", errno);
+      exit(-1);
+    }
+    numRead += ret;
+  }
+
+  return message;
+}
+
+// Variant of socketWrite for a peer that may go away: returns false instead of
+// exiting (and without raising SIGPIPE) if the connection is broken
+bool socketTryWrite(int fd, int message, int messageLength) {
+  ssize_t ret;
+
+  do {
+    ret = send(fd, &message, messageLength, MSG_NOSIGNAL);
+  } while (ret < 0 && errno == EINTR);
+
+  return ret == messageLength;
+}
+
+// Variant of socketRead for a peer that may go away: returns false instead of
+// exiting if the connection is broken or closed before a whole message arrived
+bool socketTryRead(int fd, int* message, int messageLength) {
+  char* ptr = (char*) message;
+  ssize_t ret;
+
+  while (messageLength > 0) {
+    ret = read(fd, ptr, messageLength);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return false;
+    }
+    ptr += ret;
+    messageLength -= ret;
+  }
+
+  return true;
+}
+
+// Precedes every chunk of a striped transfer, telling the consumer where in its
+// buffer the chunk goes. A zero length marks the end of the stream.
+struct stripeHeader {
+  uint64_t offset; // bytes from the start of the payload
+  uint32_t length; // bytes of data following this header
+  uint32_t padding;
+};
+
+// Writes all length bytes of buf to the socket, however many write() calls it takes
+void socketWriteAll(int fd, void* buf, size_t length, int fdlog_err) {
+  char* ptr = buf;
+  ssize_t ret;
+
+  while (length > 0) {
+    ret = write(fd, ptr, length);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("common.h socketWriteAll");
+      writeErrorLog(fdlog_err, "common.h: socketWriteAll failed", errno);
+      exit(-1);
+    }
+    ptr += ret;
+    length -= ret;
+  }
+}
+
+// Reads exactly length bytes from the socket into buf
+void socketReadAll(int fd, void* buf, size_t length, int fdlog_err) {
+  char* ptr = buf;
+  ssize_t ret;
+
+  while (length > 0) {
+    ret = read(fd, ptr, length);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      if (ret == 0) {
+        errno = ECONNRESET;
+      }
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("common.h socketReadAll");
+      writeErrorLog(fdlog_err, "common.h: socketReadAll failed", errno);
+      exit(-1);
+    }
+    ptr += ret;
+    length -= ret;
+  }
+}
 
-  if (read(fd, &message, messageLength) < 0) {
+// Reads at least one and at most length bytes from the socket into buf, as
+// many as have arrived, and returns how many
+size_t socketReadSome(int fd, void* buf, size_t length, int fdlog_err) {
+  ssize_t ret;
+
+  do {
+    ret = read(fd, buf, length);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret <= 0) {
+    if (ret == 0) {
+      errno = ECONNRESET;
+    }
     printf("Error %d in ", errno);
     fflush(stdout);
-    perror("common.h socketRead");
-    writeErrorLog(fdlog_err, "common.h: socketRead failed", errno);
+    perror("common.h socketReadSome");
+    writeErrorLog(fdlog_err, "common.h: socketReadSome failed", errno);
     exit(-1);
   }
 
-  return message;
+  return ret;
 }
 
 // Wrapper for bind()
@@ -640,13 +888,32 @@ void socketListen (int sockfd, int backlog, int fdlog_err) {
 
 // Wrapper for accept()
 int socketAccept (int sockfd, struct sockaddr* cliAddr, socklen_t* addrlen, int fdlog_err) {
-  if (accept(sockfd, cliAddr, addrlen) < 0) {
+  int fd;
+
+  fd = accept(sockfd, cliAddr, addrlen);
+  if (fd < 0) {
     printf("Error %d in ", errno);
     fflush(stdout);
     perror("common.h socketAccept");
     writeErrorLog(fdlog_err, "common.h: socketAccept failed", errno);
     exit(-1);
   }
+
+  return fd;
+}
+
+// Puts the socket in non-blocking mode
+void socketSetNonBlocking(int fd, int fdlog_err) {
+  int flags;
+
+  flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h socketSetNonBlocking");
+    writeErrorLog(fdlog_err, "common.h: socketSetNonBlocking failed", errno);
+    exit(-1);
+  }
 }
 
 // Wrapper for setsockopt()
@@ -661,6 +928,239 @@ void socketSetOpt (int sockfd, int level, int optname,
   }
 }
 
+// Returns why the socket layout options cannot work together, NULL if they can.
+// Concurrent consumers (ORION_SOCKET_CLIENTS) and striping (ORION_SOCKET_STREAMS)
+// are separate servers: both at once would leave the extra consumers waiting.
+char* socketLayoutError() {
+  int numStreams = getEnvInt("ORION_SOCKET_STREAMS", 1);
+
+  if (numStreams > 1 && getEnvInt("ORION_SOCKET_CLIENTS", 1) > 1) {
+    return "ORION_SOCKET_CLIENTS and ORION_SOCKET_STREAMS cannot both be above 1";
+  }
+  if (numStreams > 1 && getEnvString("ORION_STRIPE_CHUNK_KIB", NULL) != NULL &&
+      getEnvInt("ORION_STRIPE_CHUNK_KIB", 0) <= 0) {
+    return "ORION_STRIPE_CHUNK_KIB must be above 0";
+  }
+  return NULL;
+}
+
+// Socket options selected through the environment (see README, "Socket tuning").
+// Zero means "leave the kernel default".
+struct socketTuning {
+  int sndBuf; // ORION_SO_SNDBUF, bytes
+  int rcvBuf; // ORION_SO_RCVBUF, bytes
+  int noDelay; // ORION_TCP_NODELAY
+  int cork; // ORION_TCP_CORK
+  int busyPoll; // ORION_SO_BUSY_POLL, microseconds
+  int zeroCopy; // ORION_MSG_ZEROCOPY
+};
+
+// Reads the socket tuning options from the environment
+struct socketTuning socketTuningFromEnv() {
+  struct socketTuning tuning;
+
+  tuning.sndBuf = getEnvInt("ORION_SO_SNDBUF", 0);
+  tuning.rcvBuf = getEnvInt("ORION_SO_RCVBUF", 0);
+  tuning.noDelay = getEnvInt("ORION_TCP_NODELAY", 0);
+  tuning.cork = getEnvInt("ORION_TCP_CORK", 0);
+  tuning.busyPoll = getEnvInt("ORION_SO_BUSY_POLL", 0);
+  tuning.zeroCopy = getEnvInt("ORION_MSG_ZEROCOPY", 0);
+
+  return tuning;
+}
+
+// Writes a one-line description of the tuning into buf (at least 128 bytes)
+void socketTuningDescribe(struct socketTuning tuning, char* buf) {
+  sprintf(buf, "sndbuf=%d rcvbuf=%d nodelay=%d cork=%d busypoll=%d zerocopy=%d",
+      tuning.sndBuf, tuning.rcvBuf, tuning.noDelay, tuning.cork, tuning.busyPoll,
+      tuning.zeroCopy);
+}
+
+// Sets one tuning option. Unlike socketSetOpt a failure is only logged, since
+// some options need privileges or kernel support the benchmark can live without.
+bool socketTryOpt(int sockfd, int level, int optname, int value, char* name, int fdlog_err) {
+  char logMessage[128];
+
+  if (setsockopt(sockfd, level, optname, &value, sizeof(value)) < 0) {
+    sprintf(logMessage, "common.h: socketApplyTuning could not set %s=%d", name, value);
+    writeErrorLog(fdlog_err, logMessage, errno);
+    return false;
+  }
+
+  return true;
+}
+
+// Sets the buffer sizes of the tuning on a socket about to listen or connect.
+// TCP picks its window scale from the receive buffer during the handshake, so
+// sizes set on a connected socket come too late; accepted sockets inherit them
+// from the listening one.
+void socketApplyBufferSizes(int sockfd, struct socketTuning tuning, int fdlog_err) {
+  if (tuning.sndBuf > 0) {
+    socketTryOpt(sockfd, SOL_SOCKET, SO_SNDBUF, tuning.sndBuf, "SO_SNDBUF", fdlog_err);
+  }
+  if (tuning.rcvBuf > 0) {
+    socketTryOpt(sockfd, SOL_SOCKET, SO_RCVBUF, tuning.rcvBuf, "SO_RCVBUF", fdlog_err);
+  }
+}
+
+// Applies the other tuning options to a connected socket, whose buffer sizes
+// were set with socketApplyBufferSizes, and logs the values the kernel actually
+// uses. Returns whether zerocopy sends are enabled.
+bool socketApplyTuning(int sockfd, struct socketTuning tuning, char* caller,
+    int fdlog_info, int fdlog_err) {
+  char logMessage[256];
+  bool isZeroCopy = false;
+  int sndBuf = 0;
+  int rcvBuf = 0;
+  socklen_t optLen;
+
+  if (tuning.noDelay) {
+    socketTryOpt(sockfd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY", fdlog_err);
+  }
+  if (tuning.cork) {
+    socketTryOpt(sockfd, IPPROTO_TCP, TCP_CORK, 1, "TCP_CORK", fdlog_err);
+  }
+  if (tuning.busyPoll > 0) {
+    socketTryOpt(sockfd, SOL_SOCKET, SO_BUSY_POLL, tuning.busyPoll, "SO_BUSY_POLL", fdlog_err);
+  }
+  if (tuning.zeroCopy) {
+    isZeroCopy = socketTryOpt(sockfd, SOL_SOCKET, SO_ZEROCOPY, 1, "SO_ZEROCOPY", fdlog_err);
+  }
+
+  // The kernel doubles (and clamps) buffer sizes, so report what it settled on
+  optLen = sizeof(sndBuf);
+  getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sndBuf, &optLen);
+  optLen = sizeof(rcvBuf);
+  getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, &optLen);
+
+  sprintf(logMessage, "[%s] Socket tuning: sndbuf=%d rcvbuf=%d nodelay=%d cork=%d busypoll=%d zerocopy=%d",
+      caller, sndBuf, rcvBuf, tuning.noDelay, tuning.cork, tuning.busyPoll, isZeroCopy);
+  writeInfoLog(fdlog_info, logMessage);
+
+  return isZeroCopy;
+}
+
+// With TCP_CORK set, pushes out the partial frame still held back by the kernel
+void socketFlushCork(int sockfd, int fdlog_err) {
+  socketTryOpt(sockfd, IPPROTO_TCP, TCP_CORK, 0, "TCP_CORK", fdlog_err);
+  socketTryOpt(sockfd, IPPROTO_TCP, TCP_CORK, 1, "TCP_CORK", fdlog_err);
+}
+
+// Bookkeeping for MSG_ZEROCOPY sends on one socket. Every successful zerocopy
+// send gets a sequence number; the kernel reports completed ranges on the
+// socket error queue, after which the buffer may be reused.
+struct zeroCopyState {
+  uint32_t numSent;
+  uint32_t numCompleted;
+  unsigned long numCopied; // completions where the kernel fell back to copying
+};
+
+// Reaps zerocopy completion notifications from the error queue. If isWaiting,
+// blocks until every send so far has completed.
+void socketReapZeroCopy(int sockfd, struct zeroCopyState* state, bool isWaiting, int fdlog_err) {
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct sock_extended_err* serr;
+  struct pollfd pfd;
+  char control[128];
+  ssize_t ret;
+
+  while (state->numCompleted < state->numSent) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ret = recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!isWaiting) {
+        return;
+      }
+      // The error queue signals readiness as POLLERR
+      pfd.fd = sockfd;
+      pfd.events = 0;
+      poll(&pfd, 1, 100);
+      continue;
+    }
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("common.h socketReapZeroCopy recvmsg");
+      writeErrorLog(fdlog_err, "common.h: socketReapZeroCopy recvmsg failed", errno);
+      exit(-1);
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      serr = (struct sock_extended_err*) CMSG_DATA(cmsg);
+      if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      // Completed sends ee_info..ee_data (inclusive)
+      state->numCompleted += serr->ee_data - serr->ee_info + 1;
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        state->numCopied += serr->ee_data - serr->ee_info + 1;
+      }
+    }
+  }
+}
+
+// Sends up to length bytes with MSG_ZEROCOPY. Returns the bytes sent, or -1 with
+// errno set like send() (e.g. EAGAIN on a non-blocking socket).
+ssize_t socketSendZeroCopy(int sockfd, void* buf, size_t length,
+    struct zeroCopyState* state, int fdlog_err) {
+  ssize_t ret;
+
+  while (true) {
+    ret = send(sockfd, buf, length, MSG_ZEROCOPY);
+    if (ret >= 0) {
+      state->numSent++;
+      return ret;
+    }
+    if (errno == ENOBUFS && state->numCompleted < state->numSent) {
+      // Too many pinned pages in flight: wait for some completions first
+      socketReapZeroCopy(sockfd, state, true, fdlog_err);
+      continue;
+    }
+    if (errno != EINTR) {
+      return ret;
+    }
+  }
+}
+
+// Writes all length bytes with MSG_ZEROCOPY on a blocking socket
+void socketWriteAllZeroCopy(int sockfd, void* buf, size_t length,
+    struct zeroCopyState* state, int fdlog_err) {
+  char* ptr = buf;
+  ssize_t ret;
+
+  while (length > 0) {
+    ret = socketSendZeroCopy(sockfd, ptr, length, state, fdlog_err);
+    if (ret < 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("common.h socketWriteAllZeroCopy");
+      writeErrorLog(fdlog_err, "common.h: socketWriteAllZeroCopy failed", errno);
+      exit(-1);
+    }
+    ptr += ret;
+    length -= ret;
+
+    // Keep the error queue short
+    socketReapZeroCopy(sockfd, state, false, fdlog_err);
+  }
+}
+
+// Logs how many zerocopy sends were made and how many fell back to copying
+void socketLogZeroCopy(struct zeroCopyState* state, char* caller, int fdlog_info) {
+  char logMessage[256];
+
+  sprintf(logMessage, "[%s] MSG_ZEROCOPY: %u sends, %u completed, %lu copied by the kernel",
+      caller, state->numSent, state->numCompleted, state->numCopied);
+  writeInfoLog(fdlog_info, logMessage);
+}
+
 // Closes the socket
 void socketClose(int fd, int fdlog_err) {
   if (close(fd) == -1) {
@@ -671,3 +1171,228 @@ void socketClose(int fd, int fdlog_err) {
     exit(-1);
   }
 }
+
+/////////////////
+//// THREADS ////
+/////////////////
+
+// Wrapper for pthread_create()
+void threadCreate(pthread_t* thread, void* (*function)(void*), void* arg, int fdlog_err) {
+  int ret;
+
+  ret = pthread_create(thread, NULL, function, arg);
+  if (ret != 0) {
+    errno = ret;
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h threadCreate");
+    writeErrorLog(fdlog_err, "common.h: threadCreate failed", errno);
+    exit(-1);
+  }
+}
+
+// Wrapper for pthread_join()
+void threadJoin(pthread_t thread, int fdlog_err) {
+  int ret;
+
+  ret = pthread_join(thread, NULL);
+  if (ret != 0) {
+    errno = ret;
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h threadJoin");
+    writeErrorLog(fdlog_err, "common.h: threadJoin failed", errno);
+    exit(-1);
+  }
+}
+
+///////////////
+//// EPOLL ////
+///////////////
+
+// Wrapper for epoll_create1()
+int epollCreate(int fdlog_err) {
+  int fd;
+
+  fd = epoll_create1(0);
+  if (fd < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h epollCreate");
+    writeErrorLog(fdlog_err, "common.h: epollCreate failed", errno);
+    exit(-1);
+  }
+
+  return fd;
+}
+
+// Adds fd to the epoll set, watching the given events. data is returned with
+// every event for this fd.
+void epollAdd(int epfd, int fd, uint32_t events, void* data, int fdlog_err) {
+  struct epoll_event event;
+
+  event.events = events;
+  event.data.ptr = data;
+
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h epollAdd");
+    writeErrorLog(fdlog_err, "common.h: epollAdd failed", errno);
+    exit(-1);
+  }
+}
+
+// Removes fd from the epoll set
+void epollRemove(int epfd, int fd, int fdlog_err) {
+  if (epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h epollRemove");
+    writeErrorLog(fdlog_err, "common.h: epollRemove failed", errno);
+    exit(-1);
+  }
+}
+
+// Wrapper for epoll_wait(), restarting if interrupted by a signal
+int epollWait(int epfd, struct epoll_event* events, int maxEvents, int timeout, int fdlog_err) {
+  int numEvents;
+
+  do {
+    numEvents = epoll_wait(epfd, events, maxEvents, timeout);
+  } while (numEvents < 0 && errno == EINTR);
+
+  if (numEvents < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h epollWait");
+    writeErrorLog(fdlog_err, "common.h: epollWait failed", errno);
+    exit(-1);
+  }
+
+  return numEvents;
+}
+
+////////////////////////
+//// MESSAGE QUEUES ////
+////////////////////////
+
+// Data records carry packed integers at priority 0. Control records jump the
+// queue at a higher priority and tell the consumer how far the producer is.
+struct mqControlRecord {
+  uint64_t sequence;
+  uint64_t sent_ns; // CLOCK_MONOTONIC when the record was sent
+  uint64_t bytesSent; // data bytes queued before this record
+};
+
+// Reads a message queue limit from /proc/sys/fs/mqueue, defaultValue if unknown
+long mqSystemLimit(char* name, long defaultValue) {
+  char path[64];
+  FILE* file;
+  long value;
+
+  sprintf(path, "/proc/sys/fs/mqueue/%s", name);
+  file = fopen(path, "r");
+  if (file == NULL) {
+    return defaultValue;
+  }
+  if (fscanf(file, "%ld", &value) != 1) {
+    value = defaultValue;
+  }
+  fclose(file);
+
+  return value;
+}
+
+// Opens (creating it if needed) a message queue holding up to maxMessages
+// messages of messageSize bytes. Both are capped to the system limits.
+mqd_t mqOpen(char* name, int flags, long maxMessages, long messageSize, int fdlog_err) {
+  struct mq_attr attr;
+  mqd_t mqd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.mq_maxmsg = maxMessages < mqSystemLimit("msg_max", 10) ? maxMessages : mqSystemLimit("msg_max", 10);
+  attr.mq_msgsize = messageSize < mqSystemLimit("msgsize_max", 8192) ? messageSize : mqSystemLimit("msgsize_max", 8192);
+
+  mqd = mq_open(name, flags | O_CREAT, 0666, &attr);
+  if (mqd == (mqd_t) -1) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h mqOpen");
+    writeErrorLog(fdlog_err, "common.h: mqOpen failed", errno);
+    exit(-1);
+  }
+
+  return mqd;
+}
+
+// Wrapper for mq_getattr()
+struct mq_attr mqGetAttr(mqd_t mqd, int fdlog_err) {
+  struct mq_attr attr;
+
+  if (mq_getattr(mqd, &attr) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h mqGetAttr");
+    writeErrorLog(fdlog_err, "common.h: mqGetAttr failed", errno);
+    exit(-1);
+  }
+
+  return attr;
+}
+
+// Wrapper for mq_send(), restarting if interrupted by a signal
+void mqSend(mqd_t mqd, char* buf, size_t length, unsigned int priority, int fdlog_err) {
+  int ret;
+
+  do {
+    ret = mq_send(mqd, buf, length, priority);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h mqSend");
+    writeErrorLog(fdlog_err, "common.h: mqSend failed", errno);
+    exit(-1);
+  }
+}
+
+// Wrapper for mq_receive(), restarting if interrupted by a signal. buf must
+// hold the queue's message size. Returns the length of the message.
+size_t mqReceive(mqd_t mqd, char* buf, size_t length, unsigned int* priority, int fdlog_err) {
+  ssize_t numRead;
+
+  do {
+    numRead = mq_receive(mqd, buf, length, priority);
+  } while (numRead < 0 && errno == EINTR);
+
+  if (numRead < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h mqReceive");
+    writeErrorLog(fdlog_err, "common.h: mqReceive failed", errno);
+    exit(-1);
+  }
+
+  return numRead;
+}
+
+// Closes a message queue, unlinking it too if isUnlinking
+void mqClose(mqd_t mqd, char* name, bool isUnlinking, int fdlog_err) {
+  if (mq_close(mqd) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h mqClose mq_close");
+    writeErrorLog(fdlog_err, "common.h: mqClose mq_close failed", errno);
+    exit(-1);
+  }
+
+  if (isUnlinking && mq_unlink(name) < 0 && errno != ENOENT) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("common.h mqClose mq_unlink");
+    writeErrorLog(fdlog_err, "common.h: mqClose mq_unlink failed", errno);
+    exit(-1);
+  }
+}
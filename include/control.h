@@ -0,0 +1,422 @@
+// Per-session control block in shared memory.
+// Must be included after common.h (uses its logging and shared memory helpers),
+// perf.h, trace.h and result.h.
+//
+// Producer and consumer(s) coordinate through one binary block instead of a
+// timer segment written as text plus a pair of named semaphores. The block holds
+// the session state machine, nanosecond timestamps, byte counts, checksums and
+// per-phase durations. Fields are updated with atomics, and waiting is done with
+// futexes on the state and consumer counter words, so the happy path needs no
+// extra syscalls at all.
+//
+// With ORION_RESUME=1, the consumer also checkpoints how much of the payload it
+// has received and checked, every time it lets the producer drop data (socket
+// block acknowledged, ring space released). A consumer started after one that
+// died picks up from the checkpoint instead of from the start: the block
+// outlives the consumer, and the checkpoint is written to one of two slots
+// before the slot index is switched, so a consumer killed half-way through
+// leaves the previous one intact.
+
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/syscall.h>
+
+enum controlState {
+  CONTROL_IDLE = 0, // freshly created, nobody has initialised it yet
+  CONTROL_READY, // producer initialised the session
+  CONTROL_RUNNING, // transfer in progress, timeStart_ns is valid
+  CONTROL_DONE, // producer finished sending, its totals are valid
+  CONTROL_FAILED // a process exited with an error, peers should give up
+};
+
+enum controlPhase {
+  PHASE_GENERATE = 0,
+  PHASE_SETUP,
+  PHASE_TRANSFER,
+  PHASE_TEARDOWN,
+  NUM_PHASES
+};
+
+const char* PHASE_NAMES[] = {"generate", "setup", "transfer", "teardown"};
+
+// What a consumer has received and checked: the first numMessages messages of
+// the payload, with checksumMessages over them
+struct controlCheckpoint {
+  uint64_t numMessages;
+  uint64_t checksum;
+};
+
+struct controlBlock {
+  uint32_t state; // enum controlState, also a futex word
+  uint32_t numConsumersDone; // futex word the producer waits on
+  uint32_t numConsumers; // consumers the producer expects
+  uint32_t numChecksumMismatches;
+  uint64_t timeStart_ns; // transfer start (producer, CLOCK_MONOTONIC)
+  uint64_t timeProducerEnd_ns;
+  uint64_t timeConsumerEnd_ns; // latest consumer end
+  uint64_t bytesSent; // per consumer
+  uint64_t bytesReceived; // summed over consumers
+  uint64_t checksumSent;
+  uint64_t checksumReceived; // of the last consumer to finish
+  uint64_t consumerSetup_ns; // link setup time, sockets only
+  uint64_t producerPhase_ns[NUM_PHASES];
+  uint64_t consumerPhase_ns[NUM_PHASES];
+  uint32_t producerPid; // to tell a live session from one left behind
+  uint32_t numJoined; // consumers that checkpoint, including replacements
+  uint32_t numResumes; // consumers that took over from one that died
+  uint32_t checkpointSlot; // current entry of checkpoints
+  struct controlCheckpoint checkpoints[2];
+  struct adaptSummary adapted; // sizes the producer settled on (ORION_ADAPT)
+};
+
+// Control block of this process, and whether it completed its part of the
+// session (otherwise exiting marks the session as failed)
+struct controlBlock* control = NULL;
+bool isControlComplete = false;
+// Checkpoint this consumer started from (zero unless it took over from one
+// that died), and the last one it recorded
+struct controlCheckpoint resumedFrom;
+struct controlCheckpoint checkpointed;
+bool isCheckpointing = false;
+// Start of the current phase of this process
+uint64_t phaseStart_ns[NUM_PHASES];
+// Performance counters at the start of each phase, and collected over each phase
+struct perfSample phasePerfStart[NUM_PHASES];
+struct perfSample phasePerf[NUM_PHASES];
+
+// Name of the control block: /orion_control, or /orion_control_<ORION_SESSION>
+// so that several sessions can run side by side
+void controlName(char* buf) {
+  char* session = getEnvString("ORION_SESSION", NULL);
+
+  if (session == NULL) {
+    sprintf(buf, "/orion_control");
+  } else {
+    sprintf(buf, "/orion_control_%s", session);
+  }
+}
+
+// Wakes every process waiting on a futex word
+void controlWake(uint32_t* word) {
+  syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+// Sets the session state and wakes anyone waiting for it
+void controlSetState(struct controlBlock* ctl, enum controlState state) {
+  __atomic_store_n(&ctl->state, state, __ATOMIC_RELEASE);
+  controlWake(&ctl->state);
+}
+
+// Blocks until the session state is at least minState, returning the state
+enum controlState controlWaitState(struct controlBlock* ctl, enum controlState minState) {
+  uint32_t state;
+
+  while ((state = __atomic_load_n(&ctl->state, __ATOMIC_ACQUIRE)) < (uint32_t) minState) {
+    // Sleeps only if the state is still what we just read
+    syscall(SYS_futex, &ctl->state, FUTEX_WAIT, state, NULL, NULL, 0);
+  }
+
+  return state;
+}
+
+// Marks the session as failed if this process exits before completing its part,
+// so that peers blocked on the control block do not hang
+void controlAtExit() {
+  if (control != NULL && !isControlComplete) {
+    controlSetState(control, CONTROL_FAILED);
+    controlWake(&control->numConsumersDone);
+  }
+}
+
+// Maps the control block of the current session, creating it if needed
+struct controlBlock* controlOpen(int fdlog_err) {
+  char name[64];
+
+  controlName(name);
+  control = shmInit(name, NULL, sizeof(struct controlBlock), PROT_READ | PROT_WRITE,
+      MAP_SHARED, 0, fdlog_err);
+  atexit(controlAtExit);
+
+  return control;
+}
+
+// Producer side: clears whatever a previous session left behind and marks the
+// session ready for numConsumers consumers
+void controlReset(struct controlBlock* ctl, int numConsumers) {
+  memset((char*) ctl + sizeof(ctl->state), 0, sizeof(*ctl) - sizeof(ctl->state));
+  ctl->numConsumers = numConsumers;
+  ctl->producerPid = getpid();
+  controlSetState(ctl, CONTROL_READY);
+}
+
+// Marks the start of a phase of this process
+void controlPhaseBegin(enum controlPhase phase) {
+  perfRead(&phasePerfStart[phase]);
+  phaseStart_ns[phase] = getMonotonicTimeNS();
+}
+
+// Marks the end of a phase of this process and records its duration
+void controlPhaseEnd(struct controlBlock* ctl, bool isProducer, enum controlPhase phase) {
+  uint64_t phaseEnd_ns = getMonotonicTimeNS();
+  uint64_t duration_ns = phaseEnd_ns - phaseStart_ns[phase];
+  struct perfSample phaseEnd;
+
+  traceSpan(PHASE_NAMES[phase], "phase", phaseStart_ns[phase], phaseEnd_ns, -1);
+  perfRead(&phaseEnd);
+  perfAccumulate(&phasePerf[phase], &phasePerfStart[phase], &phaseEnd);
+
+  if (isProducer) {
+    __atomic_store_n(&ctl->producerPhase_ns[phase], duration_ns, __ATOMIC_RELAXED);
+  } else {
+    __atomic_store_n(&ctl->consumerPhase_ns[phase], duration_ns, __ATOMIC_RELAXED);
+  }
+}
+
+// Producer side: records the transfer start time and marks the session running
+void controlTransferStart(struct controlBlock* ctl) {
+  __atomic_store_n(&ctl->timeStart_ns, getMonotonicTimeNS(), __ATOMIC_RELAXED);
+  controlSetState(ctl, CONTROL_RUNNING);
+}
+
+// checksumMessages of messages from..to held elsewhere, values[0] being
+// message from (a received datagram, say)
+uint64_t checksumMessagesAt(int values[], size_t from, size_t to) {
+  uint64_t sum = 0;
+
+  for (size_t i = from; i < to; i++) {
+    sum += (uint64_t) (uint32_t) values[i - from] * (i + 1);
+  }
+
+  return sum;
+}
+
+// Position-dependent checksum of messages[from..to), so that both lost and
+// reordered data are detected. Ranges can be summed independently.
+uint64_t checksumMessages(int messages[], size_t from, size_t to) {
+  return checksumMessagesAt(&messages[from], from, to);
+}
+
+// Whether a consumer that dies can be replaced without starting the transfer
+// over (ORION_RESUME=1, sockets and shared memory)
+bool controlIsResumable() {
+  return getEnvInt("ORION_RESUME", 0) != 0;
+}
+
+// Last checkpoint recorded by a consumer of the session
+struct controlCheckpoint controlLastCheckpoint(struct controlBlock* ctl) {
+  uint32_t slot = __atomic_load_n(&ctl->checkpointSlot, __ATOMIC_ACQUIRE);
+
+  return ctl->checkpoints[slot & 1];
+}
+
+// Consumer side: records that messages[0..to) were received, checksumming
+// what arrived since the previous checkpoint. Does nothing unless resumable.
+void controlCheckpoint(struct controlBlock* ctl, int messages[], size_t to) {
+  uint32_t slot;
+
+  if (!isCheckpointing || to <= checkpointed.numMessages) {
+    return;
+  }
+
+  checkpointed.checksum += checksumMessages(messages, checkpointed.numMessages, to);
+  checkpointed.numMessages = to;
+
+  // The slot not in use is written first, so that dying here loses nothing
+  slot = (ctl->checkpointSlot + 1) & 1;
+  ctl->checkpoints[slot] = checkpointed;
+  __atomic_store_n(&ctl->checkpointSlot, slot, __ATOMIC_RELEASE);
+}
+
+// Consumer side: starts checkpointing if resumable, from the last checkpoint
+// if every expected consumer already joined, i.e. this one replaces one that
+// died. Returns whether it does.
+bool controlResume(struct controlBlock* ctl, int fdlog_info) {
+  char logMessage[128];
+
+  memset(&resumedFrom, 0, sizeof(resumedFrom));
+  checkpointed = resumedFrom;
+  isCheckpointing = controlIsResumable();
+  if (!isCheckpointing || __atomic_fetch_add(&ctl->numJoined, 1, __ATOMIC_RELAXED) < ctl->numConsumers) {
+    return false;
+  }
+
+  resumedFrom = controlLastCheckpoint(ctl);
+  checkpointed = resumedFrom;
+  __atomic_fetch_add(&ctl->numResumes, 1, __ATOMIC_RELAXED);
+  sprintf(logMessage, "[Consumer] Taking over the transfer, resuming from message %lu",
+      (unsigned long) resumedFrom.numMessages);
+  writeInfoLog(fdlog_info, logMessage);
+
+  return true;
+}
+
+// Consumer side: starts over from the first message, when the producer could
+// not match the checkpoint with what it sent
+void controlResumeReset(int fdlog_info) {
+  memset(&resumedFrom, 0, sizeof(resumedFrom));
+  checkpointed = resumedFrom;
+  writeInfoLog(fdlog_info, "[Consumer] Checkpoint rejected by the producer, starting over");
+}
+
+// Producer side: publishes what was sent and marks the session done
+void controlProducerDone(struct controlBlock* ctl, uint64_t bytesSent, uint64_t checksum) {
+  __atomic_store_n(&ctl->bytesSent, bytesSent, __ATOMIC_RELAXED);
+  __atomic_store_n(&ctl->checksumSent, checksum, __ATOMIC_RELAXED);
+  __atomic_store_n(&ctl->timeProducerEnd_ns, getMonotonicTimeNS(), __ATOMIC_RELAXED);
+  controlSetState(ctl, CONTROL_DONE);
+}
+
+// Producer side: waits until every consumer has read the results
+void controlWaitConsumers(struct controlBlock* ctl, int fdlog_err) {
+  uint32_t numDone;
+
+  while ((numDone = __atomic_load_n(&ctl->numConsumersDone, __ATOMIC_ACQUIRE)) < ctl->numConsumers) {
+    if (__atomic_load_n(&ctl->state, __ATOMIC_ACQUIRE) == CONTROL_FAILED) {
+      printf("Error in control.h controlWaitConsumers: a consumer failed\n");
+      fflush(stdout);
+      writeErrorLog(fdlog_err, "control.h: consumer failed, session aborted", 0);
+      exit(-1);
+    }
+    syscall(SYS_futex, &ctl->numConsumersDone, FUTEX_WAIT, numDone, NULL, NULL, 0);
+  }
+
+  isControlComplete = true;
+}
+
+// Consumer side: waits for the producer to finish
+void controlWaitProducer(struct controlBlock* ctl, int fdlog_info, int fdlog_err) {
+  writeInfoLog(fdlog_info, "[Consumer] Waiting for the producer to finish");
+  if (controlWaitState(ctl, CONTROL_DONE) == CONTROL_FAILED) {
+    printf("Error in control.h controlConsumerDone: the producer failed\n");
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "control.h: producer failed, session aborted", 0);
+    exit(-1);
+  }
+}
+
+// Consumer side, once the producer is done: records what was received and
+// lets the producer clean up. Returns the transfer time in seconds.
+double controlConsumerRelease(struct controlBlock* ctl, uint64_t timeEnd_ns, uint64_t bytesReceived,
+    uint64_t checksum) {
+  uint64_t latestEnd_ns;
+  double timeToTransfer_s;
+
+  // Keep the latest end time across consumers
+  latestEnd_ns = __atomic_load_n(&ctl->timeConsumerEnd_ns, __ATOMIC_RELAXED);
+  while (timeEnd_ns > latestEnd_ns &&
+      !__atomic_compare_exchange_n(&ctl->timeConsumerEnd_ns, &latestEnd_ns, timeEnd_ns,
+          false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+  __atomic_fetch_add(&ctl->bytesReceived, bytesReceived, __ATOMIC_RELAXED);
+  __atomic_store_n(&ctl->checksumReceived, checksum, __ATOMIC_RELAXED);
+
+  timeToTransfer_s = (timeEnd_ns - ctl->timeStart_ns) / 1.0e9;
+
+  // Let the producer know I'm done reading
+  __atomic_fetch_add(&ctl->numConsumersDone, 1, __ATOMIC_RELEASE);
+  controlWake(&ctl->numConsumersDone);
+  isControlComplete = true;
+
+  return timeToTransfer_s;
+}
+
+// Consumer side: waits for the producer to finish, checks what was received
+// against what was sent and returns the transfer time in seconds
+double controlConsumerDone(struct controlBlock* ctl, uint64_t timeEnd_ns, uint64_t bytesReceived,
+    uint64_t checksum, int fdlog_info, int fdlog_err) {
+  char logMessage[256];
+
+  controlWaitProducer(ctl, fdlog_info, fdlog_err);
+
+  if (bytesReceived != ctl->bytesSent || checksum != ctl->checksumSent) {
+    sprintf(logMessage, "control.h: data mismatch, received %lu of %lu bytes (checksum %016lx, expected %016lx)",
+        (unsigned long) bytesReceived, (unsigned long) ctl->bytesSent,
+        (unsigned long) checksum, (unsigned long) ctl->checksumSent);
+    writeErrorLog(fdlog_err, logMessage, 0);
+    __atomic_fetch_add(&ctl->numChecksumMismatches, 1, __ATOMIC_RELAXED);
+  } else {
+    writeInfoLog(fdlog_info, "[Consumer] Checksum verified");
+  }
+
+  return controlConsumerRelease(ctl, timeEnd_ns, bytesReceived, checksum);
+}
+
+// Logs the phase durations recorded by this process
+void controlLogPhases(struct controlBlock* ctl, bool isProducer, int fdlog_info) {
+  char logMessage[256];
+  uint64_t* phases = isProducer ? ctl->producerPhase_ns : ctl->consumerPhase_ns;
+  int length;
+
+  length = sprintf(logMessage, "[%s] Phases:", isProducer ? "Producer" : "Consumer");
+  for (int i = 0; i < NUM_PHASES; i++) {
+    length += sprintf(logMessage + length, " %s %.3f ms", PHASE_NAMES[i], phases[i] / 1.0e6);
+  }
+  writeInfoLog(fdlog_info, logMessage);
+
+  if (isPerfEnabled) {
+    for (int i = 0; i < NUM_PHASES; i++) {
+      perfLogPhase(isProducer ? "Producer" : "Consumer", PHASE_NAMES[i], &phasePerf[i], fdlog_info);
+    }
+  }
+}
+
+// Producer side: removes the control block once the session is over
+void controlClose(struct controlBlock* ctl, int fdlog_err) {
+  char name[64];
+
+  controlName(name);
+  shmUnlinkUnmap(name, (void**) &ctl, sizeof(struct controlBlock), fdlog_err);
+  control = NULL;
+}
+
+// Named objects of the transports (see producer.c), which a session that died
+// leaves behind
+const char* STALE_SEMAPHORES[] = {"/arp2_sem_listening", "/orion_sem_dgram"};
+const char* STALE_SHARED_MEMORY[] = {"/shm_arpassign2"};
+const char* STALE_QUEUES[] = {"/orion_mq"};
+
+// Removes what a session that died left behind: its control block, and the
+// transports' semaphore, ring and message queue, which the next session would
+// otherwise find posted, marked ready or holding records. Does nothing while
+// the session's producer is alive. Returns the number of objects removed.
+int controlCleanStale(int fdlog_info) {
+  char name[64];
+  char logMessage[128];
+  struct controlBlock previous;
+  int fd;
+  int numRemoved = 0;
+
+  controlName(name);
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd >= 0) {
+    memset(&previous, 0, sizeof(previous));
+    if (pread(fd, &previous, sizeof(previous), 0) < 0) {
+      perror("control.h controlCleanStale pread");
+    }
+    close(fd);
+    if (previous.producerPid != 0 && (kill(previous.producerPid, 0) == 0 || errno == EPERM)) {
+      sprintf(logMessage, "[Master] Session of producer %u still running, leaving its objects alone",
+          previous.producerPid);
+      writeInfoLog(fdlog_info, logMessage);
+      return 0;
+    }
+    numRemoved += shm_unlink(name) == 0 ? 1 : 0;
+  }
+
+  for (size_t i = 0; i < sizeof(STALE_SEMAPHORES) / sizeof(STALE_SEMAPHORES[0]); i++) {
+    numRemoved += sem_unlink(STALE_SEMAPHORES[i]) == 0 ? 1 : 0;
+  }
+  for (size_t i = 0; i < sizeof(STALE_SHARED_MEMORY) / sizeof(STALE_SHARED_MEMORY[0]); i++) {
+    numRemoved += shm_unlink(STALE_SHARED_MEMORY[i]) == 0 ? 1 : 0;
+  }
+  for (size_t i = 0; i < sizeof(STALE_QUEUES) / sizeof(STALE_QUEUES[0]); i++) {
+    numRemoved += mq_unlink(STALE_QUEUES[i]) == 0 ? 1 : 0;
+  }
+
+  if (numRemoved > 0) {
+    sprintf(logMessage, "[Master] Removed %d IPC objects left behind by a previous session", numRemoved);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+
+  return numRemoved;
+}
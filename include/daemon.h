@@ -0,0 +1,108 @@
+// Job channel between the master and warm workers (ORION_DAEMON=1).
+// Must be included after common.h (uses its logging helpers) and result.h.
+//
+// Without it, every transmission starts a new producer and consumer, which
+// create the control block, semaphores, shared memory and sockets and allocate
+// and generate the payload again. With it, the master starts one producer and
+// one consumer, which set up their link once and keep it, with their buffers,
+// for as many jobs as the master sends them. The master hands each of them one
+// end of a SOCK_SEQPACKET socket pair, named in ORION_DAEMON_FD, and talks to
+// them with fixed-size messages: a job for the producer, which resets the
+// control block and answers that it is ready, then the same job for the
+// consumer, and a result from each when the transfer is over.
+
+enum daemonCommand {
+  DAEMON_JOB = 0, // master: transfer the first sizeDataMiB of the payload
+  DAEMON_READY, // producer: the session of the job is initialised
+  DAEMON_DONE, // worker: the job is over, result is valid
+  DAEMON_STOP // master: tear the link down and exit
+};
+
+struct daemonMessage {
+  int32_t command; // enum daemonCommand
+  int32_t sizeDataMiB;
+  struct transferResult result;
+};
+
+// Warm workers of the master, for one protocol, port and maximum size
+struct daemonWorkers {
+  bool isRunning;
+  int protocol; // as numbered in the menu
+  int sizeDataMiB; // largest job the workers hold the payload for
+  char portno_str[8];
+  pid_t producerPid;
+  pid_t consumerPid;
+  int producerFd;
+  int consumerFd;
+};
+
+// Worker end of the job channel, -1 when the worker runs a single transfer
+int daemonChannel() {
+  return getEnvInt("ORION_DAEMON_FD", -1);
+}
+
+// Sends one message. Returns false if the peer has gone away.
+bool daemonSend(int fd, enum daemonCommand command, int sizeDataMiB, struct transferResult* result) {
+  struct daemonMessage message;
+  ssize_t ret;
+
+  memset(&message, 0, sizeof(message));
+  message.command = command;
+  message.sizeDataMiB = sizeDataMiB;
+  if (result != NULL) {
+    message.result = *result;
+  }
+
+  do {
+    ret = send(fd, &message, sizeof(message), MSG_NOSIGNAL);
+  } while (ret < 0 && errno == EINTR);
+
+  return ret == sizeof(message);
+}
+
+// Waits for the next message. Returns false if the peer has gone away.
+bool daemonReceive(int fd, struct daemonMessage* message) {
+  ssize_t ret;
+
+  do {
+    ret = recv(fd, message, sizeof(*message), 0);
+  } while (ret < 0 && errno == EINTR);
+
+  return ret == sizeof(*message);
+}
+
+// Master side: creates the job channel of the next worker. fds[0] is kept by
+// the master, fds[1] is inherited by the worker and named in ORION_DAEMON_FD.
+void daemonChannelOpen(int fds[2]) {
+  char fd_str[16];
+
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0 || fcntl(fds[1], F_SETFD, 0) < 0) {
+    perror("ERROR in daemonChannelOpen socketpair");
+    exit(-1);
+  }
+
+  sprintf(fd_str, "%d", fds[1]);
+  setenv("ORION_DAEMON_FD", fd_str, 1);
+}
+
+// Master side: the worker holds its end now, the master must not
+void daemonChannelHandOver(int fds[2]) {
+  close(fds[1]);
+  unsetenv("ORION_DAEMON_FD");
+}
+
+// Master side: tells the workers to exit and waits for them. Workers that
+// already died are only reaped.
+void daemonStop(struct daemonWorkers* workers) {
+  if (!workers->isRunning) {
+    return;
+  }
+
+  daemonSend(workers->producerFd, DAEMON_STOP, 0, NULL);
+  daemonSend(workers->consumerFd, DAEMON_STOP, 0, NULL);
+  close(workers->producerFd);
+  close(workers->consumerFd);
+  waitpid(workers->producerPid, NULL, 0);
+  waitpid(workers->consumerPid, NULL, 0);
+  workers->isRunning = false;
+}
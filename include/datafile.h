@@ -0,0 +1,436 @@
+// Recorded telemetry as the payload (ORION_SOURCE_FILE) and received data
+// written out as it arrives (ORION_SINK_FILE).
+// Must be included after common.h, stats.h, trace.h and pace.h, and before
+// ring.h, which hands over what it reads.
+//
+// The source is mapped read-only instead of generated, with sequential access
+// advised and readahead started, so that a capture at least as large as the
+// transfer is replayed at the speed of the disk or page cache, through any
+// transport. Pipes and the classic socket server can also skip the mapping
+// altogether and move the file to the channel in the kernel, with splice()
+// and sendfile().
+//
+// The sink never slows the receive thread down: every ORION_SINK_BLOCK_KIB of
+// the payload that has arrived is handed to a writer thread, woken only if it
+// is asleep, which writes it with large aligned writes (write), through
+// O_DIRECT from an aligned bounce buffer (direct), or copies it into a mapping
+// of the output flushed with msync() every ORION_SINK_SYNC_MIB (mmap). Ranges
+// are counted in bytes and start on block boundaries, which O_DIRECT needs.
+
+#include <linux/futex.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+const int SINK_DEFAULT_BLOCK_KIB = 1024;
+const int SINK_DEFAULT_SYNC_MIB = 16;
+const size_t SINK_ALIGNMENT = 4096; // O_DIRECT buffers, offsets and lengths
+
+//////////////////////
+////    SOURCE    ////
+//////////////////////
+
+int sourceFd = -1;
+size_t sourceLength;
+int* sourceMap;
+
+// Maps the first length bytes of ORION_SOURCE_FILE to replay them. Returns
+// NULL if unset, exits if the file is too short.
+int* sourceOpen(size_t length, int fdlog_info, int fdlog_err) {
+  char logMessage[512];
+  char* path = getEnvString("ORION_SOURCE_FILE", NULL);
+  struct stat fileStat;
+  uint64_t start_ns;
+
+  if (path == NULL || path[0] == '\0') {
+    return NULL;
+  }
+
+  sourceFd = open(path, O_RDONLY);
+  if (sourceFd < 0 || fstat(sourceFd, &fileStat) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("datafile.h sourceOpen open");
+    writeErrorLog(fdlog_err, "datafile.h: sourceOpen open failed", errno);
+    exit(-1);
+  }
+  if ((size_t) fileStat.st_size < length) {
+    fprintf(stderr, "ERROR: %s holds %lld bytes, the transfer needs %zu\n", path,
+        (long long) fileStat.st_size, length);
+    writeErrorLog(fdlog_err, "[Producer] ORION_SOURCE_FILE is shorter than the transfer", 0);
+    exit(-1);
+  }
+
+  sourceLength = length;
+  sourceMap = mmap(NULL, length > 0 ? length : 1, PROT_READ, MAP_SHARED, sourceFd, 0);
+  if (sourceMap == MAP_FAILED) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("datafile.h sourceOpen mmap");
+    writeErrorLog(fdlog_err, "datafile.h: sourceOpen mmap failed", errno);
+    exit(-1);
+  }
+
+  // Advice only: replaying works without it, just not at disk speed
+  start_ns = getMonotonicTimeNS();
+  madvise(sourceMap, length, MADV_SEQUENTIAL);
+  posix_fadvise(sourceFd, 0, length, POSIX_FADV_SEQUENTIAL);
+  readahead(sourceFd, 0, length);
+
+  snprintf(logMessage, sizeof(logMessage), "[Producer] Replaying %.1f MiB of %s (readahead started in %.3f ms)",
+      length / (1024.0 * 1024.0), path, (getMonotonicTimeNS() - start_ns) / 1.0e6);
+  writeInfoLog(fdlog_info, logMessage);
+
+  return sourceMap;
+}
+
+bool sourceIsOpen() {
+  return sourceFd >= 0;
+}
+
+// Whether the source can go to the channel without passing through this
+// process (ORION_SOURCE_SPLICE, default 1). Paced transfers cannot: the
+// kernel sends as fast as it can.
+bool sourceCanSplice() {
+  return sourceIsOpen() && !paceIsEnabled() && getEnvInt("ORION_SOURCE_SPLICE", 1) != 0;
+}
+
+// Sends length bytes of the source from offset to fd, with splice() to a
+// pipe or sendfile() to a socket
+void sourceSend(int fd, bool isPipe, size_t offset, size_t length, struct traceChunk* chunk, int fdlog_err) {
+  loff_t spliceOffset = offset;
+  off_t fileOffset = offset;
+  ssize_t numSent;
+
+  while (length > 0) {
+    if (isPipe) {
+      numSent = splice(sourceFd, &spliceOffset, fd, NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+    } else {
+      numSent = sendfile(fd, sourceFd, &fileOffset, length);
+    }
+
+    if (numSent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (numSent <= 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror(isPipe ? "datafile.h sourceSend splice" : "datafile.h sourceSend sendfile");
+      writeErrorLog(fdlog_err, isPipe ? "datafile.h: sourceSend splice failed" :
+          "datafile.h: sourceSend sendfile failed", errno);
+      exit(-1);
+    }
+
+    length -= numSent;
+    statsTransfer(numSent, numSent / sizeof(int), 1);
+    traceChunkAdd(chunk, numSent);
+  }
+}
+
+void sourceClose() {
+  if (!sourceIsOpen()) {
+    return;
+  }
+  munmap(sourceMap, sourceLength > 0 ? sourceLength : 1);
+  close(sourceFd);
+  sourceFd = -1;
+}
+
+//////////////////////
+////     SINK     ////
+//////////////////////
+
+enum sinkMode {
+  SINK_WRITE,
+  SINK_DIRECT,
+  SINK_MMAP
+};
+
+const char* SINK_MODE_NAMES[] = {"write", "direct", "mmap"};
+
+struct dataSink {
+  char* path;
+  enum sinkMode mode;
+  int fd;
+  char* payload;
+  size_t length;
+  size_t blockBytes;
+  size_t syncBytes;
+  char* bounce; // direct: aligned copy of a block
+  char* map; // mmap: the output file
+  pthread_t writer;
+  int fdlog_err; // of the writer thread
+  size_t submittedTo; // receive thread: bytes handed over so far
+  size_t arrivedTo; // bytes the writer may write
+  size_t writtenTo; // writer thread
+  size_t syncedTo; // mmap: bytes flushed with msync()
+  uint32_t numSubmitted; // futex word the writer sleeps on
+  uint32_t isSleeping;
+  uint32_t isClosed; // everything was handed over
+  uint64_t numWrites;
+  uint64_t numSyncs;
+  uint64_t firstWrite_ns;
+};
+
+struct dataSink sink;
+bool isSinkEnabled = false;
+
+// Writer thread: writes [from, to) of the payload with pwrite(), through the
+// bounce buffer for O_DIRECT
+void sinkWriteRange(size_t from, size_t to, int fdlog_err) {
+  while (from < to) {
+    size_t length = to - from;
+    char* buf = sink.payload + from;
+    ssize_t numWritten;
+
+    if (sink.mode == SINK_DIRECT) {
+      length = length < sink.blockBytes ? length : sink.blockBytes;
+      // O_DIRECT needs whole aligned blocks: the tail of the payload goes
+      // through the page cache
+      if (length % SINK_ALIGNMENT != 0) {
+        fcntl(sink.fd, F_SETFL, fcntl(sink.fd, F_GETFL) & ~O_DIRECT);
+      }
+      memcpy(sink.bounce, buf, length);
+      buf = sink.bounce;
+    }
+
+    numWritten = pwrite(sink.fd, buf, length, from);
+    if (numWritten < 0 && errno == EINTR) {
+      continue;
+    }
+    if (numWritten <= 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("datafile.h sinkWriteRange pwrite");
+      writeErrorLog(fdlog_err, "datafile.h: sinkWriteRange pwrite failed", errno);
+      exit(-1);
+    }
+    from += numWritten;
+    sink.numWrites++;
+  }
+}
+
+// Writer thread: copies [from, to) into the mapping, starting writeback of
+// every ORION_SINK_SYNC_MIB
+void sinkCopyRange(size_t from, size_t to) {
+  memcpy(sink.map + from, sink.payload + from, to - from);
+  sink.numWrites++;
+  if (to - sink.syncedTo >= sink.syncBytes) {
+    msync(sink.map + sink.syncedTo, to - sink.syncedTo, MS_ASYNC);
+    sink.syncedTo = to;
+    sink.numSyncs++;
+  }
+}
+
+void* sinkWriterMain(void* arg) {
+  uint64_t start_ns = traceBegin();
+  uint32_t seen;
+  size_t to;
+  bool isClosed;
+
+  (void) arg; // the sink is global
+  while (true) {
+    // Whatever was handed over before the sink was closed is seen here
+    seen = __atomic_load_n(&sink.numSubmitted, __ATOMIC_SEQ_CST);
+    isClosed = __atomic_load_n(&sink.isClosed, __ATOMIC_SEQ_CST);
+    to = __atomic_load_n(&sink.arrivedTo, __ATOMIC_ACQUIRE);
+
+    if (to > sink.writtenTo) {
+      if (sink.firstWrite_ns == 0) {
+        sink.firstWrite_ns = getMonotonicTimeNS();
+      }
+      if (sink.mode == SINK_MMAP) {
+        sinkCopyRange(sink.writtenTo, to);
+      } else {
+        sinkWriteRange(sink.writtenTo, to, sink.fdlog_err);
+      }
+      sink.writtenTo = to;
+      continue;
+    }
+    if (isClosed) {
+      break;
+    }
+
+    // Nothing to write: sleep until more arrives, checking once more after
+    // announcing it so that no wake-up is missed
+    __atomic_store_n(&sink.isSleeping, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sink.numSubmitted, __ATOMIC_SEQ_CST) == seen) {
+      syscall(SYS_futex, &sink.numSubmitted, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+    }
+    __atomic_store_n(&sink.isSleeping, 0, __ATOMIC_SEQ_CST);
+  }
+  traceEndBytes("sink writer", "sink", start_ns, sink.writtenTo);
+
+  return NULL;
+}
+
+// Turns ORION_SINK_FILE off for a transfer mode whose data does not arrive in
+// one piece, before sinkOpen
+void sinkDisable(char* caller, int fdlog_info) {
+  char logMessage[128];
+
+  if (getEnvString("ORION_SINK_FILE", NULL) != NULL) {
+    sprintf(logMessage, "[%s] Sink files are not supported by this transfer mode, data is not recorded", caller);
+    writeInfoLog(fdlog_info, logMessage);
+    unsetenv("ORION_SINK_FILE");
+  }
+}
+
+// Opens ORION_SINK_FILE if set and starts the writer thread, to write the
+// numMessages messages of messages out as they arrive
+void sinkOpen(int messages[], size_t numMessages, char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[512];
+  char* path = getEnvString("ORION_SINK_FILE", NULL);
+  char* mode = getEnvString("ORION_SINK_MODE", "write");
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+  isSinkEnabled = false;
+  if (path == NULL || path[0] == '\0') {
+    return;
+  }
+
+  memset(&sink, 0, sizeof(sink));
+  sink.path = path;
+  sink.payload = (char*) messages;
+  sink.length = numMessages * sizeof(int);
+  sink.mode = SINK_WRITE;
+  for (int i = 0; i < 3; i++) {
+    if (strcmp(mode, SINK_MODE_NAMES[i]) == 0) {
+      sink.mode = i;
+    }
+  }
+  if (strcmp(mode, SINK_MODE_NAMES[sink.mode]) != 0) {
+    snprintf(logMessage, sizeof(logMessage), "[%s] Unknown ORION_SINK_MODE=%s, using write", caller, mode);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+
+  // Whole aligned blocks, for O_DIRECT
+  sink.blockBytes = (size_t) getEnvInt("ORION_SINK_BLOCK_KIB", SINK_DEFAULT_BLOCK_KIB) * 1024;
+  sink.blockBytes = sink.blockBytes < SINK_ALIGNMENT ? SINK_ALIGNMENT : sink.blockBytes / SINK_ALIGNMENT * SINK_ALIGNMENT;
+  sink.syncBytes = (size_t) getEnvInt("ORION_SINK_SYNC_MIB", SINK_DEFAULT_SYNC_MIB) * 1024 * 1024;
+  sink.syncBytes = sink.syncBytes > 0 ? sink.syncBytes : sink.blockBytes;
+
+  if (sink.mode == SINK_DIRECT) {
+    sink.fd = open(path, flags | O_DIRECT, 0644);
+    // Not every file system has O_DIRECT (tmpfs does not)
+    if (sink.fd < 0 && errno == EINVAL) {
+      snprintf(logMessage, sizeof(logMessage), "[%s] %s does not support O_DIRECT, using write", caller, path);
+      writeInfoLog(fdlog_info, logMessage);
+      sink.mode = SINK_WRITE;
+    } else {
+      sink.bounce = aligned_alloc(SINK_ALIGNMENT, sink.blockBytes);
+    }
+  }
+  if (sink.mode != SINK_DIRECT) {
+    sink.fd = open(path, sink.mode == SINK_MMAP ? O_RDWR | O_CREAT | O_TRUNC : flags, 0644);
+  }
+  if (sink.fd < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("datafile.h sinkOpen open");
+    writeErrorLog(fdlog_err, "datafile.h: sinkOpen open failed", errno);
+    exit(-1);
+  }
+
+  if (sink.mode == SINK_MMAP && sink.length > 0) {
+    if (ftruncate(sink.fd, sink.length) < 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("datafile.h sinkOpen ftruncate");
+      writeErrorLog(fdlog_err, "datafile.h: sinkOpen ftruncate failed", errno);
+      exit(-1);
+    }
+    sink.map = mmap(NULL, sink.length, PROT_READ | PROT_WRITE, MAP_SHARED, sink.fd, 0);
+    if (sink.map == MAP_FAILED) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("datafile.h sinkOpen mmap");
+      writeErrorLog(fdlog_err, "datafile.h: sinkOpen mmap failed", errno);
+      exit(-1);
+    }
+    madvise(sink.map, sink.length, MADV_SEQUENTIAL);
+  }
+
+  snprintf(logMessage, sizeof(logMessage), "[%s] Writing received data to %s (%s) in blocks of %zu KiB", caller, path,
+      SINK_MODE_NAMES[sink.mode], sink.blockBytes / 1024);
+  writeInfoLog(fdlog_info, logMessage);
+
+  isSinkEnabled = true;
+  sink.fdlog_err = fdlog_err;
+  threadCreate(&sink.writer, sinkWriterMain, NULL, fdlog_err);
+}
+
+// Receive thread: hands over the payload up to to bytes
+void sinkSubmit(size_t to) {
+  sink.submittedTo = to;
+  __atomic_store_n(&sink.arrivedTo, to, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&sink.numSubmitted, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sink.isSleeping, __ATOMIC_SEQ_CST)) {
+    syscall(SYS_futex, &sink.numSubmitted, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+// Receive thread: numMessages messages from index on have arrived. Hands over
+// every complete block, without waiting.
+void sinkArrived(uint64_t index, size_t numMessages) {
+  size_t to;
+
+  if (!isSinkEnabled) {
+    return;
+  }
+
+  to = (index + numMessages) * sizeof(int);
+  if (to - sink.submittedTo >= sink.blockBytes) {
+    sinkSubmit(to / sink.blockBytes * sink.blockBytes);
+  }
+}
+
+// Receive thread, once the transfer is over: hands over the rest, waits for
+// the writer and makes the file durable
+void sinkFinish(char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[640];
+  uint64_t lastArrival_ns;
+  uint64_t done_ns;
+  int status;
+
+  if (!isSinkEnabled) {
+    return;
+  }
+
+  // Transports that do not report arrivals (striped sockets, io_uring) hand
+  // everything over here
+  lastArrival_ns = getMonotonicTimeNS();
+  __atomic_store_n(&sink.arrivedTo, sink.length, __ATOMIC_RELEASE);
+  __atomic_store_n(&sink.isClosed, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&sink.numSubmitted, 1, __ATOMIC_SEQ_CST);
+  syscall(SYS_futex, &sink.numSubmitted, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  threadJoin(sink.writer, fdlog_err);
+
+  if (sink.mode == SINK_MMAP) {
+    status = sink.length > 0 ? msync(sink.map, sink.length, MS_SYNC) : 0;
+    sink.numSyncs++;
+    if (sink.length > 0) {
+      munmap(sink.map, sink.length);
+    }
+  } else {
+    status = fdatasync(sink.fd);
+    sink.numSyncs++;
+  }
+  if (status < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("datafile.h sinkFinish sync");
+    writeErrorLog(fdlog_err, "datafile.h: sinkFinish sync failed", errno);
+    exit(-1);
+  }
+  close(sink.fd);
+  free(sink.bounce);
+  done_ns = getMonotonicTimeNS();
+  isSinkEnabled = false;
+
+  snprintf(logMessage, sizeof(logMessage), "[%s] Wrote %.1f MiB to %s (%s) in %lu writes and %lu syncs: %.1f MiB/s, durable %.3f ms "
+      "after the last arrival", caller, sink.length / (1024.0 * 1024.0), sink.path, SINK_MODE_NAMES[sink.mode],
+      sink.numWrites, sink.numSyncs,
+      sink.length / (1024.0 * 1024.0) / ((done_ns - (sink.firstWrite_ns ? sink.firstWrite_ns : done_ns)) / 1.0e9 + 1e-9),
+      (done_ns - lastArrival_ns) / 1.0e6);
+  writeInfoLog(fdlog_info, logMessage);
+}
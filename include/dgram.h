@@ -0,0 +1,250 @@
+// Datagram transport over UDP on the loopback or unix datagram sockets (IPC
+// choice 7). Must be included after common.h, stats.h, result.h and control.h.
+//
+// Nothing here is acknowledged or sent again: like telemetry on a lossy link,
+// the producer sends every chunk once and the consumer keeps what arrives. The
+// payload is cut into datagrams of ORION_DGRAM_PAYLOAD bytes, each behind a
+// header with its sequence number, where its messages go and their checksum,
+// so that the consumer can place every datagram wherever it arrives, drop
+// corrupt ones and count lost, reordered and duplicate ones. Datagrams are
+// sent ORION_DGRAM_BATCH at a time with sendmmsg() and received as many at a
+// time with recvmmsg(). Over UDP, ORION_DGRAM_GSO=1 has the kernel cut the
+// datagrams out of one large send (UDP_SEGMENT) and ORION_DGRAM_GRO=1 has it
+// hand several over in one buffer (UDP_GRO).
+//
+// A unix datagram socket with a full receive queue makes the sender wait, so
+// nothing is lost; a UDP socket drops what does not fit in its receive buffer
+// (ORION_SO_RCVBUF) when the consumer falls behind. The consumer binds first
+// and posts /orion_sem_dgram for the producer to connect. The transfer is over
+// once every datagram arrived, or nothing arrived for DGRAM_IDLE_MS after the
+// producer marked the session done.
+
+#include <sys/un.h>
+#include <netinet/udp.h>
+
+const int DGRAM_DEFAULT_PAYLOAD = 1400; // bytes, fits an Ethernet frame with the headers
+const int DGRAM_DEFAULT_BATCH = 32;
+const int DGRAM_MAX_BATCH = 1024; // iovecs per sendmmsg() and recvmmsg() call
+const int DGRAM_MAX_SIZE = 65507; // largest UDP payload
+const int DGRAM_MAX_GSO_SEGMENTS = 64;
+const int DGRAM_IDLE_MS = 10; // consumer wait between checks for the end of the transfer
+
+// Header of a datagram, followed by numMessages messages
+struct dgramHeader {
+  uint32_t sequence;
+  uint32_t firstMessage; // index of the first message in the payload
+  uint32_t numMessages;
+  uint32_t reserved;
+  uint64_t checksum; // checksumMessages of the messages, at their index
+};
+
+struct dgramOptions {
+  bool isUnix; // ORION_DGRAM_FAMILY=unix, UDP otherwise
+  int numPerDatagram; // messages per datagram
+  int batch; // datagrams per sendmmsg() or recvmmsg()
+  int numPerSend; // datagrams cut out of one send by GSO, 1 without
+  bool isGro;
+};
+
+// What the consumer received, by sequence number
+struct dgramReceiver {
+  uint8_t* isReceived;
+  uint32_t numDatagrams;
+  uint32_t nextSequence; // one past the highest sequence number seen
+  uint64_t numReceived;
+  uint64_t numReordered; // arrived after a later one
+  uint64_t numDuplicates;
+  uint64_t numCorrupt;
+  uint64_t numMessages; // placed in messages, once each
+};
+
+struct dgramOptions dgram;
+struct dgramReceiver receiver;
+
+// Reads the ORION_DGRAM_* options, and logs them
+void dgramSelect(char* caller, int fdlog_info) {
+  char logMessage[192];
+  int payload = getEnvInt("ORION_DGRAM_PAYLOAD", DGRAM_DEFAULT_PAYLOAD);
+  int maxPayload = DGRAM_MAX_SIZE - (int) sizeof(struct dgramHeader);
+
+  dgram.isUnix = strcmp(getEnvString("ORION_DGRAM_FAMILY", "udp"), "unix") == 0;
+  if (payload > maxPayload) {
+    payload = maxPayload;
+  }
+  dgram.numPerDatagram = payload / (int) sizeof(int) > 0 ? payload / (int) sizeof(int) : 1;
+  dgram.batch = getEnvInt("ORION_DGRAM_BATCH", DGRAM_DEFAULT_BATCH);
+  if (dgram.batch < 1) {
+    dgram.batch = 1;
+  } else if (dgram.batch > DGRAM_MAX_BATCH / 2) {
+    dgram.batch = DGRAM_MAX_BATCH / 2; // two iovecs per datagram
+  }
+
+  // As many full datagrams as fit in the largest UDP payload
+  dgram.numPerSend = 1;
+  if (!dgram.isUnix && getEnvInt("ORION_DGRAM_GSO", 0) != 0) {
+    dgram.numPerSend = DGRAM_MAX_SIZE / (sizeof(struct dgramHeader) + dgram.numPerDatagram * sizeof(int));
+    if (dgram.numPerSend > DGRAM_MAX_GSO_SEGMENTS) {
+      dgram.numPerSend = DGRAM_MAX_GSO_SEGMENTS;
+    } else if (dgram.numPerSend < 1) {
+      dgram.numPerSend = 1;
+    }
+  }
+  dgram.isGro = !dgram.isUnix && getEnvInt("ORION_DGRAM_GRO", 0) != 0;
+
+  sprintf(logMessage, "[%s] Datagrams over %s: %d bytes of messages each, %d per batch, GSO %s, GRO %s",
+      caller, dgram.isUnix ? "unix sockets" : "UDP", dgram.numPerDatagram * (int) sizeof(int), dgram.batch,
+      dgram.numPerSend > 1 ? "on" : "off", dgram.isGro ? "on" : "off");
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+// Size of a datagram carrying numMessages messages
+size_t dgramSize(int numMessages) {
+  return sizeof(struct dgramHeader) + (size_t) numMessages * sizeof(int);
+}
+
+// Address the consumer binds to: the loopback at portno, or an abstract unix
+// socket per session
+socklen_t dgramAddress(struct sockaddr_storage* addr, int portno) {
+  struct sockaddr_in* inAddr = (struct sockaddr_in*) addr;
+  struct sockaddr_un* unAddr = (struct sockaddr_un*) addr;
+  char* session = getEnvString("ORION_SESSION", NULL);
+
+  memset(addr, 0, sizeof(*addr));
+  if (!dgram.isUnix) {
+    inAddr->sin_family = AF_INET;
+    inAddr->sin_port = htons(portno);
+    inAddr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sizeof(*inAddr);
+  }
+
+  unAddr->sun_family = AF_UNIX;
+  // Abstract namespace: leading zero byte, nothing to unlink afterwards
+  snprintf(unAddr->sun_path + 1, sizeof(unAddr->sun_path) - 1, "orion_dgram_%s",
+      session != NULL ? session : "default");
+  return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(unAddr->sun_path + 1);
+}
+
+// Creates the datagram socket: bound for the consumer, connected to the
+// consumer for the producer. Socket buffers follow ORION_SO_SNDBUF and
+// ORION_SO_RCVBUF. GSO or GRO fall back to single datagrams if the kernel
+// does not support them.
+int dgramOpen(bool isProducer, int portno, char* caller, int fdlog_info, int fdlog_err) {
+  struct sockaddr_storage addr;
+  struct socketTuning tuning = socketTuningFromEnv();
+  socklen_t addrLength = dgramAddress(&addr, portno);
+  char logMessage[128];
+  int segmentSize = dgramSize(dgram.numPerDatagram);
+  int optVal = 1;
+  int sockfd;
+
+  sockfd = socketCreate(dgram.isUnix ? AF_UNIX : AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0, fdlog_err);
+  if (tuning.sndBuf > 0) {
+    socketSetOpt(sockfd, SOL_SOCKET, SO_SNDBUF, &tuning.sndBuf, sizeof(tuning.sndBuf), fdlog_err);
+  }
+  if (tuning.rcvBuf > 0) {
+    socketSetOpt(sockfd, SOL_SOCKET, SO_RCVBUF, &tuning.rcvBuf, sizeof(tuning.rcvBuf), fdlog_err);
+  }
+
+  if (isProducer) {
+    if (dgram.numPerSend > 1 && setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof(segmentSize)) < 0) {
+      sprintf(logMessage, "[%s] UDP GSO unavailable (error %d), sending datagrams one by one", caller, errno);
+      writeInfoLog(fdlog_info, logMessage);
+      dgram.numPerSend = 1;
+    }
+    socketConnect(sockfd, (struct sockaddr*) &addr, addrLength, fdlog_err);
+  } else {
+    if (dgram.isGro && setsockopt(sockfd, SOL_UDP, UDP_GRO, &optVal, sizeof(optVal)) < 0) {
+      sprintf(logMessage, "[%s] UDP GRO unavailable (error %d), receiving datagrams one by one", caller, errno);
+      writeInfoLog(fdlog_info, logMessage);
+      dgram.isGro = false;
+    }
+    socketBind(sockfd, (struct sockaddr*) &addr, addrLength, fdlog_err);
+  }
+
+  return sockfd;
+}
+
+// Producer side: fills the header of datagram sequence, which carries the
+// messages from firstMessage on
+void dgramFillHeader(struct dgramHeader* header, int messages[], uint32_t sequence, uint32_t firstMessage,
+    uint32_t numMessages) {
+  header->sequence = sequence;
+  header->firstMessage = firstMessage;
+  header->numMessages = numMessages;
+  header->reserved = 0;
+  header->checksum = checksumMessages(messages, firstMessage, (size_t) firstMessage + numMessages);
+}
+
+// Consumer side: expects the numMessages messages of the payload
+void dgramReceiverInit(size_t numMessages) {
+  memset(&receiver, 0, sizeof(receiver));
+  receiver.numDatagrams = (numMessages + dgram.numPerDatagram - 1) / dgram.numPerDatagram;
+  receiver.isReceived = calloc(receiver.numDatagrams > 0 ? receiver.numDatagrams : 1, 1);
+}
+
+// Consumer side: checks one datagram of length bytes and copies its messages
+// into place. Returns the index of its first message, or -1 if it was
+// dropped as corrupt or a duplicate. The header must place the payload where
+// its sequence number says, and the payload must match its checksum while
+// still in the receive buffer, so that a corrupt datagram never overwrites
+// data that arrived intact.
+int64_t dgramAccept(char* datagram, size_t length, int messages[], size_t numMessages) {
+  struct dgramHeader* header = (struct dgramHeader*) datagram;
+  int* payload = (int*) (header + 1);
+  size_t first;
+  size_t expected;
+
+  if (length < sizeof(*header) || header->sequence >= receiver.numDatagrams) {
+    receiver.numCorrupt++;
+    return -1;
+  }
+  first = (size_t) header->sequence * dgram.numPerDatagram;
+  expected = numMessages - first < (size_t) dgram.numPerDatagram ? numMessages - first : (size_t) dgram.numPerDatagram;
+  if (header->firstMessage != first || header->numMessages != expected || length != dgramSize(header->numMessages) ||
+      checksumMessagesAt(payload, first, first + expected) != header->checksum) {
+    receiver.numCorrupt++;
+    return -1;
+  }
+  if (receiver.isReceived[header->sequence]) {
+    receiver.numDuplicates++;
+    return -1;
+  }
+
+  memcpy(&messages[first], payload, expected * sizeof(int));
+
+  receiver.isReceived[header->sequence] = 1;
+  receiver.numReceived++;
+  receiver.numMessages += header->numMessages;
+  if (header->sequence < receiver.nextSequence) {
+    receiver.numReordered++;
+  } else {
+    receiver.nextSequence = header->sequence + 1;
+  }
+
+  return header->firstMessage;
+}
+
+// Consumer side: fills summary with what arrived, given the transfer time and
+// the size of a MiB as the rest of the program counts it, and logs it
+void dgramReceiverFinish(struct lossSummary* summary, double transfer_s, int bytesPerMiB, char* caller,
+    int fdlog_info) {
+  char logMessage[256];
+
+  summary->numDatagrams = receiver.numDatagrams;
+  summary->numReceived = receiver.numReceived;
+  summary->numLost = receiver.numDatagrams - receiver.numReceived;
+  summary->numReordered = receiver.numReordered;
+  summary->numDuplicates = receiver.numDuplicates;
+  summary->numCorrupt = receiver.numCorrupt;
+  summary->goodput_mibps = transfer_s > 0 ? receiver.numMessages * sizeof(int) / (double) bytesPerMiB / transfer_s : 0;
+
+  sprintf(logMessage, "[%s] Datagrams: %lu of %lu received, %lu lost (%.2f%%), %lu reordered, %lu duplicates, "
+      "%lu corrupt; goodput %.2f MiB/s", caller, (unsigned long) summary->numReceived,
+      (unsigned long) summary->numDatagrams, (unsigned long) summary->numLost,
+      summary->numDatagrams > 0 ? 100.0 * summary->numLost / summary->numDatagrams : 0.0,
+      (unsigned long) summary->numReordered, (unsigned long) summary->numDuplicates,
+      (unsigned long) summary->numCorrupt, summary->goodput_mibps);
+  writeInfoLog(fdlog_info, logMessage);
+
+  free(receiver.isReceived);
+}
@@ -0,0 +1,221 @@
+// Element type of the samples in the payload (ORION_ELEMENT_TYPE): int8,
+// int16, int32 (default), int64, float or double.
+// Must be included after common.h and kernels.h.
+//
+// Transports carry the payload as bytes, in 4-byte messages, whatever it
+// holds; a payload size in MiB is the same number of bytes for every type.
+// The loops that handle the samples themselves, generating them in the
+// producer and processing them in the consumer, are generated for every type
+// by ELEMENT_KERNELS, so that each one runs with a constant stride the
+// compiler can vectorize, and dispatched through a table picked at start-up.
+// int32 payloads go to the vectorized kernels of kernels.h instead.
+//
+// Samples are 0 to 99 for every type, floating point ones with two decimals,
+// so that the same thresholds and histogram bins apply.
+
+// Kernels of one element type, over the elements [from, to) of a payload
+struct elementType {
+  const char* name;
+  size_t size; // bytes
+  // Fills elements with samples from an xorshift32 state
+  void (*generate)(void* payload, size_t from, size_t to, uint32_t* state);
+  double (*sum)(const void* payload, size_t from, size_t to);
+  // Lowers *min and raises *max
+  void (*minMax)(const void* payload, size_t from, size_t to, double* min, double* max);
+  // Adds the samples, truncated and clamped to 0..KERNEL_HISTOGRAM_BINS-1
+  void (*histogram)(const void* payload, size_t from, size_t to, uint64_t histogram[]);
+  // Samples at or above threshold; *first gets the index of the first one, to
+  // if none
+  uint64_t (*threshold)(const void* payload, size_t from, size_t to, double threshold, size_t* first);
+  // Highest sum over window consecutive samples, for the windows ending in
+  // [from, to); -INFINITY if none does
+  double (*windowMax)(const void* payload, size_t from, size_t to, size_t window);
+};
+
+// Kernels for type, summing in sumType
+#define ELEMENT_KERNELS(suffix, type, sumType) \
+void elementGenerate##suffix(void* payload, size_t from, size_t to, uint32_t* state) { \
+  type* elements = payload; \
+  uint32_t x = *state; \
+\
+  for (size_t i = from; i < to; i++) { \
+    x ^= x << 13; \
+    x ^= x >> 17; \
+    x ^= x << 5; \
+    elements[i] = (type) ((sumType) (x % 10000) / 100); \
+  } \
+  *state = x; \
+} \
+\
+double elementSum##suffix(const void* payload, size_t from, size_t to) { \
+  const type* elements = payload; \
+  sumType sum = 0; \
+\
+  for (size_t i = from; i < to; i++) { \
+    sum += elements[i]; \
+  } \
+\
+  return sum; \
+} \
+\
+void elementMinMax##suffix(const void* payload, size_t from, size_t to, double* min, double* max) { \
+  const type* elements = payload; \
+  type low; \
+  type high; \
+\
+  if (from >= to) { \
+    return; \
+  } \
+  low = elements[from]; \
+  high = elements[from]; \
+  for (size_t i = from; i < to; i++) { \
+    low = elements[i] < low ? elements[i] : low; \
+    high = elements[i] > high ? elements[i] : high; \
+  } \
+  *min = low < *min ? low : *min; \
+  *max = high > *max ? high : *max; \
+} \
+\
+void elementHistogram##suffix(const void* payload, size_t from, size_t to, uint64_t histogram[]) { \
+  const type* elements = payload; \
+\
+  for (size_t i = from; i < to; i++) { \
+    type value = elements[i] < 0 ? 0 : elements[i]; \
+\
+    histogram[value < KERNEL_HISTOGRAM_BINS - 1 ? (int) value : KERNEL_HISTOGRAM_BINS - 1]++; \
+  } \
+} \
+\
+uint64_t elementThreshold##suffix(const void* payload, size_t from, size_t to, double threshold, size_t* first) { \
+  const type* elements = payload; \
+  uint64_t count = 0; \
+\
+  *first = to; \
+  for (size_t i = from; i < to; i++) { \
+    if (elements[i] >= threshold) { \
+      *first = count == 0 ? i : *first; \
+      count++; \
+    } \
+  } \
+\
+  return count; \
+} \
+\
+double elementWindowMax##suffix(const void* payload, size_t from, size_t to, size_t window) { \
+  const type* elements = payload; \
+  size_t end; \
+  sumType windowSum = 0; \
+  sumType max; \
+\
+  end = from > window - 1 ? from : window - 1; \
+  if (window == 0 || end >= to) { \
+    return -INFINITY; \
+  } \
+  for (size_t i = end + 1 - window; i <= end; i++) { \
+    windowSum += elements[i]; \
+  } \
+  max = windowSum; \
+  for (size_t i = end + 1; i < to; i++) { \
+    windowSum += (sumType) elements[i] - elements[i - window]; \
+    max = windowSum > max ? windowSum : max; \
+  } \
+\
+  return max; \
+}
+
+ELEMENT_KERNELS(Int8, int8_t, int64_t)
+ELEMENT_KERNELS(Int16, int16_t, int64_t)
+ELEMENT_KERNELS(Int32, int32_t, int64_t)
+ELEMENT_KERNELS(Int64, int64_t, int64_t)
+ELEMENT_KERNELS(Float, float, double)
+ELEMENT_KERNELS(Double, double, double)
+
+//// INT32 THROUGH kernels.h ////
+
+double elementSumVector(const void* payload, size_t from, size_t to) {
+  return kernels->sum((const int*) payload + from, to - from);
+}
+
+void elementMinMaxVector(const void* payload, size_t from, size_t to, double* min, double* max) {
+  int low = INT32_MAX;
+  int high = INT32_MIN;
+
+  if (from >= to) {
+    return;
+  }
+  kernels->minMax((const int*) payload + from, to - from, &low, &high);
+  *min = low < *min ? low : *min;
+  *max = high > *max ? high : *max;
+}
+
+void elementHistogramVector(const void* payload, size_t from, size_t to, uint64_t histogram[]) {
+  kernels->histogram((const int*) payload + from, to - from, histogram);
+}
+
+uint64_t elementThresholdVector(const void* payload, size_t from, size_t to, double threshold, size_t* first) {
+  uint64_t count;
+
+  // Integer samples at or above threshold are those at or above its ceiling
+  if (threshold > INT32_MAX) {
+    *first = to;
+    return 0;
+  }
+  count = kernels->threshold((const int*) payload + from, to - from,
+      threshold < INT32_MIN ? INT32_MIN : (int) ceil(threshold), first);
+  *first += from;
+
+  return count;
+}
+
+double elementWindowMaxVector(const void* payload, size_t from, size_t to, size_t window) {
+  int64_t max = kernels->windowMax(payload, from, to, window);
+
+  return max == INT64_MIN ? -INFINITY : max;
+}
+
+//// DISPATCH ////
+
+const struct elementType ELEMENT_TYPES[] = {
+  {"int8", sizeof(int8_t), elementGenerateInt8, elementSumInt8, elementMinMaxInt8, elementHistogramInt8,
+      elementThresholdInt8, elementWindowMaxInt8},
+  {"int16", sizeof(int16_t), elementGenerateInt16, elementSumInt16, elementMinMaxInt16, elementHistogramInt16,
+      elementThresholdInt16, elementWindowMaxInt16},
+  {"int32", sizeof(int32_t), elementGenerateInt32, elementSumVector, elementMinMaxVector, elementHistogramVector,
+      elementThresholdVector, elementWindowMaxVector},
+  {"int64", sizeof(int64_t), elementGenerateInt64, elementSumInt64, elementMinMaxInt64, elementHistogramInt64,
+      elementThresholdInt64, elementWindowMaxInt64},
+  {"float", sizeof(float), elementGenerateFloat, elementSumFloat, elementMinMaxFloat, elementHistogramFloat,
+      elementThresholdFloat, elementWindowMaxFloat},
+  {"double", sizeof(double), elementGenerateDouble, elementSumDouble, elementMinMaxDouble, elementHistogramDouble,
+      elementThresholdDouble, elementWindowMaxDouble}
+};
+const int NUM_ELEMENT_TYPES = sizeof(ELEMENT_TYPES) / sizeof(ELEMENT_TYPES[0]);
+
+const struct elementType* elementType = &ELEMENT_TYPES[2];
+
+// Picks the element type named by ORION_ELEMENT_TYPE, int32 if unset or
+// unknown
+void elementSelect(char* caller, int fdlog_info) {
+  char logMessage[128];
+  char* name = getEnvString("ORION_ELEMENT_TYPE", "int32");
+
+  elementType = &ELEMENT_TYPES[2];
+  for (int i = 0; i < NUM_ELEMENT_TYPES; i++) {
+    if (strcmp(name, ELEMENT_TYPES[i].name) == 0) {
+      elementType = &ELEMENT_TYPES[i];
+    }
+  }
+
+  if (strcmp(name, elementType->name) != 0) {
+    sprintf(logMessage, "[%s] Unknown ORION_ELEMENT_TYPE=%s, using int32", caller, name);
+    writeInfoLog(fdlog_info, logMessage);
+  } else if (elementType != &ELEMENT_TYPES[2]) {
+    sprintf(logMessage, "[%s] Payload of %s samples", caller, elementType->name);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+}
+
+// Element at the start of a range of 4-byte messages
+size_t elementAt(size_t message) {
+  return message * sizeof(int) / elementType->size;
+}
@@ -0,0 +1,605 @@
+// Durable queue through a journal of memory-mapped segment files (IPC choice
+// 6). Must be included after common.h, stats.h, trace.h, pace.h and control.h.
+//
+// The producer appends framed records, a header and then up to
+// ORION_JOURNAL_RECORD_KIB of messages, to segment files of
+// ORION_JOURNAL_SEGMENT_MIB in ORION_JOURNAL_DIR, and goes on to the next
+// segment when a record does not fit. Segments are preallocated, so appending
+// never changes a file's size. A record's magic number is stored last, with
+// release semantics, so that it is never seen half written, and its header
+// holds a checksum of the payload, so that one torn by a crash is detected.
+// An index file, mapped by both sides, records how far the journal may be
+// read (published), how far it is on disk (durable) and how far the consumer
+// has consumed it (committed); a consumer restarted during the session
+// resumes after its committed offset. The consumer sleeps on a futex in the
+// index when it has caught up, and the producer only wakes it if it is asleep.
+//
+// ORION_JOURNAL_SYNC sets the durability:
+// - none: records stay in the page cache, readable at once;
+// - interval: a thread syncs what was appended every ORION_JOURNAL_SYNC_MS,
+//   records are readable at once and durable within the interval;
+// - group: a committer thread syncs, in one go, every record appended while
+//   its previous sync ran, and publishes them once durable;
+// - record: the producer syncs every record before appending the next.
+// Syncs use fdatasync(), msync() or sync_file_range() on the range alone,
+// which, since segments never change size, leaves no metadata behind but
+// does not flush the disk's write cache (ORION_JOURNAL_SYNC_METHOD).
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define JOURNAL_MAX_SEGMENTS 1024
+
+const uint32_t JOURNAL_RECORD_MAGIC = 0x4f524a52; // a complete record follows
+const uint32_t JOURNAL_ROTATE_MAGIC = 0x4f524a53; // the rest of the segment is unused
+const int JOURNAL_DEFAULT_SEGMENT_MIB = 16;
+const int JOURNAL_DEFAULT_RECORD_KIB = 64;
+const int JOURNAL_DEFAULT_SYNC_MS = 10;
+const size_t JOURNAL_PAGE_SIZE = 4096;
+
+enum journalSync {
+  JOURNAL_SYNC_NONE,
+  JOURNAL_SYNC_INTERVAL,
+  JOURNAL_SYNC_GROUP,
+  JOURNAL_SYNC_RECORD
+};
+
+enum journalSyncMethod {
+  JOURNAL_FDATASYNC,
+  JOURNAL_MSYNC,
+  JOURNAL_SYNC_RANGE
+};
+
+const char* JOURNAL_SYNC_NAMES[] = {"none", "interval", "group", "record"};
+const char* JOURNAL_METHOD_NAMES[] = {"fdatasync", "msync", "range"};
+
+// Header of a record, 8-byte aligned in its segment
+struct journalRecord {
+  uint32_t magic; // stored last
+  uint32_t length; // payload bytes
+  uint64_t offset; // of the payload in the transfer, in bytes
+  uint64_t append_ns;
+  uint64_t checksum; // of the payload
+};
+
+// Index file shared by producer and consumer. Positions are in journal
+// bytes: segment k holds [k*segmentBytes, (k+1)*segmentBytes).
+struct journalIndex {
+  uint64_t segmentBytes;
+  uint64_t publishedTo; // the consumer may read up to here
+  uint64_t durableTo;
+  uint64_t committedTo; // consumer
+  uint64_t numSyncs;
+  uint32_t numPublished; // futex word the consumer sleeps on
+  uint32_t isSleeping; // consumer
+  uint32_t isClosed; // everything was published
+};
+
+struct journalSegment {
+  int fd;
+  char* map;
+};
+
+struct journal {
+  char dir[256];
+  int indexFd;
+  struct journalIndex* index;
+  size_t segmentBytes;
+  size_t recordBytes; // payload of a full record
+  enum journalSync sync;
+  enum journalSyncMethod method;
+  bool isWriting;
+  struct journalSegment segments[JOURNAL_MAX_SEGMENTS];
+  int numSegments; // mapped, published with release for the sync thread
+  // Producer
+  uint64_t appendedTo;
+  uint64_t numRecords;
+  pthread_t syncer;
+  bool hasSyncer;
+  uint32_t numAppended; // futex word the committer sleeps on
+  uint32_t isSyncerSleeping;
+  uint32_t isStopping;
+  int syncInterval_ms;
+  uint64_t sync_ns;
+  uint64_t maxSync_ns;
+  int fdlog_err;
+  // Consumer: latency from append to read, as in pace.h
+  uint64_t latencyHistogram[PACE_NUM_BUCKETS];
+  uint64_t numLatencies;
+  uint64_t maxLatency_ns;
+};
+
+struct journal journal;
+
+// Journal bytes taken by a record with length bytes of payload
+size_t journalRecordSize(size_t length) {
+  return (sizeof(struct journalRecord) + length + 7) & ~(size_t) 7;
+}
+
+// Reads the journal options
+void journalSelect(char* caller, int fdlog_info) {
+  char logMessage[160];
+  char* sync = getEnvString("ORION_JOURNAL_SYNC", "group");
+  char* method = getEnvString("ORION_JOURNAL_SYNC_METHOD", "fdatasync");
+
+  snprintf(journal.dir, sizeof(journal.dir), "%s", getEnvString("ORION_JOURNAL_DIR", "/tmp/orion_journal"));
+  journal.sync = JOURNAL_SYNC_GROUP;
+  for (int i = 0; i < 4; i++) {
+    if (strcmp(sync, JOURNAL_SYNC_NAMES[i]) == 0) {
+      journal.sync = i;
+    }
+  }
+  if (strcmp(sync, JOURNAL_SYNC_NAMES[journal.sync]) != 0) {
+    sprintf(logMessage, "[%s] Unknown ORION_JOURNAL_SYNC=%.32s, using group", caller, sync);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+  journal.method = JOURNAL_FDATASYNC;
+  for (int i = 0; i < 3; i++) {
+    if (strcmp(method, JOURNAL_METHOD_NAMES[i]) == 0) {
+      journal.method = i;
+    }
+  }
+  if (strcmp(method, JOURNAL_METHOD_NAMES[journal.method]) != 0) {
+    sprintf(logMessage, "[%s] Unknown ORION_JOURNAL_SYNC_METHOD=%.32s, using fdatasync", caller, method);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+
+  // A segment holds at least two full records
+  journal.segmentBytes = (size_t) getEnvInt("ORION_JOURNAL_SEGMENT_MIB", JOURNAL_DEFAULT_SEGMENT_MIB) * 1024 * 1024;
+  journal.segmentBytes = journal.segmentBytes < 1024 * 1024 ? 1024 * 1024 : journal.segmentBytes;
+  journal.recordBytes = (size_t) getEnvInt("ORION_JOURNAL_RECORD_KIB", JOURNAL_DEFAULT_RECORD_KIB) * 1024;
+  journal.recordBytes = journal.recordBytes < sizeof(int) ? sizeof(int) : journal.recordBytes;
+  if (journalRecordSize(journal.recordBytes) > journal.segmentBytes / 2) {
+    journal.recordBytes = journal.segmentBytes / 2 - sizeof(struct journalRecord);
+  }
+  journal.recordBytes -= journal.recordBytes % sizeof(int);
+  journal.syncInterval_ms = getEnvInt("ORION_JOURNAL_SYNC_MS", JOURNAL_DEFAULT_SYNC_MS);
+  journal.syncInterval_ms = journal.syncInterval_ms < 1 ? 1 : journal.syncInterval_ms;
+}
+
+// Maps segment k, creating and preallocating it for the producer
+void journalMapSegment(int k) {
+  char path[320];
+  struct journalSegment* segment = &journal.segments[k];
+
+  if (k >= JOURNAL_MAX_SEGMENTS) {
+    printf("Error in journal.h journalMapSegment: more than %d segments\n", JOURNAL_MAX_SEGMENTS);
+    fflush(stdout);
+    writeErrorLog(journal.fdlog_err, "journal.h: journalMapSegment too many segments", 0);
+    exit(-1);
+  }
+
+  snprintf(path, sizeof(path), "%s/segment-%06d.log", journal.dir, k);
+  segment->fd = open(path, journal.isWriting ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+  if (segment->fd < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("journal.h journalMapSegment open");
+    writeErrorLog(journal.fdlog_err, "journal.h: journalMapSegment open failed", errno);
+    exit(-1);
+  }
+  // Blocks are allocated up front, so that syncing a record never has to
+  // update the file's size or extents
+  if (journal.isWriting && posix_fallocate(segment->fd, 0, journal.segmentBytes) != 0 &&
+      ftruncate(segment->fd, journal.segmentBytes) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("journal.h journalMapSegment ftruncate");
+    writeErrorLog(journal.fdlog_err, "journal.h: journalMapSegment ftruncate failed", errno);
+    exit(-1);
+  }
+
+  segment->map = mmap(NULL, journal.segmentBytes, journal.isWriting ? PROT_READ | PROT_WRITE : PROT_READ,
+      MAP_SHARED, segment->fd, 0);
+  if (segment->map == MAP_FAILED) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("journal.h journalMapSegment mmap");
+    writeErrorLog(journal.fdlog_err, "journal.h: journalMapSegment mmap failed", errno);
+    exit(-1);
+  }
+  madvise(segment->map, journal.segmentBytes, MADV_SEQUENTIAL);
+  __atomic_store_n(&journal.numSegments, k + 1, __ATOMIC_RELEASE);
+}
+
+// Address of a journal position, mapping its segment if needed
+char* journalAt(uint64_t position) {
+  int k = position / journal.segmentBytes;
+
+  while (journal.numSegments <= k) {
+    journalMapSegment(journal.numSegments);
+  }
+
+  return journal.segments[k].map + position % journal.segmentBytes;
+}
+
+// Opens the index file, creating it afresh for the producer
+void journalOpenIndex(int fdlog_err) {
+  char path[320];
+
+  snprintf(path, sizeof(path), "%s/journal.idx", journal.dir);
+  journal.indexFd = open(path, journal.isWriting ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+  if (journal.indexFd < 0 || (journal.isWriting && ftruncate(journal.indexFd, JOURNAL_PAGE_SIZE) < 0)) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("journal.h journalOpenIndex open");
+    writeErrorLog(fdlog_err, "journal.h: journalOpenIndex open failed", errno);
+    exit(-1);
+  }
+  journal.index = mmap(NULL, JOURNAL_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, journal.indexFd, 0);
+  if (journal.index == MAP_FAILED) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("journal.h journalOpenIndex mmap");
+    writeErrorLog(fdlog_err, "journal.h: journalOpenIndex mmap failed", errno);
+    exit(-1);
+  }
+}
+
+//////////////////////
+////  DURABILITY  ////
+//////////////////////
+
+// Makes journal positions [from, to) durable
+void journalSyncRange(uint64_t from, uint64_t to) {
+  uint64_t start_ns = getMonotonicTimeNS();
+  uint64_t elapsed_ns;
+  int status = 0;
+
+  for (uint64_t k = from / journal.segmentBytes; k * journal.segmentBytes < to; k++) {
+    struct journalSegment* segment = &journal.segments[k];
+    uint64_t low = from > k * journal.segmentBytes ? from - k * journal.segmentBytes : 0;
+    uint64_t high = to - k * journal.segmentBytes < journal.segmentBytes ? to - k * journal.segmentBytes :
+        journal.segmentBytes;
+
+    low -= low % JOURNAL_PAGE_SIZE;
+    if (journal.method == JOURNAL_FDATASYNC) {
+      status = fdatasync(segment->fd);
+    } else if (journal.method == JOURNAL_MSYNC) {
+      status = msync(segment->map + low, high - low, MS_SYNC);
+    } else {
+      status = sync_file_range(segment->fd, low, high - low,
+          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+    if (status < 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("journal.h journalSyncRange");
+      writeErrorLog(journal.fdlog_err, "journal.h: journalSyncRange failed", errno);
+      exit(-1);
+    }
+    statsSyscalls(1);
+  }
+
+  elapsed_ns = getMonotonicTimeNS() - start_ns;
+  journal.sync_ns += elapsed_ns;
+  journal.maxSync_ns = elapsed_ns > journal.maxSync_ns ? elapsed_ns : journal.maxSync_ns;
+  journal.index->numSyncs++;
+  __atomic_store_n(&journal.index->durableTo, to, __ATOMIC_RELEASE);
+}
+
+// Lets the consumer read up to position to, waking it only if it is asleep
+void journalPublish(uint64_t to) {
+  __atomic_store_n(&journal.index->publishedTo, to, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&journal.index->numPublished, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&journal.index->isSleeping, __ATOMIC_SEQ_CST)) {
+    syscall(SYS_futex, &journal.index->numPublished, FUTEX_WAKE, 1, NULL, NULL, 0);
+  }
+}
+
+// Interval syncs and group commit, in a thread of the producer
+void* journalSyncerMain(void* arg) {
+  uint64_t start_ns = traceBegin();
+  struct timespec interval;
+  uint64_t to;
+  uint32_t seen;
+
+  (void) arg; // the journal is global
+  interval.tv_sec = journal.syncInterval_ms / 1000;
+  interval.tv_nsec = (long) (journal.syncInterval_ms % 1000) * 1000000;
+
+  while (true) {
+    seen = __atomic_load_n(&journal.numAppended, __ATOMIC_SEQ_CST);
+    bool isStopping = __atomic_load_n(&journal.isStopping, __ATOMIC_SEQ_CST);
+    to = __atomic_load_n(&journal.appendedTo, __ATOMIC_ACQUIRE);
+
+    if (to > journal.index->durableTo) {
+      // Every record appended while the previous sync ran goes in this one
+      journalSyncRange(journal.index->durableTo, to);
+      if (journal.sync == JOURNAL_SYNC_GROUP) {
+        journalPublish(to);
+      }
+    }
+    if (isStopping) {
+      break;
+    }
+
+    if (journal.sync == JOURNAL_SYNC_INTERVAL) {
+      nanosleep(&interval, NULL);
+    } else {
+      // Group commit: sleep until something is appended, checking once more
+      // after announcing it so that no wake-up is missed
+      __atomic_store_n(&journal.isSyncerSleeping, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&journal.numAppended, __ATOMIC_SEQ_CST) == seen) {
+        syscall(SYS_futex, &journal.numAppended, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+      }
+      __atomic_store_n(&journal.isSyncerSleeping, 0, __ATOMIC_SEQ_CST);
+    }
+  }
+  traceEnd("journal syncer", "journal", start_ns);
+
+  return NULL;
+}
+
+//////////////////////
+////   PRODUCER   ////
+//////////////////////
+
+// Starts a new journal in ORION_JOURNAL_DIR, removing the previous one
+void journalCreate(char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[512];
+  char path[320];
+
+  memset(&journal, 0, sizeof(journal));
+  journal.isWriting = true;
+  journal.fdlog_err = fdlog_err;
+  journalSelect(caller, fdlog_info);
+
+  if (mkdir(journal.dir, 0755) < 0 && errno != EEXIST) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("journal.h journalCreate mkdir");
+    writeErrorLog(fdlog_err, "journal.h: journalCreate mkdir failed", errno);
+    exit(-1);
+  }
+  for (int k = 0; k < JOURNAL_MAX_SEGMENTS; k++) {
+    snprintf(path, sizeof(path), "%s/segment-%06d.log", journal.dir, k);
+    if (unlink(path) < 0) {
+      break;
+    }
+  }
+
+  journalOpenIndex(fdlog_err);
+  journal.index->segmentBytes = journal.segmentBytes;
+  journalMapSegment(0);
+
+  if (journal.sync == JOURNAL_SYNC_INTERVAL || journal.sync == JOURNAL_SYNC_GROUP) {
+    threadCreate(&journal.syncer, journalSyncerMain, NULL, fdlog_err);
+    journal.hasSyncer = true;
+  }
+
+  snprintf(logMessage, sizeof(logMessage), "[%s] Journal in %s: segments of %zu MiB, records of up to %zu KiB, "
+      "sync %s with %s", caller, journal.dir, journal.segmentBytes / (1024 * 1024), journal.recordBytes / 1024,
+      JOURNAL_SYNC_NAMES[journal.sync], JOURNAL_METHOD_NAMES[journal.method]);
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+// Appends a record of length bytes of payload, offset bytes into the transfer
+void journalAppend(void* payload, uint32_t length, uint64_t offset) {
+  uint64_t position = journal.appendedTo;
+  uint64_t inSegment = position % journal.segmentBytes;
+  struct journalRecord* record;
+
+  // Records never straddle two segments: mark the rest of this one unused
+  if (inSegment + journalRecordSize(length) > journal.segmentBytes) {
+    if (inSegment + sizeof(struct journalRecord) <= journal.segmentBytes) {
+      record = (struct journalRecord*) journalAt(position);
+      __atomic_store_n(&record->magic, JOURNAL_ROTATE_MAGIC, __ATOMIC_RELEASE);
+    }
+    position += journal.segmentBytes - inSegment;
+  }
+
+  record = (struct journalRecord*) journalAt(position);
+  memcpy(record + 1, payload, length);
+  record->length = length;
+  record->offset = offset;
+  record->checksum = checksumMessages(payload, 0, length / sizeof(int));
+  record->append_ns = getMonotonicTimeNS();
+  __atomic_store_n(&record->magic, JOURNAL_RECORD_MAGIC, __ATOMIC_RELEASE);
+
+  position += journalRecordSize(length);
+  __atomic_store_n(&journal.appendedTo, position, __ATOMIC_RELEASE);
+  journal.numRecords++;
+
+  switch (journal.sync) {
+    case JOURNAL_SYNC_NONE:
+    case JOURNAL_SYNC_INTERVAL:
+      journalPublish(position);
+      break;
+    case JOURNAL_SYNC_RECORD:
+      journalSyncRange(journal.index->durableTo, position);
+      journalPublish(position);
+      break;
+    default:
+      // Handed to the committer, woken only if it is asleep
+      __atomic_add_fetch(&journal.numAppended, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&journal.isSyncerSleeping, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &journal.numAppended, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+      }
+      break;
+  }
+}
+
+// Makes everything durable (unless ORION_JOURNAL_SYNC=none), publishes it and
+// tells the consumer nothing more will come
+void journalClose(char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[320];
+  uint64_t numSyncs;
+
+  if (journal.hasSyncer) {
+    __atomic_store_n(&journal.isStopping, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&journal.numAppended, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &journal.numAppended, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    threadJoin(journal.syncer, fdlog_err);
+  }
+  if (journal.sync != JOURNAL_SYNC_NONE && journal.appendedTo > journal.index->durableTo) {
+    journalSyncRange(journal.index->durableTo, journal.appendedTo);
+  }
+  journalPublish(journal.appendedTo);
+  __atomic_store_n(&journal.index->isClosed, 1, __ATOMIC_SEQ_CST);
+  journalPublish(journal.appendedTo);
+
+  numSyncs = journal.index->numSyncs;
+  snprintf(logMessage, sizeof(logMessage), "[%s] Journal: %lu records in %d segments, %lu syncs (%s, %s) taking "
+      "%.3f ms, %.3f ms at most", caller, (unsigned long) journal.numRecords, journal.numSegments,
+      (unsigned long) numSyncs, JOURNAL_SYNC_NAMES[journal.sync], JOURNAL_METHOD_NAMES[journal.method],
+      journal.sync_ns / 1.0e6, journal.maxSync_ns / 1.0e6);
+  writeInfoLog(fdlog_info, logMessage);
+
+  // The segments stay on disk for the consumer, and to replay
+  for (int k = 0; k < journal.numSegments; k++) {
+    munmap(journal.segments[k].map, journal.segmentBytes);
+    close(journal.segments[k].fd);
+  }
+  munmap(journal.index, JOURNAL_PAGE_SIZE);
+  close(journal.indexFd);
+}
+
+//////////////////////
+////   CONSUMER   ////
+//////////////////////
+
+// Opens the journal the producer created. Returns the committed position a
+// consumer of this session got to before, 0 for a new one.
+uint64_t journalOpen(char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[160];
+
+  memset(&journal, 0, sizeof(journal));
+  journal.isWriting = false;
+  journal.fdlog_err = fdlog_err;
+  journalSelect(caller, fdlog_info);
+  journalOpenIndex(fdlog_err);
+  journal.segmentBytes = journal.index->segmentBytes;
+
+  if (journal.index->committedTo > 0) {
+    sprintf(logMessage, "[%s] Resuming the journal after %lu committed bytes", caller,
+        (unsigned long) journal.index->committedTo);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+
+  return journal.index->committedTo;
+}
+
+// Waits for the record at *position, moving *position past it. Returns NULL
+// once the producer closed the journal and everything was read.
+struct journalRecord* journalRead(uint64_t* position) {
+  struct journalRecord* record;
+  struct timespec timeout = {0, 100000000}; // to check on the producer
+  uint64_t inSegment;
+  uint32_t seen;
+  bool isClosed;
+
+  while (true) {
+    seen = __atomic_load_n(&journal.index->numPublished, __ATOMIC_SEQ_CST);
+    isClosed = __atomic_load_n(&journal.index->isClosed, __ATOMIC_SEQ_CST);
+
+    if (*position < __atomic_load_n(&journal.index->publishedTo, __ATOMIC_ACQUIRE)) {
+      inSegment = *position % journal.segmentBytes;
+      record = (struct journalRecord*) journalAt(*position);
+      if (inSegment + sizeof(struct journalRecord) > journal.segmentBytes ||
+          __atomic_load_n(&record->magic, __ATOMIC_ACQUIRE) == JOURNAL_ROTATE_MAGIC) {
+        *position += journal.segmentBytes - inSegment;
+        continue;
+      }
+      if (record->magic != JOURNAL_RECORD_MAGIC) {
+        printf("Error in journal.h journalRead: no record at published position %lu\n", (unsigned long) *position);
+        fflush(stdout);
+        writeErrorLog(journal.fdlog_err, "journal.h: journalRead found no record at a published position", 0);
+        exit(-1);
+      }
+      *position += journalRecordSize(record->length);
+      return record;
+    }
+    if (isClosed) {
+      return NULL;
+    }
+
+    // Caught up: sleep until more is published, checking once more after
+    // announcing it so that no wake-up is missed
+    __atomic_store_n(&journal.index->isSleeping, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&journal.index->numPublished, __ATOMIC_SEQ_CST) == seen) {
+      syscall(SYS_futex, &journal.index->numPublished, FUTEX_WAIT, seen, &timeout, NULL, 0);
+    }
+    __atomic_store_n(&journal.index->isSleeping, 0, __ATOMIC_SEQ_CST);
+
+    // A producer that died cannot close the journal
+    if (__atomic_load_n(&control->state, __ATOMIC_ACQUIRE) == CONTROL_FAILED) {
+      printf("Error in journal.h journalRead: the producer failed\n");
+      fflush(stdout);
+      writeErrorLog(journal.fdlog_err, "journal.h: journalRead producer failed", 0);
+      exit(-1);
+    }
+  }
+}
+
+// Whether a record's payload matches its checksum
+bool journalIsIntact(struct journalRecord* record) {
+  return checksumMessages((int*) (record + 1), 0, record->length / sizeof(int)) == record->checksum;
+}
+
+// Records that everything before position was consumed, persisting it every
+// segment (and at the end) unless ORION_JOURNAL_SYNC=none
+void journalCommit(uint64_t position, bool isFinal) {
+  uint64_t previous = journal.index->committedTo;
+
+  __atomic_store_n(&journal.index->committedTo, position, __ATOMIC_RELEASE);
+  if (journal.sync != JOURNAL_SYNC_NONE &&
+      (isFinal || previous / journal.segmentBytes != position / journal.segmentBytes)) {
+    msync(journal.index, JOURNAL_PAGE_SIZE, isFinal ? MS_SYNC : MS_ASYNC);
+    statsSyscalls(1);
+  }
+}
+
+// Counts the time from the append of a record to now
+void journalRecordLatency(struct journalRecord* record) {
+  uint64_t now_ns = getMonotonicTimeNS();
+  uint64_t latency_ns = now_ns > record->append_ns ? now_ns - record->append_ns : 0;
+
+  journal.latencyHistogram[paceBucket(latency_ns)]++;
+  journal.numLatencies++;
+  journal.maxLatency_ns = latency_ns > journal.maxLatency_ns ? latency_ns : journal.maxLatency_ns;
+}
+
+// Latency under which a fraction of the records were read, in microseconds
+double journalPercentile(double fraction) {
+  uint64_t rank = (uint64_t) ceil(fraction * journal.numLatencies);
+  uint64_t count = 0;
+  uint64_t value_ns;
+
+  for (int i = 0; i < PACE_NUM_BUCKETS; i++) {
+    count += journal.latencyHistogram[i];
+    if (count >= rank && count > 0) {
+      value_ns = paceBucketValue(i);
+      return (value_ns < journal.maxLatency_ns ? value_ns : journal.maxLatency_ns) / 1000.0;
+    }
+  }
+
+  return journal.maxLatency_ns / 1000.0;
+}
+
+// Summarises the append-to-read latency of the records, logs it and closes
+// the journal
+void journalFinish(struct latencySummary* summary, char* caller, int fdlog_info) {
+  char logMessage[320];
+
+  memset(summary, 0, sizeof(*summary));
+  summary->numMessages = journal.numLatencies;
+  summary->p50_us = journalPercentile(0.50);
+  summary->p90_us = journalPercentile(0.90);
+  summary->p99_us = journalPercentile(0.99);
+  summary->p999_us = journalPercentile(0.999);
+  summary->max_us = journal.maxLatency_ns / 1000.0;
+
+  snprintf(logMessage, sizeof(logMessage), "[%s] Journal records readable after (sync %s): p50 %.1f us, "
+      "p99 %.1f us, max %.1f us over %lu records, %lu syncs", caller, JOURNAL_SYNC_NAMES[journal.sync],
+      summary->p50_us, summary->p99_us, summary->max_us, (unsigned long) journal.numLatencies,
+      (unsigned long) journal.index->numSyncs);
+  writeInfoLog(fdlog_info, logMessage);
+
+  for (int k = 0; k < journal.numSegments; k++) {
+    munmap(journal.segments[k].map, journal.segmentBytes);
+    close(journal.segments[k].fd);
+  }
+  munmap(journal.index, JOURNAL_PAGE_SIZE);
+  close(journal.indexFd);
+}
@@ -0,0 +1,524 @@
+// Vectorized reductions over message payloads: sum, min/max, a histogram of
+// the values 0 to 99, a threshold count and the peak moving average.
+// Must be included after common.h (uses its logging helpers).
+//
+// Every kernel comes in a scalar, an SSE4.2, an AVX2 and an AVX-512 version,
+// compiled with target attributes so that no build flag is needed, and the
+// best one the CPU supports is picked at run time (ORION_KERNELS overrides
+// it). Kernels work on any range of a payload, so they can be called chunk by
+// chunk as data arrives; sums are widened to 64 bits so they cannot overflow.
+//
+// Not every kernel gains from every width. The histogram is not a reduction:
+// the vector code only clamps the values, and counts go to four interleaved
+// tables so that consecutive equal values do not wait on each other's
+// increments; counting is the bottleneck, so AVX-512 uses the AVX2 version.
+// The moving average needs a prefix sum in 64-bit lanes, which two SSE lanes
+// do not pay for, so SSE uses the scalar version. kernelbench measures them.
+
+#include <immintrin.h>
+
+#define KERNEL_HISTOGRAM_BINS 100
+
+// One implementation of every kernel
+struct kernelTable {
+  const char* name;
+  const char* feature; // for __builtin_cpu_supports, NULL if always available
+  // Sum of data[0..n)
+  int64_t (*sum)(const int* data, size_t n);
+  // Lowers *min and raises *max to the extremes of data[0..n)
+  void (*minMax)(const int* data, size_t n, int* min, int* max);
+  // Adds data[0..n), clamped to 0..KERNEL_HISTOGRAM_BINS-1, to histogram
+  void (*histogram)(const int* data, size_t n, uint64_t histogram[]);
+  // Number of values at or above threshold in data[0..n); *first gets the
+  // index of the first one, n if none
+  uint64_t (*threshold)(const int* data, size_t n, int threshold, size_t* first);
+  // Highest sum of window consecutive values over the windows ending in
+  // [from, to), which may reach back before from; INT64_MIN if none does
+  int64_t (*windowMax)(const int* data, size_t from, size_t to, size_t window);
+};
+
+//////////////////////
+////    SCALAR    ////
+//////////////////////
+
+int64_t kernelSumScalar(const int* data, size_t n) {
+  int64_t sum = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    sum += data[i];
+  }
+
+  return sum;
+}
+
+void kernelMinMaxScalar(const int* data, size_t n, int* min, int* max) {
+  for (size_t i = 0; i < n; i++) {
+    *min = data[i] < *min ? data[i] : *min;
+    *max = data[i] > *max ? data[i] : *max;
+  }
+}
+
+int kernelBin(int value) {
+  if (value < 0) {
+    return 0;
+  }
+  return value < KERNEL_HISTOGRAM_BINS ? value : KERNEL_HISTOGRAM_BINS - 1;
+}
+
+void kernelHistogramScalar(const int* data, size_t n, uint64_t histogram[]) {
+  for (size_t i = 0; i < n; i++) {
+    histogram[kernelBin(data[i])]++;
+  }
+}
+
+uint64_t kernelThresholdScalar(const int* data, size_t n, int threshold, size_t* first) {
+  uint64_t count = 0;
+
+  *first = n;
+  for (size_t i = 0; i < n; i++) {
+    if (data[i] >= threshold) {
+      if (count == 0) {
+        *first = i;
+      }
+      count++;
+    }
+  }
+
+  return count;
+}
+
+// First window ending in [from, to) and its sum; false if there is none
+bool kernelWindowStart(const int* data, size_t from, size_t to, size_t window, int64_t (*sum)(const int*, size_t),
+    size_t* end, int64_t* windowSum) {
+  if (window == 0) {
+    return false;
+  }
+  *end = from > window - 1 ? from : window - 1;
+  if (*end >= to) {
+    return false;
+  }
+  *windowSum = sum(&data[*end + 1 - window], window);
+
+  return true;
+}
+
+int64_t kernelWindowMaxScalar(const int* data, size_t from, size_t to, size_t window) {
+  size_t j;
+  int64_t windowSum;
+  int64_t max;
+
+  if (!kernelWindowStart(data, from, to, window, kernelSumScalar, &j, &windowSum)) {
+    return INT64_MIN;
+  }
+  max = windowSum;
+  for (j++; j < to; j++) {
+    windowSum += (int64_t) data[j] - data[j - window];
+    max = windowSum > max ? windowSum : max;
+  }
+
+  return max;
+}
+
+// Adds the values left over from i on by a vector loop to count and first
+uint64_t kernelThresholdTail(const int* data, size_t i, size_t n, int threshold, uint64_t count, size_t* first) {
+  size_t tailFirst;
+  uint64_t tailCount = kernelThresholdScalar(&data[i], n - i, threshold, &tailFirst);
+
+  if (count == 0 && tailCount > 0) {
+    *first = i + tailFirst;
+  }
+
+  return count + tailCount;
+}
+
+//////////////////////
+////    SSE4.2    ////
+//////////////////////
+
+__attribute__((target("sse4.2")))
+int64_t kernelSumSse(const int* data, size_t n) {
+  __m128i acc = _mm_setzero_si128();
+  int64_t lanes[2];
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+
+    acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(v));
+    acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+  }
+  _mm_storeu_si128((__m128i*) lanes, acc);
+
+  return lanes[0] + lanes[1] + kernelSumScalar(&data[i], n - i);
+}
+
+__attribute__((target("sse4.2")))
+void kernelMinMaxSse(const int* data, size_t n, int* min, int* max) {
+  __m128i vmin = _mm_set1_epi32(*min);
+  __m128i vmax = _mm_set1_epi32(*max);
+  int lanes[4];
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+
+    vmin = _mm_min_epi32(vmin, v);
+    vmax = _mm_max_epi32(vmax, v);
+  }
+  _mm_storeu_si128((__m128i*) lanes, vmin);
+  kernelMinMaxScalar(lanes, 4, min, max);
+  _mm_storeu_si128((__m128i*) lanes, vmax);
+  kernelMinMaxScalar(lanes, 4, min, max);
+  kernelMinMaxScalar(&data[i], n - i, min, max);
+}
+
+__attribute__((target("sse4.2")))
+void kernelHistogramSse(const int* data, size_t n, uint64_t histogram[]) {
+  uint64_t tables[4][KERNEL_HISTOGRAM_BINS] = {{0}};
+  __m128i low = _mm_setzero_si128();
+  __m128i high = _mm_set1_epi32(KERNEL_HISTOGRAM_BINS - 1);
+  int bins[4];
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+
+    _mm_storeu_si128((__m128i*) bins, _mm_min_epi32(_mm_max_epi32(v, low), high));
+    tables[0][bins[0]]++;
+    tables[1][bins[1]]++;
+    tables[2][bins[2]]++;
+    tables[3][bins[3]]++;
+  }
+  for (int b = 0; b < KERNEL_HISTOGRAM_BINS; b++) {
+    histogram[b] += tables[0][b] + tables[1][b] + tables[2][b] + tables[3][b];
+  }
+  kernelHistogramScalar(&data[i], n - i, histogram);
+}
+
+__attribute__((target("sse4.2")))
+uint64_t kernelThresholdSse(const int* data, size_t n, int threshold, size_t* first) {
+  __m128i limit = _mm_set1_epi32(threshold - 1);
+  uint64_t count = 0;
+  size_t i = 0;
+
+  if (threshold == INT32_MIN) {
+    *first = 0;
+    return n;
+  }
+
+  *first = n;
+  for (; i + 4 <= n; i += 4) {
+    __m128i above = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*) &data[i]), limit);
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(above));
+
+    if (mask != 0) {
+      if (count == 0) {
+        *first = i + __builtin_ctz(mask);
+      }
+      count += __builtin_popcount(mask);
+    }
+  }
+
+  return kernelThresholdTail(data, i, n, threshold, count, first);
+}
+
+//////////////////////
+////     AVX2     ////
+//////////////////////
+
+__attribute__((target("avx2")))
+int64_t kernelSumAvx2(const int* data, size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  int64_t lanes[4];
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) &data[i]);
+
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  _mm256_storeu_si256((__m256i*) lanes, acc);
+
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + kernelSumScalar(&data[i], n - i);
+}
+
+__attribute__((target("avx2")))
+void kernelMinMaxAvx2(const int* data, size_t n, int* min, int* max) {
+  __m256i vmin = _mm256_set1_epi32(*min);
+  __m256i vmax = _mm256_set1_epi32(*max);
+  int lanes[8];
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) &data[i]);
+
+    vmin = _mm256_min_epi32(vmin, v);
+    vmax = _mm256_max_epi32(vmax, v);
+  }
+  _mm256_storeu_si256((__m256i*) lanes, vmin);
+  kernelMinMaxScalar(lanes, 8, min, max);
+  _mm256_storeu_si256((__m256i*) lanes, vmax);
+  kernelMinMaxScalar(lanes, 8, min, max);
+  kernelMinMaxScalar(&data[i], n - i, min, max);
+}
+
+__attribute__((target("avx2")))
+void kernelHistogramAvx2(const int* data, size_t n, uint64_t histogram[]) {
+  uint64_t tables[4][KERNEL_HISTOGRAM_BINS] = {{0}};
+  __m256i low = _mm256_setzero_si256();
+  __m256i high = _mm256_set1_epi32(KERNEL_HISTOGRAM_BINS - 1);
+  int bins[8];
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) &data[i]);
+
+    _mm256_storeu_si256((__m256i*) bins, _mm256_min_epi32(_mm256_max_epi32(v, low), high));
+    tables[0][bins[0]]++;
+    tables[1][bins[1]]++;
+    tables[2][bins[2]]++;
+    tables[3][bins[3]]++;
+    tables[0][bins[4]]++;
+    tables[1][bins[5]]++;
+    tables[2][bins[6]]++;
+    tables[3][bins[7]]++;
+  }
+  for (int b = 0; b < KERNEL_HISTOGRAM_BINS; b++) {
+    histogram[b] += tables[0][b] + tables[1][b] + tables[2][b] + tables[3][b];
+  }
+  kernelHistogramScalar(&data[i], n - i, histogram);
+}
+
+__attribute__((target("avx2")))
+uint64_t kernelThresholdAvx2(const int* data, size_t n, int threshold, size_t* first) {
+  __m256i limit = _mm256_set1_epi32(threshold - 1);
+  uint64_t count = 0;
+  size_t i = 0;
+
+  if (threshold == INT32_MIN) {
+    *first = 0;
+    return n;
+  }
+
+  *first = n;
+  for (; i + 8 <= n; i += 8) {
+    __m256i above = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*) &data[i]), limit);
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(above));
+
+    if (mask != 0) {
+      if (count == 0) {
+        *first = i + __builtin_ctz(mask);
+      }
+      count += __builtin_popcount(mask);
+    }
+  }
+
+  return kernelThresholdTail(data, i, n, threshold, count, first);
+}
+
+// Window sums as a running prefix sum of data[j] - data[j - window], four
+// windows per vector
+__attribute__((target("avx2")))
+int64_t kernelWindowMaxAvx2(const int* data, size_t from, size_t to, size_t window) {
+  size_t j;
+  int64_t windowSum;
+  int64_t max;
+  int64_t lanes[4];
+  __m256i zero = _mm256_setzero_si256();
+  __m256i carry;
+  __m256i vmax;
+
+  if (!kernelWindowStart(data, from, to, window, kernelSumAvx2, &j, &windowSum)) {
+    return INT64_MIN;
+  }
+  carry = _mm256_set1_epi64x(windowSum);
+  vmax = carry;
+  for (j++; j + 4 <= to; j += 4) {
+    __m256i delta = _mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*) &data[j])),
+        _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*) &data[j - window])));
+
+    // Prefix sum of the four lanes: shift by one lane, then by two
+    delta = _mm256_add_epi64(delta, _mm256_blend_epi32(_mm256_permute4x64_epi64(delta, 0x90), zero, 0x03));
+    delta = _mm256_add_epi64(delta, _mm256_blend_epi32(_mm256_permute4x64_epi64(delta, 0x40), zero, 0x0F));
+    carry = _mm256_add_epi64(carry, delta);
+    vmax = _mm256_blendv_epi8(vmax, carry, _mm256_cmpgt_epi64(carry, vmax));
+    carry = _mm256_permute4x64_epi64(carry, 0xFF);
+  }
+  _mm256_storeu_si256((__m256i*) lanes, vmax);
+  max = lanes[0];
+  for (int k = 1; k < 4; k++) {
+    max = lanes[k] > max ? lanes[k] : max;
+  }
+  _mm256_storeu_si256((__m256i*) lanes, carry);
+
+  for (windowSum = lanes[0]; j < to; j++) {
+    windowSum += (int64_t) data[j] - data[j - window];
+    max = windowSum > max ? windowSum : max;
+  }
+
+  return max;
+}
+
+//////////////////////
+////    AVX-512   ////
+//////////////////////
+
+__attribute__((target("avx512f")))
+int64_t kernelSumAvx512(const int* data, size_t n) {
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m512i v = _mm512_loadu_si512(&data[i]);
+
+    acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+    acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+  }
+
+  return _mm512_reduce_add_epi64(acc) + kernelSumScalar(&data[i], n - i);
+}
+
+__attribute__((target("avx512f")))
+void kernelMinMaxAvx512(const int* data, size_t n, int* min, int* max) {
+  __m512i vmin = _mm512_set1_epi32(*min);
+  __m512i vmax = _mm512_set1_epi32(*max);
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m512i v = _mm512_loadu_si512(&data[i]);
+
+    vmin = _mm512_min_epi32(vmin, v);
+    vmax = _mm512_max_epi32(vmax, v);
+  }
+  *min = _mm512_reduce_min_epi32(vmin);
+  *max = _mm512_reduce_max_epi32(vmax);
+  kernelMinMaxScalar(&data[i], n - i, min, max);
+}
+
+__attribute__((target("avx512f")))
+uint64_t kernelThresholdAvx512(const int* data, size_t n, int threshold, size_t* first) {
+  __m512i limit = _mm512_set1_epi32(threshold - 1);
+  uint64_t count = 0;
+  size_t i = 0;
+
+  if (threshold == INT32_MIN) {
+    *first = 0;
+    return n;
+  }
+
+  *first = n;
+  for (; i + 16 <= n; i += 16) {
+    __mmask16 mask = _mm512_cmpgt_epi32_mask(_mm512_loadu_si512(&data[i]), limit);
+
+    if (mask != 0) {
+      if (count == 0) {
+        *first = i + __builtin_ctz(mask);
+      }
+      count += __builtin_popcount(mask);
+    }
+  }
+
+  return kernelThresholdTail(data, i, n, threshold, count, first);
+}
+
+__attribute__((target("avx512f")))
+int64_t kernelWindowMaxAvx512(const int* data, size_t from, size_t to, size_t window) {
+  size_t j;
+  int64_t windowSum;
+  int64_t max;
+  __m512i zero = _mm512_setzero_si512();
+  __m512i last = _mm512_set1_epi64(7);
+  __m512i carry;
+  __m512i vmax;
+
+  if (!kernelWindowStart(data, from, to, window, kernelSumAvx512, &j, &windowSum)) {
+    return INT64_MIN;
+  }
+  carry = _mm512_set1_epi64(windowSum);
+  vmax = carry;
+  for (j++; j + 8 <= to; j += 8) {
+    __m512i delta = _mm512_sub_epi64(_mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i*) &data[j])),
+        _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i*) &data[j - window])));
+
+    // Prefix sum of the eight lanes: shift by one, two and four lanes
+    delta = _mm512_add_epi64(delta, _mm512_alignr_epi64(delta, zero, 7));
+    delta = _mm512_add_epi64(delta, _mm512_alignr_epi64(delta, zero, 6));
+    delta = _mm512_add_epi64(delta, _mm512_alignr_epi64(delta, zero, 4));
+    carry = _mm512_add_epi64(carry, delta);
+    vmax = _mm512_max_epi64(vmax, carry);
+    carry = _mm512_permutexvar_epi64(last, carry);
+  }
+  max = _mm512_reduce_max_epi64(vmax);
+
+  for (windowSum = _mm_cvtsi128_si64(_mm512_castsi512_si128(carry)); j < to; j++) {
+    windowSum += (int64_t) data[j] - data[j - window];
+    max = windowSum > max ? windowSum : max;
+  }
+
+  return max;
+}
+
+//////////////////////
+////   DISPATCH   ////
+//////////////////////
+
+// From the most portable to the fastest
+const struct kernelTable KERNEL_TABLES[] = {
+  {"scalar", NULL, kernelSumScalar, kernelMinMaxScalar, kernelHistogramScalar, kernelThresholdScalar,
+      kernelWindowMaxScalar},
+  {"sse4.2", "sse4.2", kernelSumSse, kernelMinMaxSse, kernelHistogramSse, kernelThresholdSse,
+      kernelWindowMaxScalar},
+  {"avx2", "avx2", kernelSumAvx2, kernelMinMaxAvx2, kernelHistogramAvx2, kernelThresholdAvx2,
+      kernelWindowMaxAvx2},
+  {"avx512", "avx512f", kernelSumAvx512, kernelMinMaxAvx512, kernelHistogramAvx2, kernelThresholdAvx512,
+      kernelWindowMaxAvx512}
+};
+const int NUM_KERNEL_TABLES = sizeof(KERNEL_TABLES) / sizeof(KERNEL_TABLES[0]);
+
+const struct kernelTable* kernels = &KERNEL_TABLES[0];
+
+// Whether the CPU (and the kernel, for the wider registers) supports a table
+bool kernelIsSupported(const struct kernelTable* table) {
+  __builtin_cpu_init();
+
+  if (table->feature == NULL) {
+    return true;
+  } else if (strcmp(table->feature, "sse4.2") == 0) {
+    return __builtin_cpu_supports("sse4.2");
+  } else if (strcmp(table->feature, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  } else if (strcmp(table->feature, "avx512f") == 0) {
+    return __builtin_cpu_supports("avx512f");
+  }
+
+  return false;
+}
+
+// Picks the fastest supported kernels, or those named by ORION_KERNELS if the
+// CPU supports them
+void kernelsSelect(char* caller, int fdlog_info) {
+  char logMessage[128];
+  char* name = getEnvString("ORION_KERNELS", NULL);
+
+  kernels = &KERNEL_TABLES[0];
+  for (int i = 0; i < NUM_KERNEL_TABLES; i++) {
+    if (!kernelIsSupported(&KERNEL_TABLES[i])) {
+      continue;
+    }
+    if (name == NULL) {
+      kernels = &KERNEL_TABLES[i];
+    } else if (strcmp(name, KERNEL_TABLES[i].name) == 0) {
+      kernels = &KERNEL_TABLES[i];
+      break;
+    }
+  }
+
+  if (name != NULL && strcmp(name, kernels->name) != 0) {
+    sprintf(logMessage, "[%s] ORION_KERNELS=%s is unknown or not supported, using %s kernels", caller, name,
+        kernels->name);
+  } else {
+    sprintf(logMessage, "[%s] Using %s kernels", caller, kernels->name);
+  }
+  writeInfoLog(fdlog_info, logMessage);
+}
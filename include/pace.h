@@ -0,0 +1,290 @@
+// Optional constant-rate streaming (ORION_PACE_RATE or ORION_PACE_MIBPS).
+// Must be included after common.h, stats.h and result.h, and before ring.h,
+// which timestamps its reads.
+//
+// Telemetry does not arrive as fast as possible: message k is due at
+// start + k/rate, where start is the transfer start in the control block. The
+// producer takes tokens from a bucket filled at the target rate, waiting for
+// ORION_PACE_BURST of them before each send, and always spends every token
+// available. The schedule never slips, so the rate over a run is exactly the
+// target and a producer that falls behind shows up as missed deadlines. Waits
+// use clock_nanosleep(TIMER_ABSTIME) on CLOCK_MONOTONIC and busy-wait for the
+// last ORION_PACE_SPIN_US, which is all that is left at high rates.
+//
+// Both processes share CLOCK_MONOTONIC, so the consumer timestamps every read
+// and gets the one-way latency of each message from the same schedule. Latency
+// goes to a log-linear histogram (buckets within 1/16 of their value), jitter
+// is the RFC 3550 interarrival jitter, and a message later than
+// ORION_PACE_DEADLINE_US missed its deadline.
+
+#define PACE_SUB_BUCKETS 16 // histogram buckets per power of two
+#define PACE_NUM_BUCKETS (64 * PACE_SUB_BUCKETS)
+
+const int PACE_DEFAULT_DEADLINE_US = 1000;
+const int PACE_DEFAULT_SPIN_US = 50; // longer than a typical timer wake-up delay
+
+// Sending side
+struct paceSender {
+  uint64_t numSends;
+  uint64_t numLate; // messages sent after their deadline
+  uint64_t numSleeps;
+  uint64_t wait_ns;
+};
+
+// Receiving side
+struct paceReceiver {
+  uint64_t histogram[PACE_NUM_BUCKETS];
+  uint64_t numMessages;
+  uint64_t numMissed;
+  uint64_t max_ns;
+  int64_t lastLatency_ns;
+  double jitter_ns;
+};
+
+double paceRate = 0; // messages per second, 0 when not paced
+double pacePeriod_ns;
+uint64_t paceBurst;
+uint64_t paceDeadline_ns;
+uint64_t paceSpin_ns;
+// Transfer start in the control block, written by the producer
+uint64_t* paceStart_ns;
+struct paceSender paceSent;
+struct paceReceiver paceReceived;
+
+// Whether transfers are paced
+bool paceIsEnabled() {
+  return paceRate > 0;
+}
+
+// Reads the pacing options. start_ns points to the transfer start the schedule
+// is counted from; messagesPerMiB converts ORION_PACE_MIBPS.
+void paceOpen(uint64_t* start_ns, int messagesPerMiB, char* caller, int fdlog_info) {
+  char logMessage[192];
+
+  paceRate = getEnvInt("ORION_PACE_RATE", 0);
+  if (paceRate <= 0) {
+    paceRate = (double) getEnvInt("ORION_PACE_MIBPS", 0) * messagesPerMiB;
+  }
+  if (paceRate <= 0) {
+    paceRate = 0;
+    return;
+  }
+
+  pacePeriod_ns = 1.0e9 / paceRate;
+  paceBurst = getEnvInt("ORION_PACE_BURST", 1) > 1 ? getEnvInt("ORION_PACE_BURST", 1) : 1;
+  paceDeadline_ns = (uint64_t) getEnvInt("ORION_PACE_DEADLINE_US", PACE_DEFAULT_DEADLINE_US) * 1000;
+  paceSpin_ns = (uint64_t) getEnvInt("ORION_PACE_SPIN_US", PACE_DEFAULT_SPIN_US) * 1000;
+  paceStart_ns = start_ns;
+  memset(&paceSent, 0, sizeof(paceSent));
+  memset(&paceReceived, 0, sizeof(paceReceived));
+  paceReceived.lastLatency_ns = -1;
+
+  sprintf(logMessage, "[%s] Paced at %.0f messages/s, bursts of %lu, deadline %lu us", caller,
+      paceRate, (unsigned long) paceBurst, (unsigned long) (paceDeadline_ns / 1000));
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+// Turns pacing off for a transfer mode that does not support it
+void paceDisable(char* caller, int fdlog_info) {
+  char logMessage[128];
+
+  if (paceRate > 0) {
+    sprintf(logMessage, "[%s] Pacing is not supported by this transfer mode, sending at full speed", caller);
+    writeInfoLog(fdlog_info, logMessage);
+    paceRate = 0;
+  }
+}
+
+// Time message index is due
+uint64_t paceDue(uint64_t start_ns, uint64_t index) {
+  return start_ns + (uint64_t) (index * pacePeriod_ns);
+}
+
+// Messages due by time now_ns
+uint64_t paceNumDue(uint64_t start_ns, uint64_t now_ns) {
+  if (now_ns < start_ns) {
+    return 0;
+  }
+  return (uint64_t) ((now_ns - start_ns) / pacePeriod_ns) + 1;
+}
+
+// Sleeps until shortly before target_ns, then spins until it
+void paceWaitUntil(uint64_t target_ns) {
+  uint64_t now_ns = getMonotonicTimeNS();
+  struct timespec wake;
+
+  if (now_ns >= target_ns) {
+    return;
+  }
+
+  if (target_ns - now_ns > paceSpin_ns) {
+    wake.tv_sec = (target_ns - paceSpin_ns) / 1000000000ULL;
+    wake.tv_nsec = (target_ns - paceSpin_ns) % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+    }
+    paceSent.numSleeps++;
+    statsSyscalls(1);
+  }
+  while (getMonotonicTimeNS() < target_ns) {
+  }
+
+  paceSent.wait_ns += getMonotonicTimeNS() - now_ns;
+}
+
+// Producer side: waits until messages from index on may be sent and returns
+// how many, between 1 and maxMessages. Returns maxMessages when not paced.
+size_t paceNext(uint64_t index, size_t maxMessages) {
+  uint64_t start_ns;
+  uint64_t now_ns;
+  uint64_t numDue;
+  uint64_t numLate;
+  size_t numMessages;
+
+  if (paceRate <= 0 || maxMessages == 0) {
+    return maxMessages;
+  }
+
+  // Wait for a full bucket, or for the last messages of the transfer
+  start_ns = __atomic_load_n(paceStart_ns, __ATOMIC_RELAXED);
+  paceWaitUntil(paceDue(start_ns, index + (maxMessages < paceBurst ? maxMessages : paceBurst) - 1));
+
+  // Spend every token in the bucket
+  now_ns = getMonotonicTimeNS();
+  numDue = paceNumDue(start_ns, now_ns);
+  numMessages = numDue - index < maxMessages ? numDue - index : maxMessages;
+
+  // Messages whose deadline passed before they could leave
+  numLate = now_ns > paceDeadline_ns ? paceNumDue(start_ns, now_ns - paceDeadline_ns) : 0;
+  if (numLate > index) {
+    paceSent.numLate += numLate - index < numMessages ? numLate - index : numMessages;
+  }
+  paceSent.numSends++;
+
+  return numMessages;
+}
+
+// Histogram bucket of a latency
+int paceBucket(uint64_t value_ns) {
+  int exponent;
+
+  if (value_ns < PACE_SUB_BUCKETS) {
+    return value_ns;
+  }
+  exponent = 63 - __builtin_clzll(value_ns); // at least 4
+  return (exponent - 3) * PACE_SUB_BUCKETS + ((value_ns >> (exponent - 4)) & (PACE_SUB_BUCKETS - 1));
+}
+
+// Highest latency falling in a bucket
+uint64_t paceBucketValue(int bucket) {
+  int exponent;
+
+  if (bucket < PACE_SUB_BUCKETS) {
+    return bucket;
+  }
+  exponent = bucket / PACE_SUB_BUCKETS + 3;
+  return ((uint64_t) (PACE_SUB_BUCKETS + bucket % PACE_SUB_BUCKETS + 1) << (exponent - 4)) - 1;
+}
+
+// Consumer side: records the arrival, now, of numMessages messages from index on
+void paceArrived(uint64_t index, size_t numMessages) {
+  uint64_t start_ns;
+  uint64_t now_ns;
+  int64_t latency_ns;
+
+  if (paceRate <= 0) {
+    return;
+  }
+
+  // Data can only arrive after the producer recorded the start
+  now_ns = getMonotonicTimeNS();
+  start_ns = __atomic_load_n(paceStart_ns, __ATOMIC_RELAXED);
+  for (size_t i = 0; i < numMessages; i++) {
+    latency_ns = (int64_t) (now_ns - paceDue(start_ns, index + i));
+    if (latency_ns < 0) {
+      latency_ns = 0;
+    }
+
+    paceReceived.histogram[paceBucket(latency_ns)]++;
+    paceReceived.numMessages++;
+    if ((uint64_t) latency_ns > paceReceived.max_ns) {
+      paceReceived.max_ns = latency_ns;
+    }
+    if ((uint64_t) latency_ns > paceDeadline_ns) {
+      paceReceived.numMissed++;
+    }
+
+    // RFC 3550: J += (|D(i-1, i)| - J) / 16, D being the change in transit time
+    if (paceReceived.lastLatency_ns >= 0) {
+      paceReceived.jitter_ns += (llabs(latency_ns - paceReceived.lastLatency_ns) - paceReceived.jitter_ns) / 16;
+    }
+    paceReceived.lastLatency_ns = latency_ns;
+  }
+}
+
+// Latency under which a fraction of the messages arrived, in microseconds
+double pacePercentile(double fraction) {
+  uint64_t rank = (uint64_t) ceil(fraction * paceReceived.numMessages);
+  uint64_t count = 0;
+  uint64_t value_ns;
+
+  for (int i = 0; i < PACE_NUM_BUCKETS; i++) {
+    count += paceReceived.histogram[i];
+    if (count >= rank && count > 0) {
+      value_ns = paceBucketValue(i);
+      return (value_ns < paceReceived.max_ns ? value_ns : paceReceived.max_ns) / 1000.0;
+    }
+  }
+
+  return paceReceived.max_ns / 1000.0;
+}
+
+// Summarises what was received, zeroed when not paced
+void paceSummarize(struct latencySummary* summary) {
+  memset(summary, 0, sizeof(*summary));
+  if (paceRate <= 0) {
+    return;
+  }
+
+  summary->rate = paceRate;
+  summary->numMessages = paceReceived.numMessages;
+  summary->numMissed = paceReceived.numMissed;
+  summary->p50_us = pacePercentile(0.50);
+  summary->p90_us = pacePercentile(0.90);
+  summary->p99_us = pacePercentile(0.99);
+  summary->p999_us = pacePercentile(0.999);
+  summary->max_us = paceReceived.max_ns / 1000.0;
+  summary->jitter_us = paceReceived.jitter_ns / 1000.0;
+}
+
+// Logs how closely the producer kept to the schedule
+void paceLogSender(uint64_t numMessages, uint64_t transfer_ns, int fdlog_info) {
+  char logMessage[256];
+
+  if (paceRate <= 0) {
+    return;
+  }
+
+  sprintf(logMessage, "[Producer] Paced %lu messages in %lu sends at %.0f messages/s (target %.0f), "
+      "%lu late by more than %lu us, %lu sleeps, %.3f ms waiting",
+      (unsigned long) numMessages, (unsigned long) paceSent.numSends,
+      transfer_ns > 0 ? numMessages * 1.0e9 / transfer_ns : 0, paceRate,
+      (unsigned long) paceSent.numLate, (unsigned long) (paceDeadline_ns / 1000),
+      (unsigned long) paceSent.numSleeps, paceSent.wait_ns / 1.0e6);
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+// Logs the latency of what was received
+void paceLogReceiver(char* caller, struct latencySummary* summary, int fdlog_info) {
+  char logMessage[320];
+
+  if (summary->rate <= 0) {
+    return;
+  }
+
+  sprintf(logMessage, "[%s] Latency at %.0f messages/s: p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+      "p99.9 %.1f us, max %.1f us, jitter %.2f us, %lu of %lu messages missed the deadline",
+      caller, summary->rate, summary->p50_us, summary->p90_us, summary->p99_us, summary->p999_us,
+      summary->max_us, summary->jitter_us, (unsigned long) summary->numMissed,
+      (unsigned long) summary->numMessages);
+  writeInfoLog(fdlog_info, logMessage);
+}
@@ -0,0 +1,174 @@
+// Optional performance counter instrumentation (ORION_PERF=1).
+// Must be included after common.h (uses its logging helpers) and before
+// control.h, which samples the counters at every phase boundary.
+//
+// Counters are opened with perf_event_open() on this process and every thread
+// it creates afterwards, and are read at the start and end of each phase.
+// Hardware counters are often missing in virtual machines and containers: any
+// counter that cannot be opened is reported as unavailable and the others are
+// still collected. getrusage() adds voluntary and involuntary context switches.
+
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+enum perfCounter {
+  PERF_TASK_CLOCK = 0, // CPU time in ns, always available as a fallback for cycles
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_CONTEXT_SWITCHES,
+  PERF_PAGE_FAULTS,
+  NUM_PERF_COUNTERS
+};
+
+const char* PERF_COUNTER_NAMES[] = {"task-clock-ns", "cycles", "instructions", "cache-misses",
+    "branch-misses", "context-switches", "page-faults"};
+
+struct perfSample {
+  uint64_t counters[NUM_PERF_COUNTERS];
+  long voluntarySwitches;
+  long involuntarySwitches;
+};
+
+// Counter file descriptors, -1 when the counter is unavailable
+int perfFds[NUM_PERF_COUNTERS];
+bool isPerfEnabled = false;
+
+// Opens one counter, counting kernel time too when allowed
+int perfOpenCounter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.inherit = 1; // threads created later (striped streams) count too
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+    // perf_event_paranoid forbids kernel profiling: count user space only
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  return fd;
+}
+
+// Opens the counters if ORION_PERF is set
+void perfOpen(char* caller, int fdlog_info) {
+  char logMessage[256];
+  int length;
+  int numUnavailable;
+
+  for (int i = 0; i < NUM_PERF_COUNTERS; i++) {
+    perfFds[i] = -1;
+  }
+  if (getEnvInt("ORION_PERF", 0) == 0) {
+    return;
+  }
+
+  perfFds[PERF_TASK_CLOCK] = perfOpenCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  perfFds[PERF_CYCLES] = perfOpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  perfFds[PERF_INSTRUCTIONS] = perfOpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  perfFds[PERF_CACHE_MISSES] = perfOpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  perfFds[PERF_BRANCH_MISSES] = perfOpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  perfFds[PERF_CONTEXT_SWITCHES] = perfOpenCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+  perfFds[PERF_PAGE_FAULTS] = perfOpenCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+  isPerfEnabled = true;
+
+  numUnavailable = 0;
+  length = sprintf(logMessage, "[%s] Performance counters unavailable:", caller);
+  for (int i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (perfFds[i] < 0) {
+      length += sprintf(logMessage + length, " %s", PERF_COUNTER_NAMES[i]);
+      numUnavailable++;
+    }
+  }
+  if (numUnavailable > 0) {
+    writeInfoLog(fdlog_info, logMessage);
+  }
+}
+
+// Reads every counter, scaled up if the kernel had to multiplex them
+void perfRead(struct perfSample* sample) {
+  uint64_t values[3]; // value, time enabled, time running
+  struct rusage usage;
+
+  memset(sample, 0, sizeof(*sample));
+  if (!isPerfEnabled) {
+    return;
+  }
+
+  for (int i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (perfFds[i] >= 0 && read(perfFds[i], values, sizeof(values)) == sizeof(values)) {
+      if (values[2] > 0 && values[2] < values[1]) {
+        values[0] = (uint64_t) ((double) values[0] * values[1] / values[2]);
+      }
+      sample->counters[i] = values[0];
+    }
+  }
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    sample->voluntarySwitches = usage.ru_nvcsw;
+    sample->involuntarySwitches = usage.ru_nivcsw;
+  }
+}
+
+// Accumulates to - from into total
+void perfAccumulate(struct perfSample* total, struct perfSample* from, struct perfSample* to) {
+  for (int i = 0; i < NUM_PERF_COUNTERS; i++) {
+    total->counters[i] += to->counters[i] - from->counters[i];
+  }
+  total->voluntarySwitches += to->voluntarySwitches - from->voluntarySwitches;
+  total->involuntarySwitches += to->involuntarySwitches - from->involuntarySwitches;
+}
+
+// Logs the counters collected during one phase
+void perfLogPhase(char* caller, const char* phase, struct perfSample* sample, int fdlog_info) {
+  char logMessage[512];
+  int length;
+
+  length = sprintf(logMessage, "[%s] Counters %s:", caller, phase);
+  for (int i = 0; i < NUM_PERF_COUNTERS; i++) {
+    if (perfFds[i] >= 0) {
+      length += sprintf(logMessage + length, " %s %lu", PERF_COUNTER_NAMES[i],
+          (unsigned long) sample->counters[i]);
+    }
+  }
+  if (perfFds[PERF_CYCLES] >= 0 && perfFds[PERF_INSTRUCTIONS] >= 0 && sample->counters[PERF_CYCLES] > 0) {
+    length += sprintf(logMessage + length, " IPC %.2f",
+        (double) sample->counters[PERF_INSTRUCTIONS] / sample->counters[PERF_CYCLES]);
+  }
+  sprintf(logMessage + length, " voluntary-switches %ld involuntary-switches %ld",
+      sample->voluntarySwitches, sample->involuntarySwitches);
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+// Logs the cost of moving one byte over a transport during the transfer phase:
+// cycles (or CPU nanoseconds without hardware counters) and syscalls per byte
+void perfLogTransferCost(char* caller, const char* transport, struct perfSample* transfer,
+    uint64_t bytes, uint64_t syscalls, int fdlog_info) {
+  char logMessage[256];
+  int length;
+
+  if (!isPerfEnabled || bytes == 0) {
+    return;
+  }
+
+  length = sprintf(logMessage, "[%s] Transfer cost over %s:", caller, transport);
+  if (perfFds[PERF_CYCLES] >= 0) {
+    length += sprintf(logMessage + length, " %.3f cycles/byte,",
+        (double) transfer->counters[PERF_CYCLES] / bytes);
+  } else {
+    length += sprintf(logMessage + length, " %.3f CPU ns/byte,",
+        (double) transfer->counters[PERF_TASK_CLOCK] / bytes);
+  }
+  sprintf(logMessage + length, " %.6f syscalls/byte (%lu syscalls for %lu bytes)",
+      (double) syscalls / bytes, (unsigned long) syscalls, (unsigned long) bytes);
+  writeInfoLog(fdlog_info, logMessage);
+}
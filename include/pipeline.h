@@ -0,0 +1,241 @@
+// Pipelined payload generation for the producer (ORION_PIPELINE_THREADS).
+// Must be included after common.h, stats.h, trace.h, element.h and control.h.
+//
+// Instead of generating the whole payload before the first byte is sent, the
+// payload is split into chunks of ORION_PIPELINE_CHUNK_KIB. Generator threads
+// claim chunks in order and fill them; a checksum thread sums each chunk, in
+// order, as soon as it is complete and publishes how many messages are ready.
+// The sender only waits when it catches up with that count. Generation thus
+// overlaps link setup and the transfer itself, and the payload checksum is
+// ready with the last chunk instead of costing a pass at the end. Every chunk
+// has its own random seed, so the payload does not depend on which thread
+// generated it.
+//
+// Chunks are windows of the payload array rather than buffers recycled
+// through a free list: every transport sends straight from the payload, and
+// the socket servers send it to several consumers at different speeds.
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+const int PIPELINE_DEFAULT_CHUNK_KIB = 256;
+
+struct pipeline {
+  int* messages;
+  size_t numMessages;
+  size_t chunkMessages;
+  uint32_t numChunks;
+  uint32_t nextChunk; // next chunk a generator claims
+  uint32_t* isGenerated; // per chunk, futex words
+  uint32_t numChunksReady; // futex word: chunks generated and checksummed, in order
+  uint64_t checksum; // of the chunks ready so far, written by the checksum thread
+  unsigned int seed;
+  int numThreads;
+  pthread_t* generators;
+  pthread_t checksummer;
+  bool isJoined;
+  uint64_t start_ns; // generation start
+  uint64_t firstByte_ns; // first data handed to the transport
+  uint64_t numSenderWaits;
+  uint64_t senderWait_ns;
+};
+
+struct pipeline pipeline;
+bool isPipelined = false;
+
+// Sleeps while *word is still seen
+void pipelineSleep(uint32_t* word, uint32_t seen) {
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+}
+
+// Wakes every thread sleeping on word
+void pipelineWake(uint32_t* word) {
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+}
+
+// Last message of a chunk, excluded
+size_t pipelineChunkEnd(uint32_t chunk) {
+  size_t end = (size_t) (chunk + 1) * pipeline.chunkMessages;
+
+  return end < pipeline.numMessages ? end : pipeline.numMessages;
+}
+
+// Fills chunks until none is left
+void* pipelineGenerator(void* arg) {
+  uint64_t start_ns = traceBegin();
+  uint32_t chunk;
+  uint32_t state;
+
+  (void) arg; // the pipeline is global
+  while ((chunk = __atomic_fetch_add(&pipeline.nextChunk, 1, __ATOMIC_RELAXED)) < pipeline.numChunks) {
+    // xorshift32, seeded per chunk
+    state = (pipeline.seed + chunk) * 2654435761u;
+    if (state == 0) {
+      state = 1;
+    }
+    elementType->generate(pipeline.messages, elementAt((size_t) chunk * pipeline.chunkMessages),
+        elementAt(pipelineChunkEnd(chunk)), &state);
+
+    __atomic_store_n(&pipeline.isGenerated[chunk], 1, __ATOMIC_RELEASE);
+    pipelineWake(&pipeline.isGenerated[chunk]);
+  }
+  traceEnd("generate", "generate", start_ns);
+
+  return NULL;
+}
+
+// Sums chunks in order as they are generated, and hands them to the sender
+void* pipelineChecksummer(void* arg) {
+  uint64_t start_ns = traceBegin();
+
+  (void) arg;
+  for (uint32_t chunk = 0; chunk < pipeline.numChunks; chunk++) {
+    while (__atomic_load_n(&pipeline.isGenerated[chunk], __ATOMIC_ACQUIRE) == 0) {
+      pipelineSleep(&pipeline.isGenerated[chunk], 0);
+    }
+    pipeline.checksum += checksumMessages(pipeline.messages, (size_t) chunk * pipeline.chunkMessages,
+        pipelineChunkEnd(chunk));
+
+    __atomic_store_n(&pipeline.numChunksReady, chunk + 1, __ATOMIC_RELEASE);
+    pipelineWake(&pipeline.numChunksReady);
+  }
+  traceEnd("checksum", "generate", start_ns);
+
+  return NULL;
+}
+
+// Starts generating numMessages messages into messages. Returns false, leaving
+// generation to the caller, if ORION_PIPELINE_THREADS is 0.
+bool pipelineStart(int messages[], size_t numMessages, int fdlog_info, int fdlog_err) {
+  char logMessage[160];
+  long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  memset(&pipeline, 0, sizeof(pipeline));
+  pipeline.start_ns = getMonotonicTimeNS();
+
+  // One generator per CPU left over by the sender, by default
+  pipeline.numThreads = getEnvInt("ORION_PIPELINE_THREADS", numCpus > 2 ? numCpus - 1 : 1);
+  if (pipeline.numThreads <= 0 || numMessages == 0) {
+    return false;
+  }
+
+  pipeline.messages = messages;
+  pipeline.numMessages = numMessages;
+  pipeline.chunkMessages = (size_t) getEnvInt("ORION_PIPELINE_CHUNK_KIB", PIPELINE_DEFAULT_CHUNK_KIB) * 1024
+      / sizeof(int);
+  if (pipeline.chunkMessages < 2) {
+    pipeline.chunkMessages = 2; // whole 8-byte samples
+  }
+  pipeline.numChunks = (numMessages + pipeline.chunkMessages - 1) / pipeline.chunkMessages;
+  pipeline.isGenerated = calloc(pipeline.numChunks, sizeof(uint32_t));
+  pipeline.generators = malloc(pipeline.numThreads * sizeof(pthread_t));
+  pipeline.seed = time(NULL);
+
+  sprintf(logMessage, "[Producer] Generating %u chunks of %zu messages on %d threads while sending",
+      pipeline.numChunks, pipeline.chunkMessages, pipeline.numThreads);
+  writeInfoLog(fdlog_info, logMessage);
+
+  isPipelined = true;
+  for (int i = 0; i < pipeline.numThreads; i++) {
+    threadCreate(&pipeline.generators[i], pipelineGenerator, NULL, fdlog_err);
+  }
+  threadCreate(&pipeline.checksummer, pipelineChecksummer, NULL, fdlog_err);
+
+  return true;
+}
+
+// Waits until the first end messages can be sent
+void pipelineWaitFor(size_t end) {
+  uint32_t numNeeded;
+  uint32_t numReady;
+  uint64_t waitStart_ns;
+
+  if (isPipelined && end > 0) {
+    numNeeded = (end + pipeline.chunkMessages - 1) / pipeline.chunkMessages;
+    numReady = __atomic_load_n(&pipeline.numChunksReady, __ATOMIC_ACQUIRE);
+    if (numReady < numNeeded) {
+      waitStart_ns = getMonotonicTimeNS();
+      while (numReady < numNeeded) {
+        pipelineSleep(&pipeline.numChunksReady, numReady);
+        numReady = __atomic_load_n(&pipeline.numChunksReady, __ATOMIC_ACQUIRE);
+      }
+      pipeline.numSenderWaits++;
+      pipeline.senderWait_ns += getMonotonicTimeNS() - waitStart_ns;
+      statsStall(false, getMonotonicTimeNS() - waitStart_ns);
+    }
+  }
+
+  if (pipeline.firstByte_ns == 0) {
+    pipeline.firstByte_ns = getMonotonicTimeNS();
+    traceSpan("time to first byte", "session", pipeline.start_ns, pipeline.firstByte_ns, -1);
+  }
+}
+
+// Waits until message index can be sent and returns how many messages from
+// index on can be, at most maxMessages
+size_t pipelineReady(size_t index, size_t maxMessages) {
+  size_t end;
+
+  pipelineWaitFor(index + 1);
+  if (!isPipelined) {
+    return maxMessages;
+  }
+
+  end = (size_t) __atomic_load_n(&pipeline.numChunksReady, __ATOMIC_ACQUIRE) * pipeline.chunkMessages;
+  if (end > pipeline.numMessages) {
+    end = pipeline.numMessages;
+  }
+
+  return end - index < maxMessages ? end - index : maxMessages;
+}
+
+// Waits for the generator and checksum threads to exit
+void pipelineJoin(int fdlog_err) {
+  if (!isPipelined || pipeline.isJoined) {
+    return;
+  }
+
+  for (int i = 0; i < pipeline.numThreads; i++) {
+    threadJoin(pipeline.generators[i], fdlog_err);
+  }
+  threadJoin(pipeline.checksummer, fdlog_err);
+  pipeline.isJoined = true;
+}
+
+// Checksum of the first numMessages messages, without another pass over them
+// when the whole payload was sent
+uint64_t pipelineChecksum(int messages[], size_t numMessages, int fdlog_err) {
+  if (isPipelined && numMessages == pipeline.numMessages) {
+    pipelineJoin(fdlog_err);
+    return pipeline.checksum;
+  }
+
+  pipelineWaitFor(numMessages);
+  return checksumMessages(messages, 0, numMessages);
+}
+
+// Joins the threads, if still running, and logs the time to first byte and
+// how often the sender caught up with generation
+void pipelineFinish(int fdlog_info, int fdlog_err) {
+  char logMessage[200];
+
+  pipelineJoin(fdlog_err);
+  if (isPipelined) {
+    free(pipeline.isGenerated);
+    free(pipeline.generators);
+  }
+  if (pipeline.firstByte_ns == 0) {
+    return;
+  }
+
+  if (isPipelined) {
+    sprintf(logMessage, "[Producer] Time to first byte: %.3f ms after generation started, "
+        "sender waited for generation %lu times (%.3f ms)",
+        (pipeline.firstByte_ns - pipeline.start_ns) / 1.0e6, (unsigned long) pipeline.numSenderWaits,
+        pipeline.senderWait_ns / 1.0e6);
+  } else {
+    sprintf(logMessage, "[Producer] Time to first byte: %.3f ms after generation started",
+        (pipeline.firstByte_ns - pipeline.start_ns) / 1.0e6);
+  }
+  writeInfoLog(fdlog_info, logMessage);
+}
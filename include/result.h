@@ -0,0 +1,142 @@
+// Result channel from consumers to the master.
+// Must be included after common.h (uses its logging helpers).
+//
+// The master creates a pipe for every transmission and passes its write end
+// to the processes it spawns in ORION_RESULT_FD. Each consumer writes one
+// fixed-size record to it when its transfer is over. Records are much smaller
+// than PIPE_BUF, so records written by several consumers never interleave, and
+// the master reads them once its children have exited.
+
+// Latency of one paced transfer (ORION_PACE_RATE), or of the records of an
+// unpaced journal transfer, as seen by its consumer
+struct latencySummary {
+  double rate; // messages per second, 0 when not paced
+  uint64_t numMessages;
+  uint64_t numMissed;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double p999_us;
+  double max_us;
+  double jitter_us;
+};
+
+// What arrived of a datagram transfer (IPC choice 7), as seen by its consumer
+struct lossSummary {
+  uint64_t numDatagrams; // sent, 0 for the other transports
+  uint64_t numReceived;
+  uint64_t numLost;
+  uint64_t numReordered;
+  uint64_t numDuplicates;
+  uint64_t numCorrupt;
+  double goodput_mibps; // payload received once, per second of transfer
+};
+
+// Sizes the producer tuned at runtime (ORION_ADAPT), in bytes, 0 when not tuned
+struct adaptSummary {
+  int32_t chunk_B; // socket writes
+  int32_t window_B; // socket send buffer, or ring window
+  int32_t batch_B; // ring writes
+  int32_t numEpochs;
+  int32_t isConverged; // every size settled
+};
+
+struct transferResult {
+  int32_t pid;
+  int32_t transport; // IPC choice, as passed on the command line
+  int32_t sizeDataMiB;
+  int32_t isVerified; // bytes and checksum matched what the producer sent, or every datagram that arrived was intact
+  double transfer_s;
+  double setup_ms; // time to establish the link, -1 if not measured
+  double session_s; // set by the master: spawn of the producer to exit of the last process
+  double analytics_s; // transfer start to the end of processing (ORION_ANALYTICS), 0 otherwise
+  struct latencySummary latency; // paced transfers, and unpaced journal records (rate 0)
+  struct lossSummary loss; // datagram transfers
+  struct adaptSummary adapt; // socket and ring transfers with ORION_ADAPT
+};
+
+// Writes a one-line description of the sizes tuned at runtime into buf (at
+// least 192 bytes), an empty string if none were
+void resultDescribeAdapt(struct adaptSummary* adapt, char* buf) {
+  int length = 0;
+
+  buf[0] = '\0';
+  if (adapt->chunk_B > 0) {
+    length += sprintf(buf + length, "write chunk %d B, ", adapt->chunk_B);
+  }
+  if (adapt->window_B > 0) {
+    length += sprintf(buf + length, "window %d B, ", adapt->window_B);
+  }
+  if (adapt->batch_B > 0) {
+    length += sprintf(buf + length, "batch %d B, ", adapt->batch_B);
+  }
+  if (length > 0 && adapt->numEpochs > 0) {
+    sprintf(buf + length, "%s after %d epochs", adapt->isConverged ? "settled" : "still tuning", adapt->numEpochs);
+  } else if (length > 0) {
+    sprintf(buf + length, "over before the first epoch");
+  }
+}
+
+// Write end of the result channel, -1 when the consumer was not started by
+// the master
+int resultChannel() {
+  return getEnvInt("ORION_RESULT_FD", -1);
+}
+
+// Sends this consumer's result to the master. Returns false if there is no
+// result channel.
+bool resultSend(struct transferResult* result, int fdlog_err) {
+  int fd = resultChannel();
+
+  if (fd < 0) {
+    return false;
+  }
+
+  if (write(fd, result, sizeof(struct transferResult)) != sizeof(struct transferResult)) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("result.h resultSend write");
+    writeErrorLog(fdlog_err, "result.h: resultSend write failed", errno);
+    exit(-1);
+  }
+  close(fd);
+
+  return true;
+}
+
+// Creates the result channel for the next transmission: fds[0] is kept by
+// the master, fds[1] is inherited by the children and named in ORION_RESULT_FD
+void resultChannelOpen(int fds[2]) {
+  char fd_str[16];
+
+  if (pipe2(fds, O_CLOEXEC) < 0 || fcntl(fds[1], F_SETFD, 0) < 0) {
+    perror("ERROR in resultChannelOpen pipe");
+    exit(-1);
+  }
+
+  sprintf(fd_str, "%d", fds[1]);
+  setenv("ORION_RESULT_FD", fd_str, 1);
+}
+
+// Reads the results sent by the consumers, once every child holding the
+// write end has exited. The master's own write end must be closed first.
+// Returns the number of results read.
+int resultCollect(int fd, struct transferResult results[], int maxResults) {
+  int numResults = 0;
+  ssize_t numRead;
+
+  while (numResults < maxResults) {
+    numRead = read(fd, &results[numResults], sizeof(struct transferResult));
+    if (numRead < 0 && errno == EINTR) {
+      continue;
+    }
+    if (numRead != sizeof(struct transferResult)) {
+      break; // end of file: every writer has exited
+    }
+    numResults++;
+  }
+  close(fd);
+  unsetenv("ORION_RESULT_FD");
+
+  return numResults;
+}
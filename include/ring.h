@@ -0,0 +1,508 @@
+// Single-producer single-consumer ring of messages, shared by two processes
+// (through shared memory) or by two threads of one process.
+// Must be included after common.h, stats.h, trace.h, pace.h, analytics.h and
+// datafile.h.
+//
+// The producer only ever writes head and the consumer only ever writes tail,
+// so neither side takes a lock: it copies as many messages as there are room
+// for (or as are waiting), then publishes its new position with one release
+// store. A side only sleeps when the ring is full (producer) or empty
+// (consumer), on a futex on its peer's position, and a side only makes the
+// wake-up syscall when its peer announced it is sleeping. Positions are
+// free-running 32-bit counters and the capacity is a power of two, so they
+// wrap around correctly. The producer fills at most window messages of the
+// ring, all of it unless the adaptive controller (ORION_ADAPT) narrows it.
+//
+// The consumer can instead be woken up through an eventfd doorbell
+// (ORION_RING_NOTIFY=eventfd), so that it can wait for the ring in the same
+// epoll set as sockets or timers. The producer only rings it when data arrives
+// in a ring the consumer found empty, and rings add up in the eventfd counter,
+// so a burst costs the consumer one wake-up however many messages it holds.
+// Threads share the doorbell directly; a consumer process receives it from the
+// producer over an abstract unix socket (SCM_RIGHTS).
+//
+// Reads of paced transfers (ORION_PACE_RATE) are timestamped for the latency
+// statistics, and what is read is handed to the analytics workers
+// (ORION_ANALYTICS).
+//
+// The ring outlives a consumer process that dies, so another one can take over
+// from where it stopped: a consumer can copy messages out (ringPeek), record
+// how far it got, and only then give their room back (ringRelease).
+
+#include <linux/futex.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+enum ringNotify {
+  RING_NOTIFY_FUTEX = 0,
+  RING_NOTIFY_EVENTFD
+};
+
+struct ringBuffer {
+  uint32_t ready; // futex word, 1 once the producer has initialised the ring
+  uint32_t capacity; // in messages, a power of two
+  uint32_t notify; // enum ringNotify, how the consumer waits for data
+  // Producer's cache line
+  uint32_t head __attribute__((aligned(64))); // next message to write
+  uint32_t isProducerWaiting; // the producer sleeps on tail
+  uint32_t window; // messages the producer keeps in flight at most, up to capacity
+  uint32_t numFullStalls; // times the producer waited for room
+  // Consumer's cache line
+  uint32_t tail __attribute__((aligned(64))); // next message to read
+  uint32_t isConsumerWaiting; // the consumer sleeps on head
+  int32_t messages[] __attribute__((aligned(64)));
+};
+
+// Doorbell of this process (eventfd), -1 when the consumer waits on a futex
+int ringDoorbell = -1;
+
+// Largest power of two number of messages fitting in sizeBytes (at least 2)
+uint32_t ringCapacity(size_t sizeBytes) {
+  uint32_t capacity = 2;
+
+  while ((size_t) capacity * 2 * sizeof(int32_t) <= sizeBytes) {
+    capacity *= 2;
+  }
+
+  return capacity;
+}
+
+// Bytes needed for a ring of capacity messages
+size_t ringSize(uint32_t capacity) {
+  return sizeof(struct ringBuffer) + (size_t) capacity * sizeof(int32_t);
+}
+
+// Producer side: empties the ring and marks it ready for the consumer, who is
+// woken up through ringDoorbell if one was created
+void ringInit(struct ringBuffer* ring, uint32_t capacity) {
+  ring->capacity = capacity;
+  ring->notify = ringDoorbell >= 0 ? RING_NOTIFY_EVENTFD : RING_NOTIFY_FUTEX;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->isProducerWaiting = 0;
+  ring->window = capacity;
+  ring->numFullStalls = 0;
+  ring->isConsumerWaiting = 0;
+  __atomic_store_n(&ring->ready, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &ring->ready, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+// Consumer side: waits until the producer has initialised the ring
+void ringWaitReady(struct ringBuffer* ring) {
+  while (__atomic_load_n(&ring->ready, __ATOMIC_ACQUIRE) == 0) {
+    syscall(SYS_futex, &ring->ready, FUTEX_WAIT, 0, NULL, NULL, 0);
+  }
+}
+
+// Sleeps until *position moves away from seen, announcing it in *isWaiting.
+// Returns whether a syscall was needed.
+bool ringSleep(uint32_t* position, uint32_t* isWaiting, uint32_t seen) {
+  bool hasSlept = false;
+
+  // Sequentially consistent, like the peer's publish: either the peer sees
+  // the flag and wakes us up, or we see its new position and do not sleep
+  __atomic_store_n(isWaiting, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(position, __ATOMIC_SEQ_CST) == seen) {
+    syscall(SYS_futex, position, FUTEX_WAIT, seen, NULL, NULL, 0);
+    hasSlept = true;
+  }
+  __atomic_store_n(isWaiting, 0, __ATOMIC_RELAXED);
+
+  return hasSlept;
+}
+
+// Publishes a new position and wakes the peer if it sleeps on it. Returns
+// whether a syscall was needed.
+bool ringPublish(uint32_t* position, uint32_t* isPeerWaiting, uint32_t value) {
+  __atomic_store_n(position, value, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(isPeerWaiting, __ATOMIC_SEQ_CST)) {
+    syscall(SYS_futex, position, FUTEX_WAKE, 1, NULL, NULL, 0);
+    return true;
+  }
+
+  return false;
+}
+
+// Producer side: publishes a new head. The consumer, if it announced it is
+// waiting for data, is woken up through its futex or its doorbell.
+bool ringPublishHead(struct ringBuffer* ring, uint32_t head) {
+  uint64_t one = 1;
+
+  if (ring->notify == RING_NOTIFY_FUTEX) {
+    return ringPublish(&ring->head, &ring->isConsumerWaiting, head);
+  }
+
+  __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+  if (__atomic_exchange_n(&ring->isConsumerWaiting, 0, __ATOMIC_SEQ_CST)) {
+    // Cleared here so that further batches of the same burst do not ring again
+    if (write(ringDoorbell, &one, sizeof(one)) < 0) {
+      perror("ring.h ringPublishHead write");
+    }
+    return true;
+  }
+
+  return false;
+}
+
+// Producer side: copies numMessages messages into the ring, waiting for room
+// whenever it is full, that is when window messages are in flight. isCounted
+// reports the transfer in the live statistics.
+void ringWrite(struct ringBuffer* ring, int messages[], size_t numMessages, bool isCounted) {
+  uint32_t mask = ring->capacity - 1;
+  uint32_t head = ring->head;
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  size_t numSent = 0;
+  struct traceChunk chunk;
+
+  traceChunkStart(&chunk, "write");
+  while (numSent < numMessages) {
+    uint32_t numFree = head - tail < ring->window ? ring->window - (head - tail) : 0;
+
+    if (numFree == 0) {
+      // Full: wait for the consumer to move tail
+      uint64_t waitStart_ns = getMonotonicTimeNS();
+      bool hasSlept = ringSleep(&ring->tail, &ring->isProducerWaiting, tail);
+
+      ring->numFullStalls++;
+      if (isCounted) {
+        statsStall(true, getMonotonicTimeNS() - waitStart_ns);
+        statsSyscalls(hasSlept ? 1 : 0);
+      }
+      tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      continue;
+    }
+
+    uint32_t numBatch = numFree < numMessages - numSent ? numFree : numMessages - numSent;
+    uint32_t offset = head & mask;
+    // Copy in at most two pieces, around the end of the ring
+    uint32_t numFirst = numBatch < ring->capacity - offset ? numBatch : ring->capacity - offset;
+
+    memcpy(&ring->messages[offset], &messages[numSent], numFirst * sizeof(int32_t));
+    memcpy(&ring->messages[0], &messages[numSent + numFirst], (numBatch - numFirst) * sizeof(int32_t));
+    head += numBatch;
+    numSent += numBatch;
+
+    bool hasWoken = ringPublishHead(ring, head);
+    if (isCounted) {
+      statsTransfer(numBatch * sizeof(int32_t), numBatch, hasWoken ? 1 : 0);
+    }
+    traceChunkAdd(&chunk, numBatch * sizeof(int32_t));
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  }
+  traceChunkFinish(&chunk);
+}
+
+// Consumer side: copies up to maxMessages messages out of the ring without
+// waiting, and without giving their room back to the producer yet. Returns
+// how many were copied.
+size_t ringPeek(struct ringBuffer* ring, int messages[], size_t maxMessages) {
+  uint32_t mask = ring->capacity - 1;
+  uint32_t tail = ring->tail;
+  uint32_t numWaiting = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+  uint32_t numBatch = numWaiting < maxMessages ? numWaiting : maxMessages;
+  uint32_t offset = tail & mask;
+  uint32_t numFirst = numBatch < ring->capacity - offset ? numBatch : ring->capacity - offset;
+
+  memcpy(messages, &ring->messages[offset], numFirst * sizeof(int32_t));
+  memcpy(&messages[numFirst], &ring->messages[0], (numBatch - numFirst) * sizeof(int32_t));
+
+  return numBatch;
+}
+
+// Consumer side: gives the room of numMessages messages read with ringPeek
+// back to the producer. isCounted reports the transfer in the live statistics.
+void ringRelease(struct ringBuffer* ring, size_t numMessages, bool isCounted) {
+  bool hasWoken = ringPublish(&ring->tail, &ring->isProducerWaiting, ring->tail + numMessages);
+
+  if (isCounted) {
+    statsTransfer(numMessages * sizeof(int32_t), numMessages, hasWoken ? 1 : 0);
+  }
+}
+
+// Consumer side: copies up to maxMessages messages out of the ring without
+// waiting. Returns how many were read. isCounted reports the transfer in the
+// live statistics.
+size_t ringTryRead(struct ringBuffer* ring, int messages[], size_t maxMessages, bool isCounted) {
+  size_t numBatch = ringPeek(ring, messages, maxMessages);
+
+  if (numBatch > 0) {
+    ringRelease(ring, numBatch, isCounted);
+  }
+
+  return numBatch;
+}
+
+// Consumer side: takes over the ring from a consumer that died, which had
+// read (and checkpointed) the messages up to position. What it had peeked at
+// without releasing is skipped. Returns false if position is not in the ring.
+bool ringResume(struct ringBuffer* ring, uint32_t position) {
+  uint32_t tail = ring->tail;
+
+  __atomic_store_n(&ring->isConsumerWaiting, 0, __ATOMIC_RELAXED);
+  if (position - tail > __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail) {
+    return false;
+  }
+  if (position != tail) {
+    ringPublish(&ring->tail, &ring->isProducerWaiting, position);
+  }
+
+  return true;
+}
+
+// Consumer side: announces it is about to wait for data. Returns false, and
+// withdraws the announcement, if data arrived in the meantime.
+bool ringArm(struct ringBuffer* ring) {
+  __atomic_store_n(&ring->isConsumerWaiting, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != ring->tail) {
+    __atomic_store_n(&ring->isConsumerWaiting, 0, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  return true;
+}
+
+// Consumer side: clears a doorbell that rang. Every ring since the last one
+// is absorbed by a single read.
+void ringDoorbellDrain() {
+  uint64_t numRings;
+
+  if (read(ringDoorbell, &numRings, sizeof(numRings)) < 0 && errno != EAGAIN) {
+    perror("ring.h ringDoorbellDrain read");
+  }
+}
+
+// Consumer side: blocks until the ring holds data
+void ringWaitData(struct ringBuffer* ring, bool isCounted) {
+  uint64_t waitStart_ns = getMonotonicTimeNS();
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  bool hasSlept;
+
+  if (head != ring->tail) {
+    return;
+  }
+
+  if (ring->notify == RING_NOTIFY_FUTEX) {
+    hasSlept = ringSleep(&ring->head, &ring->isConsumerWaiting, head);
+  } else {
+    hasSlept = ringArm(ring);
+    if (hasSlept) {
+      ringDoorbellDrain();
+    }
+  }
+
+  if (isCounted) {
+    statsStall(false, getMonotonicTimeNS() - waitStart_ns);
+    statsSyscalls(hasSlept ? 1 : 0);
+  }
+}
+
+// Consumer side: copies numMessages messages out of the ring, waiting for
+// data whenever it is empty. isCounted reports the transfer in the live
+// statistics.
+void ringRead(struct ringBuffer* ring, int messages[], size_t numMessages, bool isCounted) {
+  size_t numReceived = 0;
+  size_t numBatch;
+  struct traceChunk chunk;
+
+  traceChunkStart(&chunk, "read");
+  while (numReceived < numMessages) {
+    numBatch = ringTryRead(ring, &messages[numReceived], numMessages - numReceived, isCounted);
+    if (numBatch == 0) {
+      ringWaitData(ring, isCounted);
+      continue;
+    }
+    paceArrived(numReceived, numBatch);
+    analyticsArrived(numReceived, numBatch);
+    sinkArrived(numReceived, numBatch);
+    numReceived += numBatch;
+    traceChunkAdd(&chunk, numBatch * sizeof(int32_t));
+  }
+  traceChunkFinish(&chunk);
+}
+
+// Consumer side: ringRead for a ring with a doorbell, sleeping in an epoll set
+// like an event loop serving several transports would. Returns the number of
+// wake-ups.
+uint64_t ringReadEpoll(struct ringBuffer* ring, int messages[], size_t numMessages, bool isCounted,
+    int fdlog_err) {
+  struct epoll_event event;
+  struct traceChunk chunk;
+  size_t numReceived = 0;
+  size_t numBatch;
+  uint64_t numWakeups = 0;
+  uint64_t waitStart_ns;
+  int epfd;
+
+  epfd = epollCreate(fdlog_err);
+  epollAdd(epfd, ringDoorbell, EPOLLIN, ring, fdlog_err);
+
+  traceChunkStart(&chunk, "read");
+  while (numReceived < numMessages) {
+    numBatch = ringTryRead(ring, &messages[numReceived], numMessages - numReceived, isCounted);
+    if (numBatch > 0) {
+      paceArrived(numReceived, numBatch);
+      analyticsArrived(numReceived, numBatch);
+      sinkArrived(numReceived, numBatch);
+      numReceived += numBatch;
+      traceChunkAdd(&chunk, numBatch * sizeof(int32_t));
+      continue;
+    }
+
+    // Empty: ask for the doorbell and sleep until it rings
+    if (ringArm(ring)) {
+      waitStart_ns = getMonotonicTimeNS();
+      epollWait(epfd, &event, 1, -1, fdlog_err);
+      ringDoorbellDrain();
+      if (isCounted) {
+        statsStall(false, getMonotonicTimeNS() - waitStart_ns);
+        statsSyscalls(2); // epoll_wait and read
+      }
+      numWakeups++;
+    }
+  }
+  traceChunkFinish(&chunk);
+  close(epfd);
+
+  return numWakeups;
+}
+
+// Consumer side: receives numMessages messages, the way the ring asks to be
+// waited on. Used by consumer processes and by the consumer thread of the
+// threads mode alike. caller names the side in the log.
+void ringReceive(struct ringBuffer* ring, int messages[], size_t numMessages, bool isCounted,
+    char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[128];
+  uint64_t numWakeups;
+
+  if (ring->notify != RING_NOTIFY_EVENTFD) {
+    ringRead(ring, messages, numMessages, isCounted);
+    return;
+  }
+
+  numWakeups = ringReadEpoll(ring, messages, numMessages, isCounted, fdlog_err);
+  sprintf(logMessage, "[%s] %lu doorbell wake-ups for %zu messages", caller, (unsigned long) numWakeups,
+      numMessages);
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+//// DOORBELL ////
+
+// Creates the doorbell of this process
+void ringDoorbellCreate(int fdlog_err) {
+  ringDoorbell = eventfd(0, EFD_CLOEXEC);
+  if (ringDoorbell < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("ring.h ringDoorbellCreate eventfd");
+    writeErrorLog(fdlog_err, "ring.h: ringDoorbellCreate eventfd failed", errno);
+    exit(-1);
+  }
+}
+
+// Abstract unix socket address the doorbell is handed over on, per session
+socklen_t ringDoorbellAddress(struct sockaddr_un* addr) {
+  char* session = getEnvString("ORION_SESSION", NULL);
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  // Abstract namespace: leading zero byte, nothing to unlink afterwards
+  snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "orion_doorbell_%s",
+      session != NULL ? session : "default");
+
+  return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr->sun_path + 1);
+}
+
+// Producer side: starts listening for the consumer that will ask for the
+// doorbell. Must happen before the ring is marked ready.
+int ringDoorbellListen(int fdlog_err) {
+  struct sockaddr_un addr;
+  socklen_t addrLength = ringDoorbellAddress(&addr);
+  int sockfd;
+
+  sockfd = socketCreate(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fdlog_err);
+  socketBind(sockfd, (struct sockaddr*) &addr, addrLength, fdlog_err);
+  socketListen(sockfd, 1, fdlog_err);
+
+  return sockfd;
+}
+
+// Producer side: hands the doorbell over to the consumer connecting to sockfd
+void ringDoorbellSend(int sockfd, int fdlog_err) {
+  struct msghdr message;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  char control[CMSG_SPACE(sizeof(int))];
+  char byte = 0;
+  int connfd;
+
+  connfd = socketAccept(sockfd, NULL, NULL, fdlog_err);
+
+  memset(&message, 0, sizeof(message));
+  memset(control, 0, sizeof(control));
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &ringDoorbell, sizeof(int));
+
+  if (sendmsg(connfd, &message, 0) < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("ring.h ringDoorbellSend sendmsg");
+    writeErrorLog(fdlog_err, "ring.h: ringDoorbellSend sendmsg failed", errno);
+    exit(-1);
+  }
+
+  socketClose(connfd, fdlog_err);
+  socketClose(sockfd, fdlog_err);
+}
+
+// Consumer side: receives the doorbell from the producer
+void ringDoorbellReceive(int fdlog_err) {
+  struct sockaddr_un addr;
+  socklen_t addrLength = ringDoorbellAddress(&addr);
+  struct msghdr message;
+  struct iovec iov;
+  struct cmsghdr* cmsg;
+  char control[CMSG_SPACE(sizeof(int))];
+  char byte;
+  int sockfd;
+
+  sockfd = socketCreate(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fdlog_err);
+  socketConnect(sockfd, (struct sockaddr*) &addr, addrLength, fdlog_err);
+
+  memset(&message, 0, sizeof(message));
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  if (recvmsg(sockfd, &message, MSG_CMSG_CLOEXEC) <= 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("ring.h ringDoorbellReceive recvmsg");
+    writeErrorLog(fdlog_err, "ring.h: ringDoorbellReceive recvmsg failed", errno);
+    exit(-1);
+  }
+
+  cmsg = CMSG_FIRSTHDR(&message);
+  if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+    printf("Error in ring.h ringDoorbellReceive: no doorbell received\n");
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "ring.h: ringDoorbellReceive got no file descriptor", 0);
+    exit(-1);
+  }
+  memcpy(&ringDoorbell, CMSG_DATA(cmsg), sizeof(int));
+
+  socketClose(sockfd, fdlog_err);
+}
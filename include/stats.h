@@ -0,0 +1,164 @@
+// Live transfer statistics in shared memory, read by orion-top.
+// Must be included after common.h (uses its logging and shared memory helpers)
+// and before uring.h, which reports its own batches.
+//
+// Every producer and consumer claims one slot of the /orion_stats page for the
+// lifetime of the process and bumps its counters as data moves. Counters only
+// ever grow and are updated with relaxed atomic adds, so publishing costs no
+// more than an uncontended add and never a syscall. Readers derive rates from
+// the difference between two samples.
+
+#include <signal.h>
+
+#define STATS_MAX_SLOTS 32
+#define STATS_SESSION_LENGTH 32
+
+const char* STATS_PATH = "/orion_stats";
+const uint32_t STATS_VERSION = 1;
+// Names of the IPC choices, as passed on the command line
+const char* TRANSPORT_NAMES[] = {"unnamed pipe", "named pipe", "socket", "shm ring", "threads", "mqueue",
+    "journal", "datagram"};
+const int NUM_TRANSPORT_NAMES = sizeof(TRANSPORT_NAMES) / sizeof(TRANSPORT_NAMES[0]);
+
+enum statsRole {
+  STATS_PRODUCER = 0,
+  STATS_CONSUMER
+};
+
+// One process. Aligned to a cache line so that neighbouring processes do not
+// share one.
+struct statsSlot {
+  int32_t pid; // owner, 0 when the slot is free
+  uint32_t role; // enum statsRole
+  int32_t transport; // IPC choice, as passed on the command line
+  uint32_t padding;
+  char session[STATS_SESSION_LENGTH];
+  uint64_t timeStart_ns; // CLOCK_MONOTONIC when the slot was claimed
+  uint64_t bytesTotal; // bytes this process expects to move
+  uint64_t bytes; // bytes moved so far
+  uint64_t messages; // read/write operations (or io_uring requests) that moved data
+  uint64_t syscalls; // syscalls issued to move data or wait for it
+  uint64_t ringFullStalls; // waits for room in a full buffer
+  uint64_t ringEmptyStalls; // waits for data in an empty buffer
+  uint64_t wait_ns; // time spent in those waits
+} __attribute__((aligned(64)));
+
+struct statsPage {
+  uint32_t version;
+  uint32_t numSlots;
+  struct statsSlot slots[STATS_MAX_SLOTS];
+};
+
+// Slot of this process, NULL if statistics are unavailable
+struct statsSlot* stats = NULL;
+
+// Name of an IPC choice, NULL if unknown
+const char* statsTransportName(int transport) {
+  if (transport < 0 || transport >= NUM_TRANSPORT_NAMES) {
+    return NULL;
+  }
+  return TRANSPORT_NAMES[transport];
+}
+
+// Frees the slot of this process (it may have been inherited through fork)
+void statsAtExit() {
+  if (stats != NULL && __atomic_load_n(&stats->pid, __ATOMIC_RELAXED) == getpid()) {
+    __atomic_store_n(&stats->pid, 0, __ATOMIC_RELEASE);
+  }
+}
+
+// Whether a slot is free, or owned by a process that no longer exists
+bool statsIsSlotFree(int32_t pid) {
+  return pid == 0 || (kill(pid, 0) == -1 && errno == ESRCH);
+}
+
+// Claims a slot in the stats page for this process. The page is created on
+// first use and never removed, so orion-top can be started at any time.
+// Statistics are simply disabled if every slot is taken.
+void statsOpen(enum statsRole role, int transport, uint64_t bytesTotal,
+    int fdlog_info, int fdlog_err) {
+  struct statsPage* page;
+  struct statsSlot* slot;
+  int32_t pid;
+
+  page = shmInit((char*) STATS_PATH, NULL, sizeof(struct statsPage), PROT_READ | PROT_WRITE,
+      MAP_SHARED, 0, fdlog_err);
+  __atomic_store_n(&page->version, STATS_VERSION, __ATOMIC_RELAXED);
+  __atomic_store_n(&page->numSlots, STATS_MAX_SLOTS, __ATOMIC_RELAXED);
+
+  for (int i = 0; i < STATS_MAX_SLOTS && stats == NULL; i++) {
+    slot = &page->slots[i];
+    pid = __atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE);
+    if (statsIsSlotFree(pid) &&
+        __atomic_compare_exchange_n(&slot->pid, &pid, getpid(), false,
+            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      stats = slot;
+    }
+  }
+
+  if (stats == NULL) {
+    writeInfoLog(fdlog_info, "[Stats] No free slot in the stats page, statistics disabled");
+    munmap(page, sizeof(struct statsPage));
+    return;
+  }
+
+  stats->role = role;
+  stats->transport = transport;
+  snprintf(stats->session, STATS_SESSION_LENGTH, "%s", getEnvString("ORION_SESSION", "default"));
+  __atomic_store_n(&stats->bytes, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats->messages, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats->syscalls, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats->ringFullStalls, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats->ringEmptyStalls, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats->wait_ns, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats->bytesTotal, bytesTotal, __ATOMIC_RELAXED);
+  __atomic_store_n(&stats->timeStart_ns, getMonotonicTimeNS(), __ATOMIC_RELEASE);
+  atexit(statsAtExit);
+}
+
+// Counts data moved: bytes, the operations that moved them and the syscalls it took
+void statsTransfer(uint64_t bytes, uint64_t messages, uint64_t syscalls) {
+  if (stats != NULL) {
+    __atomic_fetch_add(&stats->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->messages, messages, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->syscalls, syscalls, __ATOMIC_RELAXED);
+  }
+}
+
+// Counts syscalls that moved no data (polling, waiting)
+void statsSyscalls(uint64_t syscalls) {
+  if (stats != NULL) {
+    __atomic_fetch_add(&stats->syscalls, syscalls, __ATOMIC_RELAXED);
+  }
+}
+
+// Counts one wait for a full (isFull) or empty buffer and the time it took
+void statsStall(bool isFull, uint64_t wait_ns) {
+  if (stats != NULL) {
+    __atomic_fetch_add(isFull ? &stats->ringFullStalls : &stats->ringEmptyStalls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->wait_ns, wait_ns, __ATOMIC_RELAXED);
+  }
+}
+
+// Counts time spent blocked in a syscall waiting for any peer (epoll_wait)
+void statsWait(uint64_t wait_ns) {
+  if (stats != NULL) {
+    __atomic_fetch_add(&stats->wait_ns, wait_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->syscalls, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Waits on a semaphore guarding a buffer. Only counts a stall, with its
+// duration, when the semaphore was not immediately available.
+void statsSemWait(sem_t* sem, bool isFull, int fdlog_err) {
+  uint64_t waitStart_ns;
+
+  if (sem_trywait(sem) == 0) {
+    return;
+  }
+
+  waitStart_ns = getMonotonicTimeNS();
+  semWait(sem, fdlog_err);
+  statsStall(isFull, getMonotonicTimeNS() - waitStart_ns);
+  statsSyscalls(1); // a blocking wait goes through futex()
+}
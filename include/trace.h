@@ -0,0 +1,222 @@
+// Optional session timeline in Chrome trace-event format (ORION_TRACE=<file>).
+// Must be included after common.h (uses its clock and logging helpers).
+//
+// Every process buffers nanosecond spans in memory and appends them to the
+// trace file when it exits, holding an flock so processes never interleave.
+// The file uses the JSON array format without its closing bracket, which both
+// chrome://tracing and Perfetto accept, so it can be appended to by any number
+// of processes. Timestamps come from CLOCK_MONOTONIC, shared by all processes,
+// and every process and thread gets its own track.
+
+#include <sys/file.h>
+#include <sys/syscall.h>
+
+#define TRACE_NAME_LENGTH 48
+
+const int TRACE_INITIAL_EVENTS = 1024;
+// Transfers made of many small writes are recorded in spans of this many bytes
+const int64_t TRACE_CHUNK_BYTES = 64 * 1024;
+
+struct traceEvent {
+  char name[TRACE_NAME_LENGTH];
+  const char* category;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  pid_t tid;
+  int64_t bytes; // "bytes" argument of the span, -1 if none
+};
+
+char* tracePath = NULL; // NULL when tracing is disabled
+char* traceProcessName;
+pid_t traceOwner; // events are only flushed by the process that recorded them
+struct traceEvent* traceEvents;
+size_t traceNumEvents;
+size_t traceMaxEvents;
+pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+__thread pid_t traceTid = 0;
+
+// Whether spans are being recorded
+bool traceIsEnabled() {
+  return tracePath != NULL;
+}
+
+// Start of a span, 0 when tracing is disabled
+uint64_t traceBegin() {
+  return tracePath != NULL ? getMonotonicTimeNS() : 0;
+}
+
+// Records a span that started at start_ns and ends at end_ns. bytes is
+// attached as an argument when not negative.
+void traceSpan(const char* name, const char* category, uint64_t start_ns, uint64_t end_ns,
+    int64_t bytes) {
+  struct traceEvent* event;
+
+  if (tracePath == NULL) {
+    return;
+  }
+
+  if (traceTid == 0) {
+    traceTid = syscall(SYS_gettid);
+  }
+
+  pthread_mutex_lock(&traceMutex);
+  if (traceNumEvents == traceMaxEvents) {
+    struct traceEvent* events = realloc(traceEvents, 2 * traceMaxEvents * sizeof(struct traceEvent));
+    if (events == NULL) {
+      // Out of memory: keep what was recorded so far
+      pthread_mutex_unlock(&traceMutex);
+      return;
+    }
+    traceEvents = events;
+    traceMaxEvents *= 2;
+  }
+
+  event = &traceEvents[traceNumEvents++];
+  snprintf(event->name, TRACE_NAME_LENGTH, "%s", name);
+  event->category = category;
+  event->start_ns = start_ns;
+  event->duration_ns = end_ns - start_ns;
+  event->tid = traceTid;
+  event->bytes = bytes;
+  pthread_mutex_unlock(&traceMutex);
+}
+
+// Records a span that started at start_ns and ends now
+void traceEnd(const char* name, const char* category, uint64_t start_ns) {
+  if (tracePath != NULL) {
+    traceSpan(name, category, start_ns, getMonotonicTimeNS(), -1);
+  }
+}
+
+// Same as traceEnd, with the number of bytes the span moved
+void traceEndBytes(const char* name, const char* category, uint64_t start_ns, int64_t bytes) {
+  if (tracePath != NULL) {
+    traceSpan(name, category, start_ns, getMonotonicTimeNS(), bytes);
+  }
+}
+
+// Span covering a run of small transfers (one per message), closed every
+// TRACE_CHUNK_BYTES so that per-message loops do not record millions of spans
+struct traceChunk {
+  const char* name;
+  uint64_t start_ns;
+  int64_t bytes;
+};
+
+// Starts the first span of a run
+void traceChunkStart(struct traceChunk* chunk, const char* name) {
+  chunk->name = name;
+  chunk->start_ns = traceBegin();
+  chunk->bytes = 0;
+}
+
+// Counts bytes moved, closing the current span once it is TRACE_CHUNK_BYTES long
+void traceChunkAdd(struct traceChunk* chunk, int64_t bytes) {
+  if (tracePath != NULL) {
+    chunk->bytes += bytes;
+    if (chunk->bytes >= TRACE_CHUNK_BYTES) {
+      uint64_t now_ns = getMonotonicTimeNS();
+
+      traceSpan(chunk->name, "transfer", chunk->start_ns, now_ns, chunk->bytes);
+      chunk->start_ns = now_ns;
+      chunk->bytes = 0;
+    }
+  }
+}
+
+// Closes the last, possibly shorter, span of a run
+void traceChunkFinish(struct traceChunk* chunk) {
+  if (tracePath != NULL && chunk->bytes > 0) {
+    traceEndBytes(chunk->name, "transfer", chunk->start_ns, chunk->bytes);
+    chunk->bytes = 0;
+  }
+}
+
+// Appends the recorded spans to the trace file
+void traceFlush() {
+  FILE* file;
+  struct stat fileStat;
+  int fd;
+  pid_t pid = getpid();
+
+  if (tracePath == NULL || pid != traceOwner) {
+    return;
+  }
+
+  fd = open(tracePath, O_WRONLY | O_APPEND | O_CREAT, 0666);
+  if (fd < 0) {
+    perror("trace.h traceFlush open");
+    return;
+  }
+  flock(fd, LOCK_EX);
+  file = fdopen(fd, "a");
+
+  // The first process to write opens the array
+  if (fstat(fd, &fileStat) == 0 && fileStat.st_size == 0) {
+    fprintf(file, "[\n");
+  }
+
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+      pid, pid, traceProcessName);
+  for (size_t i = 0; i < traceNumEvents; i++) {
+    struct traceEvent* event = &traceEvents[i];
+
+    fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+        "\"ts\":%lu.%03lu,\"dur\":%lu.%03lu",
+        event->name, event->category, pid, event->tid,
+        (unsigned long) (event->start_ns / 1000), (unsigned long) (event->start_ns % 1000),
+        (unsigned long) (event->duration_ns / 1000), (unsigned long) (event->duration_ns % 1000));
+    if (event->bytes >= 0) {
+      fprintf(file, ",\"args\":{\"bytes\":%ld}", (long) event->bytes);
+    }
+    fprintf(file, "},\n");
+  }
+
+  fflush(file);
+  flock(fd, LOCK_UN);
+  fclose(file);
+
+  traceNumEvents = 0;
+}
+
+// Starts recording if ORION_TRACE names a trace file. If this process was
+// spawned by a traced parent (ORION_TRACE_SPAWN_NS), the time from fork to
+// here is recorded as an "exec" span.
+void traceOpen(char* processName) {
+  char* spawn;
+  uint64_t spawn_ns;
+
+  tracePath = getEnvString("ORION_TRACE", NULL);
+  if (tracePath == NULL || tracePath[0] == '\0') {
+    tracePath = NULL;
+    return;
+  }
+
+  traceProcessName = processName;
+  traceOwner = getpid();
+  traceMaxEvents = TRACE_INITIAL_EVENTS;
+  traceNumEvents = 0;
+  traceEvents = malloc(traceMaxEvents * sizeof(struct traceEvent));
+  if (traceEvents == NULL) {
+    tracePath = NULL;
+    return;
+  }
+  atexit(traceFlush);
+
+  spawn = getEnvString("ORION_TRACE_SPAWN_NS", NULL);
+  if (spawn != NULL) {
+    spawn_ns = strtoull(spawn, NULL, 10);
+    traceEnd("exec", "startup", spawn_ns);
+    unsetenv("ORION_TRACE_SPAWN_NS");
+  }
+}
+
+// In a child about to exec another traced program: passes the fork time on
+void traceMarkSpawn(uint64_t fork_ns) {
+  char spawn[32];
+
+  if (tracePath != NULL) {
+    sprintf(spawn, "%lu", (unsigned long) fork_ns);
+    setenv("ORION_TRACE_SPAWN_NS", spawn, 1);
+  }
+}
@@ -0,0 +1,399 @@
+// io_uring backend for the pipe and socket transports.
+// Must be included after common.h (uses its logging helpers), stats.h and trace.h.
+//
+// Talks to the kernel through the raw io_uring syscalls so no extra library is
+// needed. Data is moved in batches of up to "depth" linked requests: a whole
+// batch is submitted and waited for with a single io_uring_enter() call, and
+// linking keeps the byte stream in order on pipes and stream sockets.
+
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+const int DEFAULT_URING_DEPTH = 8; // requests in flight per batch
+const int DEFAULT_URING_CHUNK_KIB = 64; // size of each request
+
+struct uringContext {
+  int ringFd;
+  unsigned depth;
+  bool isSqpoll;
+  bool hasFixedFile; // fd registered, requests use index 0
+  bool hasFixedBuffer; // buffer registered, requests use *_FIXED opcodes
+  char* fixedBufferBase;
+  size_t fixedBufferLength;
+  // Submission queue
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqFlags;
+  unsigned* sqArray;
+  struct io_uring_sqe* sqes;
+  unsigned sqQueued; // filled past *sqTail, not yet visible to the kernel
+  // Completion queue
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_cqe* cqes;
+  // Mappings, kept for cleanup
+  void* sqRing;
+  void* cqRing;
+  size_t sqRingLength;
+  size_t cqRingLength;
+  size_t sqesLength;
+  // Statistics
+  unsigned long numRequests;
+  unsigned long numEnterCalls;
+};
+
+// Returns true if the user asked for the io_uring backend (ORION_IO_BACKEND=uring)
+bool uringIsRequested() {
+  return strcmp(getEnvString("ORION_IO_BACKEND", "blocking"), "uring") == 0;
+}
+
+// Sets up a ring with the given submission queue depth. Returns false (after
+// logging why) if io_uring is not available, in which case the caller should
+// fall back to the blocking path.
+bool uringInit(struct uringContext* ctx, unsigned depth, bool isSqpoll, int fdlog_err) {
+  struct io_uring_params params;
+
+  memset(ctx, 0, sizeof(*ctx));
+  memset(&params, 0, sizeof(params));
+  ctx->ringFd = -1;
+
+  if (isSqpoll) {
+    params.flags |= IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = 100; // milliseconds
+  }
+
+  ctx->ringFd = syscall(__NR_io_uring_setup, depth, &params);
+  if (ctx->ringFd < 0 && isSqpoll) {
+    // SQPOLL may need privileges on older kernels: retry without it
+    writeErrorLog(fdlog_err, "uring.h: uringInit SQPOLL unavailable, continuing without", errno);
+    isSqpoll = false;
+    memset(&params, 0, sizeof(params));
+    ctx->ringFd = syscall(__NR_io_uring_setup, depth, &params);
+  }
+
+  if (ctx->ringFd < 0) {
+    writeErrorLog(fdlog_err, "uring.h: uringInit io_uring_setup failed, using blocking I/O", errno);
+    return false;
+  }
+
+  ctx->depth = params.sq_entries;
+  ctx->isSqpoll = isSqpoll;
+
+  ctx->sqRingLength = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ctx->cqRingLength = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ctx->cqRingLength > ctx->sqRingLength) {
+      ctx->sqRingLength = ctx->cqRingLength;
+    }
+    ctx->cqRingLength = ctx->sqRingLength;
+  }
+
+  ctx->sqRing = mmap(NULL, ctx->sqRingLength, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ctx->ringFd, IORING_OFF_SQ_RING);
+  if (ctx->sqRing == MAP_FAILED) {
+    writeErrorLog(fdlog_err, "uring.h: uringInit mmap sq ring failed, using blocking I/O", errno);
+    close(ctx->ringFd);
+    return false;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ctx->cqRing = ctx->sqRing;
+  } else {
+    ctx->cqRing = mmap(NULL, ctx->cqRingLength, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ctx->ringFd, IORING_OFF_CQ_RING);
+    if (ctx->cqRing == MAP_FAILED) {
+      writeErrorLog(fdlog_err, "uring.h: uringInit mmap cq ring failed, using blocking I/O", errno);
+      munmap(ctx->sqRing, ctx->sqRingLength);
+      close(ctx->ringFd);
+      return false;
+    }
+  }
+
+  ctx->sqesLength = params.sq_entries * sizeof(struct io_uring_sqe);
+  ctx->sqes = mmap(NULL, ctx->sqesLength, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ctx->ringFd, IORING_OFF_SQES);
+  if (ctx->sqes == MAP_FAILED) {
+    writeErrorLog(fdlog_err, "uring.h: uringInit mmap sqes failed, using blocking I/O", errno);
+    if (ctx->cqRing != ctx->sqRing) {
+      munmap(ctx->cqRing, ctx->cqRingLength);
+    }
+    munmap(ctx->sqRing, ctx->sqRingLength);
+    close(ctx->ringFd);
+    return false;
+  }
+
+  ctx->sqHead = (unsigned*) ((char*) ctx->sqRing + params.sq_off.head);
+  ctx->sqTail = (unsigned*) ((char*) ctx->sqRing + params.sq_off.tail);
+  ctx->sqMask = (unsigned*) ((char*) ctx->sqRing + params.sq_off.ring_mask);
+  ctx->sqFlags = (unsigned*) ((char*) ctx->sqRing + params.sq_off.flags);
+  ctx->sqArray = (unsigned*) ((char*) ctx->sqRing + params.sq_off.array);
+  ctx->cqHead = (unsigned*) ((char*) ctx->cqRing + params.cq_off.head);
+  ctx->cqTail = (unsigned*) ((char*) ctx->cqRing + params.cq_off.tail);
+  ctx->cqMask = (unsigned*) ((char*) ctx->cqRing + params.cq_off.ring_mask);
+  ctx->cqes = (struct io_uring_cqe*) ((char*) ctx->cqRing + params.cq_off.cqes);
+
+  return true;
+}
+
+// Registers fd as fixed file 0, saving the per-request file lookup. Failure is
+// not fatal: requests then use the plain file descriptor.
+void uringRegisterFile(struct uringContext* ctx, int fd, int fdlog_err) {
+  if (syscall(__NR_io_uring_register, ctx->ringFd, IORING_REGISTER_FILES, &fd, 1) < 0) {
+    writeErrorLog(fdlog_err, "uring.h: uringRegisterFile failed, using plain fd", errno);
+    ctx->hasFixedFile = false;
+  } else {
+    ctx->hasFixedFile = true;
+  }
+}
+
+// Registers buf as fixed buffer 0 so the kernel pins it once instead of on every
+// request. Failure (e.g. RLIMIT_MEMLOCK too low) is not fatal.
+void uringRegisterBuffer(struct uringContext* ctx, void* buf, size_t length, int fdlog_err) {
+  struct iovec iov;
+
+  iov.iov_base = buf;
+  iov.iov_len = length;
+
+  if (syscall(__NR_io_uring_register, ctx->ringFd, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+    writeErrorLog(fdlog_err, "uring.h: uringRegisterBuffer failed, using plain buffers", errno);
+    ctx->hasFixedBuffer = false;
+  } else {
+    ctx->hasFixedBuffer = true;
+    ctx->fixedBufferBase = buf;
+    ctx->fixedBufferLength = length;
+  }
+}
+
+// Queues one read or write request, linked to the next one if isLinked. The
+// kernel only sees it after uringPublish.
+void uringQueueRequest(struct uringContext* ctx, int fd, bool isWriting,
+    char* buf, unsigned length, unsigned long userData, bool isLinked) {
+  unsigned tail = *ctx->sqTail + ctx->sqQueued;
+  unsigned index = tail & *ctx->sqMask;
+  struct io_uring_sqe* sqe = &ctx->sqes[index];
+  bool isFixedBuffer;
+
+  isFixedBuffer = ctx->hasFixedBuffer && buf >= ctx->fixedBufferBase &&
+      buf + length <= ctx->fixedBufferBase + ctx->fixedBufferLength;
+
+  memset(sqe, 0, sizeof(*sqe));
+  if (isFixedBuffer) {
+    sqe->opcode = isWriting ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = 0;
+  } else {
+    sqe->opcode = isWriting ? IORING_OP_WRITE : IORING_OP_READ;
+  }
+
+  if (ctx->hasFixedFile) {
+    sqe->fd = 0;
+    sqe->flags |= IOSQE_FIXED_FILE;
+  } else {
+    sqe->fd = fd;
+  }
+
+  if (isLinked) {
+    sqe->flags |= IOSQE_IO_LINK;
+  }
+
+  sqe->off = (__u64) -1; // current file position: pipes and sockets
+  sqe->addr = (unsigned long) buf;
+  sqe->len = length;
+  sqe->user_data = userData;
+
+  ctx->sqArray[index] = index;
+  ctx->sqQueued++;
+  ctx->numRequests++;
+}
+
+// Makes every queued request visible to the kernel at once. With SQPOLL the
+// kernel thread picks requests up as soon as the tail moves, so a linked chain
+// is published whole: it must never see the head of a chain without the rest.
+void uringPublish(struct uringContext* ctx) {
+  __atomic_store_n(ctx->sqTail, *ctx->sqTail + ctx->sqQueued, __ATOMIC_RELEASE);
+  ctx->sqQueued = 0;
+}
+
+// Submits the queued requests and waits until minComplete of them are done
+void uringSubmitAndWait(struct uringContext* ctx, unsigned toSubmit,
+    unsigned minComplete, int fdlog_err) {
+  unsigned flags = IORING_ENTER_GETEVENTS;
+  int ret;
+
+  if (ctx->isSqpoll) {
+    // The kernel thread picks up submissions by itself, unless it went idle
+    toSubmit = 0;
+    if (__atomic_load_n(ctx->sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) {
+      flags |= IORING_ENTER_SQ_WAKEUP;
+    }
+  }
+
+  do {
+    ret = syscall(__NR_io_uring_enter, ctx->ringFd, toSubmit, minComplete, flags, NULL, 0);
+    ctx->numEnterCalls++;
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("uring.h uringSubmitAndWait io_uring_enter");
+    writeErrorLog(fdlog_err, "uring.h: uringSubmitAndWait io_uring_enter failed", errno);
+    exit(-1);
+  }
+}
+
+// Reads or writes exactly length bytes of buf on fd, chunkSize bytes per request
+// with up to ctx->depth requests in flight at once
+void uringTransfer(struct uringContext* ctx, int fd, bool isWriting, char* buf,
+    size_t length, size_t chunkSize, int fdlog_err) {
+  size_t done = 0;
+  unsigned batchSize;
+  unsigned numCompleted;
+  unsigned head;
+  size_t offset;
+  size_t batchStart;
+  unsigned numEnters;
+  unsigned numMoved;
+  uint64_t batchStart_ns;
+  int results[ctx->depth];
+  size_t lengths[ctx->depth];
+
+  while (done < length) {
+    // Queue one batch of linked requests covering the next bytes in order
+    batchSize = 0;
+    for (offset = done; offset < length && batchSize < ctx->depth; offset += chunkSize) {
+      lengths[batchSize] = (length - offset < chunkSize) ? length - offset : chunkSize;
+      batchSize++;
+    }
+
+    batchStart_ns = traceBegin();
+    offset = done;
+    for (unsigned i = 0; i < batchSize; i++) {
+      uringQueueRequest(ctx, fd, isWriting, buf + offset, lengths[i], i, i + 1 < batchSize);
+      offset += lengths[i];
+    }
+    uringPublish(ctx);
+
+    uringSubmitAndWait(ctx, batchSize, batchSize, fdlog_err);
+    numEnters = 1;
+
+    // Reap the whole batch (completions may arrive out of order)
+    numCompleted = 0;
+    while (numCompleted < batchSize) {
+      head = *ctx->cqHead;
+      if (head == __atomic_load_n(ctx->cqTail, __ATOMIC_ACQUIRE)) {
+        uringSubmitAndWait(ctx, 0, batchSize - numCompleted, fdlog_err);
+        numEnters++;
+        continue;
+      }
+
+      struct io_uring_cqe* cqe = &ctx->cqes[head & *ctx->cqMask];
+      results[cqe->user_data] = cqe->res;
+      __atomic_store_n(ctx->cqHead, head + 1, __ATOMIC_RELEASE);
+      numCompleted++;
+    }
+
+    // Advance over the requests that completed in full. A short transfer breaks
+    // the link chain and cancels the rest, which are simply requeued.
+    batchStart = done;
+    numMoved = 0;
+    for (unsigned i = 0; i < batchSize; i++) {
+      if (results[i] == -ECANCELED || results[i] == -EAGAIN || results[i] == -EINTR) {
+        break;
+      }
+
+      if (results[i] < 0 || (results[i] == 0 && !isWriting)) {
+        errno = (results[i] < 0) ? -results[i] : EPIPE;
+        printf("Error %d in ", errno);
+        fflush(stdout);
+        perror("uring.h uringTransfer");
+        writeErrorLog(fdlog_err, "uring.h: uringTransfer request failed", errno);
+        exit(-1);
+      }
+
+      done += results[i];
+      numMoved++;
+      if ((size_t) results[i] < lengths[i]) {
+        // Nothing after a short transfer may have moved data
+        for (unsigned j = i + 1; j < batchSize; j++) {
+          if (results[j] > 0) {
+            printf("Error in uring.h uringTransfer: out of order completion\n");
+            fflush(stdout);
+            writeErrorLog(fdlog_err, "uring.h: uringTransfer out of order completion", 0);
+            exit(-1);
+          }
+        }
+        break;
+      }
+    }
+
+    statsTransfer(done - batchStart, numMoved, numEnters);
+    traceEndBytes("uring batch", "transfer", batchStart_ns, done - batchStart);
+  }
+}
+
+// Tears down the ring (registered files and buffers go with it)
+void uringClose(struct uringContext* ctx) {
+  munmap(ctx->sqes, ctx->sqesLength);
+  if (ctx->cqRing != ctx->sqRing) {
+    munmap(ctx->cqRing, ctx->cqRingLength);
+  }
+  munmap(ctx->sqRing, ctx->sqRingLength);
+  close(ctx->ringFd);
+}
+
+// Opens a ring configured from the environment (ORION_URING_DEPTH,
+// ORION_URING_SQPOLL) and registers fd and buf with it. Returns false if the
+// blocking path should be used instead.
+bool uringSetup(struct uringContext* ctx, int fd, void* buf, size_t length,
+    char* caller, int fdlog_info, int fdlog_err) {
+  char logMessage[256];
+  int depth = getEnvInt("ORION_URING_DEPTH", DEFAULT_URING_DEPTH);
+  bool isSqpoll = getEnvInt("ORION_URING_SQPOLL", 0) != 0;
+
+  if (!uringIsRequested()) {
+    return false;
+  }
+
+  if (depth < 1) {
+    depth = DEFAULT_URING_DEPTH;
+  }
+
+  if (!uringInit(ctx, depth, isSqpoll, fdlog_err)) {
+    sprintf(logMessage, "[%s] io_uring unavailable, falling back to blocking I/O", caller);
+    writeInfoLog(fdlog_info, logMessage);
+    return false;
+  }
+
+  uringRegisterFile(ctx, fd, fdlog_err);
+  uringRegisterBuffer(ctx, buf, length, fdlog_err);
+
+  sprintf(logMessage, "[%s] Using io_uring (depth %u, sqpoll %d, fixed file %d, fixed buffer %d)",
+      caller, ctx->depth, ctx->isSqpoll, ctx->hasFixedFile, ctx->hasFixedBuffer);
+  writeInfoLog(fdlog_info, logMessage);
+
+  return true;
+}
+
+// Logs how many syscalls the transfer needed, then closes the ring
+void uringFinish(struct uringContext* ctx, char* caller, int fdlog_info) {
+  char logMessage[256];
+
+  sprintf(logMessage, "[%s] io_uring: %lu requests in %lu io_uring_enter calls",
+      caller, ctx->numRequests, ctx->numEnterCalls);
+  writeInfoLog(fdlog_info, logMessage);
+  uringClose(ctx);
+}
+
+// Chunk size for each request, from ORION_URING_CHUNK_KIB
+size_t uringChunkSize() {
+  int chunkKiB = getEnvInt("ORION_URING_CHUNK_KIB", DEFAULT_URING_CHUNK_KIB);
+
+  if (chunkKiB < 1) {
+    chunkKiB = DEFAULT_URING_CHUNK_KIB;
+  }
+
+  return (size_t) chunkKiB * 1024;
+}
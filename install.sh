@@ -18,6 +18,8 @@ touch $1/logs/info.log
 gcc $1/src/producer.c -o $1/bin/producer -lrt -pthread -lm &>> logs/errors.log
 gcc $1/src/consumer.c -o $1/bin/consumer -lrt -pthread -lm &>> logs/errors.log
 gcc $1/src/master.c -o $1/bin/master -lrt -pthread -lm &>> logs/errors.log
+gcc $1/src/orion-top.c -o $1/bin/orion-top -lrt -pthread -lm &>> logs/errors.log
+gcc $1/src/kernelbench.c -o $1/bin/kernelbench -lrt -pthread -lm &>> logs/errors.log
 touch $1/run.sh
 chmod +x $1/run.sh;
 # main executable script: run.sh
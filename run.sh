@@ -2,5 +2,7 @@
 gcc src/producer.c -o bin/producer -lrt -pthread -lm &>> logs/errors.log
 gcc src/consumer.c -o bin/consumer -lrt -pthread -lm &>> logs/errors.log
 gcc src/master.c -o bin/master -lrt -pthread -lm &>> logs/errors.log
+gcc src/orion-top.c -o bin/orion-top -lrt -pthread -lm &>> logs/errors.log
+gcc src/kernelbench.c -o bin/kernelbench -lrt -pthread -lm &>> logs/errors.log
 
 gnome-terminal -- sh -c "./bin/master $1;bash"
@@ -1,4 +1,20 @@
 #include "../include/common.h"
+#include "../include/stats.h"
+#include "../include/perf.h"
+#include "../include/trace.h"
+#include "../include/result.h"
+#include "../include/pace.h"
+#include "../include/kernels.h"
+#include "../include/element.h"
+#include "../include/analytics.h"
+#include "../include/datafile.h"
+#include "../include/uring.h"
+#include "../include/ring.h"
+#include "../include/control.h"
+#include "../include/journal.h"
+#include "../include/daemon.h"
+#include "../include/dgram.h"
+#include "../include/adapt.h"
 
 // Different functions to read data using different IPC mechanisms
 
@@ -11,20 +27,76 @@ double readNamedPipe(int sizeDataMiB, int messages[], int fildes);
 // The consumer acts as the CLIENT
 double readSocket(int sizeDataMiB, int messages[], char* hostname, int portno);
 
+// Reads numMessages messages from messageIndex on from the socket, one per
+// read, or as many as have arrived with isGreedy. Returns the index of the next
+// message.
+int readSocketMessages(int sockfd, int messages[], int messageIndex, int numMessages, bool isGreedy,
+    struct traceChunk* chunk);
+
+// Receives a payload striped over numStreams parallel connections, one reader
+// thread per connection, placing each chunk directly at its offset
+double readSocketStriped(int sizeDataMiB, int messages[], char* hostname, int portno, int numStreams);
+
 // Uses a circular buffer to read data through shared memory
 double readSharedMemory(int sizeDataMiB, int messages[], int circularBufferSize);
 
+// Unpacks messages from POSIX message queue records, and reports the latency of
+// the control records sent on the priority lane
+double readMessageQueue(int sizeDataMiB, int messages[]);
+
+// Tails the producer's journal, committing how far it got so that a restarted
+// consumer resumes from there
+double readJournal(int sizeDataMiB, int messages[]);
+
+// Keeps whatever datagrams of the producer arrive, until all did or the
+// producer is done and no more come, and reports what was lost
+double readDatagram(int sizeDataMiB, int messages[], int portno);
+
+// Reads messages from..numMessages from a ring, checkpointing each batch in the
+// control block before giving its room back, so that another consumer can take
+// over if this one dies (ORION_RESUME)
+void readRingCheckpointed(struct ringBuffer* ring, int messages[], size_t from, size_t numMessages);
+
+// Warm worker of the master (ORION_DAEMON_FD): joins the socket or shared
+// memory link of the producer once, then receives and checks the first
+// job.sizeDataMiB of the payload for every job the master sends, until it is
+// told to stop. sizeDataMiB is the largest.
+void serveDaemonJobs(int sizeDataMiB, int messages[], char* hostname, int portno);
+
+// One job of serveDaemonJobs over the connected socket, in blocks of the same
+// layout as readSocket. Every block is acknowledged, the remainder included.
+// Returns the number of messages received.
+int readSocketJob(int sockfd, int sizeDataMiB, int messages[]);
+
+// Marks the start of the transfer as seen by the consumer
+void transferStart();
+
+// Checks the numMessages messages received against what the producer sent and
+// returns the transfer time in seconds, given the time the last byte arrived
+double transferEnd(int messages[], size_t numMessages, uint64_t timeEnd_ns);
+
 // Max possible size of data to transfer, specified here, in MiB
 const int MAX_SIZE_MIB = 100;
 const int MIB_TO_B_CONSTANT = 1049000;
 const int MESSAGE_SIZE_B = 4; // size of one message in bytes (int = 4 bytes)
-const int CIRC_BUFFER_SIZE = 4096; // max buffer size for circular buffer in shared memory
+const int CIRC_BUFFER_SIZE = 4096; // default size of the ring in shared memory, in bytes
+const int DEFAULT_MQ_DEPTH = 10; // records the message queue holds
+const int DEFAULT_MQ_MSG_KIB = 8; // size of one message queue record
 const int DEFAULT_PORTNO = 4000; // default port number for sockets
+const int LISTEN_TIMEOUT_MS = 10000; // max wait for the producer to start listening
 // Log file descriptors
 int fdlog_err;
 int fdlog_info;
 // Function to use, specified by user to master process as argv[1]
 int choiceIPC;
+// Time spent establishing the link before the transfer starts (sockets only)
+double setupTime_ms = -1;
+// Whether the data received matched what the producer sent
+bool isDataVerified = false;
+// Latency of the journal's records from append to read, when not paced
+struct latencySummary journalLatency;
+// What arrived of a datagram transfer
+struct lossSummary datagramLoss;
 
 int main (int argc, char** argv) {
   char* logMessage;
@@ -34,7 +106,8 @@ int main (int argc, char** argv) {
   int sizeDataMiB;
   // Messages to be transferred, pre-initialized to be of maximum dimension MAX_SIZE_MiB but only a portion will be used
   int* messages;
-  pid_t myPID;
+  struct transferResult result;
+  char adaptText[192];
 
   if (argc < 3) {
     fprintf(stderr, "ERROR: expecting at least 3 arguments!");
@@ -45,14 +118,18 @@ int main (int argc, char** argv) {
   fdlog_err = openErrorLog();
   fdlog_info = openInfoLog();
 
+  // Optional session timeline (ORION_TRACE)
+  traceOpen("consumer");
+
   logMessage = malloc(sizeof(char) * 128);
   // User input
   choiceIPC = atoi(argv[1]);
   sizeDataMiB = atoi(argv[2]);
 
   // Input checks
-  if (choiceIPC < 0 || choiceIPC > 3) {
-    fprintf(stderr, "ERROR: first argument should be between 0 and 3");
+  // Threads (4) only exist inside the producer
+  if (choiceIPC < 0 || choiceIPC > 7 || choiceIPC == 4) {
+    fprintf(stderr, "ERROR: first argument should be between 0 and 3, or 5 and 7");
     writeErrorLog(fdlog_err, "[Producer] Invalid user-specified IPC choice number", 0);
     exit(-1);
   }
@@ -63,11 +140,70 @@ int main (int argc, char** argv) {
     exit(-1);
   }
 
+  if (choiceIPC == 2 && socketLayoutError() != NULL) {
+    fprintf(stderr, "ERROR: %s", socketLayoutError());
+    writeErrorLog(fdlog_err, "[Consumer] Invalid socket layout options", 0);
+    exit(-1);
+  }
+
+  // Warm workers of the master only move the data
+  if (daemonChannel() >= 0 && choiceIPC != 2 && choiceIPC != 3) {
+    fprintf(stderr, "ERROR: daemon mode is only available for sockets and shared memory");
+    writeErrorLog(fdlog_err, "[Consumer] Daemon mode requested for another IPC", 0);
+    exit(-1);
+  } else if (daemonChannel() >= 0) {
+    unsetenv("ORION_RESUME");
+    unsetenv("ORION_ANALYTICS");
+    unsetenv("ORION_SINK_FILE");
+  }
+
   // Initialize size of messages as specified by args
   messages = calloc(sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, MESSAGE_SIZE_B);
 
+  // Join the session started by the producer
+  writeInfoLog(fdlog_info, "[Consumer] Opening control block");
+  controlOpen(fdlog_err);
+
+  // Paced transfers (ORION_PACE_RATE): latency is measured against the
+  // producer's schedule. The striped and event-driven socket servers are
+  // neither paced nor resumable (ORION_RESUME).
+  paceOpen(&control->timeStart_ns, MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, "Consumer", fdlog_info);
+  if (daemonChannel() >= 0) {
+    paceDisable("Consumer", fdlog_info);
+  } else if (choiceIPC == 2 && (getEnvInt("ORION_SOCKET_STREAMS", 1) > 1 || getEnvInt("ORION_SOCKET_CLIENTS", 1) > 1 ||
+      strcmp(getEnvString("ORION_SOCKET_SERVER", "classic"), "epoll") == 0)) {
+    paceDisable("Consumer", fdlog_info);
+    unsetenv("ORION_RESUME");
+  }
+  // Datagrams leave holes and arrive out of order, while processing and
+  // recording hand over the data in order as it arrives
+  if (choiceIPC == 7) {
+    analyticsDisable("Consumer", fdlog_info);
+    sinkDisable("Consumer", fdlog_info);
+  }
+  // Optional processing of the data as it arrives (ORION_ANALYTICS)
+  analyticsOpen(messages, sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, "Consumer", fdlog_info, fdlog_err);
+  // Optional recording of the data as it arrives (ORION_SINK_FILE)
+  sinkOpen(messages, sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, "Consumer", fdlog_info, fdlog_err);
+
+  // Live statistics for orion-top
+  statsOpen(STATS_CONSUMER, choiceIPC,
+      (uint64_t) (sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B)*MESSAGE_SIZE_B, fdlog_info, fdlog_err);
+
   sprintf(logMessage, "[Consumer] Total data transfer size: %dMiB", sizeDataMiB);
   writeInfoLog(fdlog_info, logMessage);
+  // Optional performance counters (ORION_PERF=1), sampled at every phase
+  perfOpen("Consumer", fdlog_info);
+  controlPhaseBegin(PHASE_SETUP);
+
+  // Warm worker of the master: one link for many transfers, each reported to
+  // the master on the job channel
+  if (daemonChannel() >= 0) {
+    serveDaemonJobs(sizeDataMiB, messages, "localhost", argc >= 4 ? atoi(argv[3]) : DEFAULT_PORTNO);
+    munmap(control, sizeof(struct controlBlock));
+    return 0;
+  }
+
   switch(choiceIPC) {
     case 0:
       ;
@@ -92,21 +228,88 @@ int main (int argc, char** argv) {
         portno = DEFAULT_PORTNO;
       }
 
-      timeToTransfer = readSocket(sizeDataMiB, messages, "localhost", portno);
+      int numStreams = getEnvInt("ORION_SOCKET_STREAMS", 1);
+      if (numStreams > 1) {
+        timeToTransfer = readSocketStriped(sizeDataMiB, messages, "localhost", portno, numStreams);
+      } else {
+        timeToTransfer = readSocket(sizeDataMiB, messages, "localhost", portno);
+      }
       break;
-    default:
+    case 3:
       // Shared Memory
-      timeToTransfer = readSharedMemory(sizeDataMiB, messages, CIRC_BUFFER_SIZE);
+      timeToTransfer = readSharedMemory(sizeDataMiB, messages, getEnvInt("ORION_RING_KIB", CIRC_BUFFER_SIZE/1024)*1024);
+      break;
+    case 5:
+      // POSIX message queues
+      timeToTransfer = readMessageQueue(sizeDataMiB, messages);
+      break;
+    case 6:
+      // Journal on disk
+      timeToTransfer = readJournal(sizeDataMiB, messages);
       break;
+    default:
+      // Datagrams, lossy
+      timeToTransfer = readDatagram(sizeDataMiB, messages, argc >= 4 ? atoi(argv[3]) : DEFAULT_PORTNO);
+      break;
+  }
+
+  // Processing may still be running when the last message arrives
+  result.analytics_s = analyticsFinish(control->timeStart_ns, "Consumer", fdlog_info, fdlog_err);
+  sinkFinish("Consumer", fdlog_info, fdlog_err);
+
+  controlPhaseEnd(control, false, PHASE_TEARDOWN);
+  controlLogPhases(control, false, fdlog_info);
+  if (stats != NULL) {
+    perfLogTransferCost("Consumer", statsTransportName(choiceIPC), &phasePerf[PHASE_TRANSFER],
+        stats->bytes, stats->syscalls, fdlog_info);
   }
+  // Sizes the producer settled on (ORION_ADAPT)
+  result.adapt = control->adapted;
+  munmap(control, sizeof(struct controlBlock));
 
-  printf("%.3f", timeToTransfer);
-  fflush(stdout);
   sprintf(logMessage, "[Consumer] Total transfer time: %.3f seconds", timeToTransfer);
   writeInfoLog(fdlog_info, logMessage);
 
-  myPID = getpid();
-  return myPID;
+  // Report to the master, or to the terminal when started by hand
+  result.pid = getpid();
+  result.transport = choiceIPC;
+  result.sizeDataMiB = sizeDataMiB;
+  result.isVerified = isDataVerified;
+  result.transfer_s = timeToTransfer;
+  result.setup_ms = setupTime_ms;
+  paceSummarize(&result.latency);
+  paceLogReceiver("Consumer", &result.latency, fdlog_info);
+  // Unpaced journal transfers report how long records took to become readable
+  if (choiceIPC == 6 && !paceIsEnabled()) {
+    result.latency = journalLatency;
+  }
+  result.loss = datagramLoss;
+  if (!resultSend(&result, fdlog_err)) {
+    if (setupTime_ms >= 0) {
+      printf("%.3f seconds (link setup: %.3f ms).", timeToTransfer, setupTime_ms);
+    } else {
+      printf("%.3f seconds.", timeToTransfer);
+    }
+    if (paceIsEnabled()) {
+      printf(" Latency p50 %.1f us, p99 %.1f us, %lu deadlines missed.", result.latency.p50_us,
+          result.latency.p99_us, (unsigned long) result.latency.numMissed);
+    }
+    if (result.analytics_s > 0) {
+      printf(" Processed after %.3f seconds.", result.analytics_s);
+    }
+    if (result.loss.numDatagrams > 0) {
+      printf(" Lost %lu of %lu datagrams, %lu reordered, goodput %.2f MiB/s.", (unsigned long) result.loss.numLost,
+          (unsigned long) result.loss.numDatagrams, (unsigned long) result.loss.numReordered,
+          result.loss.goodput_mibps);
+    }
+    resultDescribeAdapt(&result.adapt, adaptText);
+    if (adaptText[0] != '\0') {
+      printf(" Adapted: %s.", adaptText);
+    }
+    fflush(stdout);
+  }
+
+  return 0;
 }
 
 double readUnnamedPipe(int sizeDataMiB, int messages[], int fd_read) {
@@ -119,75 +322,124 @@ double readUnnamedPipe(int sizeDataMiB, int messages[], int fd_read) {
 }
 
 double readNamedPipe(int sizeDataMiB, int messages[], int fildes) {
-  sem_t* semConsumer;
-  sem_t* semProducer;
   int numReads;
   int fd;
-  double timerStart_ms, timerEnd_ms;
-  double timeToTransfer_ms; // milliseconds
-  void* ptrShmTimer;
+  bool isUring;
+  double timeToTransfer_s;
+  struct uringContext uring;
+  struct traceChunk chunk;
+  uint64_t openStart_ns;
 
   numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
 
-  // Semaphore to ensure correct usage of shared memory
-  semConsumer = semOpen("/arp2_sem_consumer", 0, fdlog_err);
-  semProducer = semOpen("/arp2_sem_producer", 0, fdlog_err);
-
   // Open pipe and read from it
   if (fildes < 0) {
     // Named pipe
     writeInfoLog(fdlog_info, "[Consumer] Opening pipe");
+    openStart_ns = traceBegin();
     fd = pipeStart("/tmp/arpassign2", false, fdlog_err);
+    traceEnd("open pipe", "setup", openStart_ns);
   } else {
     // Unnamed pipe
     fd = fildes;
   }
 
+  // Optional io_uring backend (ORION_IO_BACKEND=uring), not for paced transfers
+  isUring = !paceIsEnabled() && uringSetup(&uring, fd, messages, (size_t) numReads*MESSAGE_SIZE_B,
+      "Consumer", fdlog_info, fdlog_err);
+
   writeInfoLog(fdlog_info, "[Consumer] Starting pipe read");
+  transferStart();
 
-  for (int i = 0; i < numReads; i++) {
-    messages[i] = pipeRead(fd, fdlog_err);
+  if (isUring) {
+    uringTransfer(&uring, fd, false, (char*) messages, (size_t) numReads*MESSAGE_SIZE_B,
+        uringChunkSize(), fdlog_err);
+  } else {
+    traceChunkStart(&chunk, "read");
+    for (int i = 0; i < numReads; i++) {
+      messages[i] = pipeRead(fd, fdlog_err);
+      paceArrived(i, 1);
+      analyticsArrived(i, 1);
+      sinkArrived(i, 1);
+      statsTransfer(MESSAGE_SIZE_B, 1, 1);
+      traceChunkAdd(&chunk, MESSAGE_SIZE_B);
+    }
+    traceChunkFinish(&chunk);
   }
 
-  // Timer end
-  timerEnd_ms = getCurrrentTimeMS();
-  writeInfoLog(fdlog_info, "[Consumer] Ending transfer timer");
+  // Timer end, then check the data against what the producer sent
+  timeToTransfer_s = transferEnd(messages, numReads, getMonotonicTimeNS());
   writeInfoLog(fdlog_info, "[Consumer] Pipe read complete");
 
-  // Wait for producer to have actually written to the shared memory!
-  writeInfoLog(fdlog_info, "[Consumer] Accessing semaphore arp2_sem_consumer");
-  semWait(semConsumer, fdlog_err);
-
-  // Calculating total transfer time
-  writeInfoLog(fdlog_info, "[Consumer] Reading transfer start time from shared memory");
-  timerStart_ms = shmReadOnce_double("/shm_timerStart", &ptrShmTimer, fdlog_err);
-
-  // Let the producer know I'm done reading
-  writeInfoLog(fdlog_info, "[Consumer] Posting semaphore arp2_sem_producer");
-  semPost(semProducer, fdlog_err);
-
-  writeInfoLog(fdlog_info, "[Consumer] Calculating total transfer time");
-  timeToTransfer_ms = (timerEnd_ms - timerStart_ms)/1000;
+  if (isUring) {
+    uringFinish(&uring, "Consumer", fdlog_info);
+  }
 
   // Cleanup
   writeInfoLog(fdlog_info, "[Consumer] Closing pipe");
   pipeClose(fd, fdlog_err);
   writeInfoLog(fdlog_info, "[Consumer] Pipe closed");
 
-  writeInfoLog(fdlog_info, "[Consumer] Unlinking shared memory");
-  shmUnlinkUnmap("/shm_timerStart", &ptrShmTimer, sizeof(double), fdlog_err);
-  writeInfoLog(fdlog_info, "[Consumer] Shared memory unlinked");
+  return timeToTransfer_s;
+}
 
-  writeInfoLog(fdlog_info, "[Consumer] Unlinking semaphores");
-  semUnlink("/arp2_sem_consumer", fdlog_err);
-  writeInfoLog(fdlog_info, "[Consumer] Semaphores unlinked");
+void transferStart() {
+  controlPhaseEnd(control, false, PHASE_SETUP);
+  controlPhaseBegin(PHASE_TRANSFER);
+}
 
-  return timeToTransfer_ms;
+double transferEnd(int messages[], size_t numMessages, uint64_t timeEnd_ns) {
+  uint64_t bytes = (uint64_t) numMessages * MESSAGE_SIZE_B;
+  // A consumer that took over only holds what arrived after the checkpoint
+  uint64_t checksum = resumedFrom.checksum + checksumMessages(messages, resumedFrom.numMessages, numMessages);
+  double timeToTransfer_s;
+
+  writeInfoLog(fdlog_info, "[Consumer] Ending transfer timer");
+  controlPhaseEnd(control, false, PHASE_TRANSFER);
+  controlPhaseBegin(PHASE_TEARDOWN);
+
+  timeToTransfer_s = controlConsumerDone(control, timeEnd_ns, bytes, checksum, fdlog_info, fdlog_err);
+  isDataVerified = bytes == control->bytesSent && checksum == control->checksumSent;
+
+  return timeToTransfer_s;
+}
+
+// Waits until the producer signals it is listening, so the first connect
+// attempt normally succeeds. If no signal comes, the connect backoff takes over.
+void waitForListener() {
+  sem_t* semListening;
+  uint64_t waitStart_ns = traceBegin();
+
+  semListening = semOpen("/arp2_sem_listening", 0, fdlog_err);
+  writeInfoLog(fdlog_info, "[Consumer] Accessing semaphore arp2_sem_listening");
+  if (!semTimedWait(semListening, LISTEN_TIMEOUT_MS, fdlog_err)) {
+    writeInfoLog(fdlog_info, "[Consumer] Producer did not signal it is listening, connecting anyway");
+  }
+  semClose(semListening, fdlog_err);
+  traceEnd("wait for listener", "setup", waitStart_ns);
+}
+
+// Records and logs the time spent setting up the link
+void recordSetupTime(uint64_t setupStart_ns) {
+  char logMessage[128];
+
+  uint64_t setup_ns = getMonotonicTimeNS() - setupStart_ns;
+
+  setupTime_ms = setup_ns / 1.0e6;
+  __atomic_store_n(&control->consumerSetup_ns, setup_ns, __ATOMIC_RELAXED);
+  sprintf(logMessage, "[Consumer] Link setup time: %.3f ms", setupTime_ms);
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+// Socket tuning for the receiving side: zerocopy only applies to senders
+struct socketTuning consumerSocketTuning() {
+  struct socketTuning tuning = socketTuningFromEnv();
+
+  tuning.zeroCopy = 0;
+  return tuning;
 }
 
 double readSocket(int sizeDataMiB, int messages[], char* hostname, int portno) {
-  sem_t* semConsumer;
-  sem_t* semProducer;
   int numReads;
   int sockfd;
   int messageIndex;
@@ -195,19 +447,41 @@ double readSocket(int sizeDataMiB, int messages[], char* hostname, int portno) {
   int remainder;
   int numReadsPerBlock;
   int numReadsRemainder;
+  int numReadsTotal;
+  int resumeIndex;
+  bool isTakingOver;
+  bool isUring;
+  struct uringContext uring;
   struct sockaddr_in servAddr;
   struct hostent* server;
   char* logMessage;
-  double timerStart_ms, timerEnd_ms;
-  double timeToTransfer_ms; // milliseconds
-  void* ptrShmTimer;
+  double timeToTransfer_s;
+  uint64_t setupStart_ns;
+  uint64_t connectStart_ns;
+  struct traceChunk chunk;
+  bool isGreedy;
 
+  setupStart_ns = getMonotonicTimeNS();
   logMessage = malloc(sizeof(char) * 256);
   numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
 
-  // Semaphore to ensure correct usage of shared memory
-  semConsumer = semOpen("/arp2_sem_consumer", 0, fdlog_err);
-  semProducer = semOpen("/arp2_sem_producer", 0, fdlog_err);
+  // Request packets in blocks of 2MB to avoid buffer overflow
+  numBlocks = (int) sizeDataMiB / 2; // Rounded down
+  if (sizeDataMiB > 2) {
+    remainder = sizeDataMiB % 2;
+  } else {
+    // If sizeDataMiB < 2, then numBlocks is 0 and remainder would be 0 unless
+    // we specifically assign it here
+    remainder = sizeDataMiB;
+  }
+
+  numReadsRemainder = (remainder*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B;
+  if (numBlocks != 0) {
+    numReadsPerBlock = numReads/numBlocks - numReadsRemainder;
+  } else {
+    numReadsPerBlock = 0;
+  }
+  numReadsTotal = numBlocks*numReadsPerBlock + (remainder != 0 ? numReadsRemainder : 0);
 
   // Socket creation
   sprintf(logMessage, "[Consumer] Opening socket on %s:%d", hostname, portno);
@@ -222,164 +496,767 @@ double readSocket(int sizeDataMiB, int messages[], char* hostname, int portno) {
   bcopy((char *) server->h_addr, (char *)&servAddr.sin_addr.s_addr, server->h_length);
   servAddr.sin_port = htons(portno);
 
-  // Connect to server
-  writeInfoLog(fdlog_info, "[Consumer] Connecting to server");
-  socketConnect(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
-
-  // Request packets in blocks of 2MB to avoid buffer overflow
-  numBlocks = (int) sizeDataMiB / 2; // Rounded down
-  if (sizeDataMiB > 2) {
-    remainder = sizeDataMiB % 2;
-  } else {
-    // If sizeDataMiB < 2, then numBlocks is 0 and remainder would be 0 unless
-    // we specifically assign it here
-    remainder = sizeDataMiB;
+  // Connect to server as soon as it is listening. A consumer replacing one
+  // that died (ORION_RESUME) finds the transfer running, and the server
+  // listening for it.
+  if (__atomic_load_n(&control->state, __ATOMIC_ACQUIRE) < CONTROL_RUNNING) {
+    waitForListener();
   }
-
-  if (numBlocks != 0) {
-    numReadsRemainder = (remainder*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B;
-    numReadsPerBlock = numReads/numBlocks - numReadsRemainder;
-  } else {
-    numReadsPerBlock = 0;
+  isTakingOver = controlResume(control, fdlog_info);
+  if (isTakingOver && resumedFrom.numMessages == (uint64_t) numReadsTotal) {
+    // The consumer that died had received and checkpointed everything
+    recordSetupTime(setupStart_ns);
+    transferStart();
+    return transferEnd(messages, numReadsTotal, getMonotonicTimeNS());
   }
+  writeInfoLog(fdlog_info, "[Consumer] Connecting to server");
+  connectStart_ns = traceBegin();
+  socketApplyBufferSizes(sockfd, consumerSocketTuning(), fdlog_err);
+  socketConnect(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
+  traceEnd("connect", "setup", connectStart_ns);
+  socketApplyTuning(sockfd, consumerSocketTuning(), "Consumer", fdlog_info, fdlog_err);
+  recordSetupTime(setupStart_ns);
+  transferStart();
 
   // First, tell server how many blocks we need
   socketWrite(sockfd, numBlocks, MESSAGE_SIZE_B, fdlog_err);
   // Then, server know the remainder
   socketWrite(sockfd, remainder, MESSAGE_SIZE_B, fdlog_err);
-
+  // Resumable transfers: then, the first message we need, which the server
+  // checks against the checkpoint and confirms (or sets back to 0)
   messageIndex = 0;
-  for (int i = 0; i < numBlocks; i++) {
-    for (int j = 0; j < numReadsPerBlock; j++) {
+  if (isCheckpointing) {
+    socketWrite(sockfd, (int) resumedFrom.numMessages, MESSAGE_SIZE_B, fdlog_err);
+    resumeIndex = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
+    if (resumeIndex != (int) resumedFrom.numMessages) {
+      controlResumeReset(fdlog_info);
+    }
+    messageIndex = (int) resumedFrom.numMessages;
+  }
+
+  // Optional io_uring backend (ORION_IO_BACKEND=uring), not for paced transfers
+  isUring = !paceIsEnabled() && uringSetup(&uring, sockfd, messages, (size_t) numReads*MESSAGE_SIZE_B,
+      "Consumer", fdlog_info, fdlog_err);
+
+  // The producer tunes its writes with ORION_ADAPT: reads take whatever has
+  // arrived, so that they follow it
+  isGreedy = adaptIsRequested() && !paceIsEnabled();
+
+  for (int i = numReadsPerBlock != 0 ? messageIndex / numReadsPerBlock : 0; i < numBlocks; i++) {
+    if (isUring) {
       // Read the packets of one block
-      messages[messageIndex] = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
-      messageIndex++;
+      uringTransfer(&uring, sockfd, false, (char*) &messages[messageIndex],
+          (size_t) numReadsPerBlock*MESSAGE_SIZE_B, uringChunkSize(), fdlog_err);
+      messageIndex += numReadsPerBlock;
+    } else {
+      // Read the packets of one block
+      traceChunkStart(&chunk, "read");
+      messageIndex = readSocketMessages(sockfd, messages, messageIndex, numReadsPerBlock, isGreedy, &chunk);
+      traceChunkFinish(&chunk);
     }
 
-    // Now let the server know we are done reading, so the next block can be sent
+    // Now let the server know we are done reading, so the next block can be
+    // sent. A resumable transfer checkpoints the block first.
+    controlCheckpoint(control, messages, messageIndex);
     socketWrite(sockfd, 1, MESSAGE_SIZE_B, fdlog_err);
+    statsSyscalls(1);
   }
 
   // Read final data, if it wasn't already read (if there is a remainder)
   if (remainder != 0) {
-    for (int i = 0; i < numReadsRemainder; i++) {
-      messages[messageIndex] = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
-      messageIndex++;
+    if (isUring) {
+      uringTransfer(&uring, sockfd, false, (char*) &messages[messageIndex],
+          (size_t) numReadsRemainder*MESSAGE_SIZE_B, uringChunkSize(), fdlog_err);
+      messageIndex += numReadsRemainder;
+    } else {
+      traceChunkStart(&chunk, "read");
+      messageIndex = readSocketMessages(sockfd, messages, messageIndex, numReadsRemainder, isGreedy, &chunk);
+      traceChunkFinish(&chunk);
+    }
+
+    // The server of a resumable transfer waits for the remainder to be
+    // acknowledged too
+    if (isCheckpointing) {
+      controlCheckpoint(control, messages, messageIndex);
+      socketWrite(sockfd, 1, MESSAGE_SIZE_B, fdlog_err);
     }
   } else {
     // Otherwise, tell server there is no remainder and everything is OK
     socketWrite(sockfd, 0, MESSAGE_SIZE_B, fdlog_err);
   }
 
-  // Timer end
-  timerEnd_ms = getCurrrentTimeMS();
-  writeInfoLog(fdlog_info, "[Consumer] Ending transfer timer");
+  // Timer end, then check the data against what the producer sent
+  timeToTransfer_s = transferEnd(messages, messageIndex, getMonotonicTimeNS());
   writeInfoLog(fdlog_info, "[Consumer] Data transfer complete");
 
-  // Wait for producer to have actually written to the shared memory!
-  writeInfoLog(fdlog_info, "[Consumer] Accessing semaphore arp2_sem_consumer");
-  semWait(semConsumer, fdlog_err);
-
-  // Calculating total transfer time
-  writeInfoLog(fdlog_info, "[Consumer] Reading transfer start time from shared memory");
-  timerStart_ms = shmReadOnce_double("/shm_timerStart", &ptrShmTimer, fdlog_err);
-
-  // Let the producer know I'm done reading
-  writeInfoLog(fdlog_info, "[Consumer] Posting semaphore arp2_sem_producer");
-  semPost(semProducer, fdlog_err);
-
-  writeInfoLog(fdlog_info, "[Consumer] Calculating total transfer time");
-  timeToTransfer_ms = (timerEnd_ms - timerStart_ms)/1000;
+  if (isUring) {
+    uringFinish(&uring, "Consumer", fdlog_info);
+  }
 
   // Cleanup
   writeInfoLog(fdlog_info, "[Consumer] Closing socket");
   socketClose(sockfd, fdlog_err);
   writeInfoLog(fdlog_info, "[Consumer] Socket closed");
 
-  writeInfoLog(fdlog_info, "[Consumer] Unlinking shared memory");
-  shmUnlinkUnmap("/shm_timerStart", &ptrShmTimer, sizeof(double), fdlog_err);
-  writeInfoLog(fdlog_info, "[Consumer] Shared memory unlinked");
+  return timeToTransfer_s;
+}
+
+int readSocketMessages(int sockfd, int messages[], int messageIndex, int numMessages, bool isGreedy,
+    struct traceChunk* chunk) {
+  int first = messageIndex;
+  size_t length = (size_t) numMessages*MESSAGE_SIZE_B;
+  size_t numBytes = 0;
+  int numChunk;
+
+  while (messageIndex < first + numMessages) {
+    if (isGreedy) {
+      // A message may be split between two reads
+      numBytes += socketReadSome(sockfd, (char*) &messages[first] + numBytes, length - numBytes, fdlog_err);
+      numChunk = first + (int) (numBytes / MESSAGE_SIZE_B) - messageIndex;
+    } else {
+      messages[messageIndex] = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
+      numChunk = 1;
+    }
+    statsTransfer((uint64_t) numChunk*MESSAGE_SIZE_B, 1, 1);
+    if (numChunk > 0) {
+      paceArrived(messageIndex, numChunk);
+      analyticsArrived(messageIndex, numChunk);
+      sinkArrived(messageIndex, numChunk);
+      traceChunkAdd(chunk, numChunk*MESSAGE_SIZE_B);
+      messageIndex += numChunk;
+    }
+  }
 
-  writeInfoLog(fdlog_info, "[Consumer] Unlinking semaphores");
-  semUnlink("/arp2_sem_consumer", fdlog_err);
-  writeInfoLog(fdlog_info, "[Consumer] Semaphores unlinked");
+  return messageIndex;
+}
 
-  return timeToTransfer_ms;
+// Work of one reader thread in readSocketStriped
+struct stripeReader {
+  pthread_t thread;
+  int fd;
+  char* payload;
+  size_t payloadLength;
+  size_t bytesRead;
+};
+
+// Reads chunks from one stream straight into their place in the payload
+void* stripeReaderThread(void* arg) {
+  struct stripeReader* reader = arg;
+  struct stripeHeader header;
+  uint64_t chunkStart_ns;
+
+  while (true) {
+    socketReadAll(reader->fd, &header, sizeof(header), fdlog_err);
+    chunkStart_ns = traceBegin();
+    if (header.length == 0) {
+      break;
+    }
+
+    if (header.offset + header.length > reader->payloadLength) {
+      printf("Error in consumer.c stripeReaderThread: chunk out of bounds\n");
+      fflush(stdout);
+      writeErrorLog(fdlog_err, "consumer.c: striped chunk out of bounds", 0);
+      exit(-1);
+    }
+
+    socketReadAll(reader->fd, reader->payload + header.offset, header.length, fdlog_err);
+    reader->bytesRead += header.length;
+    statsTransfer(header.length, 1, 2); // header and payload
+    traceEndBytes("chunk", "transfer", chunkStart_ns, header.length);
+  }
+
+  return NULL;
+}
+
+double readSocketStriped(int sizeDataMiB, int messages[], char* hostname, int portno, int numStreams) {
+  int numReads;
+  size_t totalBytes;
+  struct sockaddr_in servAddr;
+  struct hostent* server;
+  struct stripeReader* readers;
+  char* logMessage;
+  double timeToTransfer_s;
+  uint64_t setupStart_ns;
+  uint64_t timeEnd_ns;
+
+  setupStart_ns = getMonotonicTimeNS();
+  logMessage = malloc(sizeof(char) * 256);
+  numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  readers = calloc(numStreams, sizeof(struct stripeReader));
+
+  // Socket configuration
+  sprintf(logMessage, "[Consumer] Opening %d striped streams to %s:%d", numStreams, hostname, portno);
+  writeInfoLog(fdlog_info, logMessage);
+  server = getHostFromName(hostname, fdlog_err);
+  bzero((char *) &servAddr, sizeof(servAddr));
+  servAddr.sin_family = AF_INET;
+  bcopy((char *) server->h_addr, (char *)&servAddr.sin_addr.s_addr, server->h_length);
+  servAddr.sin_port = htons(portno);
+
+  // Connect all streams to the server as soon as it is listening
+  waitForListener();
+  writeInfoLog(fdlog_info, "[Consumer] Connecting to server");
+  for (int i = 0; i < numStreams; i++) {
+    uint64_t connectStart_ns = traceBegin();
+
+    readers[i].fd = socketCreate(AF_INET, SOCK_STREAM, 0, fdlog_err);
+    socketApplyBufferSizes(readers[i].fd, consumerSocketTuning(), fdlog_err);
+    socketConnect(readers[i].fd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
+    traceEnd("connect", "setup", connectStart_ns);
+    socketApplyTuning(readers[i].fd, consumerSocketTuning(), "Consumer", fdlog_info, fdlog_err);
+    readers[i].payload = (char*) messages;
+    readers[i].payloadLength = (size_t) numReads * MESSAGE_SIZE_B;
+  }
+  recordSetupTime(setupStart_ns);
+  transferStart();
+
+  for (int i = 0; i < numStreams; i++) {
+    threadCreate(&readers[i].thread, stripeReaderThread, &readers[i], fdlog_err);
+  }
+
+  totalBytes = 0;
+  for (int i = 0; i < numStreams; i++) {
+    threadJoin(readers[i].thread, fdlog_err);
+    totalBytes += readers[i].bytesRead;
+  }
+
+  // Timer end
+  timeEnd_ns = getMonotonicTimeNS();
+
+  if (totalBytes != (size_t) numReads * MESSAGE_SIZE_B) {
+    printf("Error in consumer.c readSocketStriped: received %zu of %zu bytes\n",
+        totalBytes, (size_t) numReads * MESSAGE_SIZE_B);
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "consumer.c: readSocketStriped incomplete transfer", 0);
+    exit(-1);
+  }
+
+  // Acknowledge every stream
+  for (int i = 0; i < numStreams; i++) {
+    socketWrite(readers[i].fd, 1, MESSAGE_SIZE_B, fdlog_err);
+  }
+  writeInfoLog(fdlog_info, "[Consumer] Data transfer complete");
+
+  // The producer only finishes once every stream is acknowledged, so check the
+  // data against what it sent after the acknowledgements
+  timeToTransfer_s = transferEnd(messages, totalBytes / MESSAGE_SIZE_B, timeEnd_ns);
+
+  // Cleanup
+  writeInfoLog(fdlog_info, "[Consumer] Closing sockets");
+  for (int i = 0; i < numStreams; i++) {
+    socketClose(readers[i].fd, fdlog_err);
+  }
+  writeInfoLog(fdlog_info, "[Consumer] Sockets closed");
+  free(readers);
+
+  return timeToTransfer_s;
 }
 
 double readSharedMemory(int sizeDataMiB, int messages[], int circularBufferSize) {
-  sem_t* mutexCircBuffer;
-  sem_t* semConsumer;
-  sem_t* semProducer;
-  sem_t* semCircBufferProducer;
-  sem_t* semCircBufferConsumer;
-  int cbufferTail; // Keeps track of position in circular buffer
+  struct ringBuffer* ring;
+  uint32_t capacity;
   int numReads;
-  double timerStart_ms, timerEnd_ms;
-  double timeToTransfer_ms; // milliseconds
-  void* ptrShmTimer;
-  void* ptrShmCBuffer;
+  double timeToTransfer_s;
 
   numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  capacity = ringCapacity(adaptRingBytes(circularBufferSize)); // as large as the producer made it
 
-  // Initialise shared memory
+  // Initialise shared memory, holding the ring
   writeInfoLog(fdlog_info, "[Consumer] Initialising shared memory");
-  ptrShmCBuffer = shmInit("/shm_arpassign2", NULL, circularBufferSize,
-      PROT_WRITE, MAP_SHARED, 0, fdlog_err);
-
-  // Semaphore to ensure correct usage of shared memory
-  writeInfoLog(fdlog_info, "[Consumer] Initializing semaphores");
-  cbufferTail = 0;
-  mutexCircBuffer = semOpen("arp2_mutex_cbuffer", 1, fdlog_err);
-  semConsumer = semOpen("/arp2_sem_consumer", 0, fdlog_err);
-  semProducer = semOpen("/arp2_sem_producer", 0, fdlog_err);
-  semCircBufferProducer = semOpen("/arp2_sem_cbuffer_producer",
-      circularBufferSize/MESSAGE_SIZE_B, fdlog_err);
-  semCircBufferConsumer = semOpen("/arp2_sem_cbuffer_consumer", 0, fdlog_err);
+  ring = shmInit("/shm_arpassign2", NULL, ringSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, 0, fdlog_err);
+
+  writeInfoLog(fdlog_info, "[Consumer] Waiting for the producer to initialise the ring");
+  ringWaitReady(ring);
+  if (ring->notify == RING_NOTIFY_EVENTFD) {
+    writeInfoLog(fdlog_info, "[Consumer] Receiving the ring doorbell");
+    ringDoorbellReceive(fdlog_err);
+  } else if (controlResume(control, fdlog_info) &&
+      !ringResume(ring, (uint32_t) resumedFrom.numMessages)) {
+    // Taking over from a consumer that died (ORION_RESUME)
+    printf("Error in consumer.c readSharedMemory: checkpoint is not in the ring\n");
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "consumer.c: readSharedMemory checkpoint is not in the ring", 0);
+    exit(-1);
+  }
 
   writeInfoLog(fdlog_info, "[Consumer] Reading from shared memory");
+  transferStart();
 
-  for (int i = 0; i < numReads; i++) {
-    semWait(semCircBufferConsumer, fdlog_err);
-    semWait(mutexCircBuffer, fdlog_err);
-    // Dividing cbufferTail by size of message because the ptr already increments by sizeof message
-    messages[i] = shmReadInteger(&ptrShmCBuffer, cbufferTail/MESSAGE_SIZE_B, fdlog_err);
-    semPost(mutexCircBuffer, fdlog_err);
-    cbufferTail = (++cbufferTail % (circularBufferSize - 1));
-    semPost(semCircBufferProducer, fdlog_err);
+  if (isCheckpointing && ring->notify != RING_NOTIFY_EVENTFD) {
+    readRingCheckpointed(ring, messages, resumedFrom.numMessages, numReads);
+  } else {
+    ringReceive(ring, messages, numReads, true, "Consumer", fdlog_info, fdlog_err);
+  }
+  if (ring->notify == RING_NOTIFY_EVENTFD) {
+    close(ringDoorbell);
   }
 
-  // Timer end
-  timerEnd_ms = getCurrrentTimeMS();
-  writeInfoLog(fdlog_info, "[Consumer] Ending transfer timer");
+  // Timer end, then check the data against what the producer sent
+  timeToTransfer_s = transferEnd(messages, numReads, getMonotonicTimeNS());
   writeInfoLog(fdlog_info, "[Consumer] Read complete");
 
-  // Wait for producer to have actually written to the shared memory!
-  writeInfoLog(fdlog_info, "[Consumer] Accessing semaphore arp2_sem_consumer");
-  semWait(semConsumer, fdlog_err);
+  // Cleanup: the next producer initialises the ring again
+  writeInfoLog(fdlog_info, "[Consumer] Unlinking shared memory");
+  __atomic_store_n(&ring->ready, 0, __ATOMIC_RELAXED);
+  shmUnlinkUnmap("/shm_arpassign2", (void**) &ring, ringSize(capacity), fdlog_err);
+  writeInfoLog(fdlog_info, "[Consumer] Shared memory unlinked");
 
-  // Calculating total transfer time
-  writeInfoLog(fdlog_info, "[Consumer] Reading transfer start time from shared memory");
-  timerStart_ms = shmReadOnce_double("/shm_timerStart", &ptrShmTimer, fdlog_err);
+  return timeToTransfer_s;
+}
 
-  // Let the producer know I'm done reading
-  writeInfoLog(fdlog_info, "[Consumer] Posting semaphore arp2_sem_producer");
-  semPost(semProducer, fdlog_err);
+double readMessageQueue(int sizeDataMiB, int messages[]) {
+  struct mq_attr attr;
+  struct mqControlRecord record;
+  struct traceChunk chunk;
+  char logMessage[160];
+  char* buffer;
+  mqd_t mqd;
+  size_t numReads;
+  size_t numReceived;
+  size_t length;
+  unsigned int priority;
+  uint64_t numControl;
+  uint64_t controlLatencySum_ns;
+  uint64_t controlLatencyMax_ns;
+  double timeToTransfer_s;
 
-  writeInfoLog(fdlog_info, "[Consumer] Calculating total transfer time");
-  timeToTransfer_ms = (timerEnd_ms - timerStart_ms)/1000;
+  numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
 
-  // Cleanup
-  writeInfoLog(fdlog_info, "[Consumer] Unlinking shared memory");
-  shmUnlinkUnmap("/shm_timerStart", &ptrShmTimer, sizeof(double), fdlog_err);
-  shmUnlinkUnmap("/shm_arpassign2", &ptrShmCBuffer, sizeof(double), fdlog_err);
-  writeInfoLog(fdlog_info, "[Consumer] Shared memory unlinked");
+  writeInfoLog(fdlog_info, "[Consumer] Opening message queue");
+  mqd = mqOpen("/orion_mq", O_RDONLY, getEnvInt("ORION_MQ_DEPTH", DEFAULT_MQ_DEPTH),
+      getEnvInt("ORION_MQ_MSG_KIB", DEFAULT_MQ_MSG_KIB)*1024, fdlog_err);
+  attr = mqGetAttr(mqd, fdlog_err);
+  buffer = malloc(attr.mq_msgsize);
+
+  writeInfoLog(fdlog_info, "[Consumer] Reading from message queue");
+  transferStart();
+
+  numReceived = 0;
+  numControl = 0;
+  controlLatencySum_ns = 0;
+  controlLatencyMax_ns = 0;
+  traceChunkStart(&chunk, "receive");
+  while (numReceived < numReads) {
+    length = mqReceive(mqd, buffer, attr.mq_msgsize, &priority, fdlog_err);
+
+    if (priority > 0) {
+      // Control record from the priority lane
+      uint64_t latency_ns;
+
+      memcpy(&record, buffer, sizeof(record));
+      latency_ns = getMonotonicTimeNS() - record.sent_ns;
+      controlLatencySum_ns += latency_ns;
+      if (latency_ns > controlLatencyMax_ns) {
+        controlLatencyMax_ns = latency_ns;
+      }
+      numControl++;
+      statsSyscalls(1);
+      continue;
+    }
 
-  writeInfoLog(fdlog_info, "[Consumer] Unlinking semaphores");
-  semUnlink("/arp2_mutex_cbuffer", fdlog_err);
-  semUnlink("/arp2_sem_consumer", fdlog_err);
-  semUnlink("/arp2_sem_cbuffer_consumer", fdlog_err);
-  writeInfoLog(fdlog_info, "[Consumer] Semaphores unlinked");
+    if (length > (numReads - numReceived) * MESSAGE_SIZE_B) {
+      printf("Error in consumer.c readMessageQueue: record overflows the payload\n");
+      fflush(stdout);
+      writeErrorLog(fdlog_err, "consumer.c: readMessageQueue record overflows the payload", 0);
+      exit(-1);
+    }
+    memcpy(&messages[numReceived], buffer, length);
+    paceArrived(numReceived, length / MESSAGE_SIZE_B);
+    analyticsArrived(numReceived, length / MESSAGE_SIZE_B);
+    sinkArrived(numReceived, length / MESSAGE_SIZE_B);
+    numReceived += length / MESSAGE_SIZE_B;
+    statsTransfer(length, 1, 1);
+    traceChunkAdd(&chunk, length);
+  }
+  traceChunkFinish(&chunk);
 
-  return timeToTransfer_ms;
+  // Timer end, then check the data against what the producer sent
+  timeToTransfer_s = transferEnd(messages, numReceived, getMonotonicTimeNS());
+  writeInfoLog(fdlog_info, "[Consumer] Read complete");
+
+  if (numControl > 0) {
+    sprintf(logMessage, "[Consumer] %lu control records, latency mean %.1f us max %.1f us",
+        (unsigned long) numControl, controlLatencySum_ns / 1000.0 / numControl, controlLatencyMax_ns / 1000.0);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+
+  // Control records sent after the last data record are still queued, and
+  // go with the queue
+  writeInfoLog(fdlog_info, "[Consumer] Unlinking message queue");
+  mqClose(mqd, "/orion_mq", true, fdlog_err);
+  free(buffer);
+
+  return timeToTransfer_s;
+}
+
+double readJournal(int sizeDataMiB, int messages[]) {
+  struct journalRecord* record;
+  struct traceChunk chunk;
+  char logMessage[160];
+  size_t numReads;
+  size_t numReceived;
+  size_t index;
+  uint64_t position;
+  uint64_t committedTo;
+  uint64_t numRecovered;
+  double timeToTransfer_s;
+
+  numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+
+  // The producer creates the journal before starting the transfer
+  writeInfoLog(fdlog_info, "[Consumer] Waiting for the producer to create the journal");
+  if (controlWaitState(control, CONTROL_RUNNING) == CONTROL_FAILED) {
+    printf("Error in consumer.c readJournal: the producer failed\n");
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "consumer.c: readJournal producer failed", 0);
+    exit(-1);
+  }
+  writeInfoLog(fdlog_info, "[Consumer] Opening journal");
+  committedTo = journalOpen("Consumer", fdlog_info, fdlog_err);
+
+  writeInfoLog(fdlog_info, "[Consumer] Reading from journal");
+  transferStart();
+
+  position = 0;
+  numReceived = 0;
+  numRecovered = 0;
+  traceChunkStart(&chunk, "tail");
+  while ((record = journalRead(&position)) != NULL) {
+    index = record->offset / MESSAGE_SIZE_B;
+    if (record->length % MESSAGE_SIZE_B != 0 || index + record->length / MESSAGE_SIZE_B > numReads) {
+      printf("Error in consumer.c readJournal: record overflows the payload\n");
+      fflush(stdout);
+      writeErrorLog(fdlog_err, "consumer.c: readJournal record overflows the payload", 0);
+      exit(-1);
+    }
+
+    // What a previous consumer committed is read back from disk, checked
+    // against the record checksum, without counting towards latency
+    if (position <= committedTo) {
+      if (!journalIsIntact(record)) {
+        printf("Error in consumer.c readJournal: torn record at offset %lu\n", (unsigned long) record->offset);
+        fflush(stdout);
+        writeErrorLog(fdlog_err, "consumer.c: readJournal torn record", 0);
+        exit(-1);
+      }
+      numRecovered++;
+    } else {
+      journalRecordLatency(record);
+    }
+
+    memcpy(&messages[index], record + 1, record->length);
+    numReceived += record->length / MESSAGE_SIZE_B;
+    paceArrived(index, record->length / MESSAGE_SIZE_B);
+    analyticsArrived(index, record->length / MESSAGE_SIZE_B);
+    sinkArrived(index, record->length / MESSAGE_SIZE_B);
+    statsTransfer(record->length, 1, 0);
+    traceChunkAdd(&chunk, record->length);
+    journalCommit(position, false);
+  }
+  traceChunkFinish(&chunk);
+
+  // Timer end, then check the data against what the producer sent
+  timeToTransfer_s = transferEnd(messages, numReceived, getMonotonicTimeNS());
+  writeInfoLog(fdlog_info, "[Consumer] Read complete");
+
+  journalCommit(position, true);
+  if (numRecovered > 0) {
+    sprintf(logMessage, "[Consumer] Recovered %lu records committed before the restart", (unsigned long) numRecovered);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+  journalFinish(&journalLatency, "Consumer", fdlog_info);
+
+  return timeToTransfer_s;
+}
+
+double readDatagram(int sizeDataMiB, int messages[], int portno) {
+  struct mmsghdr* msgs;
+  struct iovec* iovs;
+  struct traceChunk chunk;
+  struct timeval timeout;
+  struct cmsghdr* cmsg;
+  sem_t* semBound;
+  char* buffers;
+  char* controls;
+  size_t bufferSize;
+  size_t segmentSize;
+  size_t numReads;
+  uint64_t numBytes;
+  uint64_t lastArrival_ns;
+  int64_t index;
+  int sockfd;
+  int numMsgs;
+  double timeToTransfer_s;
+  const size_t controlSize = CMSG_SPACE(sizeof(int));
+
+  numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  dgramSelect("Consumer", fdlog_info);
+  dgramReceiverInit(numReads);
+
+  // Bound before the producer sends anything, then waits at most
+  // DGRAM_IDLE_MS at a time so that it notices the end of the transfer
+  writeInfoLog(fdlog_info, "[Consumer] Binding datagram socket");
+  sockfd = dgramOpen(false, portno, "Consumer", fdlog_info, fdlog_err);
+  timeout.tv_sec = 0;
+  timeout.tv_usec = DGRAM_IDLE_MS * 1000;
+  socketSetOpt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout), fdlog_err);
+  semBound = semOpen("/orion_sem_dgram", 0, fdlog_err);
+  semPost(semBound, fdlog_err);
+  semClose(semBound, fdlog_err);
+
+  // One buffer per datagram of a batch, large enough for what GRO coalesces
+  bufferSize = dgram.isGro ? (size_t) DGRAM_MAX_SIZE : dgramSize(dgram.numPerDatagram);
+  buffers = malloc(bufferSize * dgram.batch);
+  controls = malloc(controlSize * dgram.batch);
+  iovs = malloc(sizeof(struct iovec) * dgram.batch);
+  msgs = calloc(dgram.batch, sizeof(struct mmsghdr));
+
+  writeInfoLog(fdlog_info, "[Consumer] Receiving datagrams");
+  transferStart();
+
+  lastArrival_ns = getMonotonicTimeNS();
+  traceChunkStart(&chunk, "recvmmsg");
+  while (receiver.numReceived < receiver.numDatagrams) {
+    for (int i = 0; i < dgram.batch; i++) {
+      iovs[i].iov_base = buffers + i * bufferSize;
+      iovs[i].iov_len = bufferSize;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_control = dgram.isGro ? controls + i * controlSize : NULL;
+      msgs[i].msg_hdr.msg_controllen = dgram.isGro ? controlSize : 0;
+    }
+
+    // Whatever is queued, once at least one datagram is
+    numMsgs = recvmmsg(sockfd, msgs, dgram.batch, MSG_WAITFORONE, NULL);
+    if (numMsgs < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      statsSyscalls(1);
+      // Nothing for a while: the rest is lost if the producer is done
+      if (__atomic_load_n(&control->state, __ATOMIC_ACQUIRE) >= CONTROL_DONE) {
+        break;
+      }
+      continue;
+    }
+    if (numMsgs < 0) {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("consumer.c readDatagram recvmmsg");
+      writeErrorLog(fdlog_err, "consumer.c: readDatagram recvmmsg failed", errno);
+      exit(-1);
+    }
+    lastArrival_ns = getMonotonicTimeNS();
+
+    numBytes = 0;
+    for (int i = 0; i < numMsgs; i++) {
+      // GRO hands over several datagrams of the same size back to back
+      segmentSize = msgs[i].msg_len;
+      for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+          segmentSize = *(int*) CMSG_DATA(cmsg);
+        }
+      }
+
+      for (size_t offset = 0; offset < msgs[i].msg_len; offset += segmentSize) {
+        char* datagram = (char*) iovs[i].iov_base + offset;
+        size_t length = msgs[i].msg_len - offset < segmentSize ? msgs[i].msg_len - offset : segmentSize;
+
+        index = dgramAccept(datagram, length, messages, numReads);
+        if (index < 0) {
+          continue;
+        }
+        numBytes += length - sizeof(struct dgramHeader);
+        paceArrived(index, ((struct dgramHeader*) datagram)->numMessages);
+      }
+    }
+    statsTransfer(numBytes, numMsgs, 1);
+    traceChunkAdd(&chunk, numBytes);
+  }
+  traceChunkFinish(&chunk);
+
+  // Timer end at the last arrival. Only a complete transfer can be checked
+  // against what the producer sent; otherwise each datagram that arrived was
+  // checked on its own.
+  if (receiver.numReceived == receiver.numDatagrams && receiver.numCorrupt == 0) {
+    timeToTransfer_s = transferEnd(messages, numReads, lastArrival_ns);
+  } else {
+    controlPhaseEnd(control, false, PHASE_TRANSFER);
+    controlPhaseBegin(PHASE_TEARDOWN);
+    controlWaitProducer(control, fdlog_info, fdlog_err);
+    timeToTransfer_s = controlConsumerRelease(control, lastArrival_ns, receiver.numMessages * MESSAGE_SIZE_B,
+        checksumMessages(messages, 0, numReads));
+    isDataVerified = receiver.numCorrupt == 0;
+  }
+  dgramReceiverFinish(&datagramLoss, timeToTransfer_s, MIB_TO_B_CONSTANT, "Consumer", fdlog_info);
+
+  socketClose(sockfd, fdlog_err);
+  free(buffers);
+  free(controls);
+  free(iovs);
+  free(msgs);
+
+  return timeToTransfer_s;
+}
+
+void readRingCheckpointed(struct ringBuffer* ring, int messages[], size_t from, size_t numMessages) {
+  size_t numReceived = from;
+  size_t numBatch;
+  struct traceChunk chunk;
+
+  traceChunkStart(&chunk, "read");
+  while (numReceived < numMessages) {
+    numBatch = ringPeek(ring, &messages[numReceived], numMessages - numReceived);
+    if (numBatch == 0) {
+      ringWaitData(ring, true);
+      continue;
+    }
+    // Recorded before the producer may overwrite the batch
+    controlCheckpoint(control, messages, numReceived + numBatch);
+    ringRelease(ring, numBatch, true);
+    paceArrived(numReceived, numBatch);
+    analyticsArrived(numReceived, numBatch);
+    sinkArrived(numReceived, numBatch);
+    numReceived += numBatch;
+    traceChunkAdd(&chunk, numBatch * MESSAGE_SIZE_B);
+  }
+  traceChunkFinish(&chunk);
+}
+
+void serveDaemonJobs(int sizeDataMiB, int messages[], char* hostname, int portno) {
+  struct daemonMessage job;
+  struct transferResult result;
+  struct ringBuffer* ring = NULL;
+  struct sockaddr_in servAddr;
+  struct hostent* server;
+  uint32_t capacity;
+  uint64_t setupStart_ns;
+  int fd = daemonChannel();
+  int sockfd = -1;
+  int numReads;
+  double timeToTransfer_s;
+  char logMessage[128];
+
+  setupStart_ns = getMonotonicTimeNS();
+  capacity = ringCapacity(getEnvInt("ORION_RING_KIB", CIRC_BUFFER_SIZE/1024)*1024);
+
+  // The link is set up once, for every job
+  if (choiceIPC == 3) {
+    writeInfoLog(fdlog_info, "[Consumer] Initialising shared memory");
+    ring = shmInit("/shm_arpassign2", NULL, ringSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, 0, fdlog_err);
+    writeInfoLog(fdlog_info, "[Consumer] Waiting for the producer to initialise the ring");
+    ringWaitReady(ring);
+  } else {
+    sprintf(logMessage, "[Consumer] Opening socket on %s:%d", hostname, portno);
+    writeInfoLog(fdlog_info, logMessage);
+    sockfd = socketCreate(AF_INET, SOCK_STREAM, 0, fdlog_err);
+    server = getHostFromName(hostname, fdlog_err);
+    bzero((char *) &servAddr, sizeof(servAddr));
+    servAddr.sin_family = AF_INET;
+    bcopy((char *) server->h_addr, (char *)&servAddr.sin_addr.s_addr, server->h_length);
+    servAddr.sin_port = htons(portno);
+
+    waitForListener();
+    writeInfoLog(fdlog_info, "[Consumer] Connecting to server");
+    socketApplyBufferSizes(sockfd, consumerSocketTuning(), fdlog_err);
+    socketConnect(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
+    socketApplyTuning(sockfd, consumerSocketTuning(), "Consumer", fdlog_info, fdlog_err);
+  }
+  recordSetupTime(setupStart_ns);
+
+  writeInfoLog(fdlog_info, "[Consumer] Waiting for jobs from the master");
+  while (daemonReceive(fd, &job) && job.command == DAEMON_JOB) {
+    if (job.sizeDataMiB < 1 || job.sizeDataMiB > sizeDataMiB) {
+      printf("Error in consumer.c serveDaemonJobs: job of %d MiB, at most %d expected\n", job.sizeDataMiB, sizeDataMiB);
+      fflush(stdout);
+      writeErrorLog(fdlog_err, "consumer.c: serveDaemonJobs job larger than the buffer", 0);
+      exit(-1);
+    }
+    numReads = (job.sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+    sprintf(logMessage, "[Consumer] Starting a job of %dMiB", job.sizeDataMiB);
+    writeInfoLog(fdlog_info, logMessage);
+
+    // The producer has already started the session of the job
+    isControlComplete = false;
+    controlPhaseBegin(PHASE_SETUP);
+    transferStart();
+    if (ring != NULL) {
+      ringRead(ring, messages, numReads, true);
+    } else {
+      numReads = readSocketJob(sockfd, job.sizeDataMiB, messages);
+    }
+    timeToTransfer_s = transferEnd(messages, numReads, getMonotonicTimeNS());
+    controlPhaseEnd(control, false, PHASE_TEARDOWN);
+    controlLogPhases(control, false, fdlog_info);
+
+    sprintf(logMessage, "[Consumer] Total transfer time: %.3f seconds", timeToTransfer_s);
+    writeInfoLog(fdlog_info, logMessage);
+
+    // The link was already up, so there was no setup to measure
+    memset(&result, 0, sizeof(result));
+    result.pid = getpid();
+    result.transport = choiceIPC;
+    result.sizeDataMiB = job.sizeDataMiB;
+    result.isVerified = isDataVerified;
+    result.transfer_s = timeToTransfer_s;
+    result.setup_ms = -1;
+    if (!daemonSend(fd, DAEMON_DONE, job.sizeDataMiB, &result)) {
+      break;
+    }
+  }
+
+  // Told to stop, or the master went away
+  writeInfoLog(fdlog_info, "[Consumer] No more jobs, closing the link");
+  if (ring != NULL) {
+    // The next producer initialises the ring again
+    __atomic_store_n(&ring->ready, 0, __ATOMIC_RELAXED);
+    shmUnlinkUnmap("/shm_arpassign2", (void**) &ring, ringSize(capacity), fdlog_err);
+  } else {
+    socketClose(sockfd, fdlog_err);
+  }
+  isControlComplete = true;
+}
+
+int readSocketJob(int sockfd, int sizeDataMiB, int messages[]) {
+  int numReads;
+  int numBlocks;
+  int remainder;
+  int numPieces;
+  int numToRead;
+  int numReadsPerBlock;
+  int numReadsRemainder;
+  int messageIndex;
+
+  numReads = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+
+  // Blocks of 2MB, as in readSocket
+  numBlocks = (int) sizeDataMiB / 2;
+  if (sizeDataMiB > 2) {
+    remainder = sizeDataMiB % 2;
+  } else {
+    remainder = sizeDataMiB;
+  }
+  numReadsRemainder = (remainder*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B;
+  if (numBlocks != 0) {
+    numReadsPerBlock = numReads/numBlocks - numReadsRemainder;
+  } else {
+    numReadsPerBlock = 0;
+  }
+  numPieces = numBlocks + (remainder != 0);
+
+  socketWrite(sockfd, numBlocks, MESSAGE_SIZE_B, fdlog_err);
+  socketWrite(sockfd, remainder, MESSAGE_SIZE_B, fdlog_err);
+
+  messageIndex = 0;
+  for (int piece = 0; piece < numPieces; piece++) {
+    numToRead = piece < numBlocks ? numReadsPerBlock : numReadsRemainder;
+    for (int j = 0; j < numToRead; j++) {
+      messages[messageIndex] = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
+      statsTransfer(MESSAGE_SIZE_B, 1, 1);
+      messageIndex++;
+    }
+
+    // The next block, or the next job, only comes once this one is in
+    socketWrite(sockfd, 1, MESSAGE_SIZE_B, fdlog_err);
+    statsSyscalls(1);
+  }
+
+  return messageIndex;
 }
@@ -0,0 +1,141 @@
+#include "../include/common.h"
+#include "../include/kernels.h"
+
+/**
+* kernelbench times every analytics kernel of kernels.h in each version the
+* CPU supports against the scalar one, on a payload like the producer's, and
+* checks that they all agree.
+*
+* Usage: kernelbench [size MiB] [repetitions]
+* Every kernel is run repetitions times (default 5) and the fastest run is
+* reported. Exits with a non-zero status if a version disagrees.
+*/
+
+// What a kernel computed, compared with the scalar version
+struct kernelOutput {
+  int64_t values[KERNEL_HISTOGRAM_BINS];
+  int numValues;
+};
+
+// Runs one kernel of a table over data[0..n)
+typedef void (*kernelRunner)(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out);
+
+void runSum(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out);
+void runMinMax(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out);
+void runHistogram(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out);
+void runThreshold(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out);
+void runWindowMax(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out);
+
+const int DEFAULT_SIZE_MIB = 64;
+const int DEFAULT_REPETITIONS = 5;
+const int BENCH_THRESHOLD = 99;
+const size_t BENCH_WINDOW = 1024;
+const char* KERNEL_NAMES[] = {"sum", "minmax", "histogram", "threshold", "average"};
+const kernelRunner KERNEL_RUNNERS[] = {runSum, runMinMax, runHistogram, runThreshold, runWindowMax};
+const int NUM_KERNELS = 5;
+
+int main (int argc, char** argv) {
+  int sizeMiB;
+  int numRepetitions;
+  size_t numMessages;
+  int* data;
+  struct kernelOutput expected;
+  struct kernelOutput output;
+  bool isCorrect = true;
+
+  sizeMiB = (argc >= 2) ? atoi(argv[1]) : DEFAULT_SIZE_MIB;
+  numRepetitions = (argc >= 3) ? atoi(argv[2]) : DEFAULT_REPETITIONS;
+  if (sizeMiB <= 0 || numRepetitions <= 0) {
+    fprintf(stderr, "ERROR: size and repetitions must be positive numbers\n");
+    exit(-1);
+  }
+
+  // Same values as the producer's payload; an odd length exercises the tails
+  numMessages = (size_t) sizeMiB * 1024 * 1024 / sizeof(int) - 3;
+  data = malloc(numMessages * sizeof(int));
+  srand(time(NULL));
+  for (size_t i = 0; i < numMessages; i++) {
+    data[i] = rand() % 100;
+  }
+
+  printf("%d MiB, fastest of %d runs\n", sizeMiB, numRepetitions);
+  printf("%-10s %-8s %10s %9s %8s\n", "kernel", "version", "ms", "GiB/s", "speedup");
+  for (int k = 0; k < NUM_KERNELS; k++) {
+    double scalar_ns = 0;
+
+    for (int t = 0; t < NUM_KERNEL_TABLES; t++) {
+      uint64_t best_ns = UINT64_MAX;
+
+      if (!kernelIsSupported(&KERNEL_TABLES[t])) {
+        printf("%-10s %-8s %10s\n", KERNEL_NAMES[k], KERNEL_TABLES[t].name, "unsupported");
+        continue;
+      }
+
+      for (int run = 0; run < numRepetitions; run++) {
+        uint64_t start_ns = getMonotonicTimeNS();
+        uint64_t elapsed_ns;
+
+        KERNEL_RUNNERS[k](&KERNEL_TABLES[t], data, numMessages, &output);
+        elapsed_ns = getMonotonicTimeNS() - start_ns;
+        best_ns = elapsed_ns < best_ns ? elapsed_ns : best_ns;
+      }
+
+      if (t == 0) {
+        expected = output;
+        scalar_ns = best_ns;
+      } else if (output.numValues != expected.numValues ||
+          memcmp(output.values, expected.values, sizeof(int64_t) * output.numValues) != 0) {
+        printf("%-10s %-8s disagrees with the scalar version\n", KERNEL_NAMES[k], KERNEL_TABLES[t].name);
+        isCorrect = false;
+        continue;
+      }
+
+      printf("%-10s %-8s %10.3f %9.2f %7.2fx\n", KERNEL_NAMES[k], KERNEL_TABLES[t].name, best_ns / 1.0e6,
+          numMessages * sizeof(int) / (1024.0 * 1024.0 * 1024.0) / (best_ns / 1.0e9), scalar_ns / best_ns);
+    }
+  }
+  fflush(stdout);
+
+  free(data);
+  return isCorrect ? 0 : -1;
+}
+
+void runSum(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out) {
+  out->values[0] = table->sum(data, n);
+  out->numValues = 1;
+}
+
+void runMinMax(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out) {
+  int min = INT32_MAX;
+  int max = INT32_MIN;
+
+  table->minMax(data, n, &min, &max);
+  out->values[0] = min;
+  out->values[1] = max;
+  out->numValues = 2;
+}
+
+void runHistogram(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out) {
+  uint64_t histogram[KERNEL_HISTOGRAM_BINS] = {0};
+
+  table->histogram(data, n, histogram);
+  for (int i = 0; i < KERNEL_HISTOGRAM_BINS; i++) {
+    out->values[i] = histogram[i];
+  }
+  out->numValues = KERNEL_HISTOGRAM_BINS;
+}
+
+void runThreshold(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out) {
+  size_t first;
+
+  out->values[0] = table->threshold(data, n, BENCH_THRESHOLD, &first);
+  out->values[1] = first;
+  out->numValues = 2;
+}
+
+void runWindowMax(const struct kernelTable* table, const int* data, size_t n, struct kernelOutput* out) {
+  // Two halves, as the analytics workers would see two ranges
+  out->values[0] = table->windowMax(data, 0, n / 2, BENCH_WINDOW);
+  out->values[1] = table->windowMax(data, n / 2, n, BENCH_WINDOW);
+  out->numValues = 2;
+}
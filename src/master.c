@@ -1,27 +1,125 @@
 #include "../include/common.h"
+#include "../include/perf.h"
+#include "../include/trace.h"
+#include "../include/result.h"
+#include "../include/bench.h"
+#include "../include/control.h"
+#include "../include/daemon.h"
 
 /**
 * The master process prompts users to select the transfer method and opens the
 * appropriate processes.
+*
+* Usage: master [debug]
+*        master bench <protocols> <sizes MiB> [port]
+* The bench mode repeats transmissions for every protocol (1-8) and size in the
+* comma-separated lists, prints statistics and can compare them with a saved
+* baseline, measures latency at the steady rates of ORION_BENCH_PACE_RATES,
+* how processing scales with ORION_BENCH_ANALYTICS_WORKERS, or what every
+* durability setting of ORION_BENCH_JOURNAL_SYNC costs (see README).
 */
 
+#define MAX_CONSUMERS 64
+
 // Print decorative text
 void printStartOfTransmission(char* transmissionProtocol);
 
+// Forks and executes argList[0] so master process can remain in control
+pid_t spawnChild(char* argList[]);
+
+// Runs one transmission with protocol (1 to 8, as numbered in the menu) and
+// waits for it to end, after removing what a previous session that died left
+// behind. A consumer of a resumable transfer (ORION_RESUME) killed by a signal
+// is replaced, up to ORION_RESUME_ATTEMPTS times. With ORION_DAEMON=1, single
+// socket and shared memory transmissions go to warm workers instead, which are
+// stopped before any other one. result gets the slowest
+// consumer's result. Returns false if a process failed or the data did not
+// match.
+bool runTransmission(int protocol, char* sizeDataMiB_str, char* portno_str, struct transferResult* result);
+
+// Runs one transmission on the warm workers (ORION_DAEMON=1), after starting
+// them if none are running for this protocol and port, or they hold less data
+// than sizeDataMiB_str. Returns false if a worker failed or the data did not
+// match.
+bool runDaemonTransmission(int protocol, char* sizeDataMiB_str, char* portno_str, struct transferResult* result);
+
+// Starts a producer and a consumer that keep their link for as many jobs of
+// up to sizeDataMiB_str as the master sends them
+void startWorkers(int protocol, char* sizeDataMiB_str, char* portno_str);
+
+// Stops the warm workers, if any
+void stopWorkers();
+
+// Repeats a transmission ORION_BENCH_RUNS times after ORION_BENCH_WARMUP
+// discarded runs, prints summary statistics and stores them in entry. Returns
+// false if a run failed.
+bool runBenchmark(int protocol, int sizeDataMiB, char* portno_str, struct benchEntry* entry);
+
+// Benchmarks every protocol and size of the comma-separated lists, then
+// compares with ORION_BENCH_BASELINE, writes ORION_BENCH_REPORT and saves
+// ORION_BENCH_SAVE. Returns the exit status: non-zero on failure or regression.
+int runBenchmarks(char* protocols_str, char* sizes_str, char* portno_str);
+
+// Measures latency at every rate (messages/s) of the comma-separated list for
+// every protocol and size, ORION_BENCH_RUNS times each, and prints a table.
+// Returns the exit status: non-zero if a run failed.
+int runPacedBenchmarks(int protocols[], int numProtocols, int sizes[], int numSizes, char* rates_str,
+    char* portno_str);
+
+// Measures the time to receive and process (ORION_ANALYTICS) the data with
+// every worker count of the comma-separated list, for every protocol and size,
+// ORION_BENCH_RUNS times each, and prints a table. Returns the exit status:
+// non-zero if a run failed.
+int runAnalyticsBenchmarks(int protocols[], int numProtocols, int sizes[], int numSizes, char* workers_str,
+    char* portno_str);
+
+// Measures throughput and record latency of the journal with every durability
+// setting (ORION_JOURNAL_SYNC) of the comma-separated list, for every protocol
+// and size, ORION_BENCH_RUNS times each, and prints a table. Returns the exit
+// status: non-zero if a run failed.
+int runJournalBenchmarks(int protocols[], int numProtocols, int sizes[], int numSizes, char* syncs_str,
+    char* portno_str);
+
+// Parses a comma-separated list of integers between min and max. Returns the
+// number of values, -1 if one is out of range.
+int parseList(char* list_str, int values[], int maxValues, int min, int max);
+
 int TEXT_DELAY = 25000; // Delay in "typing" text to terminal
 bool DEBUG_MODE = false;
 const int MAX_SIZE_MIB = 100; // Amount of data to transfer
+const char* PROTOCOL_NAMES[] = {"Unnamed Pipes", "Named Pipes", "Sockets", "Shared Memory", "Threads",
+    "Message Queues", "Journal", "Datagrams"};
+const int NUM_PROTOCOLS = 8;
+const int PROTOCOL_THREADS = 5; // in-process baseline the others are compared with
+const int DEFAULT_RESUME_ATTEMPTS = 3; // consumers started to replace ones that died
+// Info log, for what the master cleans up
+int fdlog_info;
+// Warm producer and consumer of ORION_DAEMON=1
+struct daemonWorkers workers;
 
 int main (int argc, char** argv) {
   bool isInputCorrect;
   bool isRunning;
-  bool hasOneChild;
   int sizeDataMiB;
   char* sizeDataMiB_str;
+  char portno_str[8];
   int input;
-  int retStatus;
-  pid_t childPID;
-  pid_t waitPID;
+  int protocol;
+  struct transferResult result;
+  char adaptText[192];
+
+  // Optional session timeline (ORION_TRACE): every transmission of this run is
+  // appended to a fresh trace file
+  traceOpen("master");
+  if (traceIsEnabled() && truncate(tracePath, 0) < 0 && errno != ENOENT) {
+    perror("ERROR in trace file truncate");
+  }
+  fdlog_info = openInfoLog();
+  atexit(stopWorkers);
+
+  if (argc >= 4 && !strcmp(argv[1], "bench")) {
+    return runBenchmarks(argv[2], argv[3], (argc >= 5) ? argv[4] : "4000");
+  }
 
   if (argc == 1) {
     DEBUG_MODE = false;
@@ -39,7 +137,6 @@ int main (int argc, char** argv) {
 
   isRunning = true;
   while (isRunning) {
-    hasOneChild = false;
     isInputCorrect = false;
     sizeDataMiB_str = malloc(sizeof(char)*8); // Just some extra room!
     sizeDataMiB = 1;
@@ -83,7 +180,11 @@ int main (int argc, char** argv) {
     displayText("1) Unnamed Pipes\n", TEXT_DELAY);
     displayText("2) Named Pipes\n", TEXT_DELAY);
     displayText("3) Sockets\n", TEXT_DELAY);
-    displayText("4) Shared Memory\n\n", TEXT_DELAY);
+    displayText("4) Shared Memory\n", TEXT_DELAY);
+    displayText("5) Threads (in-process baseline)\n", TEXT_DELAY);
+    displayText("6) Message Queues\n", TEXT_DELAY);
+    displayText("7) Journal (durable, on disk)\n", TEXT_DELAY);
+    displayText("8) Datagrams (lossy, UDP or unix)\n\n", TEXT_DELAY);
     displayText("Or press any other key to power down Orion.", TEXT_DELAY);
     fflush(stdout);
 
@@ -93,144 +194,50 @@ int main (int argc, char** argv) {
 
     // Spawn processes with user-specified configuration
     switch (input) {
-      case 49: {
+      case 49:
         // Key Pressed "1" : Unnamed Pipes
-        // Only need to spawn producer in this case, which spawns the consumer on its own!
-        char* argListProducer[] = {"./bin/producer", "0", sizeDataMiB_str, NULL};
-
-        hasOneChild = true; // Special case, only spawned producer
-
-        printStartOfTransmission("Unnamed Pipes");
-
-        // Forking so master process can remain in control
-        childPID = fork();
-        if (childPID == 0) {
-          // Child
-          if (execvp("./bin/producer", argListProducer) < 0) {
-            perror("ERROR in case 49 execvp");
-          }
-        } else if (childPID < 0) {
-          perror("ERROR in case 49 fork");
-          exit(-1);
-        }
-        break;
-      }
-
-      case 50: {
+      case 50:
         // Key pressed "2": Named Pipes
-        char* argListProducer[] = {"./bin/producer", "1", sizeDataMiB_str, NULL};
-        char* argListConsumer[] = {"./bin/consumer", "1", sizeDataMiB_str, NULL};
-
-        printStartOfTransmission("Named Pipes");
-
-        // Forking so master process can remain in control
-        // PRODUCER
-        childPID = fork();
-        if (childPID == 0) {
-          // Child
-          if (execvp("./bin/producer", argListProducer) < 0) {
-            perror("ERROR in case 50 execvp 1");
-          }
-        } else if (childPID < 0) {
-          perror("ERROR in case 50 fork 1");
-          exit(-1);
-        }
-
-        // CONSUMER
-        childPID = fork();
-        if (childPID == 0) {
-          // Child
-          if (execvp("./bin/consumer", argListConsumer) < 0) {
-            perror("ERROR in case 50 execvp 2");
-          }
-        } else if (childPID < 0) {
-          perror("ERROR in case 50 fork 2");
-          exit(-1);
-        }
+      case 52:
+        // Key pressed "4": Shared Memory
+      case 53:
+        // Key pressed "5": Threads
+      case 54:
+        // Key pressed "6": Message Queues
+      case 55:
+        // Key pressed "7": Journal
+      case 56: {
+        // Key pressed "8": Datagrams, on the default port
+        protocol = input - 48;
+        portno_str[0] = '\0';
 
+        printStartOfTransmission((char*) PROTOCOL_NAMES[protocol - 1]);
         break;
       }
 
       case 51: {
         // Key pressed "3": Sockets
-        char* portno_str = malloc(sizeof(char) * 5);
+        protocol = 3;
 
         // Get port number from user
         clearTerminal();
         displayText("Insert port number for transmission: ", TEXT_DELAY);
 
-        if (fgets(portno_str, sizeof(portno_str), stdin) < 0) {
+        if (fgets(portno_str, sizeof(portno_str), stdin) == NULL) {
           perror("ERROR in portno fgets");
           exit(-1);
         }
-
-        char* argListProducer[] = {"./bin/producer", "2", sizeDataMiB_str, portno_str, NULL};
-        char* argListConsumer[] = {"./bin/consumer", "2", sizeDataMiB_str, portno_str, NULL};
+        portno_str[strcspn(portno_str, "\n")] = '\0';
 
         clearTerminal();
         terminalColor(36, true);
-        printf("Port Number: %s", portno_str);
+        printf("Port Number: %s\n", portno_str);
+        // Tuning comes from ORION_SO_SNDBUF, ORION_TCP_NODELAY, ... (see README)
+        char tuningDescription[128];
+        socketTuningDescribe(socketTuningFromEnv(), tuningDescription);
+        printf("Socket tuning: %s\n", tuningDescription);
         fflush(stdout);
         printStartOfTransmission("Sockets");
-
-        // Forking so master process can remain in control
-        childPID = fork();
-        if (childPID == 0) {
-          // Child
-          if (execvp("./bin/producer", argListProducer) < 0) {
-            perror("ERROR in case 51 execvp 1");
-          }
-        } else if (childPID < 0) {
-          perror("ERROR in case 51 fork 1");
-          exit(-1);
-        }
-
-        // CONSUMER
-        childPID = fork();
-        if (childPID == 0) {
-          // Child
-          if (execvp("./bin/consumer", argListConsumer) < 0) {
-            perror("ERROR in case 50 execvp 2");
-          }
-        } else if (childPID < 0) {
-          perror("ERROR in case 50 fork 2");
-          exit(-1);
-        }
-
-        break;
-      }
-
-      case 52: {
-        // Key pressed "4": Shared Memory
-        char* argListProducer[] = {"./bin/producer", "3", sizeDataMiB_str, NULL};
-        char* argListConsumer[] = {"./bin/consumer", "3", sizeDataMiB_str, NULL};
-
-        printStartOfTransmission("Shared Memory");
-
-        // Forking so master process can remain in control
-        childPID = fork();
-        if (childPID == 0) {
-          // Child
-          if (execvp("./bin/producer", argListProducer) < 0) {
-            perror("ERROR in case 52 execvp 1");
-          }
-        } else if (childPID < 0) {
-          perror("ERROR in case 52 fork 1");
-          exit(-1);
-        }
-
-        // CONSUMER
-        childPID = fork();
-        if (childPID == 0) {
-          // Child
-          if (execvp("./bin/consumer", argListConsumer) < 0) {
-            perror("ERROR in case 50 execvp 2");
-          }
-        } else if (childPID < 0) {
-          perror("ERROR in case 50 fork 2");
-          exit(-1);
-        }
-
         break;
       }
 
@@ -243,21 +250,25 @@ int main (int argc, char** argv) {
       }
     }
 
-
-    if (hasOneChild) {
-      waitPID = wait(&retStatus);
-    } else {
-      waitPID = wait(&retStatus);
-      waitPID = wait(&retStatus);
-    }
-
-    if (WEXITSTATUS(retStatus) < 0) {
+    if (!runTransmission(protocol, sizeDataMiB_str, portno_str[0] != '\0' ? portno_str : NULL, &result)) {
       clearTerminal();
       terminalColor(31, true);
       displayText("Transmission error. Please consult error logs.\nSatellite powering off...", TEXT_DELAY);
+    } else if (result.setup_ms >= 0) {
+      printf("%.3f seconds (link setup: %.3f ms).", result.transfer_s, result.setup_ms);
+    } else {
+      printf("%.3f seconds.", result.transfer_s);
+    }
+    if (result.loss.numDatagrams > 0) {
+      printf(" Lost %lu of %lu datagrams.", (unsigned long) result.loss.numLost,
+          (unsigned long) result.loss.numDatagrams);
+    }
+    resultDescribeAdapt(&result.adapt, adaptText);
+    if (adaptText[0] != '\0') {
+      printf(" Adapted: %s.", adaptText);
     }
+    fflush(stdout);
 
-    displayText(" seconds.", TEXT_DELAY);
     displayText("\n\nPress any key to continue...", TEXT_DELAY);
     getchar();
   }
@@ -287,3 +298,848 @@ void printStartOfTransmission(char* transmissionProtocol) {
     terminalColor(32, true);
   }
 }
+
+pid_t spawnChild(char* argList[]) {
+  pid_t childPID;
+  uint64_t fork_ns = traceBegin();
+
+  childPID = fork();
+  if (childPID == 0) {
+    // Child: the spawned program records the time from fork to its main()
+    traceMarkSpawn(fork_ns);
+    if (execvp(argList[0], argList) < 0) {
+      perror("ERROR in spawnChild execvp");
+      exit(-1);
+    }
+  } else if (childPID < 0) {
+    perror("ERROR in spawnChild fork");
+    exit(-1);
+  }
+
+  traceEnd("fork", "startup", fork_ns);
+  return childPID;
+}
+
+bool runTransmission(int protocol, char* sizeDataMiB_str, char* portno_str, struct transferResult* result) {
+  char ipc_str[12];
+  char* argListProducer[] = {"./bin/producer", ipc_str, sizeDataMiB_str, portno_str, NULL};
+  char* argListConsumer[] = {"./bin/consumer", ipc_str, sizeDataMiB_str, portno_str, NULL};
+  struct transferResult results[MAX_CONSUMERS];
+  int resultFds[2];
+  int numConsumers;
+  int numChildren; // processes to wait for at the end of a transmission
+  int numResults;
+  int retStatus;
+  int numReplaced;
+  int maxReplaced;
+  pid_t producerPID;
+  pid_t childPID;
+  bool isSuccessful;
+  uint64_t transmissionStart_ns;
+  uint64_t transmissionEnd_ns;
+
+  snprintf(ipc_str, sizeof(ipc_str), "%d", protocol - 1);
+  numConsumers = 1;
+  if (protocol == 3 && socketLayoutError() != NULL) {
+    // The children would refuse to start anyway
+    printf("ERROR: %s\n", socketLayoutError());
+    fflush(stdout);
+    return false;
+  }
+  if (protocol == 3) {
+    // More than one consumer if ORION_SOCKET_CLIENTS is set, served concurrently
+    // by the producer
+    numConsumers = getEnvInt("ORION_SOCKET_CLIENTS", 1);
+    if (numConsumers < 1) {
+      numConsumers = 1;
+    } else if (numConsumers > MAX_CONSUMERS) {
+      numConsumers = MAX_CONSUMERS;
+    }
+  }
+
+  // Single sockets and shared memory links can be kept between transmissions
+  // (ORION_DAEMON=1). Anything else needs the control block to itself.
+  if (getEnvInt("ORION_DAEMON", 0) != 0 && numConsumers == 1 && (protocol == 3 || protocol == 4) &&
+      getEnvInt("ORION_SOCKET_STREAMS", 1) <= 1 && !controlIsResumable()) {
+    return runDaemonTransmission(protocol, sizeDataMiB_str, portno_str, result);
+  }
+  stopWorkers();
+
+  // Semaphores, rings and queues of a session that died would mislead this one
+  controlCleanStale(fdlog_info);
+
+  // Only sockets (classic server) and shared memory can replace a consumer
+  maxReplaced = 0;
+  if (controlIsResumable() && numConsumers == 1 && (protocol == 3 || protocol == 4)) {
+    maxReplaced = getEnvInt("ORION_RESUME_ATTEMPTS", DEFAULT_RESUME_ATTEMPTS);
+  }
+
+  transmissionStart_ns = getMonotonicTimeNS();
+  resultChannelOpen(resultFds);
+
+  producerPID = spawnChild(argListProducer);
+  numChildren = 1;
+  // Unnamed pipes and threads: the producer starts the consumer on its own
+  if (protocol != 1 && protocol != PROTOCOL_THREADS) {
+    for (int i = 0; i < numConsumers; i++) {
+      spawnChild(argListConsumer);
+    }
+    numChildren += numConsumers;
+  }
+  // Only the children may hold the write end, so reading stops once they exit.
+  // A consumer replacing one that died needs it too.
+  if (maxReplaced == 0) {
+    close(resultFds[1]);
+  }
+
+  isSuccessful = true;
+  numReplaced = 0;
+  for (int i = 0; i < numChildren; i++) {
+    childPID = wait(&retStatus);
+    if (childPID > 0 && childPID != producerPID && WIFSIGNALED(retStatus) && numReplaced < maxReplaced) {
+      // The new consumer takes over from the last checkpoint of this one
+      printf("Consumer %d killed by signal %d, starting another one\n", childPID, WTERMSIG(retStatus));
+      fflush(stdout);
+      spawnChild(argListConsumer);
+      numReplaced++;
+      i--;
+      continue;
+    }
+    if (childPID < 0 || !WIFEXITED(retStatus) || WEXITSTATUS(retStatus) != 0) {
+      isSuccessful = false;
+    }
+  }
+  if (maxReplaced > 0) {
+    close(resultFds[1]);
+  }
+  traceEnd("transmission", "session", transmissionStart_ns);
+  transmissionEnd_ns = getMonotonicTimeNS();
+
+  numResults = resultCollect(resultFds[0], results, MAX_CONSUMERS);
+  if (numResults != numConsumers) {
+    isSuccessful = false;
+  }
+
+  // The session lasts until its slowest consumer is done
+  memset(result, 0, sizeof(*result));
+  result->setup_ms = -1;
+  for (int i = 0; i < numResults; i++) {
+    if (!results[i].isVerified) {
+      isSuccessful = false;
+    }
+    if (i == 0 || results[i].transfer_s > result->transfer_s) {
+      *result = results[i];
+    }
+  }
+  // Generation, process start-up and link setup included
+  result->session_s = (transmissionEnd_ns - transmissionStart_ns) / 1.0e9;
+
+  return isSuccessful && numResults > 0;
+}
+
+bool runDaemonTransmission(int protocol, char* sizeDataMiB_str, char* portno_str, struct transferResult* result) {
+  struct daemonMessage reply;
+  int sizeDataMiB = atoi(sizeDataMiB_str);
+  bool isSuccessful;
+  uint64_t transmissionStart_ns;
+
+  transmissionStart_ns = getMonotonicTimeNS();
+  if (workers.isRunning && (workers.protocol != protocol || workers.sizeDataMiB < sizeDataMiB ||
+      strcmp(workers.portno_str, portno_str != NULL ? portno_str : "") != 0)) {
+    stopWorkers();
+  }
+  if (!workers.isRunning) {
+    startWorkers(protocol, sizeDataMiB_str, portno_str);
+  }
+
+  // The producer starts the session of the job before the consumer joins it
+  memset(result, 0, sizeof(*result));
+  result->setup_ms = -1;
+  isSuccessful = daemonSend(workers.producerFd, DAEMON_JOB, sizeDataMiB, NULL) &&
+      daemonReceive(workers.producerFd, &reply) && reply.command == DAEMON_READY &&
+      daemonSend(workers.consumerFd, DAEMON_JOB, sizeDataMiB, NULL) &&
+      daemonReceive(workers.consumerFd, &reply) && reply.command == DAEMON_DONE;
+  if (isSuccessful) {
+    *result = reply.result;
+    isSuccessful = daemonReceive(workers.producerFd, &reply) && reply.command == DAEMON_DONE;
+  }
+  traceEnd("transmission", "session", transmissionStart_ns);
+  // Only the transfer itself and the job messages
+  result->session_s = (getMonotonicTimeNS() - transmissionStart_ns) / 1.0e9;
+
+  // A worker that failed has exited: the next transmission starts new ones
+  if (!isSuccessful) {
+    stopWorkers();
+  }
+
+  return isSuccessful && result->isVerified;
+}
+
+void startWorkers(int protocol, char* sizeDataMiB_str, char* portno_str) {
+  char ipc_str[12];
+  char* argListProducer[] = {"./bin/producer", ipc_str, sizeDataMiB_str, portno_str, NULL};
+  char* argListConsumer[] = {"./bin/consumer", ipc_str, sizeDataMiB_str, portno_str, NULL};
+  char logMessage[128];
+  int fds[2];
+
+  snprintf(ipc_str, sizeof(ipc_str), "%d", protocol - 1);
+  controlCleanStale(fdlog_info);
+
+  // Each worker only gets its own end of its channel
+  daemonChannelOpen(fds);
+  workers.producerPid = spawnChild(argListProducer);
+  workers.producerFd = fds[0];
+  daemonChannelHandOver(fds);
+
+  daemonChannelOpen(fds);
+  workers.consumerPid = spawnChild(argListConsumer);
+  workers.consumerFd = fds[0];
+  daemonChannelHandOver(fds);
+
+  workers.protocol = protocol;
+  workers.sizeDataMiB = atoi(sizeDataMiB_str);
+  snprintf(workers.portno_str, sizeof(workers.portno_str), "%s", portno_str != NULL ? portno_str : "");
+  workers.isRunning = true;
+
+  sprintf(logMessage, "[Master] Started warm workers for %s, up to %dMiB", PROTOCOL_NAMES[protocol - 1],
+      workers.sizeDataMiB);
+  writeInfoLog(fdlog_info, logMessage);
+}
+
+void stopWorkers() {
+  if (workers.isRunning) {
+    writeInfoLog(fdlog_info, "[Master] Stopping warm workers");
+  }
+  daemonStop(&workers);
+}
+
+bool runBenchmark(int protocol, int sizeDataMiB, char* portno_str, struct benchEntry* entry) {
+  char sizeDataMiB_str[8];
+  double* samples;
+  int numRuns;
+  int numWarmup;
+  int numSamples;
+  int numFailed;
+  bool rejectOutliers;
+  double receivedMiB; // summed over the runs
+  struct transferResult result;
+  char adaptText[192];
+  struct benchSummary* summary = &entry->summary;
+
+  numRuns = getEnvInt("ORION_BENCH_RUNS", 10);
+  numWarmup = getEnvInt("ORION_BENCH_WARMUP", 1);
+  rejectOutliers = getEnvInt("ORION_BENCH_REJECT_OUTLIERS", 0) != 0;
+  if (numRuns < 1) {
+    numRuns = 1;
+  }
+  if (numWarmup < 0) {
+    numWarmup = 0;
+  }
+
+  memset(entry, 0, sizeof(*entry));
+  entry->protocol = protocol;
+  entry->sizeDataMiB = sizeDataMiB;
+  snprintf(entry->name, BENCH_NAME_LENGTH, "%s", PROTOCOL_NAMES[protocol - 1]);
+  // Socket options in effect, so that results taken with different ones are told apart
+  if (protocol == 3 || protocol == 8) {
+    socketTuningDescribe(socketTuningFromEnv(), entry->tuning);
+  } else {
+    strcpy(entry->tuning, "-");
+  }
+
+  sprintf(sizeDataMiB_str, "%d", sizeDataMiB);
+  if (protocol != 3 && protocol != 8) {
+    portno_str = NULL;
+  }
+  samples = malloc(sizeof(double) * numRuns);
+
+  printf("Benchmark: %s, %d MiB, %d runs after %d warmup run%s\n", PROTOCOL_NAMES[protocol - 1],
+      sizeDataMiB, numRuns, numWarmup, numWarmup == 1 ? "" : "s");
+  if (strcmp(entry->tuning, "-") != 0) {
+    printf("Socket tuning: %s\n", entry->tuning);
+  }
+  fflush(stdout);
+
+  numSamples = 0;
+  numFailed = 0;
+  receivedMiB = 0;
+  for (int run = 0; run < numWarmup + numRuns; run++) {
+    bool isWarmup = run < numWarmup;
+
+    if (!runTransmission(protocol, sizeDataMiB_str, portno_str, &result)) {
+      printf("%s %d: failed, see error logs\n", isWarmup ? "warmup" : "run", isWarmup ? run + 1 : run - numWarmup + 1);
+      fflush(stdout);
+      numFailed++;
+      continue;
+    }
+
+    if (result.analytics_s > 0) {
+      printf("%s %d: %.6f seconds (processed %.6f s, session %.6f s)\n", isWarmup ? "warmup" : "run",
+          isWarmup ? run + 1 : run - numWarmup + 1, result.transfer_s, result.analytics_s, result.session_s);
+    } else {
+      printf("%s %d: %.6f seconds (session %.6f s)\n", isWarmup ? "warmup" : "run",
+          isWarmup ? run + 1 : run - numWarmup + 1, result.transfer_s, result.session_s);
+    }
+    // Datagrams are not sent again: what was lost is part of the result
+    if (result.loss.numDatagrams > 0) {
+      printf("  lost %lu of %lu datagrams (%.2f%%), %lu reordered, %lu duplicates, goodput %.2f MiB/s\n",
+          (unsigned long) result.loss.numLost, (unsigned long) result.loss.numDatagrams,
+          100.0 * result.loss.numLost / result.loss.numDatagrams, (unsigned long) result.loss.numReordered,
+          (unsigned long) result.loss.numDuplicates, result.loss.goodput_mibps);
+    }
+    // Sizes tuned while the run went (ORION_ADAPT)
+    resultDescribeAdapt(&result.adapt, adaptText);
+    if (adaptText[0] != '\0') {
+      printf("  adapted: %s\n", adaptText);
+    }
+    fflush(stdout);
+    if (!isWarmup) {
+      samples[numSamples] = result.transfer_s;
+      numSamples++;
+      // Datagrams that were lost did not make it: only count what arrived
+      receivedMiB += result.loss.numDatagrams > 0 ? result.loss.goodput_mibps * result.transfer_s : sizeDataMiB;
+    }
+  }
+
+  if (numSamples == 0) {
+    printf("No successful run.\n\n");
+    free(samples);
+    return false;
+  }
+
+  benchSummarize(samples, numSamples, rejectOutliers, summary);
+  printf("\nruns     %d", summary->numRuns);
+  if (rejectOutliers) {
+    printf(" (%d outlier%s rejected)", summary->numRejected, summary->numRejected == 1 ? "" : "s");
+  }
+  printf("\nmean     %.6f s (%.2f MiB/s%s)\n", summary->mean, receivedMiB / numSamples / summary->mean,
+      protocol == 8 ? " goodput" : "");
+  printf("median   %.6f s\n", summary->median);
+  printf("stddev   %.6f s (%.1f%% of mean)\n", summary->stddev, 100.0 * summary->stddev / summary->mean);
+  printf("min/max  %.6f / %.6f s\n", summary->min, summary->max);
+  printf("p95      %.6f s\n", summary->p95);
+  printf("95%% CI   [%.6f, %.6f] s\n\n", summary->ciLow, summary->ciHigh);
+  fflush(stdout);
+
+  free(samples);
+  return numFailed == 0;
+}
+
+int runBenchmarks(char* protocols_str, char* sizes_str, char* portno_str) {
+  int protocols[BENCH_MAX_ENTRIES];
+  int sizes[BENCH_MAX_ENTRIES];
+  int numProtocols;
+  int numSizes;
+  struct benchEntry baseline[BENCH_MAX_ENTRIES];
+  struct benchEntry entry;
+  struct benchComparison* comparisons;
+  int numBaseline;
+  int numComparisons;
+  int exitStatus;
+  char* baselinePath;
+  char* reportPath;
+  char* savePath;
+  double threshold;
+  bool isTerminal = isatty(STDOUT_FILENO); // colours only on a terminal
+
+  numProtocols = parseList(protocols_str, protocols, BENCH_MAX_ENTRIES, 1, NUM_PROTOCOLS);
+  numSizes = parseList(sizes_str, sizes, BENCH_MAX_ENTRIES, 1, MAX_SIZE_MIB);
+  if (numProtocols <= 0 || numSizes <= 0) {
+    printf("ERROR: bench expects protocols between 1 and %d and sizes between 1 and %d MiB.\n",
+        NUM_PROTOCOLS, MAX_SIZE_MIB);
+    fflush(stdout);
+    exit(-1);
+  }
+
+  // Latency at steady rates instead of time at full speed
+  if (getEnvString("ORION_BENCH_PACE_RATES", NULL) != NULL) {
+    return runPacedBenchmarks(protocols, numProtocols, sizes, numSizes,
+        getEnvString("ORION_BENCH_PACE_RATES", NULL), portno_str);
+  }
+  // Scaling of post-receive processing with the number of workers
+  if (getEnvString("ORION_BENCH_ANALYTICS_WORKERS", NULL) != NULL) {
+    return runAnalyticsBenchmarks(protocols, numProtocols, sizes, numSizes,
+        getEnvString("ORION_BENCH_ANALYTICS_WORKERS", NULL), portno_str);
+  }
+  // Cost of every durability setting of the journal
+  if (getEnvString("ORION_BENCH_JOURNAL_SYNC", NULL) != NULL) {
+    return runJournalBenchmarks(protocols, numProtocols, sizes, numSizes,
+        getEnvString("ORION_BENCH_JOURNAL_SYNC", NULL), portno_str);
+  }
+
+  baselinePath = getEnvString("ORION_BENCH_BASELINE", NULL);
+  reportPath = getEnvString("ORION_BENCH_REPORT", NULL);
+  savePath = getEnvString("ORION_BENCH_SAVE", NULL);
+  threshold = getEnvInt("ORION_BENCH_THRESHOLD_PCT", 5) / 100.0;
+
+  numBaseline = 0;
+  if (baselinePath != NULL) {
+    numBaseline = benchLoadBaseline(baselinePath, baseline, BENCH_MAX_ENTRIES);
+    if (numBaseline < 0) {
+      printf("ERROR: cannot read baseline %s\n", baselinePath);
+      fflush(stdout);
+      exit(-1);
+    }
+  } else if (savePath != NULL) {
+    // Entries for other protocols and sizes are kept when saving
+    numBaseline = benchLoadBaseline(savePath, baseline, BENCH_MAX_ENTRIES);
+    if (numBaseline < 0) {
+      numBaseline = 0;
+    }
+  }
+
+  comparisons = malloc(sizeof(struct benchComparison) * numProtocols * numSizes);
+  numComparisons = 0;
+  exitStatus = 0;
+  for (int i = 0; i < numProtocols; i++) {
+    for (int j = 0; j < numSizes; j++) {
+      if (!runBenchmark(protocols[i], sizes[j], portno_str, &entry)) {
+        exitStatus = -1;
+      }
+      benchCompare(&entry, baselinePath != NULL ?
+          benchFindEntry(baseline, numBaseline, protocols[i], sizes[j]) : NULL,
+          threshold, &comparisons[numComparisons]);
+      numComparisons++;
+    }
+  }
+
+  // Overhead of each mechanism relative to the in-process baseline of the same size
+  for (int i = 0; i < numComparisons; i++) {
+    struct benchEntry* threads = NULL;
+
+    for (int j = 0; j < numComparisons; j++) {
+      if (comparisons[j].current.protocol == PROTOCOL_THREADS &&
+          comparisons[j].current.sizeDataMiB == comparisons[i].current.sizeDataMiB &&
+          comparisons[j].current.summary.numRuns > 0) {
+        threads = &comparisons[j].current;
+      }
+    }
+    if (threads != NULL && comparisons[i].current.summary.numRuns > 0) {
+      comparisons[i].overhead = comparisons[i].current.summary.mean / threads->summary.mean;
+      if (comparisons[i].current.protocol != PROTOCOL_THREADS) {
+        printf("%-14s %3d MiB: %.2fx the in-process time\n", comparisons[i].current.name,
+            comparisons[i].current.sizeDataMiB, comparisons[i].overhead);
+      }
+    }
+  }
+
+  if (baselinePath != NULL) {
+    printf("Compared with %s (threshold %.1f%%):\n", baselinePath, 100 * threshold);
+    for (int i = 0; i < numComparisons; i++) {
+      struct benchComparison* c = &comparisons[i];
+
+      if (c->verdict == BENCH_REGRESSED) {
+        exitStatus = -1;
+      }
+      if (isTerminal && c->verdict == BENCH_REGRESSED) {
+        terminalColor(31, true);
+      } else if (isTerminal && c->verdict == BENCH_IMPROVED) {
+        terminalColor(32, true);
+      }
+      printf("  %-14s %3d MiB  %-9s", c->current.name, c->current.sizeDataMiB,
+          BENCH_VERDICT_NAMES[c->verdict]);
+      if (c->verdict != BENCH_NEW && c->verdict != BENCH_FAILED) {
+        printf(" %+.1f%% (t = %.2f)", 100 * c->change, c->t);
+      }
+      printf("\n");
+      if (isTerminal) {
+        terminalColor(37, false);
+      }
+    }
+    fflush(stdout);
+  }
+
+  if (reportPath != NULL && benchWriteReport(reportPath, comparisons, numComparisons, threshold)) {
+    printf("Report written to %s\n", reportPath);
+  }
+
+  if (savePath != NULL) {
+    // Replace the entries that were measured again, keep the others
+    for (int i = 0; i < numComparisons; i++) {
+      struct benchEntry* current = &comparisons[i].current;
+      struct benchEntry* saved;
+
+      if (current->summary.numRuns == 0) {
+        continue;
+      }
+      saved = benchFindEntry(baseline, numBaseline, current->protocol, current->sizeDataMiB);
+      if (saved != NULL) {
+        *saved = *current;
+      } else if (numBaseline < BENCH_MAX_ENTRIES) {
+        baseline[numBaseline] = *current;
+        numBaseline++;
+      }
+    }
+    if (benchSaveBaseline(savePath, baseline, numBaseline)) {
+      printf("Baseline saved to %s\n", savePath);
+    } else {
+      exitStatus = -1;
+    }
+  }
+  fflush(stdout);
+
+  free(comparisons);
+  return exitStatus;
+}
+
+int runPacedBenchmarks(int protocols[], int numProtocols, int sizes[], int numSizes, char* rates_str,
+    char* portno_str) {
+  int rates[BENCH_MAX_ENTRIES];
+  int numRates;
+  int numRuns;
+  int exitStatus;
+  char sizeDataMiB_str[8];
+  char rate_str[16];
+  double* p50;
+  double* p99;
+  double* p999;
+  double* jitter;
+  // One line per protocol, size and rate
+  char (*rows)[160];
+  int numRows;
+
+  numRates = parseList(rates_str, rates, BENCH_MAX_ENTRIES, 1, INT32_MAX);
+  if (numRates <= 0) {
+    printf("ERROR: ORION_BENCH_PACE_RATES expects a comma-separated list of rates in messages/s.\n");
+    fflush(stdout);
+    exit(-1);
+  }
+  numRuns = getEnvInt("ORION_BENCH_RUNS", 10);
+  if (numRuns < 1) {
+    numRuns = 1;
+  }
+
+  p50 = malloc(sizeof(double) * numRuns);
+  p99 = malloc(sizeof(double) * numRuns);
+  p999 = malloc(sizeof(double) * numRuns);
+  jitter = malloc(sizeof(double) * numRuns);
+  rows = malloc(sizeof(*rows) * numProtocols * numSizes * numRates);
+  numRows = 0;
+  exitStatus = 0;
+
+  for (int i = 0; i < numProtocols; i++) {
+    for (int j = 0; j < numSizes; j++) {
+      for (int k = 0; k < numRates; k++) {
+        struct transferResult result;
+        struct benchSummary summary;
+        uint64_t numMessages = 0;
+        uint64_t numMissed = 0;
+        double max_us = 0;
+        int numSamples = 0;
+        int length;
+
+        sprintf(sizeDataMiB_str, "%d", sizes[j]);
+        sprintf(rate_str, "%d", rates[k]);
+        setenv("ORION_PACE_RATE", rate_str, 1);
+        printf("Paced benchmark: %s, %d MiB at %d messages/s, %d runs\n", PROTOCOL_NAMES[protocols[i] - 1],
+            sizes[j], rates[k], numRuns);
+        fflush(stdout);
+
+        for (int run = 0; run < numRuns; run++) {
+          if (!runTransmission(protocols[i], sizeDataMiB_str, protocols[i] == 3 ? portno_str : NULL, &result) ||
+              result.latency.rate <= 0) {
+            printf("run %d: failed, see error logs\n", run + 1);
+            fflush(stdout);
+            exitStatus = -1;
+            continue;
+          }
+
+          printf("run %d: p50 %.1f us, p99 %.1f us, max %.1f us, %lu deadlines missed\n", run + 1,
+              result.latency.p50_us, result.latency.p99_us, result.latency.max_us,
+              (unsigned long) result.latency.numMissed);
+          fflush(stdout);
+          p50[numSamples] = result.latency.p50_us;
+          p99[numSamples] = result.latency.p99_us;
+          p999[numSamples] = result.latency.p999_us;
+          jitter[numSamples] = result.latency.jitter_us;
+          if (result.latency.max_us > max_us) {
+            max_us = result.latency.max_us;
+          }
+          numMessages += result.latency.numMessages;
+          numMissed += result.latency.numMissed;
+          numSamples++;
+        }
+        printf("\n");
+
+        if (numSamples == 0) {
+          snprintf(rows[numRows], sizeof(rows[numRows]), "%-14s %4d %10d   failed", PROTOCOL_NAMES[protocols[i] - 1],
+              sizes[j], rates[k]);
+          numRows++;
+          continue;
+        }
+
+        // Medians over the runs, worst case over all of them
+        length = snprintf(rows[numRows], sizeof(rows[numRows]), "%-14s %4d %10d",
+            PROTOCOL_NAMES[protocols[i] - 1], sizes[j], rates[k]);
+        benchSummarize(p50, numSamples, false, &summary);
+        length += snprintf(rows[numRows] + length, sizeof(rows[numRows]) - length, " %9.1f", summary.median);
+        benchSummarize(p99, numSamples, false, &summary);
+        length += snprintf(rows[numRows] + length, sizeof(rows[numRows]) - length, " %9.1f", summary.median);
+        benchSummarize(p999, numSamples, false, &summary);
+        length += snprintf(rows[numRows] + length, sizeof(rows[numRows]) - length, " %9.1f %9.1f", summary.median,
+            max_us);
+        benchSummarize(jitter, numSamples, false, &summary);
+        snprintf(rows[numRows] + length, sizeof(rows[numRows]) - length, " %9.2f %8.3f%%", summary.median,
+            numMessages > 0 ? 100.0 * numMissed / numMessages : 0);
+        numRows++;
+      }
+    }
+  }
+  unsetenv("ORION_PACE_RATE");
+
+  printf("One-way latency in us (median over runs; max over all runs), deadline %d us:\n",
+      getEnvInt("ORION_PACE_DEADLINE_US", 1000));
+  printf("%-14s %4s %10s %9s %9s %9s %9s %9s %9s\n", "protocol", "MiB", "msg/s", "p50", "p99", "p99.9", "max",
+      "jitter", "missed");
+  for (int i = 0; i < numRows; i++) {
+    printf("%s\n", rows[i]);
+  }
+  fflush(stdout);
+
+  free(p50);
+  free(p99);
+  free(p999);
+  free(jitter);
+  free(rows);
+  return exitStatus;
+}
+
+int runAnalyticsBenchmarks(int protocols[], int numProtocols, int sizes[], int numSizes, char* workers_str,
+    char* portno_str) {
+  int workers[BENCH_MAX_ENTRIES];
+  int numWorkerCounts;
+  int numRuns;
+  int exitStatus;
+  char sizeDataMiB_str[8];
+  char count_str[16];
+  double* transfer;
+  double* processed;
+  // One line per protocol, size and worker count
+  char (*rows)[160];
+  int numRows;
+
+  numWorkerCounts = parseList(workers_str, workers, BENCH_MAX_ENTRIES, 1, 1024);
+  if (numWorkerCounts <= 0) {
+    printf("ERROR: ORION_BENCH_ANALYTICS_WORKERS expects a comma-separated list of worker counts.\n");
+    fflush(stdout);
+    exit(-1);
+  }
+  numRuns = getEnvInt("ORION_BENCH_RUNS", 10);
+  if (numRuns < 1) {
+    numRuns = 1;
+  }
+  // Every kernel, unless a selection was given
+  if (getEnvString("ORION_ANALYTICS", NULL) == NULL) {
+    setenv("ORION_ANALYTICS", "all", 1);
+  }
+
+  transfer = malloc(sizeof(double) * numRuns);
+  processed = malloc(sizeof(double) * numRuns);
+  rows = malloc(sizeof(*rows) * numProtocols * numSizes * numWorkerCounts);
+  numRows = 0;
+  exitStatus = 0;
+
+  for (int i = 0; i < numProtocols; i++) {
+    for (int j = 0; j < numSizes; j++) {
+      double firstProcessed = 0; // median with the first worker count, for the speedup
+
+      for (int k = 0; k < numWorkerCounts; k++) {
+        struct transferResult result;
+        struct benchSummary summary;
+        double transferMedian;
+        int numSamples = 0;
+
+        sprintf(sizeDataMiB_str, "%d", sizes[j]);
+        sprintf(count_str, "%d", workers[k]);
+        setenv("ORION_ANALYTICS_WORKERS", count_str, 1);
+        printf("Analytics benchmark: %s, %d MiB on %d worker%s, %d runs\n", PROTOCOL_NAMES[protocols[i] - 1],
+            sizes[j], workers[k], workers[k] == 1 ? "" : "s", numRuns);
+        fflush(stdout);
+
+        for (int run = 0; run < numRuns; run++) {
+          if (!runTransmission(protocols[i], sizeDataMiB_str, protocols[i] == 3 ? portno_str : NULL, &result) ||
+              result.analytics_s <= 0) {
+            printf("run %d: failed, see error logs\n", run + 1);
+            fflush(stdout);
+            exitStatus = -1;
+            continue;
+          }
+
+          printf("run %d: received %.6f s, processed %.6f s\n", run + 1, result.transfer_s, result.analytics_s);
+          fflush(stdout);
+          transfer[numSamples] = result.transfer_s;
+          processed[numSamples] = result.analytics_s;
+          numSamples++;
+        }
+        printf("\n");
+
+        if (numSamples == 0) {
+          snprintf(rows[numRows], sizeof(rows[numRows]), "%-14s %4d %7d   failed", PROTOCOL_NAMES[protocols[i] - 1],
+              sizes[j], workers[k]);
+          numRows++;
+          continue;
+        }
+
+        // Medians over the runs
+        benchSummarize(transfer, numSamples, false, &summary);
+        transferMedian = summary.median;
+        benchSummarize(processed, numSamples, false, &summary);
+        if (firstProcessed == 0) {
+          firstProcessed = summary.median;
+        }
+        snprintf(rows[numRows], sizeof(rows[numRows]), "%-14s %4d %7d %10.6f %10.6f %9.2f %7.2fx",
+            PROTOCOL_NAMES[protocols[i] - 1], sizes[j], workers[k], transferMedian, summary.median,
+            sizes[j] / summary.median, firstProcessed / summary.median);
+        numRows++;
+      }
+    }
+  }
+  unsetenv("ORION_ANALYTICS_WORKERS");
+
+  printf("Receive and end-to-end time including processing in s (median over runs), kernels %s:\n",
+      getEnvString("ORION_ANALYTICS", "all"));
+  printf("%-14s %4s %7s %10s %10s %9s %8s\n", "protocol", "MiB", "workers", "received", "processed", "MiB/s",
+      "speedup");
+  for (int i = 0; i < numRows; i++) {
+    printf("%s\n", rows[i]);
+  }
+  fflush(stdout);
+
+  free(transfer);
+  free(processed);
+  free(rows);
+  return exitStatus;
+}
+
+int runJournalBenchmarks(int protocols[], int numProtocols, int sizes[], int numSizes, char* syncs_str,
+    char* portno_str) {
+  char* syncs[BENCH_MAX_ENTRIES];
+  char* saveptr;
+  int numSyncs;
+  int numRuns;
+  int exitStatus;
+  char sizeDataMiB_str[8];
+  double* transfer;
+  double* p50;
+  double* p99;
+  // One line per protocol, size and durability setting
+  char (*rows)[160];
+  int numRows;
+
+  syncs_str = strdup(syncs_str);
+  numSyncs = 0;
+  for (char* sync = strtok_r(syncs_str, ",", &saveptr); sync != NULL && numSyncs < BENCH_MAX_ENTRIES;
+      sync = strtok_r(NULL, ",", &saveptr)) {
+    syncs[numSyncs++] = sync;
+  }
+  if (numSyncs == 0) {
+    printf("ERROR: ORION_BENCH_JOURNAL_SYNC expects a comma-separated list of none, interval, group or record.\n");
+    fflush(stdout);
+    exit(-1);
+  }
+  numRuns = getEnvInt("ORION_BENCH_RUNS", 10);
+  if (numRuns < 1) {
+    numRuns = 1;
+  }
+
+  transfer = malloc(sizeof(double) * numRuns);
+  p50 = malloc(sizeof(double) * numRuns);
+  p99 = malloc(sizeof(double) * numRuns);
+  rows = malloc(sizeof(*rows) * numProtocols * numSizes * numSyncs);
+  numRows = 0;
+  exitStatus = 0;
+
+  for (int i = 0; i < numProtocols; i++) {
+    for (int j = 0; j < numSizes; j++) {
+      for (int k = 0; k < numSyncs; k++) {
+        struct transferResult result;
+        struct benchSummary summary;
+        double transferMedian;
+        double p50Median;
+        int numSamples = 0;
+
+        sprintf(sizeDataMiB_str, "%d", sizes[j]);
+        setenv("ORION_JOURNAL_SYNC", syncs[k], 1);
+        printf("Journal benchmark: %s, %d MiB with sync %s, %d runs\n", PROTOCOL_NAMES[protocols[i] - 1],
+            sizes[j], syncs[k], numRuns);
+        fflush(stdout);
+
+        for (int run = 0; run < numRuns; run++) {
+          if (!runTransmission(protocols[i], sizeDataMiB_str, protocols[i] == 3 ? portno_str : NULL, &result)) {
+            printf("run %d: failed, see error logs\n", run + 1);
+            fflush(stdout);
+            exitStatus = -1;
+            continue;
+          }
+
+          printf("run %d: %.6f s, records readable after p50 %.1f us, p99 %.1f us\n", run + 1, result.transfer_s,
+              result.latency.p50_us, result.latency.p99_us);
+          fflush(stdout);
+          transfer[numSamples] = result.transfer_s;
+          p50[numSamples] = result.latency.p50_us;
+          p99[numSamples] = result.latency.p99_us;
+          numSamples++;
+        }
+        printf("\n");
+
+        if (numSamples == 0) {
+          snprintf(rows[numRows], sizeof(rows[numRows]), "%-14s %4d %-9s   failed", PROTOCOL_NAMES[protocols[i] - 1],
+              sizes[j], syncs[k]);
+          numRows++;
+          continue;
+        }
+
+        // Medians over the runs
+        benchSummarize(transfer, numSamples, false, &summary);
+        transferMedian = summary.median;
+        benchSummarize(p50, numSamples, false, &summary);
+        p50Median = summary.median;
+        benchSummarize(p99, numSamples, false, &summary);
+        snprintf(rows[numRows], sizeof(rows[numRows]), "%-14s %4d %-9s %10.6f %9.2f %10.1f %10.1f",
+            PROTOCOL_NAMES[protocols[i] - 1], sizes[j], syncs[k], transferMedian, sizes[j] / transferMedian,
+            p50Median, summary.median);
+        numRows++;
+      }
+    }
+  }
+  unsetenv("ORION_JOURNAL_SYNC");
+
+  printf("Transfer time in s and record latency from append to read in us (median over runs), sync method %s:\n",
+      getEnvString("ORION_JOURNAL_SYNC_METHOD", "fdatasync"));
+  printf("%-14s %4s %-9s %10s %9s %10s %10s\n", "protocol", "MiB", "sync", "seconds", "MiB/s", "p50", "p99");
+  for (int i = 0; i < numRows; i++) {
+    printf("%s\n", rows[i]);
+  }
+  fflush(stdout);
+
+  free(transfer);
+  free(p50);
+  free(p99);
+  free(rows);
+  free(syncs_str);
+  return exitStatus;
+}
+
+int parseList(char* list_str, int values[], int maxValues, int min, int max) {
+  int numValues = 0;
+  char* end;
+  long value;
+
+  while (*list_str != '\0' && numValues < maxValues) {
+    value = strtol(list_str, &end, 10);
+    if (end == list_str || value < min || value > max) {
+      return -1;
+    }
+    values[numValues] = value;
+    numValues++;
+
+    if (*end == ',') {
+      end++;
+    } else if (*end != '\0') {
+      return -1;
+    }
+    list_str = end;
+  }
+
+  return numValues;
+}
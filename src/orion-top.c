@@ -0,0 +1,193 @@
+#include "../include/common.h"
+#include "../include/stats.h"
+
+/**
+* orion-top samples the live statistics page published by every producer and
+* consumer and shows throughput and backpressure of all active sessions.
+*
+* Usage: orion-top [interval_ms] [samples]
+* samples = 0 (default) keeps refreshing until interrupted.
+*/
+
+// Opens the stats page read-only, NULL if no transfer has created it yet
+struct statsPage* openStatsPage();
+
+// Display order of two slots: by session, then producer before consumer
+int compareSlots(struct statsSlot* a, struct statsSlot* b);
+
+// Prints one line per active process, grouped by session
+void printSample(struct statsPage* page, struct statsSlot* previous, uint64_t interval_ns);
+
+const int DEFAULT_INTERVAL_MS = 1000;
+const double B_TO_MIB_CONSTANT = 1024.0 * 1024.0;
+// Redraw the screen and use colours only when writing to a terminal
+bool isTerminal;
+
+int main (int argc, char** argv) {
+  struct statsPage* page;
+  struct statsSlot previous[STATS_MAX_SLOTS];
+  int interval_ms;
+  int numSamples;
+  uint64_t lastSample_ns;
+  uint64_t now_ns;
+
+  interval_ms = (argc >= 2) ? atoi(argv[1]) : DEFAULT_INTERVAL_MS;
+  numSamples = (argc >= 3) ? atoi(argv[2]) : 0;
+  if (interval_ms <= 0) {
+    fprintf(stderr, "ERROR: interval must be a positive number of milliseconds\n");
+    exit(-1);
+  }
+
+  isTerminal = isatty(STDOUT_FILENO);
+  page = NULL;
+  memset(previous, 0, sizeof(previous));
+  lastSample_ns = getMonotonicTimeNS();
+
+  for (int sample = 0; numSamples == 0 || sample < numSamples; sample++) {
+    usleep(interval_ms * 1000);
+
+    if (page == NULL) {
+      page = openStatsPage();
+    }
+
+    now_ns = getMonotonicTimeNS();
+    if (isTerminal) {
+      clearTerminal();
+    }
+
+    if (page == NULL) {
+      printf("No transfer has run yet, waiting...\n");
+    } else {
+      printSample(page, previous, now_ns - lastSample_ns);
+    }
+    fflush(stdout);
+    lastSample_ns = now_ns;
+  }
+
+  return 0;
+}
+
+struct statsPage* openStatsPage() {
+  struct statsPage* page;
+  int fd;
+
+  fd = shm_open(STATS_PATH, O_RDONLY, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  page = mmap(NULL, sizeof(struct statsPage), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    printf("Error %d in ", errno);
+    fflush(stdout);
+    perror("orion-top.c openStatsPage mmap");
+    exit(-1);
+  }
+
+  return page;
+}
+
+int compareSlots(struct statsSlot* a, struct statsSlot* b) {
+  int cmp = strcmp(a->session, b->session);
+
+  if (cmp != 0) {
+    return cmp;
+  }
+  return (int) a->role - (int) b->role;
+}
+
+void printSample(struct statsPage* page, struct statsSlot* previous, uint64_t interval_ns) {
+  struct statsSlot current[STATS_MAX_SLOTS];
+  int order[STATS_MAX_SLOTS]; // active slots, in display order
+  int numActive;
+  double interval_s = interval_ns / 1.0e9;
+
+  // Snapshot every slot first so all rows describe the same instant
+  numActive = 0;
+  for (int i = 0; i < STATS_MAX_SLOTS; i++) {
+    current[i].pid = __atomic_load_n(&page->slots[i].pid, __ATOMIC_ACQUIRE);
+    if (statsIsSlotFree(current[i].pid)) {
+      current[i].pid = 0;
+      continue;
+    }
+
+    current[i].role = page->slots[i].role;
+    current[i].transport = page->slots[i].transport;
+    memcpy(current[i].session, page->slots[i].session, STATS_SESSION_LENGTH);
+    current[i].session[STATS_SESSION_LENGTH - 1] = '\0';
+    current[i].timeStart_ns = __atomic_load_n(&page->slots[i].timeStart_ns, __ATOMIC_ACQUIRE);
+    current[i].bytesTotal = __atomic_load_n(&page->slots[i].bytesTotal, __ATOMIC_RELAXED);
+    current[i].bytes = __atomic_load_n(&page->slots[i].bytes, __ATOMIC_RELAXED);
+    current[i].messages = __atomic_load_n(&page->slots[i].messages, __ATOMIC_RELAXED);
+    current[i].syscalls = __atomic_load_n(&page->slots[i].syscalls, __ATOMIC_RELAXED);
+    current[i].ringFullStalls = __atomic_load_n(&page->slots[i].ringFullStalls, __ATOMIC_RELAXED);
+    current[i].ringEmptyStalls = __atomic_load_n(&page->slots[i].ringEmptyStalls, __ATOMIC_RELAXED);
+    current[i].wait_ns = __atomic_load_n(&page->slots[i].wait_ns, __ATOMIC_RELAXED);
+
+    // A new process in this slot starts from zero
+    if (previous[i].pid != current[i].pid || previous[i].timeStart_ns != current[i].timeStart_ns) {
+      memset(&previous[i], 0, sizeof(struct statsSlot));
+    }
+    order[numActive] = i;
+    numActive++;
+  }
+
+  if (isTerminal) {
+    terminalColor(36, true);
+  }
+  printf("%d active process%s, sampled every %.0f ms\n\n", numActive, numActive == 1 ? "" : "es",
+      interval_s * 1000);
+  printf("%-12s %-8s %7s %-12s %6s %9s %10s %10s %10s %8s %8s %6s\n", "SESSION", "ROLE", "PID",
+      "TRANSPORT", "DONE", "MiB/s", "msgs/s", "syscalls/s", "B/syscall", "full/s", "empty/s", "wait");
+  if (isTerminal) {
+    terminalColor(37, true);
+  }
+
+  // One session at a time, producers first
+  for (int i = 1; i < numActive; i++) {
+    int index = order[i];
+    int j = i - 1;
+
+    while (j >= 0 && compareSlots(&current[order[j]], &current[index]) > 0) {
+      order[j + 1] = order[j];
+      j--;
+    }
+    order[j + 1] = index;
+  }
+
+  for (int i = 0; i < numActive; i++) {
+    struct statsSlot* cur = &current[order[i]];
+    struct statsSlot* prev = &previous[order[i]];
+    uint64_t deltaBytes = cur->bytes - prev->bytes;
+    uint64_t deltaSyscalls = cur->syscalls - prev->syscalls;
+    char transport[16];
+
+    if (statsTransportName(cur->transport) != NULL) {
+      sprintf(transport, "%s", statsTransportName(cur->transport));
+    } else {
+      sprintf(transport, "ipc %d", cur->transport);
+    }
+
+    // Highlight processes spending most of the interval waiting on their peer
+    if (isTerminal && cur->wait_ns - prev->wait_ns > interval_ns / 2) {
+      terminalColor(33, true);
+    }
+
+    printf("%-12s %-8s %7d %-12s %5.1f%% %9.2f %10.0f %10.0f %10.0f %8.0f %8.0f %5.1f%%\n",
+        cur->session, cur->role == STATS_PRODUCER ? "producer" : "consumer", cur->pid, transport,
+        cur->bytesTotal > 0 ? 100.0 * cur->bytes / cur->bytesTotal : 0,
+        deltaBytes / B_TO_MIB_CONSTANT / interval_s,
+        (cur->messages - prev->messages) / interval_s,
+        deltaSyscalls / interval_s,
+        deltaSyscalls > 0 ? (double) deltaBytes / deltaSyscalls : 0,
+        (cur->ringFullStalls - prev->ringFullStalls) / interval_s,
+        (cur->ringEmptyStalls - prev->ringEmptyStalls) / interval_s,
+        100.0 * (cur->wait_ns - prev->wait_ns) / interval_ns);
+    if (isTerminal) {
+      terminalColor(37, true);
+    }
+  }
+
+  memcpy(previous, current, sizeof(current));
+}
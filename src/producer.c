@@ -1,4 +1,21 @@
 #include "../include/common.h"
+#include "../include/stats.h"
+#include "../include/perf.h"
+#include "../include/trace.h"
+#include "../include/result.h"
+#include "../include/pace.h"
+#include "../include/kernels.h"
+#include "../include/element.h"
+#include "../include/analytics.h"
+#include "../include/datafile.h"
+#include "../include/uring.h"
+#include "../include/ring.h"
+#include "../include/control.h"
+#include "../include/journal.h"
+#include "../include/pipeline.h"
+#include "../include/daemon.h"
+#include "../include/dgram.h"
+#include "../include/adapt.h"
 
 // Different functions to send data using different IPC mechanisms. These functions
 // all return the transfer time measured in seconds and milliseconds
@@ -12,17 +29,106 @@ void sendNamedPipe(int sizeDataMiB, int messages[], int fildes);
 // The producer acts as the CLIENT
 void sendSocket(int sizeDataMiB, int messages[], int portno);
 
+// Writes numMessages messages from messageIndex on to the socket, in chunks as
+// large as the adaptive controller says (one message without ORION_ADAPT) and
+// as generation and pacing allow. Applies the send buffer the controller picks.
+// Returns the index of the next message.
+int sendSocketMessages(int sockfd, int messages[], int messageIndex, int numMessages, struct adaptController* adapt,
+    struct traceChunk* chunk);
+
+// Variant of sendSocket for resumable transfers (ORION_RESUME): if the consumer
+// goes away, waits for another one to connect and carries on from the last
+// block its predecessor checkpointed
+void sendSocketResumable(int sizeDataMiB, int messages[], int portno);
+
+// Accepts a consumer of sendSocketResumable and reads the blocks it needs. The
+// first message to send is the one it asks for if that matches the checkpoint
+// in the control block and what was sent, 0 otherwise. Gives up after
+// ORION_RESUME_TIMEOUT_MS without a consumer. Returns the connection, or -1 if
+// the consumer went away during the exchange.
+int acceptResumingConsumer(int sockfd, int messages[], struct socketTuning tuning, int* numBlocks, int* remainder,
+    int* messageIndex);
+
+// Event-driven variant of sendSocket: serves numClients consumers concurrently
+// from one thread using non-blocking sockets and edge-triggered epoll
+void sendSocketEpoll(int sizeDataMiB, int messages[], int portno, int numClients);
+
+// Stripes the payload across numStreams parallel connections, each served by its
+// own thread. Chunks carry their offset so the consumer can reassemble them.
+void sendSocketStriped(int sizeDataMiB, int messages[], int portno, int numStreams);
+
 // Uses a circular buffer to send data through shared memory
 void sendSharedMemory(int sizeDataMiB, int messages[], int circularBufferSize);
 
+// Sends data through the same ring to a consumer thread of this process: the
+// in-process baseline for the overhead of the other IPC mechanisms
+void sendThread(int sizeDataMiB, int messages[], int circularBufferSize);
+
+// Writes numWrites messages into the ring, in batches as generation and pacing
+// allow, all at once otherwise. With ORION_ADAPT, tunes the ring window and the
+// batches as data moves, starting from a window of window messages.
+void sendRing(struct ringBuffer* ring, int messages[], int numWrites, uint32_t window);
+
+// Packs the messages into POSIX message queue records, as many as fit in
+// the queue's message size
+void sendMessageQueue(int sizeDataMiB, int messages[]);
+
+// Appends the messages as records to a journal of segment files on disk, made
+// durable as ORION_JOURNAL_SYNC says, which the consumer tails
+void sendJournal(int sizeDataMiB, int messages[]);
+
+// Sends the messages once, in sequence-numbered datagrams over UDP or a unix
+// datagram socket, in batches of sendmmsg(), to a consumer that keeps what arrives
+void sendDatagram(int sizeDataMiB, int messages[], int portno);
+
+// Warm worker of the master (ORION_DAEMON_FD): sets up the socket or shared
+// memory link once, then sends the first job.sizeDataMiB of messages for every
+// job the master sends, until it is told to stop. sizeDataMiB is the largest.
+void serveDaemonJobs(int sizeDataMiB, int messages[], int portno);
+
+// One job of serveDaemonJobs over the connected socket, in blocks of the same
+// layout as sendSocket. Every block is acknowledged, the remainder included.
+// Returns the number of messages sent.
+int sendSocketJob(int sockfd, int sizeDataMiB, int messages[], struct socketTuning tuning);
+
+// Consumer side of sendThread
+struct threadConsumer {
+  struct ringBuffer* ring;
+  int sizeDataMiB;
+  size_t numMessages;
+  int* messages; // destination
+};
+
+// Reads everything from the ring, checks it and reports the result like a
+// consumer process would
+void* threadConsumerMain(void* arg);
+
 // Generates random messages up to specified max size in MiB and fills array
 void generateMessages(int sizeDataMiB, int *messages);
 
+// Marks the start of the transfer in the control block
+void transferStart();
+
+// Publishes what was sent in the control block, then waits for the consumer(s)
+// to have checked it
+void transferEnd(uint64_t bytesSent, uint64_t checksum);
+
 const int MAX_SIZE_MIB = 100; // Amount of data to transfer
 const int MIB_TO_B_CONSTANT = 1049000;
 const int MESSAGE_SIZE_B = 4; // size of messages in bytes (int = 4 bytes)
-const int CIRC_BUFFER_SIZE = 4096; // max buffer size for circular buffer in shared memory
+const int CIRC_BUFFER_SIZE = 4096; // default size of the ring in shared memory, in bytes
+const int DEFAULT_MQ_DEPTH = 10; // records the message queue holds
+const int DEFAULT_MQ_MSG_KIB = 8; // size of one message queue record
+const unsigned int MQ_CONTROL_PRIORITY = 1; // data records have priority 0
 const int DEFAULT_PORTNO = 4000; // default port number for sockets
+const int MAX_EPOLL_EVENTS = 64; // events handled per epoll_wait in sendSocketEpoll
+const int DEFAULT_STRIPE_CHUNK_KIB = 1024; // chunk size for striped socket transfers
+const int DEFAULT_RESUME_TIMEOUT_MS = 10000; // max wait for a consumer to take over
+const int DGRAM_BIND_TIMEOUT_MS = 10000; // max wait for the datagram consumer to bind
+const int ADAPT_MIN_RING_B = 256; // smallest ring window or batch ORION_ADAPT tries
+const int ADAPT_MAX_CHUNK_B = 1048576; // largest socket write ORION_ADAPT tries
+const int ADAPT_MIN_SNDBUF_B = 4096;
+const int ADAPT_MAX_SNDBUF_B = 4194304;
 // Log file descriptors
 int fdlog_err;
 int fdlog_info;
@@ -46,29 +152,96 @@ int main (int argc, char** argv) {
   fdlog_err = openErrorLog();
   fdlog_info = openInfoLog();
 
+  // Optional session timeline (ORION_TRACE)
+  traceOpen("producer");
+
   // IPC chosen by user
   choiceIPC = atoi(argv[1]);
 
   // Input checks
-  if (choiceIPC < 0 || choiceIPC > 3) {
-    fprintf(stderr, "ERROR: first argument should be between 0 and 3");
+  if (choiceIPC < 0 || choiceIPC > 7) {
+    fprintf(stderr, "ERROR: first argument should be between 0 and 7");
     writeErrorLog(fdlog_err, "[Producer] Invalid user-specified IPC choice number", 0);
     exit(-1);
   }
 
+  // Warm workers only keep socket and shared memory links
+  if (daemonChannel() >= 0 && choiceIPC != 2 && choiceIPC != 3) {
+    fprintf(stderr, "ERROR: daemon mode is only available for sockets and shared memory");
+    writeErrorLog(fdlog_err, "[Producer] Daemon mode requested for another IPC", 0);
+    exit(-1);
+  }
+
   if (sizeDataMiB > MAX_SIZE_MIB) {
     fprintf(stderr, "ERROR: maximum data transfer size is %d MiB", MAX_SIZE_MIB);
     writeErrorLog(fdlog_err, "[Producer] Invalid user-specified transfer size", 0);
     exit(-1);
   }
 
+  if (choiceIPC == 2 && socketLayoutError() != NULL) {
+    fprintf(stderr, "ERROR: %s", socketLayoutError());
+    writeErrorLog(fdlog_err, "[Producer] Invalid socket layout options", 0);
+    exit(-1);
+  }
+
   writeInfoLog(fdlog_info, "================"); // new line
 
-  // Initialize size of messages as specified by args
-  messages = calloc(sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, MESSAGE_SIZE_B);
+  // Start a new session in the control block. Only the event-driven socket
+  // server has more than one consumer.
+  writeInfoLog(fdlog_info, "[Producer] Initialising control block");
+  controlOpen(fdlog_err);
+  if (choiceIPC == 2 && getEnvInt("ORION_SOCKET_STREAMS", 1) <= 1 &&
+      getEnvInt("ORION_SOCKET_CLIENTS", 1) > 1) {
+    controlReset(control, getEnvInt("ORION_SOCKET_CLIENTS", 1));
+  } else {
+    controlReset(control, 1);
+  }
+
+  // Optional constant-rate streaming (ORION_PACE_RATE), scheduled from the
+  // transfer start in the control block
+  paceOpen(&control->timeStart_ns, MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, "Producer", fdlog_info);
+  if (daemonChannel() >= 0) {
+    paceDisable("Producer", fdlog_info);
+  }
+
+  // Live statistics for orion-top, counting what goes to every consumer
+  statsOpen(STATS_PRODUCER, choiceIPC,
+      (uint64_t) (sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B)*MESSAGE_SIZE_B*control->numConsumers,
+      fdlog_info, fdlog_err);
+
+  // Initialize size of messages as specified by args, or map the recorded
+  // telemetry to replay instead (ORION_SOURCE_FILE)
+  messages = sourceOpen((size_t) (sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B)*MESSAGE_SIZE_B, fdlog_info, fdlog_err);
+  if (messages == NULL) {
+    messages = calloc(sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, MESSAGE_SIZE_B);
+  }
+
+  // Optional performance counters (ORION_PERF=1), sampled at every phase
+  perfOpen("Producer", fdlog_info);
+
+  // Randomly generate data to be transferred and store it in "messages", in
+  // the background while the link is set up and data is sent
+  // (ORION_PIPELINE_THREADS), or all of it first. Samples are of the
+  // ORION_ELEMENT_TYPE type.
+  elementSelect("Producer", fdlog_info);
+  controlPhaseBegin(PHASE_GENERATE);
+  if (!sourceIsOpen() && !pipelineStart(messages, sizeDataMiB*MIB_TO_B_CONSTANT/MESSAGE_SIZE_B, fdlog_info, fdlog_err)) {
+    generateMessages(sizeDataMiB, messages);
+  }
+  controlPhaseEnd(control, true, PHASE_GENERATE);
+
+  controlPhaseBegin(PHASE_SETUP);
 
-  // Randomly generate data to be transferred and store it in "messages"
-  generateMessages(sizeDataMiB, messages);
+  // Warm worker of the master: one link and one payload for many transfers
+  if (daemonChannel() >= 0) {
+    serveDaemonJobs(sizeDataMiB, messages, argc >= 4 ? atoi(argv[3]) : DEFAULT_PORTNO);
+
+    pipelineFinish(fdlog_info, fdlog_err);
+    sourceClose();
+    writeInfoLog(fdlog_info, "[Producer] Removing control block");
+    controlClose(control, fdlog_err);
+    return 0;
+  }
 
   switch(choiceIPC) {
     case 0:
@@ -89,19 +262,62 @@ int main (int argc, char** argv) {
         portno = DEFAULT_PORTNO;
       }
 
-      sendSocket(sizeDataMiB, messages, portno);
+      // Several concurrent consumers (ORION_SOCKET_CLIENTS) need the
+      // event-driven server, which can also be requested for a single one
+      int numClients = getEnvInt("ORION_SOCKET_CLIENTS", 1);
+      // One large payload can instead be striped over several connections
+      int numStreams = getEnvInt("ORION_SOCKET_STREAMS", 1);
+      if (numStreams > 1) {
+        paceDisable("Producer", fdlog_info);
+        sendSocketStriped(sizeDataMiB, messages, portno, numStreams);
+      } else if (numClients > 1 || strcmp(getEnvString("ORION_SOCKET_SERVER", "classic"), "epoll") == 0) {
+        paceDisable("Producer", fdlog_info);
+        sendSocketEpoll(sizeDataMiB, messages, portno, numClients < 1 ? 1 : numClients);
+      } else if (controlIsResumable()) {
+        sendSocketResumable(sizeDataMiB, messages, portno);
+      } else {
+        sendSocket(sizeDataMiB, messages, portno);
+      }
       break;
-    default:
+    case 3:
       // Shared Memory
-      sendSharedMemory(sizeDataMiB, messages, CIRC_BUFFER_SIZE);
+      sendSharedMemory(sizeDataMiB, messages, getEnvInt("ORION_RING_KIB", CIRC_BUFFER_SIZE/1024)*1024);
+      break;
+    case 4:
+      // Threads of this process, through the shared memory ring
+      sendThread(sizeDataMiB, messages, getEnvInt("ORION_RING_KIB", CIRC_BUFFER_SIZE/1024)*1024);
+      break;
+    case 5:
+      // POSIX message queues
+      sendMessageQueue(sizeDataMiB, messages);
+      break;
+    case 6:
+      // Journal on disk
+      sendJournal(sizeDataMiB, messages);
+      break;
+    default:
+      // Datagrams, lossy
+      sendDatagram(sizeDataMiB, messages, argc >= 4 ? atoi(argv[3]) : DEFAULT_PORTNO);
       break;
   }
 
+  pipelineFinish(fdlog_info, fdlog_err);
+  sourceClose();
+  controlPhaseEnd(control, true, PHASE_TEARDOWN);
+  controlLogPhases(control, true, fdlog_info);
+  if (stats != NULL) {
+    perfLogTransferCost("Producer", statsTransportName(choiceIPC), &phasePerf[PHASE_TRANSFER],
+        stats->bytes, stats->syscalls, fdlog_info);
+  }
+  writeInfoLog(fdlog_info, "[Producer] Removing control block");
+  controlClose(control, fdlog_err);
+
   return 0;
 }
 
 void sendUnnamedPipe(int sizeDataMiB, int messages[]) {
   int fildes[2];
+  uint64_t fork_ns;
 
   // Create pipe
   writeInfoLog(fdlog_info, "[Producer] Opening pipe");
@@ -115,6 +331,7 @@ void sendUnnamedPipe(int sizeDataMiB, int messages[]) {
 
   // Fork into reader/writer
   writeInfoLog(fdlog_info, "[Producer] Forking process");
+  fork_ns = traceBegin();
   switch (fork()) {
     case -1: // Error
       printf("Error %d in ", errno);
@@ -139,10 +356,12 @@ void sendUnnamedPipe(int sizeDataMiB, int messages[]) {
 
       char* arg_list[] = {"./bin/consumer", choiceIPC_str, sizeDataMiB_str,
           fd_read_str, NULL};
+      traceMarkSpawn(fork_ns);
       execvp("./bin/consumer", arg_list);
       exit(1);
 
     default: // Producer (writer)
+      traceEnd("fork consumer", "startup", fork_ns);
       pipeClose(fildes[0], fdlog_err);
 
       // Pipe has already been created so from here on it works just as a named pipe
@@ -155,66 +374,81 @@ void sendUnnamedPipe(int sizeDataMiB, int messages[]) {
 }
 
 void sendNamedPipe(int sizeDataMiB, int messages[], int fildes) {
-  sem_t *semConsumer;
-  sem_t* semProducer;
   int numWrites;
   int fd;
-  double timerStart_ms;
-  void *ptrShmTimer;
+  bool isSpliced;
+  bool isUring;
+  struct uringContext uring;
+  struct traceChunk chunk;
+  uint64_t openStart_ns;
 
   numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
 
-  // Semaphore to ensure correct usage of shared memory
-  semConsumer = semOpen("/arp2_sem_consumer", 0, fdlog_err);
-  semProducer = semOpen("/arp2_sem_producer", 0, fdlog_err);
-
   // Create/open pipe and write all the data to it
   if (fildes < 0) {
     // Named pipe
     writeInfoLog(fdlog_info, "[Producer] Opening pipe");
+    openStart_ns = traceBegin();
     fd = pipeStart("/tmp/arpassign2", true, fdlog_err);
+    traceEnd("open pipe", "setup", openStart_ns);
   } else {
     // Unnamed pipe
     fd = fildes;
   }
 
+  // A replayed capture is spliced from the file into the pipe
+  // (ORION_SOURCE_SPLICE). Otherwise, optional io_uring backend
+  // (ORION_IO_BACKEND=uring), which sends everything at once and so cannot be
+  // paced.
+  isSpliced = sourceCanSplice();
+  isUring = !isSpliced && !paceIsEnabled() && uringSetup(&uring, fd, messages, (size_t) numWrites*MESSAGE_SIZE_B,
+      "Producer", fdlog_info, fdlog_err);
+
   writeInfoLog(fdlog_info, "[Producer] Starting data transfer via pipe");
 
-  // Timer start (epoch time)
+  // Timer start, recorded in the control block
   writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
-  timerStart_ms = getCurrrentTimeMS();
-
-  for (int i = 0; i < numWrites; i++) {
-    pipeWrite(fd, messages[i], fdlog_err);
+  transferStart();
+
+  if (isSpliced) {
+    traceChunkStart(&chunk, "splice");
+    sourceSend(fd, true, 0, (size_t) numWrites*MESSAGE_SIZE_B, &chunk, fdlog_err);
+    traceChunkFinish(&chunk);
+  } else if (isUring) {
+    pipelineWaitFor(numWrites);
+    uringTransfer(&uring, fd, true, (char*) messages, (size_t) numWrites*MESSAGE_SIZE_B,
+        uringChunkSize(), fdlog_err);
+  } else {
+    traceChunkStart(&chunk, "write");
+    for (int i = 0; i < numWrites; i++) {
+      pipelineReady(i, 1);
+      paceNext(i, 1);
+      pipeWrite(fd, messages[i], fdlog_err);
+      statsTransfer(MESSAGE_SIZE_B, 1, 1);
+      traceChunkAdd(&chunk, MESSAGE_SIZE_B);
+    }
+    traceChunkFinish(&chunk);
   }
 
   writeInfoLog(fdlog_info, "[Producer] Data transfer via pipe complete");
 
-  // Send timer start time over to the consumer
-  writeInfoLog(fdlog_info, "[Producer] Writing transfer start time to shared memory");
-  shmWriteOnce_double("/shm_timerStart", timerStart_ms, &ptrShmTimer, fdlog_err);
-
-  // Let the consumer know the shared memory is ready to be read
-  writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_consumer");
-  semPost(semConsumer, fdlog_err);
+  if (isUring) {
+    uringFinish(&uring, "Producer", fdlog_info);
+  }
 
-  // Wait for the consumer to have finished reading before cleaning up
-  writeInfoLog(fdlog_info, "[Producer] Accessing semaphore arp2_sem_producer");
-  semWait(semProducer, fdlog_err);
+  // Publish totals, then wait for the consumer to have checked them before cleaning up
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, pipelineChecksum(messages, numWrites, fdlog_err));
 
   // Cleanup
   writeInfoLog(fdlog_info, "[Producer] Closing pipe");
   pipeClose(fd, fdlog_err);
   writeInfoLog(fdlog_info, "[Producer] Pipe closed");
 
-  writeInfoLog(fdlog_info, "[Producer] Unlinking semaphores");
-  semUnlink("/arp2_sem_producer", fdlog_err);
-  writeInfoLog(fdlog_info, "[Producer] Semaphores unlinked");
 }
 
 void sendSocket(int sizeDataMiB, int messages[], int portno) {
-  sem_t *semConsumer;
-  sem_t* semProducer;
+  sem_t* semListening;
   int sockfd;
   int sockfdAccept;
   int clilen;
@@ -225,20 +459,30 @@ void sendSocket(int sizeDataMiB, int messages[], int portno) {
   int numWritesPerBlock;
   int remainder;
   int numWritesRemainder;
+  bool isSpliced;
+  bool isUring;
+  bool isZeroCopy;
+  struct uringContext uring;
+  struct socketTuning tuning;
+  struct zeroCopyState zeroCopy;
+  uint32_t numSentBefore;
+  struct traceChunk chunk;
+  struct adaptController adapt;
+  int sndBuf;
+  socklen_t sndBufLen;
+  uint64_t acceptStart_ns;
+  uint64_t ackStart_ns;
   struct sockaddr_in servAddr;
   struct sockaddr_in cliAddr;
   char* logMessage;
-  double timerStart_ms;
-  void *ptrShmTimer;
   const int optVal = 1;
   const socklen_t optLen = sizeof(optVal);
 
   logMessage = malloc(sizeof(char) * 256);
   numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
 
-  // Semaphore to ensure correct usage of shared memory
-  semConsumer = semOpen("/arp2_sem_consumer", 0, fdlog_err);
-  semProducer = semOpen("/arp2_sem_producer", 0, fdlog_err);
+  // Semaphore the consumer waits on before connecting
+  semListening = semOpen("/arp2_sem_listening", 0, fdlog_err);
 
   // Socket creation
   sprintf(logMessage, "[Producer] Opening socket on port %d", portno);
@@ -260,12 +504,27 @@ void sendSocket(int sizeDataMiB, int messages[], int portno) {
   socketBind(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
   writeInfoLog(fdlog_info, "[Producer] Listening on socket");
 
+  // Optional socket tuning (ORION_SO_SNDBUF, ORION_MSG_ZEROCOPY, ...): buffer
+  // sizes before the handshake, the rest once connected
+  tuning = socketTuningFromEnv();
+  socketApplyBufferSizes(sockfd, tuning, fdlog_err);
   socketListen(sockfd, 5, fdlog_err);
 
+  // Tell the consumer it can connect now
+  writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_listening");
+  semPost(semListening, fdlog_err);
+
   // Accept incoming connections
   writeInfoLog(fdlog_info, "[Producer] Accepting incoming connection");
   clilen = sizeof(cliAddr);
+  acceptStart_ns = traceBegin();
   sockfdAccept = socketAccept(sockfd, (struct sockaddr *) &cliAddr, &clilen, fdlog_err);
+  traceEnd("accept", "setup", acceptStart_ns);
+
+  isSpliced = sourceCanSplice();
+  isZeroCopy = socketApplyTuning(sockfdAccept, tuning, "Producer", fdlog_info, fdlog_err) && !paceIsEnabled() &&
+      !isSpliced;
+  memset(&zeroCopy, 0, sizeof(zeroCopy));
 
   // Client tells us how many blocks of data to send and how big each block is in MiB
   writeInfoLog(fdlog_info, "[Producer] Reading packet structure information");
@@ -283,20 +542,70 @@ void sendSocket(int sizeDataMiB, int messages[], int portno) {
 
   messageIndex = 0;
 
+  // A replayed capture goes from the file to the socket with sendfile()
+  // (ORION_SOURCE_SPLICE). Otherwise, optional io_uring backend
+  // (ORION_IO_BACKEND=uring), not for paced transfers.
+  isUring = !isSpliced && !paceIsEnabled() && uringSetup(&uring, sockfdAccept, messages, (size_t) numWrites*MESSAGE_SIZE_B,
+      "Producer", fdlog_info, fdlog_err);
+
+  // Writes message by message are tuned with ORION_ADAPT: first how many
+  // messages go in one write, then the send buffer, starting from the one the
+  // kernel picked (it reports twice what was asked for)
+  adaptInit(&adapt, !isSpliced && !isUring && !isZeroCopy && !paceIsEnabled(), "Producer", fdlog_info);
+  sndBufLen = sizeof(sndBuf);
+  if (getsockopt(sockfdAccept, SOL_SOCKET, SO_SNDBUF, &sndBuf, &sndBufLen) < 0) {
+    sndBuf = 2*ADAPT_MIN_SNDBUF_B;
+  }
+  adaptAddKnob(&adapt, "socket write chunk", MESSAGE_SIZE_B, MESSAGE_SIZE_B, ADAPT_MAX_CHUNK_B);
+  adaptAddKnob(&adapt, "socket send buffer", sndBuf / 2, ADAPT_MIN_SNDBUF_B, ADAPT_MAX_SNDBUF_B);
+
   // Transfer all data
   writeInfoLog(fdlog_info, "[Producer] Starting packet transfer");
 
-  // Timer start (epoch time)
+  // Timer start, recorded in the control block
   writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
-  timerStart_ms = getCurrrentTimeMS();
+  transferStart();
 
   for (int i = 0; i < numBlocks; i++) {
-    for (int j = 0; j < numWritesPerBlock; j++) {
-      socketWrite(sockfdAccept, messages[messageIndex], MESSAGE_SIZE_B, fdlog_err);
-      messageIndex++;
+    // Blocks sent at once need all their messages
+    if (isUring || isZeroCopy) {
+      pipelineWaitFor(messageIndex + numWritesPerBlock);
+    }
+
+    if (isSpliced) {
+      traceChunkStart(&chunk, "sendfile");
+      sourceSend(sockfdAccept, false, (size_t) messageIndex*MESSAGE_SIZE_B, (size_t) numWritesPerBlock*MESSAGE_SIZE_B,
+          &chunk, fdlog_err);
+      traceChunkFinish(&chunk);
+      messageIndex += numWritesPerBlock;
+    } else if (isUring) {
+      uringTransfer(&uring, sockfdAccept, true, (char*) &messages[messageIndex],
+          (size_t) numWritesPerBlock*MESSAGE_SIZE_B, uringChunkSize(), fdlog_err);
+      messageIndex += numWritesPerBlock;
+    } else if (isZeroCopy) {
+      // Zerocopy only pays off for large sends: the whole block goes at once
+      numSentBefore = zeroCopy.numSent;
+      traceChunkStart(&chunk, "zerocopy block");
+      socketWriteAllZeroCopy(sockfdAccept, &messages[messageIndex],
+          (size_t) numWritesPerBlock*MESSAGE_SIZE_B, &zeroCopy, fdlog_err);
+      traceEndBytes(chunk.name, "transfer", chunk.start_ns, (int64_t) numWritesPerBlock*MESSAGE_SIZE_B);
+      statsTransfer((uint64_t) numWritesPerBlock*MESSAGE_SIZE_B, 1, zeroCopy.numSent - numSentBefore);
+      messageIndex += numWritesPerBlock;
+    } else {
+      traceChunkStart(&chunk, "write");
+      messageIndex = sendSocketMessages(sockfdAccept, messages, messageIndex, numWritesPerBlock, &adapt, &chunk);
+      traceChunkFinish(&chunk);
     }
 
+    // The consumer waits for the whole block before acknowledging
+    if (tuning.cork) {
+      socketFlushCork(sockfdAccept, fdlog_err);
+    }
+
+    ackStart_ns = traceBegin();
     response = socketRead(sockfdAccept, MESSAGE_SIZE_B, fdlog_err);
+    statsSyscalls(1);
+    traceEnd("wait ack", "transfer", ackStart_ns);
 
     if (response != 1) {
       perror("ERROR in packet transfer");
@@ -308,25 +617,67 @@ void sendSocket(int sizeDataMiB, int messages[], int portno) {
   if (remainder != 0) {
     // There is remaining data, send it!
     numWritesRemainder = (remainder*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B;
-    for (int i = 0; i < numWritesRemainder; i++) {
-      socketWrite(sockfdAccept, messages[messageIndex], MESSAGE_SIZE_B, fdlog_err);
-      messageIndex++;
+    if (isUring || isZeroCopy) {
+      pipelineWaitFor(messageIndex + numWritesRemainder);
     }
+    if (isSpliced) {
+      traceChunkStart(&chunk, "sendfile");
+      sourceSend(sockfdAccept, false, (size_t) messageIndex*MESSAGE_SIZE_B, (size_t) numWritesRemainder*MESSAGE_SIZE_B,
+          &chunk, fdlog_err);
+      traceChunkFinish(&chunk);
+      messageIndex += numWritesRemainder;
+    } else if (isUring) {
+      uringTransfer(&uring, sockfdAccept, true, (char*) &messages[messageIndex],
+          (size_t) numWritesRemainder*MESSAGE_SIZE_B, uringChunkSize(), fdlog_err);
+      messageIndex += numWritesRemainder;
+    } else if (isZeroCopy) {
+      numSentBefore = zeroCopy.numSent;
+      traceChunkStart(&chunk, "zerocopy block");
+      socketWriteAllZeroCopy(sockfdAccept, &messages[messageIndex],
+          (size_t) numWritesRemainder*MESSAGE_SIZE_B, &zeroCopy, fdlog_err);
+      traceEndBytes(chunk.name, "transfer", chunk.start_ns, (int64_t) numWritesRemainder*MESSAGE_SIZE_B);
+      statsTransfer((uint64_t) numWritesRemainder*MESSAGE_SIZE_B, 1, zeroCopy.numSent - numSentBefore);
+      messageIndex += numWritesRemainder;
+    } else {
+      traceChunkStart(&chunk, "write");
+      messageIndex = sendSocketMessages(sockfdAccept, messages, messageIndex, numWritesRemainder, &adapt, &chunk);
+      traceChunkFinish(&chunk);
+    }
+  }
+
+  if (tuning.cork) {
+    socketFlushCork(sockfdAccept, fdlog_err);
   }
 
   writeInfoLog(fdlog_info, "[Producer] Data transfer complete");
 
-  // Send timer start time over to the consumer
-  writeInfoLog(fdlog_info, "[Producer] Writing transfer start time to shared memory");
-  shmWriteOnce_double("/shm_timerStart", timerStart_ms, &ptrShmTimer, fdlog_err);
+  // Reported to the master through the consumer: the send buffer as the
+  // kernel has it
+  if (adapt.isEnabled) {
+    adaptLog(&adapt);
+    control->adapted.chunk_B = adaptValue(&adapt, 0);
+    sndBufLen = sizeof(sndBuf);
+    if (getsockopt(sockfdAccept, SOL_SOCKET, SO_SNDBUF, &sndBuf, &sndBufLen) == 0) {
+      control->adapted.window_B = sndBuf / 2;
+    } else {
+      control->adapted.window_B = adaptValue(&adapt, 1);
+    }
+    control->adapted.numEpochs = adapt.numEpochs;
+    control->adapted.isConverged = adaptIsConverged(&adapt);
+  }
 
-  // Let the consumer know the shared memory is ready to be read
-  writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_consumer");
-  semPost(semConsumer, fdlog_err);
+  if (isUring) {
+    uringFinish(&uring, "Producer", fdlog_info);
+  }
 
-  // Wait for the consumer to have finished reading before cleaning up
-  writeInfoLog(fdlog_info, "[Producer] Accessing semaphore arp2_sem_producer");
-  semWait(semProducer, fdlog_err);
+  if (isZeroCopy) {
+    socketReapZeroCopy(sockfdAccept, &zeroCopy, true, fdlog_err);
+    socketLogZeroCopy(&zeroCopy, "Producer", fdlog_info);
+  }
+
+  // Publish totals, then wait for the consumer to have checked them before cleaning up
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) messageIndex*MESSAGE_SIZE_B, pipelineChecksum(messages, messageIndex, fdlog_err));
 
   // Cleanup
   writeInfoLog(fdlog_info, "[Producer] Closing socket");
@@ -334,86 +685,1359 @@ void sendSocket(int sizeDataMiB, int messages[], int portno) {
   writeInfoLog(fdlog_info, "[Producer] Socket closed");
 
   writeInfoLog(fdlog_info, "[Producer] Unlinking semaphores");
-  semUnlink("/arp2_sem_producer", fdlog_err);
+  semUnlink("/arp2_sem_listening", fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Semaphores unlinked");
+}
+
+int sendSocketMessages(int sockfd, int messages[], int messageIndex, int numMessages, struct adaptController* adapt,
+    struct traceChunk* chunk) {
+  int end = messageIndex + numMessages;
+  size_t maxChunk;
+  size_t numChunk;
+  int sndBuf;
+  socklen_t sndBufLen = sizeof(sndBuf);
+
+  while (messageIndex < end) {
+    maxChunk = adaptValue(adapt, 0) / MESSAGE_SIZE_B;
+    numChunk = (size_t) (end - messageIndex) < maxChunk ? (size_t) (end - messageIndex) : maxChunk;
+    numChunk = paceNext(messageIndex, pipelineReady(messageIndex, numChunk));
+    socketWriteAll(sockfd, &messages[messageIndex], numChunk*MESSAGE_SIZE_B, fdlog_err);
+    statsTransfer(numChunk*MESSAGE_SIZE_B, 1, 1);
+    traceChunkAdd(chunk, numChunk*MESSAGE_SIZE_B);
+    messageIndex += numChunk;
+
+    if (adaptUpdate(adapt, numChunk*MESSAGE_SIZE_B, 0) == 1) {
+      // The kernel caps the buffer at net.core.wmem_max, and reports twice
+      // what it set
+      socketTryOpt(sockfd, SOL_SOCKET, SO_SNDBUF, adaptValue(adapt, 1), "SO_SNDBUF", fdlog_err);
+      if (getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sndBuf, &sndBufLen) == 0) {
+        adaptLimit(adapt, 1, sndBuf / 2);
+      }
+    }
+  }
+
+  return messageIndex;
+}
+
+void sendSocketResumable(int sizeDataMiB, int messages[], int portno) {
+  sem_t* semListening;
+  int sockfd;
+  int sockfdAccept;
+  int messageIndex;
+  int response;
+  int numBlocks;
+  int remainder;
+  int numWrites;
+  int numWritesPerBlock;
+  int numWritesRemainder;
+  int numWritesTotal;
+  int numToSend;
+  int numAccepted;
+  int piece; // block, or the remainder after the last block
+  int numPieces;
+  bool isSent;
+  struct socketTuning tuning;
+  struct controlCheckpoint checkpoint;
+  struct traceChunk chunk;
+  struct sockaddr_in servAddr;
+  char* logMessage;
+  const int optVal = 1;
+  const socklen_t optLen = sizeof(optVal);
+
+  logMessage = malloc(sizeof(char) * 256);
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+
+  // Semaphore the consumer waits on before connecting
+  semListening = semOpen("/arp2_sem_listening", 0, fdlog_err);
+
+  // Socket creation and configuration, as in sendSocket
+  sprintf(logMessage, "[Producer] Opening resumable socket on port %d", portno);
+  writeInfoLog(fdlog_info, logMessage);
+  sockfd = socketCreate(AF_INET, SOCK_STREAM, 0, fdlog_err);
+  socketSetOpt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void*) &optVal, optLen, fdlog_err);
+  bzero((char *) &servAddr, sizeof(servAddr));
+  servAddr.sin_family = AF_INET;
+  servAddr.sin_port = htons(portno);
+  servAddr.sin_addr.s_addr = INADDR_ANY; // IP of current machine
+  socketBind(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
+  socketApplyBufferSizes(sockfd, socketTuningFromEnv(), fdlog_err);
+  socketListen(sockfd, 5, fdlog_err);
+
+  // Tell the consumer it can connect now
+  writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_listening");
+  semPost(semListening, fdlog_err);
+
+  // Messages go one by one, so that a consumer going away is noticed at once:
+  // no zerocopy, io_uring or sendfile
+  tuning = socketTuningFromEnv();
+  tuning.zeroCopy = 0;
+
+  sockfdAccept = -1;
+  numAccepted = 0;
+  numWritesTotal = 0;
+  numWritesPerBlock = 0;
+  messageIndex = 0;
+  piece = 0;
+  numPieces = 0;
+  while (sockfdAccept < 0 || piece < numPieces) {
+    if (sockfdAccept < 0) {
+      writeInfoLog(fdlog_info, "[Producer] Accepting incoming connection");
+      sockfdAccept = acceptResumingConsumer(sockfd, messages, tuning, &numBlocks, &remainder, &messageIndex);
+      if (sockfdAccept < 0) {
+        continue;
+      }
+
+      numWritesRemainder = (remainder*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B;
+      if (numBlocks != 0) {
+        numWritesPerBlock = numWrites/numBlocks - numWritesRemainder;
+      }
+      numWritesTotal = numBlocks*numWritesPerBlock + numWritesRemainder;
+      numPieces = numBlocks + (remainder != 0 ? 1 : 0);
+      piece = numWritesPerBlock != 0 ? messageIndex / numWritesPerBlock : 0;
+
+      // Timer start, recorded in the control block, once the first consumer is there
+      if (numAccepted++ == 0) {
+        writeInfoLog(fdlog_info, "[Producer] Starting packet transfer");
+        transferStart();
+      }
+    }
+
+    // One block, or the remainder, then wait for the consumer to acknowledge it
+    numToSend = piece < numBlocks ? numWritesPerBlock : numWritesRemainder;
+    isSent = true;
+    traceChunkStart(&chunk, "write");
+    for (int j = 0; j < numToSend && isSent; j++) {
+      pipelineReady(messageIndex + j, 1);
+      paceNext(messageIndex + j, 1);
+      isSent = socketTryWrite(sockfdAccept, messages[messageIndex + j], MESSAGE_SIZE_B);
+      statsTransfer(MESSAGE_SIZE_B, 1, 1);
+      traceChunkAdd(&chunk, MESSAGE_SIZE_B);
+    }
+    traceChunkFinish(&chunk);
+    if (tuning.cork) {
+      socketFlushCork(sockfdAccept, fdlog_err);
+    }
+
+    if (isSent && socketTryRead(sockfdAccept, &response, MESSAGE_SIZE_B) && response == 1) {
+      statsSyscalls(1);
+      messageIndex += numToSend;
+      piece++;
+      continue;
+    }
+
+    // The consumer went away. If it checkpointed everything, the one taking
+    // over only has to report; otherwise it connects again.
+    socketClose(sockfdAccept, fdlog_err);
+    sockfdAccept = -1;
+    checkpoint = controlLastCheckpoint(control);
+    sprintf(logMessage, "[Producer] Consumer went away at message %d, checkpointed up to %lu",
+        messageIndex, (unsigned long) checkpoint.numMessages);
+    writeInfoLog(fdlog_info, logMessage);
+    if (checkpoint.numMessages == (uint64_t) numWritesTotal) {
+      messageIndex = numWritesTotal;
+      break;
+    }
+  }
+
+  writeInfoLog(fdlog_info, "[Producer] Data transfer complete");
+  if (numAccepted > 1) {
+    sprintf(logMessage, "[Producer] Transfer resumed by %d consumers", numAccepted - 1);
+    writeInfoLog(fdlog_info, logMessage);
+  }
+
+  // Publish totals, then wait for the consumer to have checked them before cleaning up
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) messageIndex*MESSAGE_SIZE_B, pipelineChecksum(messages, messageIndex, fdlog_err));
+
+  // Cleanup
+  writeInfoLog(fdlog_info, "[Producer] Closing socket");
+  if (sockfdAccept >= 0) {
+    socketClose(sockfdAccept, fdlog_err);
+  }
+  socketClose(sockfd, fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Socket closed");
+
+  writeInfoLog(fdlog_info, "[Producer] Unlinking semaphores");
+  semUnlink("/arp2_sem_listening", fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Semaphores unlinked");
+}
+
+int acceptResumingConsumer(int sockfd, int messages[], struct socketTuning tuning, int* numBlocks, int* remainder,
+    int* messageIndex) {
+  struct sockaddr_in cliAddr;
+  socklen_t clilen = sizeof(cliAddr);
+  struct pollfd pfd;
+  struct controlCheckpoint checkpoint;
+  char logMessage[256];
+  int sockfdAccept;
+  int resumeIndex;
+  uint64_t acceptStart_ns = traceBegin();
+  uint64_t deadline_ns;
+
+  // Polled in short slices, so as to give up as soon as the session fails
+  deadline_ns = getMonotonicTimeNS() + (uint64_t) getEnvInt("ORION_RESUME_TIMEOUT_MS", DEFAULT_RESUME_TIMEOUT_MS)*1000000;
+  pfd.fd = sockfd;
+  pfd.events = POLLIN;
+  while (poll(&pfd, 1, 100) <= 0) {
+    if (getMonotonicTimeNS() > deadline_ns || __atomic_load_n(&control->state, __ATOMIC_ACQUIRE) == CONTROL_FAILED) {
+      printf("Error in producer.c acceptResumingConsumer: no consumer connected\n");
+      fflush(stdout);
+      writeErrorLog(fdlog_err, "producer.c: acceptResumingConsumer gave up waiting for a consumer", ETIMEDOUT);
+      exit(-1);
+    }
+  }
+  sockfdAccept = socketAccept(sockfd, (struct sockaddr *) &cliAddr, &clilen, fdlog_err);
+  traceEnd("accept", "setup", acceptStart_ns);
+  socketApplyTuning(sockfdAccept, tuning, "Producer", fdlog_info, fdlog_err);
+
+  // Blocks needed, remainder, and the first message needed
+  if (!socketTryRead(sockfdAccept, numBlocks, MESSAGE_SIZE_B) || !socketTryRead(sockfdAccept, remainder, MESSAGE_SIZE_B) ||
+      !socketTryRead(sockfdAccept, &resumeIndex, MESSAGE_SIZE_B)) {
+    socketClose(sockfdAccept, fdlog_err);
+    return -1;
+  }
+
+  // The data before the checkpoint is not sent again, so it must be what the
+  // consumer that died received
+  checkpoint = controlLastCheckpoint(control);
+  if (resumeIndex != 0) {
+    if (resumeIndex > 0 && (uint64_t) resumeIndex == checkpoint.numMessages &&
+        checksumMessages(messages, 0, resumeIndex) == checkpoint.checksum) {
+      sprintf(logMessage, "[Producer] Consumer took over, resuming from message %d", resumeIndex);
+    } else {
+      sprintf(logMessage, "[Producer] Checkpoint at message %d does not match what was sent, starting over",
+          resumeIndex);
+      resumeIndex = 0;
+    }
+    writeInfoLog(fdlog_info, logMessage);
+  }
+
+  if (!socketTryWrite(sockfdAccept, resumeIndex, MESSAGE_SIZE_B)) {
+    socketClose(sockfdAccept, fdlog_err);
+    return -1;
+  }
+  *messageIndex = resumeIndex;
+
+  return sockfdAccept;
+}
+
+// States of one client connection in sendSocketEpoll, following the same
+// request/acknowledge protocol as sendSocket
+enum connectionState {
+  CONNECTION_READ_HEADER, // waiting for number of blocks and remainder
+  CONNECTION_SEND, // sending a block (or the remainder)
+  CONNECTION_READ_ACK, // waiting for the consumer to acknowledge a block
+  CONNECTION_DONE
+};
+
+// Per-connection stream state
+struct clientConnection {
+  int fd;
+  int id;
+  enum connectionState state;
+  int header[2]; // number of blocks, remainder in MiB
+  int ack;
+  size_t bytesIn; // bytes of header/ack read so far
+  int blockIndex;
+  int numWritesPerBlock;
+  int numWritesRemainder;
+  char* sendPtr; // next byte to send
+  size_t sendLeft; // bytes left in the current block
+  size_t bytesSent;
+  unsigned long numStalls; // times the socket buffer was full (backpressure)
+  bool isCork;
+  bool isZeroCopy;
+  struct zeroCopyState zeroCopy;
+  uint64_t timeStart_ns;
+  uint64_t timeEnd_ns;
+  uint64_t blockStart_ns; // for the trace
+};
+
+// Reads into buf until want bytes are in or the socket would block. Returns
+// false once the socket is drained.
+bool connectionReadInto(struct clientConnection* conn, char* buf, size_t want) {
+  ssize_t ret;
+
+  while (conn->bytesIn < want) {
+    ret = read(conn->fd, buf + conn->bytesIn, want - conn->bytesIn);
+    statsSyscalls(1);
+    if (ret > 0) {
+      conn->bytesIn += ret;
+    } else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return false;
+    } else if (ret < 0 && errno == EINTR) {
+      continue;
+    } else {
+      printf("Error %d in ", errno);
+      fflush(stdout);
+      perror("producer.c connectionReadInto");
+      writeErrorLog(fdlog_err, "producer.c: sendSocketEpoll client read failed", errno);
+      exit(-1);
+    }
+  }
+
+  return true;
+}
+
+// Starts sending the next block, or the remainder once all blocks are acknowledged
+void connectionNextBlock(struct clientConnection* conn, int messages[]) {
+  int messageIndex = conn->blockIndex * conn->numWritesPerBlock;
+
+  conn->blockStart_ns = traceBegin();
+  if (conn->blockIndex < conn->header[0]) {
+    conn->sendPtr = (char*) &messages[messageIndex];
+    conn->sendLeft = (size_t) conn->numWritesPerBlock * MESSAGE_SIZE_B;
+    conn->state = CONNECTION_SEND;
+  } else if (conn->header[1] != 0 && conn->blockIndex == conn->header[0]) {
+    conn->sendPtr = (char*) &messages[messageIndex];
+    conn->sendLeft = (size_t) conn->numWritesRemainder * MESSAGE_SIZE_B;
+    conn->state = CONNECTION_SEND;
+  } else {
+    conn->timeEnd_ns = getMonotonicTimeNS();
+    conn->state = CONNECTION_DONE;
+  }
+}
+
+// Advances the connection as far as it can go without blocking
+void connectionProgress(struct clientConnection* conn, int messages[], int numWrites) {
+  ssize_t ret;
+
+  while (conn->state != CONNECTION_DONE) {
+    switch (conn->state) {
+      case CONNECTION_READ_HEADER:
+        if (!connectionReadInto(conn, (char*) conn->header, sizeof(conn->header))) {
+          return;
+        }
+        conn->bytesIn = 0;
+        conn->numWritesRemainder = (conn->header[1]*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B;
+        if (conn->header[0] != 0) {
+          conn->numWritesPerBlock = numWrites/conn->header[0] - conn->numWritesRemainder;
+        } else {
+          conn->numWritesPerBlock = 0;
+        }
+        conn->blockIndex = 0;
+        conn->timeStart_ns = getMonotonicTimeNS();
+        connectionNextBlock(conn, messages);
+        break;
+
+      case CONNECTION_SEND:
+        while (conn->sendLeft > 0) {
+          if (conn->isZeroCopy) {
+            ret = socketSendZeroCopy(conn->fd, conn->sendPtr, conn->sendLeft,
+                &conn->zeroCopy, fdlog_err);
+          } else {
+            ret = write(conn->fd, conn->sendPtr, conn->sendLeft);
+          }
+          if (ret > 0) {
+            conn->sendPtr += ret;
+            conn->sendLeft -= ret;
+            conn->bytesSent += ret;
+            statsTransfer(ret, 1, 1);
+          } else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket buffer full: resume on the next EPOLLOUT edge
+            conn->numStalls++;
+            statsSyscalls(1);
+            statsStall(true, 0); // the wait itself is counted around epoll_wait
+            return;
+          } else if (ret < 0 && errno == EINTR) {
+            continue;
+          } else {
+            printf("Error %d in ", errno);
+            fflush(stdout);
+            perror("producer.c connectionProgress write");
+            writeErrorLog(fdlog_err, "producer.c: sendSocketEpoll client write failed", errno);
+            exit(-1);
+          }
+        }
+
+        if (conn->isCork) {
+          socketFlushCork(conn->fd, fdlog_err);
+        }
+
+        if (traceIsEnabled()) {
+          char spanName[TRACE_NAME_LENGTH];
+
+          sprintf(spanName, "client %d block %d", conn->id, conn->blockIndex);
+          traceEndBytes(spanName, "transfer", conn->blockStart_ns,
+              conn->blockIndex < conn->header[0] ? (int64_t) conn->numWritesPerBlock * MESSAGE_SIZE_B :
+              (int64_t) conn->numWritesRemainder * MESSAGE_SIZE_B);
+        }
+
+        if (conn->blockIndex < conn->header[0]) {
+          conn->state = CONNECTION_READ_ACK;
+        } else {
+          // Remainder sent, no acknowledgement follows
+          conn->blockIndex++;
+          connectionNextBlock(conn, messages);
+        }
+        break;
+
+      case CONNECTION_READ_ACK:
+        if (!connectionReadInto(conn, (char*) &conn->ack, sizeof(conn->ack))) {
+          return;
+        }
+        conn->bytesIn = 0;
+        if (conn->ack != 1) {
+          perror("ERROR in packet transfer");
+          writeErrorLog(fdlog_err, "producer.c: packet transfer response negative", errno);
+          exit(-1);
+        }
+        conn->blockIndex++;
+        connectionNextBlock(conn, messages);
+        break;
+
+      default:
+        return;
+    }
+  }
+}
+
+void sendSocketEpoll(int sizeDataMiB, int messages[], int portno, int numClients) {
+  sem_t* semListening;
+  int sockfd;
+  int epfd;
+  int numWrites;
+  int numAccepted;
+  int numDone;
+  int numEvents;
+  struct sockaddr_in servAddr;
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+  struct clientConnection* connections;
+  struct socketTuning tuning;
+  char* logMessage;
+  uint64_t firstStart_ns;
+  uint64_t lastEnd_ns;
+  uint64_t waitStart_ns;
+  size_t totalBytes;
+  bool isStarted;
+  const int optVal = 1;
+  const socklen_t optLen = sizeof(optVal);
+
+  logMessage = malloc(sizeof(char) * 256);
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  connections = calloc(numClients, sizeof(struct clientConnection));
+  tuning = socketTuningFromEnv();
+
+  // Semaphore the consumer waits on before connecting
+  semListening = semOpen("/arp2_sem_listening", 0, fdlog_err);
+
+  // Socket creation
+  sprintf(logMessage, "[Producer] Opening event-driven server on port %d for %d clients",
+      portno, numClients);
+  writeInfoLog(fdlog_info, logMessage);
+  sockfd = socketCreate(AF_INET, SOCK_STREAM, 0, fdlog_err);
+
+  // Socket configuration
+  writeInfoLog(fdlog_info, "[Producer] Configuring socket");
+  socketSetOpt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void*) &optVal, optLen, fdlog_err);
+  socketSetNonBlocking(sockfd, fdlog_err);
+  bzero((char *) &servAddr, sizeof(servAddr));
+  servAddr.sin_family = AF_INET;
+  servAddr.sin_port = htons(portno);
+  servAddr.sin_addr.s_addr = INADDR_ANY; // IP of current machine
+
+  // Bind socket and listen for connections
+  writeInfoLog(fdlog_info, "[Producer] Binding socket");
+  socketBind(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Listening on socket");
+  socketApplyBufferSizes(sockfd, tuning, fdlog_err);
+  socketListen(sockfd, numClients, fdlog_err);
+
+  // Tell the consumers they can connect now
+  writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_listening");
+  for (int i = 0; i < numClients; i++) {
+    semPost(semListening, fdlog_err);
+  }
+
+  epfd = epollCreate(fdlog_err);
+  epollAdd(epfd, sockfd, EPOLLIN, NULL, fdlog_err);
+
+  // Timer starts when the first client requests its data. Clients are served
+  // at their own speed, so generation must be complete first.
+  isStarted = false;
+  pipelineWaitFor(numWrites);
+
+  // Event loop: accept clients and serve every ready connection until all are done
+  writeInfoLog(fdlog_info, "[Producer] Starting packet transfer");
+  numAccepted = 0;
+  numDone = 0;
+  while (numDone < numClients) {
+    waitStart_ns = getMonotonicTimeNS();
+    numEvents = epollWait(epfd, events, MAX_EPOLL_EVENTS, -1, fdlog_err);
+    statsWait(getMonotonicTimeNS() - waitStart_ns);
+
+    for (int i = 0; i < numEvents; i++) {
+      struct clientConnection* conn = events[i].data.ptr;
+
+      if (conn == NULL) {
+        // Listening socket: accept everything that is pending
+        int fd;
+        uint64_t acceptStart_ns = traceBegin();
+        while (numAccepted < numClients && (fd = accept(sockfd, NULL, NULL)) >= 0) {
+          traceEnd("accept", "setup", acceptStart_ns);
+          conn = &connections[numAccepted];
+          conn->fd = fd;
+          conn->id = numAccepted;
+          conn->state = CONNECTION_READ_HEADER;
+          conn->isCork = tuning.cork;
+          conn->isZeroCopy = socketApplyTuning(fd, tuning, "Producer", fdlog_info, fdlog_err);
+          socketSetNonBlocking(fd, fdlog_err);
+          epollAdd(epfd, fd, EPOLLIN | EPOLLOUT | EPOLLET, conn, fdlog_err);
+          numAccepted++;
+
+          sprintf(logMessage, "[Producer] Accepted client %d", conn->id);
+          writeInfoLog(fdlog_info, logMessage);
+
+          // Edge-triggered: the header may already be waiting
+          connectionProgress(conn, messages, numWrites);
+          acceptStart_ns = traceBegin();
+          if (!isStarted && conn->timeStart_ns != 0) {
+            writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
+            transferStart();
+            isStarted = true;
+          }
+          if (conn->state == CONNECTION_DONE) {
+            numDone++;
+          }
+        }
+
+        if (numAccepted == numClients) {
+          epollRemove(epfd, sockfd, fdlog_err);
+        }
+        continue;
+      }
+
+      if (conn->state == CONNECTION_DONE) {
+        continue;
+      }
+
+      if (conn->isZeroCopy && (events[i].events & EPOLLERR)) {
+        // Zerocopy completions arrive on the error queue
+        socketReapZeroCopy(conn->fd, &conn->zeroCopy, false, fdlog_err);
+      } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        printf("Error in producer.c sendSocketEpoll: client %d hung up\n", conn->id);
+        fflush(stdout);
+        writeErrorLog(fdlog_err, "producer.c: sendSocketEpoll client hung up", 0);
+        exit(-1);
+      }
+
+      connectionProgress(conn, messages, numWrites);
+      if (!isStarted && conn->timeStart_ns != 0) {
+        writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
+        transferStart();
+        isStarted = true;
+      }
+      if (conn->state == CONNECTION_DONE) {
+        numDone++;
+      }
+    }
+  }
+
+  writeInfoLog(fdlog_info, "[Producer] Data transfer complete");
+
+  // Per-connection and aggregate throughput
+  firstStart_ns = connections[0].timeStart_ns;
+  lastEnd_ns = connections[0].timeEnd_ns;
+  totalBytes = 0;
+  for (int i = 0; i < numClients; i++) {
+    double elapsed_s = (connections[i].timeEnd_ns - connections[i].timeStart_ns) / 1.0e9;
+
+    if (connections[i].isZeroCopy) {
+      socketReapZeroCopy(connections[i].fd, &connections[i].zeroCopy, true, fdlog_err);
+      socketLogZeroCopy(&connections[i].zeroCopy, "Producer", fdlog_info);
+    }
+
+    sprintf(logMessage, "[Producer] Client %d: %zu bytes in %.3f ms (%.2f MiB/s, %lu backpressure stalls)",
+        i, connections[i].bytesSent, elapsed_s * 1000,
+        elapsed_s > 0 ? connections[i].bytesSent / elapsed_s / (1024 * 1024) : 0,
+        connections[i].numStalls);
+    writeInfoLog(fdlog_info, logMessage);
+
+    totalBytes += connections[i].bytesSent;
+    if (connections[i].timeStart_ns < firstStart_ns) {
+      firstStart_ns = connections[i].timeStart_ns;
+    }
+    if (connections[i].timeEnd_ns > lastEnd_ns) {
+      lastEnd_ns = connections[i].timeEnd_ns;
+    }
+  }
+
+  sprintf(logMessage, "[Producer] Aggregate: %zu bytes to %d clients in %.3f ms (%.2f MiB/s)",
+      totalBytes, numClients, (lastEnd_ns - firstStart_ns) / 1.0e6,
+      lastEnd_ns > firstStart_ns ? totalBytes / ((lastEnd_ns - firstStart_ns) / 1.0e9) / (1024 * 1024) : 0);
+  writeInfoLog(fdlog_info, logMessage);
+
+  // Publish totals (what each client received), then wait for every consumer
+  // to have checked them before cleaning up
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd(connections[0].bytesSent,
+      pipelineChecksum(messages, connections[0].bytesSent / MESSAGE_SIZE_B, fdlog_err));
+
+  // Cleanup
+  writeInfoLog(fdlog_info, "[Producer] Closing sockets");
+  for (int i = 0; i < numClients; i++) {
+    socketClose(connections[i].fd, fdlog_err);
+  }
+  close(epfd);
+  socketClose(sockfd, fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Sockets closed");
+
+  writeInfoLog(fdlog_info, "[Producer] Unlinking semaphores");
+  semUnlink("/arp2_sem_listening", fdlog_err);
   writeInfoLog(fdlog_info, "[Producer] Semaphores unlinked");
+  free(connections);
+}
+
+// Work of one sender thread in sendSocketStriped
+struct stripeSender {
+  pthread_t thread;
+  int fd;
+  int streamIndex;
+  int numStreams;
+  char* payload;
+  size_t payloadLength;
+  size_t chunkSize;
+  size_t bytesSent;
+  bool isCork;
+  bool isZeroCopy;
+  struct zeroCopyState zeroCopy;
+};
+
+// Sends every numStreams-th chunk of the payload, starting from chunk streamIndex
+void* stripeSenderThread(void* arg) {
+  struct stripeSender* sender = arg;
+  struct stripeHeader header;
+  size_t offset;
+
+  uint64_t chunkStart_ns;
+
+  memset(&header, 0, sizeof(header));
+  for (offset = sender->streamIndex * sender->chunkSize; offset < sender->payloadLength;
+      offset += sender->numStreams * sender->chunkSize) {
+    chunkStart_ns = traceBegin();
+    header.offset = offset;
+    header.length = (sender->payloadLength - offset < sender->chunkSize) ?
+        sender->payloadLength - offset : sender->chunkSize;
+    socketWriteAll(sender->fd, &header, sizeof(header), fdlog_err);
+    if (sender->isZeroCopy) {
+      socketWriteAllZeroCopy(sender->fd, sender->payload + offset, header.length,
+          &sender->zeroCopy, fdlog_err);
+    } else {
+      socketWriteAll(sender->fd, sender->payload + offset, header.length, fdlog_err);
+    }
+    sender->bytesSent += header.length;
+    statsTransfer(header.length, 1, 2); // header and payload
+    traceEndBytes("chunk", "transfer", chunkStart_ns, header.length);
+  }
+
+  // End of stream
+  header.offset = 0;
+  header.length = 0;
+  socketWriteAll(sender->fd, &header, sizeof(header), fdlog_err);
+  if (sender->isCork) {
+    socketFlushCork(sender->fd, fdlog_err);
+  }
+  if (sender->isZeroCopy) {
+    socketReapZeroCopy(sender->fd, &sender->zeroCopy, true, fdlog_err);
+  }
+
+  return NULL;
+}
+
+void sendSocketStriped(int sizeDataMiB, int messages[], int portno, int numStreams) {
+  sem_t* semListening;
+  int sockfd;
+  int numWrites;
+  int response;
+  struct sockaddr_in servAddr;
+  struct stripeSender* senders;
+  struct socketTuning tuning;
+  char* logMessage;
+  const int optVal = 1;
+  const socklen_t optLen = sizeof(optVal);
+
+  logMessage = malloc(sizeof(char) * 256);
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  senders = calloc(numStreams, sizeof(struct stripeSender));
+  tuning = socketTuningFromEnv();
+
+  // Semaphore the consumer waits on before connecting
+  semListening = semOpen("/arp2_sem_listening", 0, fdlog_err);
+
+  // Socket creation
+  sprintf(logMessage, "[Producer] Opening socket on port %d for %d striped streams",
+      portno, numStreams);
+  writeInfoLog(fdlog_info, logMessage);
+  sockfd = socketCreate(AF_INET, SOCK_STREAM, 0, fdlog_err);
+
+  // Socket configuration
+  writeInfoLog(fdlog_info, "[Producer] Configuring socket");
+  socketSetOpt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void*) &optVal, optLen, fdlog_err);
+  bzero((char *) &servAddr, sizeof(servAddr));
+  servAddr.sin_family = AF_INET;
+  servAddr.sin_port = htons(portno);
+  servAddr.sin_addr.s_addr = INADDR_ANY; // IP of current machine
+
+  // Bind socket and listen for connections
+  writeInfoLog(fdlog_info, "[Producer] Binding socket");
+  socketBind(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Listening on socket");
+  socketApplyBufferSizes(sockfd, tuning, fdlog_err);
+  socketListen(sockfd, numStreams, fdlog_err);
+
+  // Tell the consumer it can connect now
+  writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_listening");
+  semPost(semListening, fdlog_err);
+
+  // One connection per stream
+  writeInfoLog(fdlog_info, "[Producer] Accepting incoming connections");
+  for (int i = 0; i < numStreams; i++) {
+    uint64_t acceptStart_ns = traceBegin();
+
+    senders[i].fd = socketAccept(sockfd, NULL, NULL, fdlog_err);
+    traceEnd("accept", "setup", acceptStart_ns);
+    senders[i].isCork = tuning.cork;
+    senders[i].isZeroCopy = socketApplyTuning(senders[i].fd, tuning, "Producer",
+        fdlog_info, fdlog_err);
+    senders[i].streamIndex = i;
+    senders[i].numStreams = numStreams;
+    senders[i].payload = (char*) messages;
+    senders[i].payloadLength = (size_t) numWrites * MESSAGE_SIZE_B;
+    senders[i].chunkSize = (size_t) getEnvInt("ORION_STRIPE_CHUNK_KIB", DEFAULT_STRIPE_CHUNK_KIB) * 1024;
+  }
+
+  // Transfer all data, once it is all generated: streams send disjoint chunks
+  // in parallel
+  pipelineWaitFor(numWrites);
+  writeInfoLog(fdlog_info, "[Producer] Starting striped packet transfer");
+
+  // Timer start, recorded in the control block
+  writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
+  transferStart();
+
+  for (int i = 0; i < numStreams; i++) {
+    threadCreate(&senders[i].thread, stripeSenderThread, &senders[i], fdlog_err);
+  }
+
+  for (int i = 0; i < numStreams; i++) {
+    threadJoin(senders[i].thread, fdlog_err);
+  }
+
+  // Every stream acknowledges once its data is in place
+  for (int i = 0; i < numStreams; i++) {
+    response = socketRead(senders[i].fd, MESSAGE_SIZE_B, fdlog_err);
+    if (response != 1) {
+      perror("ERROR in packet transfer");
+      writeErrorLog(fdlog_err, "producer.c: striped transfer response negative", errno);
+      exit(-1);
+    }
+
+    sprintf(logMessage, "[Producer] Stream %d: %zu bytes", i, senders[i].bytesSent);
+    writeInfoLog(fdlog_info, logMessage);
+    if (senders[i].isZeroCopy) {
+      socketLogZeroCopy(&senders[i].zeroCopy, "Producer", fdlog_info);
+    }
+  }
+
+  writeInfoLog(fdlog_info, "[Producer] Data transfer complete");
+
+  // Publish totals, then wait for the consumer to have checked them before cleaning up
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, pipelineChecksum(messages, numWrites, fdlog_err));
+
+  // Cleanup
+  writeInfoLog(fdlog_info, "[Producer] Closing sockets");
+  for (int i = 0; i < numStreams; i++) {
+    socketClose(senders[i].fd, fdlog_err);
+  }
+  socketClose(sockfd, fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Sockets closed");
+
+  writeInfoLog(fdlog_info, "[Producer] Unlinking semaphores");
+  semUnlink("/arp2_sem_listening", fdlog_err);
+  writeInfoLog(fdlog_info, "[Producer] Semaphores unlinked");
+  free(senders);
 }
 
 void sendSharedMemory(int sizeDataMiB, int messages[], int circularBufferSize) {
-  sem_t* mutexCircBuffer;
-  sem_t* semConsumer;
-  sem_t* semProducer;
-  sem_t* semCircBufferProducer;
-  sem_t* semCircBufferConsumer;
-  int cbufferHead; // Keeps track of position in circular buffer
+  struct ringBuffer* ring;
+  uint32_t capacity;
+  uint32_t window;
   int numWrites;
-  double timerStart_ms;
-  void *ptrShmTimer;
-  void *ptrShmCBuffer;
+  int doorbellSockfd = -1;
 
   numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  // With ORION_ADAPT, the ring is larger than the window it starts with
+  capacity = ringCapacity(adaptRingBytes(circularBufferSize));
+  window = ringCapacity(circularBufferSize);
+
+  // Optional eventfd doorbell (ORION_RING_NOTIFY=eventfd), handed over to the
+  // consumer once it has found the ring
+  if (strcmp(getEnvString("ORION_RING_NOTIFY", "futex"), "eventfd") == 0) {
+    writeInfoLog(fdlog_info, "[Producer] Creating the ring doorbell");
+    ringDoorbellCreate(fdlog_err);
+    doorbellSockfd = ringDoorbellListen(fdlog_err);
+  }
 
-  // Initialise shared memory
+  // Initialise shared memory, holding the ring
   writeInfoLog(fdlog_info, "[Producer] Initialising shared memory");
-  ptrShmCBuffer = shmInit("/shm_arpassign2", NULL, circularBufferSize,
-      PROT_WRITE, MAP_SHARED, 0, fdlog_err);
-
-  // Semaphore to ensure correct usage of shared memory and bounded buffer
-  writeInfoLog(fdlog_info, "[Producer] Initializing semaphores");
-  cbufferHead = 0;
-  mutexCircBuffer = semOpen("arp2_mutex_cbuffer", 1, fdlog_err);
-  semConsumer = semOpen("/arp2_sem_consumer", 0, fdlog_err);
-  semProducer = semOpen("/arp2_sem_producer", 0, fdlog_err);
-  semCircBufferProducer = semOpen("/arp2_sem_cbuffer_producer",
-      circularBufferSize/MESSAGE_SIZE_B, fdlog_err);
-  semCircBufferConsumer = semOpen("/arp2_sem_cbuffer_consumer", 0, fdlog_err);
+  ring = shmInit("/shm_arpassign2", NULL, ringSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, 0, fdlog_err);
+  ringInit(ring, capacity);
+
+  if (ringDoorbell >= 0) {
+    writeInfoLog(fdlog_info, "[Producer] Handing the ring doorbell over to the consumer");
+    ringDoorbellSend(doorbellSockfd, fdlog_err);
+  }
 
   writeInfoLog(fdlog_info, "[Producer] Starting data transfer via shared memory");
 
-  // Timer start (epoch time)
+  // Timer start, recorded in the control block
   writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
-  timerStart_ms = getCurrrentTimeMS();
+  transferStart();
+
+  sendRing(ring, messages, numWrites, window);
+
+  writeInfoLog(fdlog_info, "[Producer] Data transfer complete");
+
+  // Publish totals, then wait for the consumer to have checked them before cleaning up
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, pipelineChecksum(messages, numWrites, fdlog_err));
+
+  // The consumer unlinks the shared memory
+  munmap(ring, ringSize(capacity));
+}
+
+void serveDaemonJobs(int sizeDataMiB, int messages[], int portno) {
+  struct daemonMessage job;
+  struct transferResult result;
+  struct ringBuffer* ring = NULL;
+  struct socketTuning tuning;
+  struct sockaddr_in servAddr;
+  struct sockaddr_in cliAddr;
+  sem_t* semListening;
+  uint32_t capacity;
+  uint64_t checksum = 0;
+  int fd = daemonChannel();
+  int sockfd = -1;
+  int sockfdAccept = -1;
+  socklen_t clilen;
+  int numWrites;
+  int numBatch;
+  int numChecksummed = -1; // messages checksum is of
+  char logMessage[128];
+  const int optVal = 1;
+
+  capacity = ringCapacity(getEnvInt("ORION_RING_KIB", CIRC_BUFFER_SIZE/1024)*1024);
 
-  for (int i = 0; i < numWrites; i++) {
-    semWait(semCircBufferProducer, fdlog_err);
-    semWait(mutexCircBuffer, fdlog_err);
-    // Dividing cbufferHead by size of message because the ptr already increments by sizeof message
-    shmWriteInteger(&ptrShmCBuffer, messages[i], cbufferHead/MESSAGE_SIZE_B, fdlog_err);
-    semPost(mutexCircBuffer, fdlog_err);
-    cbufferHead = (++cbufferHead % (circularBufferSize - 1));
-    semPost(semCircBufferConsumer, fdlog_err);
+  // The link is set up once, for every job
+  if (choiceIPC == 3) {
+    writeInfoLog(fdlog_info, "[Producer] Initialising shared memory");
+    ring = shmInit("/shm_arpassign2", NULL, ringSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, 0, fdlog_err);
+    ringInit(ring, capacity);
+  } else {
+    semListening = semOpen("/arp2_sem_listening", 0, fdlog_err);
+
+    sprintf(logMessage, "[Producer] Opening socket on port %d", portno);
+    writeInfoLog(fdlog_info, logMessage);
+    sockfd = socketCreate(AF_INET, SOCK_STREAM, 0, fdlog_err);
+    socketSetOpt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void*) &optVal, sizeof(optVal), fdlog_err);
+    bzero((char *) &servAddr, sizeof(servAddr));
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_port = htons(portno);
+    servAddr.sin_addr.s_addr = INADDR_ANY;
+    socketBind(sockfd, (struct sockaddr *) &servAddr, sizeof(servAddr), fdlog_err);
+    socketApplyBufferSizes(sockfd, socketTuningFromEnv(), fdlog_err);
+    socketListen(sockfd, 5, fdlog_err);
+
+    writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_listening");
+    semPost(semListening, fdlog_err);
+
+    writeInfoLog(fdlog_info, "[Producer] Accepting incoming connection");
+    clilen = sizeof(cliAddr);
+    sockfdAccept = socketAccept(sockfd, (struct sockaddr *) &cliAddr, &clilen, fdlog_err);
+
+    // Blocks are written message by message, zerocopy would not pay off
+    tuning = socketTuningFromEnv();
+    tuning.zeroCopy = 0;
+    socketApplyTuning(sockfdAccept, tuning, "Producer", fdlog_info, fdlog_err);
   }
 
+  writeInfoLog(fdlog_info, "[Producer] Waiting for jobs from the master");
+  while (daemonReceive(fd, &job) && job.command == DAEMON_JOB) {
+    if (job.sizeDataMiB < 1 || job.sizeDataMiB > sizeDataMiB) {
+      printf("Error in producer.c serveDaemonJobs: job of %d MiB, at most %d expected\n", job.sizeDataMiB, sizeDataMiB);
+      fflush(stdout);
+      writeErrorLog(fdlog_err, "producer.c: serveDaemonJobs job larger than the payload", 0);
+      exit(-1);
+    }
+    numWrites = (job.sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+    sprintf(logMessage, "[Producer] Starting a job of %dMiB", job.sizeDataMiB);
+    writeInfoLog(fdlog_info, logMessage);
+
+    // New session in the control block. The master lets the consumer join it
+    // once it is ready.
+    isControlComplete = false;
+    controlReset(control, 1);
+    controlPhaseBegin(PHASE_SETUP);
+    if (!daemonSend(fd, DAEMON_READY, job.sizeDataMiB, NULL)) {
+      break;
+    }
+
+    transferStart();
+    if (ring != NULL) {
+      for (int i = 0; i < numWrites; i += numBatch) {
+        numBatch = pipelineReady(i, numWrites - i);
+        ringWrite(ring, &messages[i], numBatch, true);
+      }
+    } else {
+      numWrites = sendSocketJob(sockfdAccept, job.sizeDataMiB, messages, tuning);
+    }
+
+    // Repeated jobs of the same size do not checksum the payload again
+    if (numWrites != numChecksummed) {
+      checksum = pipelineChecksum(messages, numWrites, fdlog_err);
+      numChecksummed = numWrites;
+    }
+    transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, checksum);
+    controlPhaseEnd(control, true, PHASE_TEARDOWN);
+    controlLogPhases(control, true, fdlog_info);
+
+    memset(&result, 0, sizeof(result));
+    result.pid = getpid();
+    result.transport = choiceIPC;
+    result.sizeDataMiB = job.sizeDataMiB;
+    result.isVerified = control->numChecksumMismatches == 0;
+    result.transfer_s = (control->timeProducerEnd_ns - control->timeStart_ns) / 1.0e9;
+    result.setup_ms = -1;
+    if (!daemonSend(fd, DAEMON_DONE, job.sizeDataMiB, &result)) {
+      break;
+    }
+  }
+
+  // Told to stop, or the master went away
+  writeInfoLog(fdlog_info, "[Producer] No more jobs, closing the link");
+  if (ring != NULL) {
+    // The consumer unlinks the shared memory
+    munmap(ring, ringSize(capacity));
+  } else {
+    socketClose(sockfdAccept, fdlog_err);
+    socketClose(sockfd, fdlog_err);
+    semUnlink("/arp2_sem_listening", fdlog_err);
+  }
+  isControlComplete = true;
+}
+
+int sendSocketJob(int sockfd, int sizeDataMiB, int messages[], struct socketTuning tuning) {
+  int numWrites;
+  int numBlocks;
+  int remainder;
+  int numPieces;
+  int numToSend;
+  int numWritesPerBlock;
+  int numWritesRemainder;
+  int messageIndex;
+  int response;
+
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+
+  // The consumer asks for the blocks of the job, as in sendSocket
+  numBlocks = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
+  remainder = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
+  numWritesRemainder = (remainder*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B;
+  if (numBlocks != 0) {
+    numWritesPerBlock = numWrites/numBlocks - numWritesRemainder;
+  } else {
+    numWritesPerBlock = 0;
+  }
+  numPieces = numBlocks + (remainder != 0);
+
+  messageIndex = 0;
+  for (int piece = 0; piece < numPieces; piece++) {
+    numToSend = piece < numBlocks ? numWritesPerBlock : numWritesRemainder;
+    for (int j = 0; j < numToSend; j++) {
+      pipelineReady(messageIndex, 1);
+      socketWrite(sockfd, messages[messageIndex], MESSAGE_SIZE_B, fdlog_err);
+      statsTransfer(MESSAGE_SIZE_B, 1, 1);
+      messageIndex++;
+    }
+    if (tuning.cork) {
+      socketFlushCork(sockfd, fdlog_err);
+    }
+
+    response = socketRead(sockfd, MESSAGE_SIZE_B, fdlog_err);
+    statsSyscalls(1);
+    if (response != 1) {
+      perror("ERROR in packet transfer");
+      writeErrorLog(fdlog_err, "producer.c: packet transfer response negative", errno);
+      exit(-1);
+    }
+  }
+
+  return messageIndex;
+}
+
+void sendThread(int sizeDataMiB, int messages[], int circularBufferSize) {
+  struct ringBuffer* ring;
+  struct threadConsumer consumer;
+  pthread_t thread;
+  uint32_t capacity;
+  uint32_t window;
+  int numWrites;
+
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  capacity = ringCapacity(adaptRingBytes(circularBufferSize));
+  window = ringCapacity(circularBufferSize);
+
+  // Same ring as for shared memory, in private memory. The consumer thread
+  // shares the doorbell, if any.
+  if (strcmp(getEnvString("ORION_RING_NOTIFY", "futex"), "eventfd") == 0) {
+    ringDoorbellCreate(fdlog_err);
+  }
+  writeInfoLog(fdlog_info, "[Producer] Initialising in-process ring");
+  ring = aligned_alloc(64, ringSize(capacity));
+  if (ring == NULL) {
+    printf("Error in producer.c sendThread: cannot allocate the ring\n");
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "producer.c: sendThread ring allocation failed", 0);
+    exit(-1);
+  }
+  ringInit(ring, capacity);
+
+  consumer.ring = ring;
+  consumer.sizeDataMiB = sizeDataMiB;
+  consumer.numMessages = numWrites;
+  consumer.messages = calloc(numWrites, MESSAGE_SIZE_B);
+  if (consumer.messages == NULL) {
+    printf("Error in producer.c sendThread: cannot allocate the consumer's buffer\n");
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "producer.c: sendThread consumer buffer allocation failed", 0);
+    exit(-1);
+  }
+  writeInfoLog(fdlog_info, "[Producer] Starting consumer thread");
+  threadCreate(&thread, threadConsumerMain, &consumer, fdlog_err);
+
+  // Timer start, recorded in the control block
+  writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
+  transferStart();
+
+  sendRing(ring, messages, numWrites, window);
+
   writeInfoLog(fdlog_info, "[Producer] Data transfer complete");
+  transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, pipelineChecksum(messages, numWrites, fdlog_err));
 
-  // Send timer start time over to the consumer
-  writeInfoLog(fdlog_info, "[Producer] Writing transfer start time to shared memory");
-  shmWriteOnce_double("/shm_timerStart", timerStart_ms, &ptrShmTimer, fdlog_err);
+  threadJoin(thread, fdlog_err);
+  free(consumer.messages);
+  free(ring);
+}
 
-  // Let the consumer know the shared memory is ready to be read
-  writeInfoLog(fdlog_info, "[Producer] Posting semaphore arp2_sem_consumer");
-  semPost(semConsumer, fdlog_err);
+void sendRing(struct ringBuffer* ring, int messages[], int numWrites, uint32_t window) {
+  struct adaptController adapt;
+  int windowKnob;
+  int batchKnob;
+  size_t maxBatch;
+  uint32_t numStalls = 0;
+  int numBatch;
+
+  // Pacing sets its own batches
+  adaptInit(&adapt, !paceIsEnabled(), "Producer", fdlog_info);
+  windowKnob = adaptAddKnob(&adapt, "ring window", window * MESSAGE_SIZE_B, ADAPT_MIN_RING_B,
+      ring->capacity * MESSAGE_SIZE_B);
+  batchKnob = adaptAddKnob(&adapt, "ring batch", ring->capacity * MESSAGE_SIZE_B, ADAPT_MIN_RING_B,
+      ring->capacity * MESSAGE_SIZE_B);
+  ring->window = window;
+  maxBatch = adapt.isEnabled ? ring->capacity : (size_t) numWrites;
+
+  for (int i = 0; i < numWrites; i += numBatch) {
+    numBatch = paceNext(i, pipelineReady(i, (size_t) (numWrites - i) < maxBatch ? (size_t) (numWrites - i) : maxBatch));
+    ringWrite(ring, &messages[i], numBatch, true);
+
+    if (adaptUpdate(&adapt, (uint64_t) numBatch*MESSAGE_SIZE_B, ring->numFullStalls - numStalls) >= 0) {
+      ring->window = adaptValue(&adapt, windowKnob) / MESSAGE_SIZE_B;
+      maxBatch = adaptValue(&adapt, batchKnob) / MESSAGE_SIZE_B;
+    }
+    numStalls = ring->numFullStalls;
+  }
 
-  // Wait for the consumer to have finished reading before cleaning up
-  writeInfoLog(fdlog_info, "[Producer] Accessing semaphore arp2_sem_producer");
-  semWait(semProducer, fdlog_err);
+  // Reported to the master through the consumer
+  if (adapt.isEnabled) {
+    adaptLog(&adapt);
+    control->adapted.window_B = adaptValue(&adapt, windowKnob);
+    control->adapted.batch_B = adaptValue(&adapt, batchKnob);
+    control->adapted.numEpochs = adapt.numEpochs;
+    control->adapted.isConverged = adaptIsConverged(&adapt);
+  }
+}
 
-  // Cleanup
-  writeInfoLog(fdlog_info, "[Producer] Unlinking semaphores");
-  semUnlink("/arp2_sem_producer", fdlog_err);
-  semUnlink("/arp2_sem_cbuffer_producer", fdlog_err);
-  writeInfoLog(fdlog_info, "[Producer] Semaphores unlinked");
+void sendMessageQueue(int sizeDataMiB, int messages[]) {
+  struct mq_attr attr;
+  struct mqControlRecord record;
+  struct traceChunk chunk;
+  char logMessage[128];
+  mqd_t mqd;
+  int numWrites;
+  int numPerRecord; // messages packed in one record
+  int numInRecord;
+  int numRecords;
+  int controlEvery; // data records between two control records, 0 for none
+
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  controlEvery = getEnvInt("ORION_MQ_CONTROL_EVERY", 0);
+
+  writeInfoLog(fdlog_info, "[Producer] Opening message queue");
+  mqd = mqOpen("/orion_mq", O_WRONLY, getEnvInt("ORION_MQ_DEPTH", DEFAULT_MQ_DEPTH),
+      getEnvInt("ORION_MQ_MSG_KIB", DEFAULT_MQ_MSG_KIB)*1024, fdlog_err);
+  // The queue may already exist: use whatever size it was created with
+  attr = mqGetAttr(mqd, fdlog_err);
+  numPerRecord = attr.mq_msgsize / MESSAGE_SIZE_B;
+  sprintf(logMessage, "[Producer] Message queue holds %ld records of %ld bytes (%d messages each)",
+      attr.mq_maxmsg, attr.mq_msgsize, numPerRecord);
+  writeInfoLog(fdlog_info, logMessage);
+
+  // Timer start, recorded in the control block
+  writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
+  transferStart();
+
+  numRecords = 0;
+  record.sequence = 0;
+  traceChunkStart(&chunk, "send");
+  for (int i = 0; i < numWrites; i += numInRecord) {
+    numInRecord = paceNext(i, pipelineReady(i, (numWrites - i < numPerRecord) ? numWrites - i : numPerRecord));
+
+    mqSend(mqd, (char*) &messages[i], numInRecord * MESSAGE_SIZE_B, 0, fdlog_err);
+    statsTransfer(numInRecord * MESSAGE_SIZE_B, 1, 1);
+    traceChunkAdd(&chunk, numInRecord * MESSAGE_SIZE_B);
+    numRecords++;
+
+    // Progress telemetry on the priority lane
+    if (controlEvery > 0 && numRecords % controlEvery == 0) {
+      record.sequence++;
+      record.bytesSent = (uint64_t) (i + numInRecord) * MESSAGE_SIZE_B;
+      record.sent_ns = getMonotonicTimeNS();
+      mqSend(mqd, (char*) &record, sizeof(record), MQ_CONTROL_PRIORITY, fdlog_err);
+      statsSyscalls(1);
+    }
+  }
+  traceChunkFinish(&chunk);
+
+  sprintf(logMessage, "[Producer] Sent %d data records and %lu control records", numRecords,
+      (unsigned long) record.sequence);
+  writeInfoLog(fdlog_info, logMessage);
+
+  // Publish totals, then wait for the consumer to have checked them before cleaning up
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, pipelineChecksum(messages, numWrites, fdlog_err));
+
+  // The consumer unlinks the queue
+  mqClose(mqd, "/orion_mq", false, fdlog_err);
+}
+
+void sendJournal(int sizeDataMiB, int messages[]) {
+  struct traceChunk chunk;
+  int numWrites;
+  int numPerRecord; // messages in a full record
+  int numInRecord;
+
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+
+  writeInfoLog(fdlog_info, "[Producer] Creating journal");
+  journalCreate("Producer", fdlog_info, fdlog_err);
+  numPerRecord = journal.recordBytes / MESSAGE_SIZE_B;
+
+  // Timer start, recorded in the control block: the consumer opens the journal
+  // once the transfer is running
+  writeInfoLog(fdlog_info, "[Producer] Recording transfer start time");
+  transferStart();
+
+  traceChunkStart(&chunk, "append");
+  for (int i = 0; i < numWrites; i += numInRecord) {
+    numInRecord = paceNext(i, pipelineReady(i, (numWrites - i < numPerRecord) ? numWrites - i : numPerRecord));
+
+    journalAppend(&messages[i], numInRecord * MESSAGE_SIZE_B, (uint64_t) i * MESSAGE_SIZE_B);
+    statsTransfer(numInRecord * MESSAGE_SIZE_B, 1, 0);
+    traceChunkAdd(&chunk, numInRecord * MESSAGE_SIZE_B);
+  }
+  traceChunkFinish(&chunk);
+
+  journalClose("Producer", fdlog_info, fdlog_err);
+
+  // Publish totals, then wait for the consumer to have checked them
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, pipelineChecksum(messages, numWrites, fdlog_err));
+}
+
+void sendDatagram(int sizeDataMiB, int messages[], int portno) {
+  struct dgramHeader* headers;
+  struct mmsghdr* msgs;
+  struct iovec* iovs;
+  struct traceChunk chunk;
+  sem_t* semBound;
+  int sockfd;
+  int numMsgs; // sendmmsg() entries of the batch
+  int numSent;
+  int numCalls;
+  int ret;
+  uint64_t numBytes;
+  // Message and datagram indices, unsigned like the sequence numbers
+  uint32_t numWrites;
+  uint32_t numDatagrams;
+  uint32_t numInBatch; // datagrams
+  uint32_t perDatagram; // messages per datagram
+  uint32_t perBatch; // messages per batch
+  uint32_t first;
+  uint32_t numMessages;
+
+  numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
+  dgramSelect("Producer", fdlog_info);
+  perDatagram = dgram.numPerDatagram;
+  perBatch = (uint32_t) dgram.batch * perDatagram;
+  numDatagrams = (numWrites + perDatagram - 1) / perDatagram;
+
+  // The consumer must be bound before anything is sent, or it would be lost
+  writeInfoLog(fdlog_info, "[Producer] Waiting for the consumer to bind its datagram socket");
+  semBound = semOpen("/orion_sem_dgram", 0, fdlog_err);
+  if (!semTimedWait(semBound, DGRAM_BIND_TIMEOUT_MS, fdlog_err)) {
+    printf("Error in producer.c sendDatagram: the consumer did not bind its socket\n");
+    fflush(stdout);
+    writeErrorLog(fdlog_err, "producer.c: sendDatagram consumer did not bind", 0);
+    exit(-1);
+  }
+  semClose(semBound, fdlog_err);
+  semUnlink("/orion_sem_dgram", fdlog_err);
+  sockfd = dgramOpen(true, portno, "Producer", fdlog_info, fdlog_err);
+
+  // A header and the messages in place for every datagram of a batch
+  headers = malloc(sizeof(struct dgramHeader) * dgram.batch);
+  iovs = malloc(sizeof(struct iovec) * 2 * dgram.batch);
+  msgs = calloc(dgram.batch, sizeof(struct mmsghdr));
+
+  writeInfoLog(fdlog_info, "[Producer] Starting data transfer via datagrams");
+  transferStart();
+
+  traceChunkStart(&chunk, "sendmmsg");
+  for (uint32_t sequence = 0; sequence < numDatagrams; sequence += numInBatch) {
+    // Whole datagrams, as generated and paced
+    first = sequence * perDatagram;
+    numMessages = paceNext(first, pipelineReady(first, numWrites - first < perBatch ? numWrites - first : perBatch));
+    numInBatch = (numMessages + perDatagram - 1) / perDatagram;
+    pipelineWaitFor(first + numInBatch * perDatagram < numWrites ? first + numInBatch * perDatagram : numWrites);
+
+    numMsgs = 0;
+    numBytes = 0;
+    for (uint32_t i = 0; i < numInBatch; i++) {
+      first = (sequence + i) * perDatagram;
+      numMessages = numWrites - first < perDatagram ? numWrites - first : perDatagram;
+      dgramFillHeader(&headers[i], messages, sequence + i, first, numMessages);
+      iovs[2*i].iov_base = &headers[i];
+      iovs[2*i].iov_len = sizeof(struct dgramHeader);
+      iovs[2*i + 1].iov_base = &messages[first];
+      iovs[2*i + 1].iov_len = (size_t) numMessages * MESSAGE_SIZE_B;
+      numBytes += (uint64_t) numMessages * MESSAGE_SIZE_B;
+
+      // With GSO, one entry carries several datagrams for the kernel to cut
+      if (i % (uint32_t) dgram.numPerSend == 0) {
+        msgs[numMsgs].msg_hdr.msg_iov = &iovs[2*i];
+        msgs[numMsgs].msg_hdr.msg_iovlen = 0;
+        numMsgs++;
+      }
+      msgs[numMsgs - 1].msg_hdr.msg_iovlen += 2;
+    }
+
+    numSent = 0;
+    numCalls = 0;
+    while (numSent < numMsgs) {
+      ret = sendmmsg(sockfd, &msgs[numSent], numMsgs - numSent, 0);
+      if (ret < 0 && (errno == EINTR || errno == ENOBUFS)) {
+        continue;
+      }
+      if (ret < 0) {
+        printf("Error %d in ", errno);
+        fflush(stdout);
+        perror("producer.c sendDatagram sendmmsg");
+        writeErrorLog(fdlog_err, "producer.c: sendDatagram sendmmsg failed", errno);
+        exit(-1);
+      }
+      numSent += ret;
+      numCalls++;
+    }
+    statsTransfer(numBytes, numInBatch, numCalls);
+    traceChunkAdd(&chunk, numBytes);
+  }
+  traceChunkFinish(&chunk);
+
+  writeInfoLog(fdlog_info, "[Producer] Data transfer complete");
+
+  // Publish totals: the consumer stops waiting for datagrams once it sees them
+  writeInfoLog(fdlog_info, "[Producer] Publishing transfer results in the control block");
+  transferEnd((uint64_t) numWrites*MESSAGE_SIZE_B, pipelineChecksum(messages, numWrites, fdlog_err));
+
+  socketClose(sockfd, fdlog_err);
+  free(headers);
+  free(iovs);
+  free(msgs);
+}
+
+void* threadConsumerMain(void* arg) {
+  struct threadConsumer* consumer = (struct threadConsumer*) arg;
+  struct transferResult result;
+  uint64_t timeEnd_ns;
+  uint64_t checksum;
+
+  memset(&result, 0, sizeof(result));
+
+  // The producer's statistics already count what goes through the ring
+  analyticsOpen(consumer->messages, consumer->numMessages, "Consumer", fdlog_info, fdlog_err);
+  sinkOpen(consumer->messages, consumer->numMessages, "Consumer", fdlog_info, fdlog_err);
+  ringReceive(consumer->ring, consumer->messages, consumer->numMessages, false, "Consumer", fdlog_info, fdlog_err);
+  timeEnd_ns = getMonotonicTimeNS();
+  writeInfoLog(fdlog_info, "[Consumer] Read complete");
+  result.analytics_s = analyticsFinish(control->timeStart_ns, "Consumer", fdlog_info, fdlog_err);
+  sinkFinish("Consumer", fdlog_info, fdlog_err);
+
+  checksum = checksumMessages(consumer->messages, 0, consumer->numMessages);
+  result.pid = getpid();
+  result.transport = choiceIPC;
+  result.sizeDataMiB = consumer->sizeDataMiB;
+  result.transfer_s = controlConsumerDone(control, timeEnd_ns, (uint64_t) consumer->numMessages*MESSAGE_SIZE_B,
+      checksum, fdlog_info, fdlog_err);
+  result.isVerified = checksum == control->checksumSent;
+  result.setup_ms = -1;
+  result.adapt = control->adapted;
+  paceSummarize(&result.latency);
+  paceLogReceiver("Consumer", &result.latency, fdlog_info);
+
+  // Report like a consumer process would
+  if (!resultSend(&result, fdlog_err)) {
+    printf("%.3f seconds.", result.transfer_s);
+    fflush(stdout);
+  }
+
+  return NULL;
+}
+
+void transferStart() {
+  controlPhaseEnd(control, true, PHASE_SETUP);
+  controlPhaseBegin(PHASE_TRANSFER);
+  controlTransferStart(control);
+}
+
+void transferEnd(uint64_t bytesSent, uint64_t checksum) {
+  controlPhaseEnd(control, true, PHASE_TRANSFER);
+  controlPhaseBegin(PHASE_TEARDOWN);
+  controlProducerDone(control, bytesSent, checksum);
+  paceLogSender(bytesSent / MESSAGE_SIZE_B, control->timeProducerEnd_ns - control->timeStart_ns, fdlog_info);
+
+  writeInfoLog(fdlog_info, "[Producer] Waiting for the consumer to check the results");
+  controlWaitConsumers(control, fdlog_err);
 }
 
 void generateMessages(int sizeDataMiB, int *messages) {
   int numWrites = (sizeDataMiB*MIB_TO_B_CONSTANT)/MESSAGE_SIZE_B; // mebibytes to bytes
-  srand(time(NULL));
+  uint32_t state = time(NULL) | 1;
 
   writeInfoLog(fdlog_info, "[Producer] Generating data to be transferred");
 
-  // Generates random data and fills passed array messages
-  for (int i = 0; i < numWrites; i++) {
-    messages[i] = rand() % 100;
-  }
+  // Generates random samples of the element type and fills passed array messages
+  elementType->generate(messages, 0, elementAt(numWrites), &state);
 
   writeInfoLog(fdlog_info, "[Producer] Data generation complete");
 }